@@ -43,12 +43,12 @@ namespace hailo_common
     inline void add_classification(HailoROIPtr roi, std::string type, std::string label, float confidence, int class_id = NULL_CLASS_ID)
     {
         add_object(roi,
-                   std::make_shared<HailoClassification>(type, class_id, label, confidence));
+                   hailo_make_shared<HailoClassification>(type, class_id, label, confidence));
     }
 
     inline HailoDetectionPtr add_detection(HailoROIPtr roi, HailoBBox bbox, std::string label, float confidence, int class_id = NULL_CLASS_ID)
     {
-        HailoDetectionPtr detection = std::make_shared<HailoDetection>(bbox, class_id, label, confidence);
+        HailoDetectionPtr detection = hailo_make_shared<HailoDetection>(bbox, class_id, label, confidence);
         detection->set_scaling_bbox(roi->get_bbox());
         add_object(roi, detection);
         return detection;
@@ -56,9 +56,9 @@ namespace hailo_common
 
     inline void add_detections(HailoROIPtr roi, std::vector<HailoDetection> detections)
     {
-        for (auto det : detections)
+        for (auto &det : detections)
         {
-            add_object(roi, std::make_shared<HailoDetection>(det));
+            add_object(roi, hailo_make_shared<HailoDetection>(std::move(det)));
         }
     }
 
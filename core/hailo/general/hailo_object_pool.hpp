@@ -0,0 +1,211 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file hailo_object_pool.hpp
+ * @authors Hailo
+ **/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief HailoSpinLock - A lightweight lock for short critical sections.
+ * Kept by value inside every HailoObject, so it costs no allocation.
+ * Copying an object gives the copy a new unlocked lock.
+ */
+class HailoSpinLock
+{
+private:
+    std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+
+public:
+    HailoSpinLock() = default;
+    HailoSpinLock(const HailoSpinLock &) {}
+    HailoSpinLock &operator=(const HailoSpinLock &) { return *this; }
+
+    void lock()
+    {
+        unsigned int spins = 0;
+        while (m_flag.test_and_set(std::memory_order_acquire))
+        {
+            if (++spins % 64 == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    bool try_lock()
+    {
+        return !m_flag.test_and_set(std::memory_order_acquire);
+    }
+
+    void unlock()
+    {
+        m_flag.clear(std::memory_order_release);
+    }
+};
+
+/**
+ * @brief HailoBlockPool - A pool of fixed size memory blocks.
+ * Every thread keeps a private cache of free blocks, so allocating and freeing are lock free.
+ * Caches are refilled from (and spilled to) a shared free list in batches.
+ * Blocks are never returned to the system, the pool is sized by the peak number of live objects.
+ */
+template <std::size_t BLOCK_SIZE, std::size_t BLOCK_ALIGN>
+class HailoBlockPool
+{
+private:
+    static constexpr std::size_t BATCH_SIZE = 64;
+    static constexpr std::size_t MAX_CACHED = 4 * BATCH_SIZE;
+    static constexpr std::size_t STRIDE = ((BLOCK_SIZE + BLOCK_ALIGN - 1) / BLOCK_ALIGN) * BLOCK_ALIGN;
+
+    struct SharedFreeList
+    {
+        std::mutex mutex;
+        std::vector<void *> blocks;
+    };
+
+    struct ThreadCache
+    {
+        std::vector<void *> blocks;
+        ~ThreadCache()
+        {
+            // The thread is exiting, hand its free blocks to the other threads.
+            SharedFreeList &shared = shared_free_list();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.blocks.insert(shared.blocks.end(), blocks.begin(), blocks.end());
+            blocks.clear();
+            cache_destroyed() = true;
+        }
+    };
+
+    static bool &cache_destroyed()
+    {
+        // Trivially destructible, so it's still valid while other thread locals are destroyed.
+        static thread_local bool destroyed = false;
+        return destroyed;
+    }
+
+    static SharedFreeList &shared_free_list()
+    {
+        // Intentionally leaked, objects may be released after static destruction.
+        static SharedFreeList *shared = new SharedFreeList();
+        return *shared;
+    }
+
+    static ThreadCache &thread_cache()
+    {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    static void refill(ThreadCache &cache)
+    {
+        SharedFreeList &shared = shared_free_list();
+        {
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            std::size_t count = std::min(BATCH_SIZE, shared.blocks.size());
+            cache.blocks.insert(cache.blocks.end(), shared.blocks.end() - count, shared.blocks.end());
+            shared.blocks.resize(shared.blocks.size() - count);
+        }
+        if (!cache.blocks.empty())
+            return;
+        // No free blocks anywhere, carve a new slab.
+        char *slab = static_cast<char *>(::operator new(STRIDE * BATCH_SIZE, std::align_val_t(BLOCK_ALIGN)));
+        for (std::size_t i = 0; i < BATCH_SIZE; i++)
+            cache.blocks.push_back(slab + i * STRIDE);
+    }
+
+public:
+    static void *allocate()
+    {
+        if (cache_destroyed())
+            return ::operator new(STRIDE, std::align_val_t(BLOCK_ALIGN));
+        ThreadCache &cache = thread_cache();
+        if (cache.blocks.empty())
+            refill(cache);
+        void *block = cache.blocks.back();
+        cache.blocks.pop_back();
+        return block;
+    }
+
+    static void deallocate(void *block)
+    {
+        if (cache_destroyed())
+        {
+            SharedFreeList &shared = shared_free_list();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.blocks.push_back(block);
+            return;
+        }
+        ThreadCache &cache = thread_cache();
+        cache.blocks.push_back(block);
+        if (cache.blocks.size() >= MAX_CACHED)
+        {
+            // Objects are often freed on another thread than the one that created them,
+            // spill a batch so the creating thread can reuse them.
+            SharedFreeList &shared = shared_free_list();
+            std::lock_guard<std::mutex> lock(shared.mutex);
+            shared.blocks.insert(shared.blocks.end(), cache.blocks.end() - BATCH_SIZE, cache.blocks.end());
+            cache.blocks.resize(cache.blocks.size() - BATCH_SIZE);
+        }
+    }
+};
+
+/**
+ * @brief HailoPoolAllocator - An std allocator over HailoBlockPool.
+ * Used through hailo_make_shared, so the object and its shared_ptr control block
+ * are a single pooled block.
+ */
+template <typename T>
+class HailoPoolAllocator
+{
+public:
+    using value_type = T;
+
+    HailoPoolAllocator() noexcept = default;
+    template <typename U>
+    HailoPoolAllocator(const HailoPoolAllocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n)
+    {
+        if (n != 1)
+            return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        return static_cast<T *>(HailoBlockPool<sizeof(T), alignof(T)>::allocate());
+    }
+
+    void deallocate(T *ptr, std::size_t n) noexcept
+    {
+        if (n != 1)
+            return ::operator delete(ptr, std::align_val_t(alignof(T)));
+        HailoBlockPool<sizeof(T), alignof(T)>::deallocate(ptr);
+    }
+
+    template <typename U>
+    bool operator==(const HailoPoolAllocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const HailoPoolAllocator<U> &) const noexcept { return false; }
+};
+
+/**
+ * @brief Create a shared object from the object pool.
+ * Drop-in replacement for std::make_shared for metadata objects that are created per frame.
+ *
+ * @tparam T The type of object to create.
+ * @param args Arguments for T's constructor.
+ * @return std::shared_ptr<T>
+ */
+template <typename T, typename... Args>
+inline std::shared_ptr<T> hailo_make_shared(Args &&...args)
+{
+    return std::allocate_shared<T>(HailoPoolAllocator<T>(), std::forward<Args>(args)...);
+}
@@ -10,8 +10,11 @@
 #pragma once
 
 #include "hailo_tensors.hpp"
+#include "hailo_object_pool.hpp"
 #include <map>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -161,14 +164,11 @@ public:
 class HailoObject
 {
 protected:
-    std::shared_ptr<std::mutex> mutex;
+    HailoSpinLock mutex; // Guards the object's members, held only for short critical sections.
 
 public:
     // Constructor
-    HailoObject()
-    {
-        mutex = std::make_shared<std::mutex>();
-    };
+    HailoObject() = default;
     // Destructor
     virtual ~HailoObject() = default;
     HailoObject &operator=(const HailoObject &other) = default;
@@ -197,10 +197,7 @@ protected:
     std::map<std::string, HailoTensorPtr> m_tensors;
 
 public:
-    HailoMainObject()
-    {
-        mutex = std::make_shared<std::mutex>();
-    };
+    HailoMainObject() = default;
     virtual ~HailoMainObject() = default;
     HailoMainObject(HailoMainObject &&other) noexcept : HailoObject(other), m_sub_objects(std::move(other.m_sub_objects)){};
     HailoMainObject(const HailoMainObject &other) : HailoObject(other), m_sub_objects(other.m_sub_objects){};
@@ -214,7 +211,7 @@ public:
      */
     void add_object(HailoObjectPtr obj)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_sub_objects.emplace_back(obj);
     };
 
@@ -225,7 +222,7 @@ public:
      */
     void add_tensor(HailoTensorPtr tensor)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_tensors.emplace(tensor->name(), tensor);
     };
 
@@ -237,7 +234,7 @@ public:
      */
     void remove_object(HailoObjectPtr obj)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_sub_objects.erase(std::remove(m_sub_objects.begin(), m_sub_objects.end(), obj), m_sub_objects.end());
     };
 
@@ -249,7 +246,7 @@ public:
      */
     void remove_object(uint index)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_sub_objects.erase(m_sub_objects.begin() + index);
     };
 
@@ -261,7 +258,7 @@ public:
      */
     HailoTensorPtr get_tensor(std::string name)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         auto itr = m_tensors.find(name);
         if (itr == m_tensors.end())
         {
@@ -288,7 +285,7 @@ public:
      */
     std::vector<HailoTensorPtr> get_tensors()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         std::vector<HailoTensorPtr> _tensors;
         _tensors.reserve(m_tensors.size());
         for (auto &tensor_pair : m_tensors)
@@ -315,7 +312,7 @@ public:
      */
     void clear_tensors()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_tensors.clear();
     }
 
@@ -326,7 +323,7 @@ public:
      */
     std::vector<HailoObjectPtr> get_objects()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_sub_objects;
     }
 
@@ -338,7 +335,7 @@ public:
      */
     std::vector<HailoObjectPtr> get_objects_typed(hailo_object_t type)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         std::vector<HailoObjectPtr> filtered_subobjects;
         for (auto &obj : m_sub_objects)
         {
@@ -357,10 +354,22 @@ public:
      */
     void remove_objects_typed(hailo_object_t type)
     {
-        for (auto obj : this->get_objects_typed(type))
-        {
-            this->remove_object(obj);
-        }
+        remove_objects_if([type](const HailoObjectPtr &obj)
+                          { return obj->get_type() == type; });
+    }
+
+    /**
+     * @brief Removes all the objects a predicate returns true for, in a single pass
+     *        that keeps the order of the remaining objects.
+     *
+     * @param predicate  -  bool(const HailoObjectPtr &)
+     *        Returns true for the objects to remove.
+     */
+    template <typename Predicate>
+    void remove_objects_if(Predicate predicate)
+    {
+        std::lock_guard<HailoSpinLock> lock(mutex);
+        m_sub_objects.erase(std::remove_if(m_sub_objects.begin(), m_sub_objects.end(), predicate), m_sub_objects.end());
     }
 };
 using HailoMainObjectPtr = std::shared_ptr<HailoMainObject>;
@@ -426,7 +435,7 @@ public:
      */
     HailoBBox &get_bbox()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_bbox;
     }
 
@@ -437,7 +446,7 @@ public:
      */
     void set_bbox(HailoBBox bbox)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_bbox = std::move(bbox);
     }
 
@@ -448,7 +457,7 @@ public:
      */
     HailoBBox &get_scaling_bbox()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_scaling_bbox;
     }
 
@@ -459,7 +468,7 @@ public:
      */
     void set_scaling_bbox(HailoBBox bbox)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         float new_xmin = (m_scaling_bbox.xmin() * bbox.width()) + bbox.xmin();
         float new_ymin = (m_scaling_bbox.ymin() * bbox.height()) + bbox.ymin();
         float new_width = m_scaling_bbox.width() * bbox.width();
@@ -474,7 +483,7 @@ public:
      */
     void clear_scaling_bbox()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_scaling_bbox = HailoBBox(0.0, 0.0, 1.0, 1.0);
     }
 
@@ -485,7 +494,7 @@ public:
      */
     std::string get_stream_id()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_stream_id;
     }
 
@@ -496,7 +505,7 @@ public:
      */
     void set_stream_id(std::string stream_id)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_stream_id = std::move(stream_id);
     }
 };
@@ -650,41 +659,41 @@ public:
 
     virtual hailo_object_t get_type()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return HAILO_DETECTION;
     }
 
     std::shared_ptr<HailoObject> clone()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
-        return std::make_shared<HailoDetection>(*this);
+        std::lock_guard<HailoSpinLock> lock(mutex);
+        return hailo_make_shared<HailoDetection>(*this);
     }
 
     // Getters of DetectionObject.
 
     float get_confidence()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_confidence;
     }
     void set_confidence(float conf)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_confidence = conf;
     }
     std::string get_label()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_label;
     }
     void set_label(std::string label)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_label = label;
     }
     int get_class_id()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_class_id;
     }
 };
@@ -772,13 +781,13 @@ public:
 
     std::shared_ptr<HailoObject> clone()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
-        return std::make_shared<HailoClassification>(*this);
+        std::lock_guard<HailoSpinLock> lock(mutex);
+        return hailo_make_shared<HailoClassification>(*this);
     }
 
     virtual hailo_object_t get_type()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return HAILO_CLASSIFICATION;
     }
 
@@ -786,22 +795,22 @@ public:
 
     float get_confidence()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_confidence;
     }
     std::string get_label()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_label;
     }
     std::string get_classification_type()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_classification_type;
     }
     int get_class_id()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_class_id;
     }
 };
@@ -861,7 +870,7 @@ public:
      */
     void add_point(HailoPoint point)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_points.emplace_back(point);
     };
 
@@ -872,22 +881,22 @@ public:
      */
     void set_points(std::vector<HailoPoint> points)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_points.clear();
         m_points = std::move(points);
     };
 
     std::shared_ptr<HailoObject> clone()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
-        return std::make_shared<HailoLandmarks>(*this);
+        std::lock_guard<HailoSpinLock> lock(mutex);
+        return hailo_make_shared<HailoLandmarks>(*this);
     }
 
     // Getters for HailoLandmarks object.
 
     std::vector<HailoPoint> get_points()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_points;
     }
     float get_threshold()
@@ -937,8 +946,8 @@ public:
 
     std::shared_ptr<HailoObject> clone()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
-        return std::make_shared<HailoUniqueID>(*this);
+        std::lock_guard<HailoSpinLock> lock(mutex);
+        return hailo_make_shared<HailoUniqueID>(*this);
     }
 
     virtual hailo_object_t get_type()
@@ -948,6 +957,78 @@ public:
 };
 using HailoUniqueIDPtr = std::shared_ptr<HailoUniqueID>;
 
+/**
+ * @brief HailoMaskData - The pixels of a mask, either given up front or decoded on first access.
+ * A lazy mask keeps only its decoder, which holds what it decodes from (e.g. an output tensor that keeps its
+ * buffer referenced). Masks that no element reads are never decoded.
+ */
+template <typename T>
+class HailoMaskData
+{
+public:
+    using Decoder = std::function<void(std::vector<T> &)>;
+
+private:
+    std::vector<T> m_data;
+    Decoder m_decoder;
+    std::atomic<bool> m_decoded;
+    std::mutex m_mutex;
+
+    std::vector<T> &materialize()
+    {
+        if (!m_decoded.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_decoded.load(std::memory_order_relaxed))
+            {
+                m_decoder(m_data);
+                // Release the source of the mask
+                m_decoder = nullptr;
+                m_decoded.store(true, std::memory_order_release);
+            }
+        }
+        return m_data;
+    }
+
+public:
+    HailoMaskData(std::vector<T> &&data) : m_data(std::move(data)), m_decoded(true){};
+    HailoMaskData(Decoder &&decoder) : m_decoder(std::move(decoder)), m_decoded(false){};
+
+    // Copies and moves decode the source first
+    HailoMaskData(const HailoMaskData &other) : m_data(const_cast<HailoMaskData &>(other).materialize()), m_decoded(true){};
+    HailoMaskData(HailoMaskData &&other) : m_data(std::move(other.materialize())), m_decoded(true){};
+    HailoMaskData &operator=(const HailoMaskData &other)
+    {
+        if (this != &other)
+            set(std::vector<T>(const_cast<HailoMaskData &>(other).materialize()));
+        return *this;
+    }
+    HailoMaskData &operator=(HailoMaskData &&other)
+    {
+        if (this != &other)
+            set(std::move(other.materialize()));
+        return *this;
+    }
+
+    const std::vector<T> &get()
+    {
+        return materialize();
+    }
+
+    void set(std::vector<T> &&data)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_data = std::move(data);
+        m_decoder = nullptr;
+        m_decoded.store(true, std::memory_order_release);
+    }
+
+    bool is_decoded() const
+    {
+        return m_decoded.load(std::memory_order_acquire);
+    }
+};
+
 class HailoMask : public HailoObject
 {
 protected:
@@ -1010,10 +1091,12 @@ using HailoDepthMaskPtr = std::shared_ptr<HailoDepthMask>;
 class HailoClassMask : public HailoMask
 {
 protected:
-    std::vector<uint8_t> m_data;
+    HailoMaskData<uint8_t> m_data;
 
 public:
     HailoClassMask(std::vector<uint8_t> &&data_vec, int mask_width, int mask_height, float transparency) : HailoMask(mask_width, mask_height, transparency), m_data(std::move(data_vec)){};
+    // A mask decoded by decoder when its data is first read
+    HailoClassMask(HailoMaskData<uint8_t>::Decoder &&decoder, int mask_width, int mask_height, float transparency) : HailoMask(mask_width, mask_height, transparency), m_data(std::move(decoder)){};
 
     virtual hailo_object_t get_type()
     {
@@ -1022,7 +1105,12 @@ public:
 
     const std::vector<uint8_t> &get_data()
     {
-        return m_data;
+        return m_data.get();
+    }
+
+    bool is_decoded()
+    {
+        return m_data.is_decoded();
     }
     virtual ~HailoClassMask() = default;
 };
@@ -1032,10 +1120,12 @@ class HailoConfClassMask : public HailoMask
 {
 protected:
     int m_class_id;
-    std::vector<float> m_data;
+    HailoMaskData<float> m_data;
 
 public:
     HailoConfClassMask(std::vector<float> &&data_vec, int mask_width, int mask_height, float transparency, int class_id) : HailoMask(mask_width, mask_height, transparency), m_class_id(class_id), m_data(std::move(data_vec)){};
+    // A mask decoded by decoder when its data is first read
+    HailoConfClassMask(HailoMaskData<float>::Decoder &&decoder, int mask_width, int mask_height, float transparency, int class_id) : HailoMask(mask_width, mask_height, transparency), m_class_id(class_id), m_data(std::move(decoder)){};
 
     virtual hailo_object_t get_type()
     {
@@ -1044,7 +1134,12 @@ public:
 
     const std::vector<float> &get_data()
     {
-        return m_data;
+        return m_data.get();
+    }
+
+    bool is_decoded()
+    {
+        return m_data.is_decoded();
     }
 
     virtual ~HailoConfClassMask() = default;
@@ -1076,7 +1171,7 @@ public:
 
     std::shared_ptr<HailoObject> clone()
     {
-        return std::dynamic_pointer_cast<HailoObject>(std::make_shared<HailoMatrix>(*this));
+        return std::dynamic_pointer_cast<HailoObject>(hailo_make_shared<HailoMatrix>(*this));
     }
 
     const uint32_t width()
@@ -1127,38 +1222,38 @@ public:
 
     virtual hailo_object_t get_type()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return HAILO_USER_META;
     }
 
     float get_user_float()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_user_float;
     }
     std::string get_user_string()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_user_string;
     }
     int get_user_int()
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         return m_user_int;
     }
     void set_user_float(float user_float)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_user_float = user_float;
     }
     void set_user_string(std::string user_string)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_user_string = user_string;
     }
     void set_user_int(int user_int)
     {
-        std::lock_guard<std::mutex> lock(*mutex);
+        std::lock_guard<HailoSpinLock> lock(mutex);
         m_user_int = user_int;
     }
 };
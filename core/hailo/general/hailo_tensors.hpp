@@ -9,8 +9,13 @@
 
 #pragma once
 #include "hailo/hailort.h"
+#include <array>
+#include <cmath>
+#include <limits>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 class HailoTensor
@@ -128,3 +133,215 @@ public:
 };
 
 using HailoTensorPtr = std::shared_ptr<HailoTensor>;
+
+//-------------------------------
+// TYPED TENSOR ACCESSORS
+//-------------------------------
+
+/**
+ * @brief Memory layout of the height x width x features cells of a tensor.
+ */
+enum class HailoTensorLayout
+{
+    NHWC, // Features are interleaved, the layout of the output vstreams
+    NCHW  // Every feature is a plane of its own
+};
+
+// Activations applied to dequantized values by QuantizedLUT.
+struct IdentityActivation
+{
+    float operator()(float x) const { return x; }
+};
+
+struct SigmoidActivation
+{
+    float operator()(float x) const { return 1.0f / (1.0f + std::exp(-x)); }
+};
+
+struct ExpActivation
+{
+    float operator()(float x) const { return std::exp(x); }
+};
+
+/**
+ * @brief Maps a quantized value to activation(dequantized value).
+ *        For uint8 every one of the 256 results is computed once, on construction, so a lookup is a single load.
+ *        A uint16 table would need 65536 entries, more than a frame's worth of lookups, so uint16 values are
+ *        computed on access instead - code using the table is the same for both.
+ *        Values are dequantized with the same arithmetic as HailoTensor::fix_scale.
+ *
+ * @tparam T The quantized type (uint8_t / uint16_t).
+ * @tparam Activation Functor applied to the dequantized value.
+ */
+template <typename T, typename Activation = IdentityActivation>
+class QuantizedLUT
+{
+private:
+    float m_qp_zp;
+    float m_qp_scale;
+    Activation m_activation;
+
+public:
+    QuantizedLUT(float qp_zp, float qp_scale, Activation activation = Activation())
+        : m_qp_zp(qp_zp), m_qp_scale(qp_scale), m_activation(activation) {}
+
+    float operator[](T num) const
+    {
+        return m_activation((float(num) - m_qp_zp) * m_qp_scale);
+    }
+};
+
+template <typename Activation>
+class QuantizedLUT<uint8_t, Activation>
+{
+private:
+    std::array<float, 256> m_table;
+
+public:
+    QuantizedLUT(float qp_zp, float qp_scale, Activation activation = Activation())
+    {
+        for (uint num = 0; num < m_table.size(); num++)
+            m_table[num] = activation((float(num) - qp_zp) * qp_scale);
+    }
+
+    float operator[](uint8_t num) const
+    {
+        return m_table[num];
+    }
+};
+
+/**
+ * @brief Read-only accessor of a tensor whose element type and layout are known at compile time.
+ *        Strides and quantization parameters are read once, on construction, so getting an element is a
+ *        multiply-add and dequantizing it doesn't go back to the vstream info.
+ *        The accessor doesn't own the data, it must not outlive the tensor.
+ *
+ * @tparam T The element type (uint8_t / uint16_t).
+ * @tparam Layout The memory layout of the tensor.
+ */
+template <typename T, HailoTensorLayout Layout = HailoTensorLayout::NHWC>
+class TypedTensor
+{
+    static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value, "TypedTensor reads quantized tensors");
+
+private:
+    const T *m_data;
+    uint m_height;
+    uint m_width;
+    uint m_features;
+    std::size_t m_row_stride;
+    std::size_t m_col_stride;
+    std::size_t m_channel_stride;
+    float m_qp_zp;
+    float m_qp_scale;
+
+public:
+    explicit TypedTensor(HailoTensor &tensor)
+        : m_data(reinterpret_cast<const T *>(tensor.data())),
+          m_height(tensor.height()),
+          m_width(tensor.width()),
+          m_features(tensor.features()),
+          m_qp_zp(tensor.vstream_info().quant_info.qp_zp),
+          m_qp_scale(tensor.vstream_info().quant_info.qp_scale)
+    {
+        if (Layout == HailoTensorLayout::NHWC)
+        {
+            m_row_stride = (std::size_t)m_width * m_features;
+            m_col_stride = m_features;
+            m_channel_stride = 1;
+        }
+        else
+        {
+            m_row_stride = m_width;
+            m_col_stride = 1;
+            m_channel_stride = (std::size_t)m_height * m_width;
+        }
+    }
+    explicit TypedTensor(const std::shared_ptr<HailoTensor> &tensor) : TypedTensor(*tensor) {}
+
+    const T *data() const { return m_data; }
+    uint width() const { return m_width; }
+    uint height() const { return m_height; }
+    uint features() const { return m_features; }
+    float qp_zp() const { return m_qp_zp; }
+    float qp_scale() const { return m_qp_scale; }
+
+    /**
+     * @brief Position of a cell in the tensor's data.
+     */
+    std::size_t index(uint row, uint col, uint channel) const
+    {
+        return row * m_row_stride + col * m_col_stride + channel * m_channel_stride;
+    }
+
+    /**
+     * @brief Pointer to a cell, in NHWC its features follow it contiguously.
+     */
+    const T *cell(uint row, uint col, uint channel = 0) const
+    {
+        return m_data + index(row, col, channel);
+    }
+
+    T get(uint row, uint col, uint channel) const
+    {
+        return m_data[index(row, col, channel)];
+    }
+
+    float fix_scale(T num) const
+    {
+        return (float(num) - m_qp_zp) * m_qp_scale;
+    }
+
+    float get_full_precision(uint row, uint col, uint channel) const
+    {
+        return fix_scale(get(row, col, channel));
+    }
+
+    /**
+     * @brief Table of activation(dequantized value) for the quantized values of this tensor.
+     */
+    template <typename Activation = IdentityActivation>
+    QuantizedLUT<T, Activation> make_lut(Activation activation = Activation()) const
+    {
+        return QuantizedLUT<T, Activation>(m_qp_zp, m_qp_scale, activation);
+    }
+};
+
+/**
+ * @brief Run a kernel instantiated for the element type of a tensor format, so the type is resolved
+ *        once per tensor instead of once per element. The kernel is a generic callable taking a value of
+ *        the element type as a tag:
+ *          dispatch_by_format(tensor->vstream_info().format.type, [&](auto tag) {
+ *              using T = decltype(tag);
+ *              decode<T>(tensor);
+ *          });
+ *        As everywhere else in the postprocesses, formats other than uint16 are read as uint8.
+ *
+ * @param format_type The format type of the tensor.
+ * @param kernel The kernel to run.
+ */
+template <typename Kernel>
+decltype(auto) dispatch_by_format(hailo_format_type_t format_type, Kernel &&kernel)
+{
+    switch (format_type)
+    {
+    case HAILO_FORMAT_TYPE_UINT16:
+        return kernel(uint16_t());
+    case HAILO_FORMAT_TYPE_FLOAT32:
+        throw std::invalid_argument("Tensors of type float32 are not quantized");
+    default:
+        return kernel(uint8_t());
+    }
+}
+
+template <typename Kernel>
+decltype(auto) dispatch_by_format(bool is_uint16, Kernel &&kernel)
+{
+    return dispatch_by_format(is_uint16 ? HAILO_FORMAT_TYPE_UINT16 : HAILO_FORMAT_TYPE_UINT8, std::forward<Kernel>(kernel));
+}
+
+template <typename Kernel>
+decltype(auto) dispatch_by_format(HailoTensor &tensor, Kernel &&kernel)
+{
+    return dispatch_by_format(tensor.vstream_info().format.type, std::forward<Kernel>(kernel));
+}
@@ -135,7 +135,7 @@ HailoBBox algorithm_face_crop(uint width, uint height, const HailoBBox &roi, flo
 
 HailoDetectionPtr clone_detection_object(HailoDetectionPtr detection)
 {
-    HailoDetectionPtr new_roi = std::make_shared<HailoDetection>(detection->get_bbox(), detection->get_label(), detection->get_confidence());
+    HailoDetectionPtr new_roi = hailo_make_shared<HailoDetection>(detection->get_bbox(), detection->get_label(), detection->get_confidence());
 
     for (auto object : detection->get_objects())
     {
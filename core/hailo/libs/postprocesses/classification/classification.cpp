@@ -29,8 +29,8 @@ void top1(HailoROIPtr roi, std::string layer_name, int label_offset)
     // Extract the relevant output tensor.
     HailoTensorPtr scores = roi->get_tensor(layer_name);
 
-    // Convert the tensor to xarray.
-    xt::xarray<uint8_t> xscores = common::get_xtensor(scores);
+    // View the tensor in place.
+    auto xscores = common::tensor_view<uint8_t>(scores);
 
     // Find the topk scores.
     xt::xarray<int> top_k_scores = common::top_k(xscores, k);
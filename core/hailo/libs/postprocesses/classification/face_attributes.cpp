@@ -22,14 +22,14 @@ xt::xarray<float> get_face_attributes(HailoROIPtr roi, std::string output_layer_
     // Extract the relevant output tensor.
     HailoTensorPtr outp_tensor = roi->get_tensor(output_layer_name);
 
-    // Convert the tensor to xarray
-    xt::xarray<float> output_dequantize = common::get_xtensor_float(outp_tensor);
+    // View the tensor in place, dequantization keeps the order so argmax can run on the quantized values
+    auto output_quantized = common::tensor_view<uint8_t>(outp_tensor);
 
     // Reshape the output tensor to 40 classes view
-    output_dequantize = xt::reshape_view(output_dequantize, {1, RESNET_V1_18_FACE_NUMBER_OF_CLASSES, 2});
+    auto output_reshaped = xt::reshape_view(output_quantized, {1, RESNET_V1_18_FACE_NUMBER_OF_CLASSES, 2});
 
     // Get the face attributes values by argmax
-    xt::xarray<float>  attr_predictions = xt::argmax(output_dequantize, -1);
+    xt::xarray<float>  attr_predictions = xt::argmax(output_reshaped, -1);
     return attr_predictions;
 }
 
@@ -42,7 +42,7 @@ void add_attribute_prediction_to_roi(HailoROIPtr roi, std::vector<HailoUniqueIDP
         if (label != "No_Beard")
         {
             // Create the classification result
-            classification = std::make_shared<HailoClassification>(std::string("face_attributes"),
+            classification = hailo_make_shared<HailoClassification>(std::string("face_attributes"),
                                                                    index,
                                                                    label,
                                                                    confidence);
@@ -58,7 +58,7 @@ void add_attribute_prediction_to_roi(HailoROIPtr roi, std::vector<HailoUniqueIDP
         if (new_label != "")
         {
             // Create the classification result
-            classification = std::make_shared<HailoClassification>(std::string("face_attributes"),
+            classification = hailo_make_shared<HailoClassification>(std::string("face_attributes"),
                                                                    index,
                                                                    new_label,
                                                                    0.99f);
@@ -18,9 +18,8 @@ std::string tracker_name = "hailo_person_tracker";
 
 xt::xarray<float> get_attr_predictions_from_tensor(HailoTensorPtr outp_tensor)
 {
-    // Convert the tensor to xarray
-    xt::xarray<float> xscores = common::get_xtensor_float(outp_tensor);
-    auto attr_predictions = xt::view(xscores, 0, 0, xt::all());
+    // Dequantize only the attributes row of the tensor
+    xt::xarray<float> attr_predictions = xt::view(common::dequantized_view<uint8_t>(outp_tensor), 0, 0, xt::all());
 
     // Calculate the face attributes values by sigmoid
     common::sigmoid(attr_predictions.data(), attr_predictions.size());
@@ -61,14 +60,14 @@ void person_attributes_postprocess(HailoROIPtr roi, std::string output_layer_nam
         HailoClassificationPtr classification;
         if (label != "" && confidence > RESNET_V1_18_PERSON_THRESHOLD)
         {
-            classification = std::make_shared<HailoClassification>(std::string("person_attributes"),
+            classification = hailo_make_shared<HailoClassification>(std::string("person_attributes"),
                                                                    i,
                                                                    label,
                                                                    0.99f);
         }
         else if(label == "Male")
         {
-            classification = std::make_shared<HailoClassification>(std::string("person_attributes"),
+            classification = hailo_make_shared<HailoClassification>(std::string("person_attributes"),
                                                         i,
                                                         "Female",
                                                         0.99f);
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file heatmap_peaks.hpp
+ * @brief Top k peak extraction over quantized heatmaps, shared by the pose estimation postprocesses.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "quantized_kernels.hpp"
+
+namespace common
+{
+    //-------------------------------
+    // HEATMAP PEAKS
+    //-------------------------------
+
+    template <typename T>
+    struct HeatmapPeak
+    {
+        uint32_t index; // Cell of the peak, y * width + x
+        T value;        // Quantized score of the peak
+    };
+
+    /**
+     * @brief Top k peaks of every channel of a quantized (uint8/uint16) HWC heatmap, read in place.
+     *        A histogram of the scores' high byte gives every channel a cut that at least k of its scores reach,
+     *        scores at or above the cut are collected with a SIMD threshold scan, and only the best k are sorted.
+     *        With suppress_non_peaks a score is kept only if it is the maximum of its 3x3 neighbourhood (max-pool NMS).
+     *        All the buffers are kept between runs, so a reused engine doesn't allocate.
+     */
+    template <typename T>
+    class HeatmapPeakEngine
+    {
+    private:
+        static constexpr int HISTOGRAM_BINS = 256;
+        static constexpr int HISTOGRAM_SHIFT = (sizeof(T) - 1) * 8;
+
+        std::vector<uint32_t> m_histogram;
+        std::vector<T> m_cuts;
+        std::vector<uint32_t> m_candidates;
+        std::vector<std::vector<HeatmapPeak<T>>> m_peaks;
+
+        static bool is_local_max(const T *data, uint32_t height, uint32_t width, uint32_t channels,
+                                 uint32_t channel, uint32_t y, uint32_t x, T value)
+        {
+            uint32_t y_begin = (y > 0) ? y - 1 : 0, y_end = std::min(y + 2, height);
+            uint32_t x_begin = (x > 0) ? x - 1 : 0, x_end = std::min(x + 2, width);
+            for (uint32_t ny = y_begin; ny < y_end; ny++)
+            {
+                const T *row = data + (std::size_t)ny * width * channels + channel;
+                for (uint32_t nx = x_begin; nx < x_end; nx++)
+                {
+                    if (row[nx * channels] > value)
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        void find_cuts(const T *data, std::size_t cells, uint32_t channels, uint32_t k)
+        {
+            m_histogram.assign(channels * HISTOGRAM_BINS, 0);
+            const T *cell = data;
+            for (std::size_t i = 0; i < cells; i++, cell += channels)
+            {
+                for (uint32_t c = 0; c < channels; c++)
+                    m_histogram[c * HISTOGRAM_BINS + (cell[c] >> HISTOGRAM_SHIFT)]++;
+            }
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                uint32_t count = 0;
+                for (int bin = HISTOGRAM_BINS - 1; bin >= 0; bin--)
+                {
+                    count += m_histogram[c * HISTOGRAM_BINS + bin];
+                    if (count >= k)
+                    {
+                        m_cuts[c] = std::max(m_cuts[c], static_cast<T>(bin << HISTOGRAM_SHIFT));
+                        break;
+                    }
+                }
+            }
+        }
+
+    public:
+        /**
+         * @brief Find the top k peaks of every channel.
+         *
+         * @param data  -  const T *
+         *        The heatmap, height x width x channels.
+         *
+         * @param k  -  uint32_t
+         *        Maximal number of peaks to keep per channel.
+         *
+         * @param threshold  -  T
+         *        Quantized threshold, lower scores are never peaks.
+         *
+         * @param suppress_non_peaks  -  bool
+         *        Keep only the scores that are the maximum of their 3x3 neighbourhood.
+         */
+        void run(const T *data, uint32_t height, uint32_t width, uint32_t channels, uint32_t k,
+                 T threshold = 0, bool suppress_non_peaks = false)
+        {
+            const std::size_t cells = (std::size_t)height * width;
+            m_peaks.resize(channels);
+            for (auto &peaks : m_peaks)
+                peaks.clear();
+            if (k == 0 || cells == 0)
+                return;
+
+            m_cuts.assign(channels, threshold);
+            // The histogram counts scores, it can't tell how many of them are local maxima
+            if (!suppress_non_peaks)
+                find_cuts(data, cells, channels, k);
+
+            m_candidates.clear();
+            collect_above_threshold(data, cells * channels, 1, *std::min_element(m_cuts.begin(), m_cuts.end()), 1, 0, m_candidates);
+            for (uint32_t flat_index : m_candidates)
+            {
+                uint32_t channel = flat_index % channels;
+                uint32_t index = flat_index / channels;
+                T value = data[flat_index];
+                if (value < m_cuts[channel])
+                    continue;
+                if (suppress_non_peaks && !is_local_max(data, height, width, channels, channel, index / width, index % width, value))
+                    continue;
+                m_peaks[channel].push_back({index, value});
+            }
+
+            // Best score first, ties by cell order
+            auto better = [](const HeatmapPeak<T> &a, const HeatmapPeak<T> &b)
+            { return a.value > b.value || (a.value == b.value && a.index < b.index); };
+            for (auto &peaks : m_peaks)
+            {
+                if (peaks.size() > k)
+                {
+                    std::partial_sort(peaks.begin(), peaks.begin() + k, peaks.end(), better);
+                    peaks.resize(k);
+                }
+                else
+                {
+                    std::sort(peaks.begin(), peaks.end(), better);
+                }
+            }
+        }
+
+        /**
+         * @brief The peaks of a channel after the last run, by descending score.
+         */
+        const std::vector<HeatmapPeak<T>> &peaks(uint32_t channel = 0) const { return m_peaks[channel]; }
+    };
+
+}
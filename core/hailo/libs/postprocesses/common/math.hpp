@@ -16,8 +16,8 @@ namespace common
     //-------------------------------
     // COMMON FILTERS
     //-------------------------------
-    template <typename T>
-    xt::xarray<int> top_k(xt::xarray<T> &data, const int k)
+    template <typename E>
+    xt::xarray<int> top_k(E &data, const int k)
     {
         // First we negate the array so that we sort in descending order.
         auto descending_order_array = xt::eval(-data);
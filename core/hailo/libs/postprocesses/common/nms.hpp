@@ -4,6 +4,11 @@
  **/
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
 #include "hailo_objects.hpp"
 #include "hailo_common.hpp"
 namespace common
@@ -24,6 +29,328 @@ namespace common
         return area_of_overlap / (box_1_area + box_2_area - area_of_overlap);
     }
 
+    //-------------------------------
+    // NMS ENGINE
+    //-------------------------------
+
+    enum class NmsMethod
+    {
+        HARD,         // Suppress every box with IOU >= threshold against a kept box.
+        DIOU,         // Like HARD, but compares IOU minus the normalized distance between the box centers.
+        SOFT_LINEAR,  // Decay overlapping boxes' scores by (1 - IOU) instead of suppressing them.
+        SOFT_GAUSSIAN // Decay overlapping boxes' scores by exp(-IOU^2 / sigma).
+    };
+
+    struct NmsParams
+    {
+        float iou_threshold;
+        bool cross_classes = false;      // If true, apply NMS regardless of class differences.
+        NmsMethod method = NmsMethod::HARD;
+        uint top_k = 0;                  // Maximal number of boxes to keep (over all classes), 0 for no limit.
+        float soft_sigma = 0.5f;         // Gaussian soft-NMS sigma.
+        float score_threshold = 0.0f;    // Soft-NMS drops boxes whose decayed score falls below this threshold.
+        NmsParams(float iou_threshold) : iou_threshold(iou_threshold){};
+    };
+
+    /**
+     * @brief NMS over a compact SoA array of boxes, scores and class ids.
+     *        Boxes are partitioned by class and sorted by xmin, so each kept box is
+     *        compared only against the boxes that overlap it along the x axis.
+     *        All the buffers are kept between runs, so a reused engine doesn't allocate.
+     */
+    class NmsEngine
+    {
+    public:
+        void clear()
+        {
+            m_xmin.clear();
+            m_ymin.clear();
+            m_xmax.clear();
+            m_ymax.clear();
+            m_area.clear();
+            m_score.clear();
+            m_class_id.clear();
+        }
+
+        void reserve(std::size_t size)
+        {
+            m_xmin.reserve(size);
+            m_ymin.reserve(size);
+            m_xmax.reserve(size);
+            m_ymax.reserve(size);
+            m_area.reserve(size);
+            m_score.reserve(size);
+            m_class_id.reserve(size);
+        }
+
+        std::size_t size() const { return m_score.size(); }
+
+        void add(const HailoBBox &bbox, float score, int class_id)
+        {
+            // Same arithmetic as iou_calc, so decisions match it exactly.
+            m_xmin.push_back(bbox.xmin());
+            m_ymin.push_back(bbox.ymin());
+            m_xmax.push_back(bbox.xmax());
+            m_ymax.push_back(bbox.ymax());
+            m_area.push_back((bbox.ymax() - bbox.ymin()) * (bbox.xmax() - bbox.xmin()));
+            m_score.push_back(score);
+            m_class_id.push_back(class_id);
+        }
+
+        /**
+         * @brief Score of a box after the last run (differs from the added score only for soft-NMS).
+         */
+        float score(uint32_t index) const { return m_score[index]; }
+
+        /**
+         * @brief Run NMS over the added boxes.
+         *        Boxes with a score of 0 are ignored.
+         *
+         * @param params  -  NmsParams
+         *        The NMS configuration.
+         *
+         * @return const std::vector<uint32_t>& indices of the kept boxes, by descending score.
+         */
+        const std::vector<uint32_t> &run(const NmsParams &params)
+        {
+            const uint32_t count = size();
+            m_kept.clear();
+            m_by_class_x.resize(count);
+            m_position.resize(count);
+            m_state.assign(count, PENDING);
+            for (uint32_t i = 0; i < count; i++)
+            {
+                m_by_class_x[i] = i;
+                if (m_score[i] == 0.0f)
+                    m_state[i] = SUPPRESSED;
+            }
+
+            // Partition by class, and sort each partition by xmin for the sweep.
+            std::sort(m_by_class_x.begin(), m_by_class_x.end(),
+                      [&](uint32_t a, uint32_t b)
+                      {
+                          if (!params.cross_classes && m_class_id[a] != m_class_id[b])
+                              return m_class_id[a] < m_class_id[b];
+                          return m_xmin[a] < m_xmin[b];
+                      });
+            for (uint32_t i = 0; i < count; i++)
+                m_position[m_by_class_x[i]] = i;
+
+            uint32_t begin = 0;
+            while (begin < count)
+            {
+                uint32_t end = begin + 1;
+                while (end < count && (params.cross_classes || m_class_id[m_by_class_x[end]] == m_class_id[m_by_class_x[begin]]))
+                    end++;
+                if (params.method == NmsMethod::SOFT_LINEAR || params.method == NmsMethod::SOFT_GAUSSIAN)
+                    run_soft_partition(begin, end, params);
+                else
+                    run_hard_partition(begin, end, params);
+                begin = end;
+            }
+
+            // Merge the partitions by descending score, ties are broken by insertion order.
+            std::sort(m_kept.begin(), m_kept.end(),
+                      [&](uint32_t a, uint32_t b)
+                      { return by_score(a, b); });
+            if (params.top_k > 0 && m_kept.size() > params.top_k)
+                m_kept.resize(params.top_k);
+            return m_kept;
+        }
+
+        /**
+         * @brief Run NMS over a vector of HailoDetection objects, keeping only the surviving ones.
+         *        The survivors are ordered by descending confidence, and soft-NMS updates their confidence.
+         *
+         * @param objects  -  std::vector<HailoDetection>
+         *        The detections to perform NMS on.
+         *
+         * @param params  -  NmsParams
+         *        The NMS configuration.
+         */
+        void apply(std::vector<HailoDetection> &objects, const NmsParams &params)
+        {
+            clear();
+            reserve(objects.size());
+            for (auto &object : objects)
+                add(object.get_bbox(), object.get_confidence(), object.get_class_id());
+            const std::vector<uint32_t> &kept = run(params);
+
+            std::vector<HailoDetection> objects_after_nms;
+            objects_after_nms.reserve(kept.size());
+            for (uint32_t index : kept)
+            {
+                objects_after_nms.emplace_back(std::move(objects[index]));
+                if (objects_after_nms.back().get_confidence() != m_score[index])
+                    objects_after_nms.back().set_confidence(m_score[index]);
+            }
+            objects = std::move(objects_after_nms);
+        }
+
+    private:
+        enum : uint8_t
+        {
+            PENDING,
+            KEPT,
+            SUPPRESSED
+        };
+
+        std::vector<float> m_xmin;
+        std::vector<float> m_ymin;
+        std::vector<float> m_xmax;
+        std::vector<float> m_ymax;
+        std::vector<float> m_area;
+        std::vector<float> m_score;
+        std::vector<int> m_class_id;
+
+        std::vector<uint32_t> m_by_class_x; // Box indices, partitioned by class and sorted by xmin.
+        std::vector<uint32_t> m_position;   // Position of each box in m_by_class_x.
+        std::vector<uint32_t> m_by_score;   // Box indices of the current partition, by descending score.
+        std::vector<uint8_t> m_state;
+        std::vector<uint32_t> m_kept;
+
+        bool by_score(uint32_t a, uint32_t b) const
+        {
+            return m_score[a] > m_score[b] || (m_score[a] == m_score[b] && a < b);
+        }
+
+        float iou(uint32_t a, uint32_t b) const
+        {
+            const float width_of_overlap_area = std::min(m_xmax[a], m_xmax[b]) - std::max(m_xmin[a], m_xmin[b]);
+            const float height_of_overlap_area = std::min(m_ymax[a], m_ymax[b]) - std::max(m_ymin[a], m_ymin[b]);
+            const float area_of_overlap = std::max(width_of_overlap_area, 0.0f) * std::max(height_of_overlap_area, 0.0f);
+            return area_of_overlap / (m_area[a] + m_area[b] - area_of_overlap);
+        }
+
+        float diou(uint32_t a, uint32_t b) const
+        {
+            // IOU minus the squared distance between the centers, normalized by the enclosing box diagonal.
+            const float center_dx = (m_xmin[a] + m_xmax[a] - m_xmin[b] - m_xmax[b]) / 2.0f;
+            const float center_dy = (m_ymin[a] + m_ymax[a] - m_ymin[b] - m_ymax[b]) / 2.0f;
+            const float enclosing_w = std::max(m_xmax[a], m_xmax[b]) - std::min(m_xmin[a], m_xmin[b]);
+            const float enclosing_h = std::max(m_ymax[a], m_ymax[b]) - std::min(m_ymin[a], m_ymin[b]);
+            const float diagonal = enclosing_w * enclosing_w + enclosing_h * enclosing_h;
+            if (diagonal <= 0.0f)
+                return iou(a, b);
+            return iou(a, b) - (center_dx * center_dx + center_dy * center_dy) / diagonal;
+        }
+
+        /**
+         * @brief Call func(j) for every box of the partition [begin, end) that may overlap box i along the x axis.
+         *        If no overlap is needed to pass the threshold, every box of the partition is visited.
+         */
+        template <typename F>
+        void for_each_x_neighbour(uint32_t i, uint32_t begin, uint32_t end, float max_width, bool needs_overlap, F func)
+        {
+            if (!needs_overlap)
+            {
+                for (uint32_t pos = begin; pos < end; pos++)
+                    if (m_by_class_x[pos] != i)
+                        func(m_by_class_x[pos]);
+                return;
+            }
+            const uint32_t position = m_position[i];
+            // Boxes to the left overlap only if they start at most max_width before box i.
+            const float left_limit = m_xmin[i] - max_width;
+            for (uint32_t pos = position; pos > begin && m_xmin[m_by_class_x[pos - 1]] >= left_limit; pos--)
+                func(m_by_class_x[pos - 1]);
+            for (uint32_t pos = position + 1; pos < end && m_xmin[m_by_class_x[pos]] < m_xmax[i]; pos++)
+                func(m_by_class_x[pos]);
+        }
+
+        float partition_max_width(uint32_t begin, uint32_t end) const
+        {
+            float max_width = 0.0f;
+            for (uint32_t pos = begin; pos < end; pos++)
+                max_width = std::max(max_width, m_xmax[m_by_class_x[pos]] - m_xmin[m_by_class_x[pos]]);
+            // Leave some slack for rounding, the exact IOU is computed for every visited box anyway.
+            return max_width * 1.001f + 1e-6f;
+        }
+
+        void run_hard_partition(uint32_t begin, uint32_t end, const NmsParams &params)
+        {
+            m_by_score.assign(m_by_class_x.begin() + begin, m_by_class_x.begin() + end);
+            std::sort(m_by_score.begin(), m_by_score.end(),
+                      [&](uint32_t a, uint32_t b)
+                      { return by_score(a, b); });
+            const float max_width = partition_max_width(begin, end);
+            // With a positive threshold, only overlapping boxes can be suppressed (DIOU <= IOU).
+            const bool needs_overlap = params.iou_threshold > 0.0f;
+            uint kept_in_partition = 0;
+            for (uint32_t i : m_by_score)
+            {
+                if (m_state[i] != PENDING)
+                    continue;
+                m_state[i] = KEPT;
+                m_kept.push_back(i);
+                if (params.top_k > 0 && ++kept_in_partition >= params.top_k)
+                    break;
+                for_each_x_neighbour(i, begin, end, max_width, needs_overlap,
+                                     [&](uint32_t j)
+                                     {
+                                         if (m_state[j] != PENDING)
+                                             return;
+                                         float overlap = (params.method == NmsMethod::DIOU) ? diou(i, j) : iou(i, j);
+                                         if (overlap >= params.iou_threshold)
+                                             m_state[j] = SUPPRESSED;
+                                     });
+            }
+        }
+
+        void run_soft_partition(uint32_t begin, uint32_t end, const NmsParams &params)
+        {
+            const float max_width = partition_max_width(begin, end);
+            // Gaussian decay applies to any overlap, linear decay only above the threshold.
+            const bool needs_overlap = params.method == NmsMethod::SOFT_GAUSSIAN || params.iou_threshold > 0.0f;
+            uint kept_in_partition = 0;
+            while (params.top_k == 0 || kept_in_partition < params.top_k)
+            {
+                // Pick the pending box with the highest (decayed) score.
+                uint32_t best = UINT32_MAX;
+                for (uint32_t pos = begin; pos < end; pos++)
+                {
+                    uint32_t j = m_by_class_x[pos];
+                    if (m_state[j] == PENDING && (best == UINT32_MAX || by_score(j, best)))
+                        best = j;
+                }
+                if (best == UINT32_MAX)
+                    break;
+                m_state[best] = KEPT;
+                m_kept.push_back(best);
+                kept_in_partition++;
+                for_each_x_neighbour(best, begin, end, max_width, needs_overlap,
+                                     [&](uint32_t j)
+                                     {
+                                         if (m_state[j] != PENDING)
+                                             return;
+                                         float overlap = iou(best, j);
+                                         if (params.method == NmsMethod::SOFT_GAUSSIAN)
+                                             m_score[j] *= std::exp(-(overlap * overlap) / params.soft_sigma);
+                                         else if (overlap >= params.iou_threshold)
+                                             m_score[j] *= (1.0f - overlap);
+                                         if (m_score[j] <= params.score_threshold)
+                                             m_state[j] = SUPPRESSED;
+                                     });
+            }
+        }
+    };
+
+    /**
+     * @brief Perform NMS on a vector of HailoDetection objects
+     *
+     * @param objects  -  std::vector<HailoDetection>
+     *        The detections to perform NMS on.
+     *
+     * @param params  -  NmsParams
+     *        The NMS configuration (method, top-k, cross classes).
+     */
+    inline void nms(std::vector<HailoDetection> &objects, const NmsParams &params)
+    {
+        // Reused between calls, so the engine's buffers are allocated only once per thread.
+        thread_local NmsEngine engine;
+        engine.apply(objects, params);
+    }
+
     /**
      * @brief Perform IOU based NMS on a vector of HailoDetection objects
      *
@@ -38,45 +365,9 @@ namespace common
      */
     void nms(std::vector<HailoDetection> &objects, const float iou_thr, bool should_nms_cross_classes = false)
     {
-        std::vector<HailoDetection> objects_after_nms;
-        // The network may propose multiple detections of similar size/score,
-        // which are actually the same detection. We want to filter out the lesser
-        // detections with a simple nms.
-        std::sort(objects.begin(), objects.end(),
-                  [](HailoDetection a, HailoDetection b)
-                  { return a.get_confidence() > b.get_confidence(); });
-
-        for (uint index = 0; index < objects.size(); index++)
-        {
-            if (objects[index].get_confidence() != 0.0f)
-            {
-                for (uint jindex = index + 1; jindex < objects.size(); jindex++)
-                {
-                    if ((should_nms_cross_classes || (objects[index].get_class_id() == objects[jindex].get_class_id())) &&
-                        objects[jindex].get_confidence() != 0.0f)
-                    {
-                        // For each detection, calculate the IOU against each following detection.
-                        float iou = iou_calc(objects[index].get_bbox(), objects[jindex].get_bbox());
-                        // If the IOU is above threshold, then we have two similar detections,
-                        // and want to delete the one.
-                        if (iou >= iou_thr)
-                        {
-                            // The detections are arranged in highest score order,
-                            // so we want to erase the latter detection.
-                            objects[jindex].set_confidence(0.0f);
-                        }
-                    }
-                }
-            }
-        }
-        for (uint index = 0; index < objects.size(); index++)
-        {
-            if (objects[index].get_confidence() != 0.0f)
-            {
-                objects_after_nms.push_back(objects[index]);
-            }
-        }
-        objects = objects_after_nms;
+        NmsParams params(iou_thr);
+        params.cross_classes = should_nms_cross_classes;
+        nms(objects, params);
     }
 
-}
\ No newline at end of file
+}
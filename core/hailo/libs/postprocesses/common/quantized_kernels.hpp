@@ -0,0 +1,313 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file quantized_kernels.hpp
+ * @brief Kernels that operate directly on quantized (uint8/uint16) tensor data,
+ *        so postprocesses can filter before paying for dequantization.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAILO_KERNELS_X86
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace common
+{
+    //-------------------------------
+    // QUANTIZED THRESHOLDING
+    //-------------------------------
+
+    /**
+     * @brief Scalar strided scan of elements [begin, end), see collect_above_threshold.
+     */
+    template <typename T>
+    inline void collect_above_threshold_scalar(const T *data, std::size_t begin, std::size_t end, std::size_t stride, T threshold,
+                                               uint32_t index_step, uint32_t index_offset, std::vector<uint32_t> &indices)
+    {
+        const T *ptr = data + begin * stride;
+        for (std::size_t i = begin; i < end; i++, ptr += stride)
+        {
+            if (*ptr >= threshold)
+                indices.push_back(i * index_step + index_offset);
+        }
+    }
+
+    /**
+     * @brief Collect the indices of all the elements that are greater or equal to a quantized threshold.
+     *        Element i is read from data[i * stride], and is reported as (i * index_step + index_offset).
+     *        Contiguous data (stride == 1) is scanned with SSE2/NEON when available.
+     *
+     * @param data  -  const T *
+     *        Pointer to the first element to scan.
+     *
+     * @param count  -  std::size_t
+     *        Number of elements to scan.
+     *
+     * @param stride  -  std::size_t
+     *        Distance (in elements) between two consecutive scanned elements.
+     *
+     * @param threshold  -  T
+     *        Quantized threshold, elements >= threshold are collected.
+     *
+     * @param index_step  -  uint32_t
+     *        Multiplier applied to the element index before it is reported.
+     *
+     * @param index_offset  -  uint32_t
+     *        Offset added to the element index before it is reported.
+     *
+     * @param indices  -  std::vector<uint32_t>
+     *        Output vector, indices are appended in ascending order.
+     */
+    template <typename T>
+    inline void collect_above_threshold(const T *data, std::size_t count, std::size_t stride, T threshold,
+                                        uint32_t index_step, uint32_t index_offset, std::vector<uint32_t> &indices)
+    {
+        collect_above_threshold_scalar(data, 0, count, stride, threshold, index_step, index_offset, indices);
+    }
+
+    template <>
+    inline void collect_above_threshold<uint8_t>(const uint8_t *data, std::size_t count, std::size_t stride, uint8_t threshold,
+                                                 uint32_t index_step, uint32_t index_offset, std::vector<uint32_t> &indices)
+    {
+        std::size_t i = 0;
+        if (stride == 1)
+        {
+#if defined(HAILO_KERNELS_X86) && defined(__SSE2__)
+            const __m128i thr = _mm_set1_epi8(static_cast<char>(threshold));
+            for (; i + 16 <= count; i += 16)
+            {
+                __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                // max(v, thr) == v  <=>  v >= thr (unsigned)
+                uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(values, thr), values));
+                while (mask)
+                {
+                    uint32_t lane = __builtin_ctz(mask);
+                    indices.push_back((i + lane) * index_step + index_offset);
+                    mask &= mask - 1;
+                }
+            }
+#elif defined(__aarch64__)
+            const uint8x16_t thr = vdupq_n_u8(threshold);
+            for (; i + 16 <= count; i += 16)
+            {
+                uint8x16_t ge = vcgeq_u8(vld1q_u8(data + i), thr);
+                if (vmaxvq_u8(ge) == 0)
+                    continue;
+                collect_above_threshold_scalar(data, i, i + 16, 1, threshold, index_step, index_offset, indices);
+            }
+#endif
+        }
+        collect_above_threshold_scalar(data, i, count, stride, threshold, index_step, index_offset, indices);
+    }
+
+    template <>
+    inline void collect_above_threshold<uint16_t>(const uint16_t *data, std::size_t count, std::size_t stride, uint16_t threshold,
+                                                  uint32_t index_step, uint32_t index_offset, std::vector<uint32_t> &indices)
+    {
+        std::size_t i = 0;
+        if (stride == 1)
+        {
+#if defined(HAILO_KERNELS_X86) && defined(__SSE2__)
+            // SSE2 has no unsigned 16 bit compare, flip the sign bit and compare signed instead.
+            const __m128i sign = _mm_set1_epi16(static_cast<short>(0x8000));
+            const __m128i thr = _mm_xor_si128(_mm_set1_epi16(static_cast<short>(threshold)), sign);
+            for (; i + 8 <= count; i += 8)
+            {
+                __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), sign);
+                // Every 16 bit lane contributes two bits to the byte mask, keep only the even ones.
+                uint32_t mask = ~_mm_movemask_epi8(_mm_cmplt_epi16(values, thr)) & 0x5555;
+                while (mask)
+                {
+                    uint32_t lane = __builtin_ctz(mask) / 2;
+                    indices.push_back((i + lane) * index_step + index_offset);
+                    mask &= mask - 1;
+                }
+            }
+#elif defined(__aarch64__)
+            const uint16x8_t thr = vdupq_n_u16(threshold);
+            for (; i + 8 <= count; i += 8)
+            {
+                uint16x8_t ge = vcgeq_u16(vld1q_u16(data + i), thr);
+                if (vmaxvq_u16(ge) == 0)
+                    continue;
+                collect_above_threshold_scalar(data, i, i + 8, 1, threshold, index_step, index_offset, indices);
+            }
+#endif
+        }
+        collect_above_threshold_scalar(data, i, count, stride, threshold, index_step, index_offset, indices);
+    }
+
+    /**
+     * @brief Get the smallest quantized value whose dequantized value is >= value.
+     *        Comparing quantized data against it is the same as comparing the dequantized data against value.
+     *
+     * @param threshold  -  T &
+     *        The quantized threshold. When no value of T reaches value it is set to the largest value of T,
+     *        which would still pass a >= comparison, so the return value has to be checked.
+     *
+     * @return bool whether any quantized value reaches value.
+     */
+    template <typename T>
+    inline bool quantized_lower_bound(float value, float qp_zp, float qp_scale, T &threshold)
+    {
+        const float max_value = static_cast<float>(std::numeric_limits<T>::max());
+        float estimate = std::ceil(value / qp_scale + qp_zp);
+        threshold = static_cast<T>(std::min(std::max(estimate, 0.0f), max_value));
+        // The estimate may be off by one from float rounding, settle it on the dequantized values
+        while (threshold > 0 && (static_cast<float>(threshold - 1) - qp_zp) * qp_scale >= value)
+            threshold--;
+        while (threshold < std::numeric_limits<T>::max() && (static_cast<float>(threshold) - qp_zp) * qp_scale < value)
+            threshold++;
+        return (static_cast<float>(threshold) - qp_zp) * qp_scale >= value;
+    }
+
+    //-------------------------------
+    // QUANTIZED ARGMAX
+    //-------------------------------
+
+    template <typename T>
+    inline T max_quantized_scalar(const T *data, std::size_t count)
+    {
+        T max_value = 0;
+        for (std::size_t i = 0; i < count; i++)
+            max_value = std::max(max_value, data[i]);
+        return max_value;
+    }
+
+#if defined(HAILO_KERNELS_X86)
+    inline bool cpu_supports_avx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    __attribute__((target("avx2"))) inline uint8_t max_quantized_avx2(const uint8_t *data, std::size_t count)
+    {
+        __m256i max_vec = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 32 <= count; i += 32)
+            max_vec = _mm256_max_epu8(max_vec, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+        __m128i max_128 = _mm_max_epu8(_mm256_castsi256_si128(max_vec), _mm256_extracti128_si256(max_vec, 1));
+        max_128 = _mm_max_epu8(max_128, _mm_srli_si128(max_128, 8));
+        max_128 = _mm_max_epu8(max_128, _mm_srli_si128(max_128, 4));
+        max_128 = _mm_max_epu8(max_128, _mm_srli_si128(max_128, 2));
+        max_128 = _mm_max_epu8(max_128, _mm_srli_si128(max_128, 1));
+        uint8_t max_value = static_cast<uint8_t>(_mm_cvtsi128_si32(max_128));
+        return std::max(max_value, max_quantized_scalar(data + i, count - i));
+    }
+
+    __attribute__((target("avx2"))) inline uint16_t max_quantized_avx2(const uint16_t *data, std::size_t count)
+    {
+        __m256i max_vec = _mm256_setzero_si256();
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            max_vec = _mm256_max_epu16(max_vec, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+        __m128i max_128 = _mm_max_epu16(_mm256_castsi256_si128(max_vec), _mm256_extracti128_si256(max_vec, 1));
+        max_128 = _mm_max_epu16(max_128, _mm_srli_si128(max_128, 8));
+        max_128 = _mm_max_epu16(max_128, _mm_srli_si128(max_128, 4));
+        max_128 = _mm_max_epu16(max_128, _mm_srli_si128(max_128, 2));
+        uint16_t max_value = static_cast<uint16_t>(_mm_cvtsi128_si32(max_128));
+        return std::max(max_value, max_quantized_scalar(data + i, count - i));
+    }
+#elif defined(__aarch64__)
+    inline uint8_t max_quantized_neon(const uint8_t *data, std::size_t count)
+    {
+        uint8x16_t max_vec = vdupq_n_u8(0);
+        std::size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            max_vec = vmaxq_u8(max_vec, vld1q_u8(data + i));
+        return std::max(vmaxvq_u8(max_vec), max_quantized_scalar(data + i, count - i));
+    }
+
+    inline uint16_t max_quantized_neon(const uint16_t *data, std::size_t count)
+    {
+        uint16x8_t max_vec = vdupq_n_u16(0);
+        std::size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            max_vec = vmaxq_u16(max_vec, vld1q_u16(data + i));
+        return std::max(vmaxvq_u16(max_vec), max_quantized_scalar(data + i, count - i));
+    }
+#endif
+
+    /**
+     * @brief Get the maximal value of a contiguous run of quantized values.
+     *        Uses AVX2 when the running CPU supports it, NEON on aarch64, and a scalar loop otherwise.
+     *
+     * @param data  -  const T *
+     *        Pointer to the first element (uint8_t or uint16_t).
+     *
+     * @param count  -  std::size_t
+     *        Number of elements in the run.
+     *
+     * @return T the maximal value, 0 for an empty run.
+     */
+    template <typename T>
+    inline T max_quantized(const T *data, std::size_t count)
+    {
+#if defined(HAILO_KERNELS_X86)
+        if (cpu_supports_avx2())
+            return max_quantized_avx2(data, count);
+#elif defined(__aarch64__)
+        return max_quantized_neon(data, count);
+#endif
+        return max_quantized_scalar(data, count);
+    }
+
+    /**
+     * @brief Get the index of the first occurrence of a value in a contiguous run.
+     *
+     * @return std::size_t the index of the value, count if not found.
+     */
+    inline std::size_t find_quantized(const uint8_t *data, std::size_t count, uint8_t value)
+    {
+        const void *found = std::memchr(data, value, count);
+        return found ? static_cast<const uint8_t *>(found) - data : count;
+    }
+
+    inline std::size_t find_quantized(const uint16_t *data, std::size_t count, uint16_t value)
+    {
+        return std::find(data, data + count, value) - data;
+    }
+
+    /**
+     * @brief Argmax over a contiguous run of quantized values, with early exit.
+     *        The maximum is found first, and the (more expensive) index lookup is skipped
+     *        when it is below min_value.
+     *
+     * @param data  -  const T *
+     *        Pointer to the first element (uint8_t or uint16_t).
+     *
+     * @param count  -  std::size_t
+     *        Number of elements in the run.
+     *
+     * @param min_value  -  T
+     *        Smallest maximum that is of interest to the caller.
+     *
+     * @param max_value  -  T
+     *        Output, the maximal value of the run.
+     *
+     * @return std::size_t index of the first occurrence of max_value, or count when max_value < min_value.
+     */
+    template <typename T>
+    inline std::size_t argmax_quantized(const T *data, std::size_t count, T min_value, T &max_value)
+    {
+        max_value = max_quantized(data, count);
+        if (max_value < min_value)
+            return count;
+        return find_quantized(data, count, max_value);
+    }
+
+}
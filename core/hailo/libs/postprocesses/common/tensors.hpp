@@ -7,6 +7,7 @@
 #include "hailo_objects.hpp"
 #include "xtensor/xadapt.hpp"
 #include "xtensor/xarray.hpp"
+#include "xtensor/xmath.hpp"
 
 namespace common
 {
@@ -14,42 +15,100 @@ namespace common
     // COMMON TRANSFORMS
     //-------------------------------
     template <typename T>
-    xt::xarray<float> dequantize(const xt::xarray<T> &input, const float &qp_scale, const float &qp_zp)
+    inline xt::xarray<float> dequantize(const xt::xarray<T> &input, const float &qp_scale, const float &qp_zp)
     {
         // Rescale the input using the given scale and zero-point
         auto rescaled_data = (input - qp_zp) * qp_scale;
         return rescaled_data;
     }
 
-    xt::xarray<uint8_t> get_xtensor(HailoTensorPtr &tensor)
+    //-------------------------------
+    // TENSOR VIEWS
+    //-------------------------------
+
+    /**
+     * @brief A non-owning view of a tensor's data as an xtensor expression (height x width x features).
+     *        Nothing is copied: the view reads the tensor's buffer in place, so it must not outlive the tensor.
+     *
+     * @param tensor  -  HailoTensorPtr
+     *        The tensor to view.
+     * @tparam T  The type of the tensor's elements (uint8_t / uint16_t).
+     */
+    template <typename T>
+    inline auto tensor_view(const HailoTensorPtr &tensor)
+    {
+        return xt::adapt(reinterpret_cast<T *>(tensor->data()), tensor->size(), xt::no_ownership(), tensor->shape());
+    }
+
+    /**
+     * @brief A non-owning strided view of one feature (channel) of a tensor, as a height x width expression.
+     *
+     * @param tensor  -  HailoTensorPtr
+     *        The tensor to view.
+     * @param feature  -  uint
+     *        The feature to view.
+     * @tparam T  The type of the tensor's elements (uint8_t / uint16_t).
+     */
+    template <typename T>
+    inline auto tensor_feature_view(const HailoTensorPtr &tensor, uint feature)
+    {
+        std::vector<std::size_t> shape = {tensor->height(), tensor->width()};
+        std::vector<std::size_t> strides = {tensor->width() * tensor->features(), tensor->features()};
+        std::size_t size = (tensor->height() - 1) * strides[0] + (tensor->width() - 1) * strides[1] + 1;
+        return xt::adapt(reinterpret_cast<T *>(tensor->data()) + feature, size, xt::no_ownership(), shape, strides);
+    }
+
+    /**
+     * @brief A lazily dequantized view of a tensor: (q - qp_zp) * qp_scale is computed element by element
+     *        inside whatever consumes the expression, no float copy of the tensor is made.
+     *        Assign it to an xarray to materialize it, or reduce / slice it directly.
+     *
+     * @param tensor  -  HailoTensorPtr
+     *        The tensor to view.
+     * @tparam T  The type of the tensor's elements (uint8_t / uint16_t).
+     */
+    template <typename T>
+    inline auto dequantized_view(const HailoTensorPtr &tensor)
+    {
+        // The expression outlives this call, so it has to own the quantization params: a named float
+        // would be captured by reference (xscalar<const float &>) and dangle once we return.
+        const auto &quant_info = tensor->vstream_info().quant_info;
+        return (xt::cast<float>(tensor_view<T>(tensor)) - xt::xscalar<float>(quant_info.qp_zp)) *
+               xt::xscalar<float>(quant_info.qp_scale);
+    }
+
+    /**
+     * @brief Copy a tensor into an owning xarray. Prefer tensor_view, which doesn't copy.
+     */
+    inline xt::xarray<uint8_t> get_xtensor(HailoTensorPtr &tensor)
     {
-        // Adapt a HailoTensorPtr to an xarray (quantized)
-        xt::xarray<uint8_t> xtensor = xt::adapt(tensor->data(), tensor->size(), xt::no_ownership(), tensor->shape());
-        return xtensor;
+        return tensor_view<uint8_t>(tensor);
     }
 
-    xt::xarray<uint16_t> get_xtensor_uint16(HailoTensorPtr &tensor)
+    /**
+     * @brief Copy a uint16 tensor into an owning xarray. Prefer tensor_view<uint16_t>, which doesn't copy.
+     */
+    inline xt::xarray<uint16_t> get_xtensor_uint16(HailoTensorPtr &tensor)
     {
-        // Adapt a HailoTensorPtr to an xarray (quantized)
-        uint16_t *data = (uint16_t *)(tensor->data());
-        xt::xarray<uint16_t> xtensor = xt::adapt(data, tensor->size(), xt::no_ownership(), tensor->shape());
-        return xtensor;
+        return tensor_view<uint16_t>(tensor);
     }
 
-    xt::xarray<float> get_xtensor_float(HailoTensorPtr &tensor)
+    /**
+     * @brief Dequantize a tensor into an owning float xarray, in one pass.
+     *        Prefer dequantized_view when the floats are consumed only once.
+     */
+    inline xt::xarray<float> get_xtensor_float(HailoTensorPtr &tensor)
     {
-        // Adapt a HailoTensorPtr to an xarray (quantized)
-        auto vstream_info = tensor->vstream_info();
-        xt::xarray<uint8_t> xtensor = get_xtensor(tensor);
-        return dequantize(xtensor, vstream_info.quant_info.qp_scale, vstream_info.quant_info.qp_zp);
+        return dequantized_view<uint8_t>(tensor);
     }
+
     /**
      * @brief Get the only the tensors (vector) from a map of string->tensor.
      * 
      * @param tensors A map between tensors name to the tensor pointer
      * @return std::vector<HailoTensorPtr> A vector of tensor pointer.
      */
-    std::vector<HailoTensorPtr> get_tensor_values(const std::map<std::string, HailoTensorPtr> &tensors)
+    inline std::vector<HailoTensorPtr> get_tensor_values(const std::map<std::string, HailoTensorPtr> &tensors)
     {
         std::vector<HailoTensorPtr> _tensors;
         _tensors.reserve(tensors.size());
@@ -17,16 +17,12 @@ void fast_depth(HailoROIPtr roi)
     }
     HailoTensorPtr tensor_ptr = roi->get_tensor(output_layer_name);
 
-    // get the output buffer in uint16 format, and parse it to xarray in the proper size
-    xt::xarray<uint16_t> tensor_data = common::get_xtensor_uint16(tensor_ptr);
-
-    // de-quantization of the xarray from uint16 to float32
-    xt::xarray<float> logits_dequantized = common::dequantize(tensor_data, tensor_ptr->vstream_info().quant_info.qp_scale, tensor_ptr->vstream_info().quant_info.qp_zp);
+    // view the output buffer in uint16 format, de-quantized to float32 on the fly
+    auto logits_dequantized = common::dequantized_view<uint16_t>(tensor_ptr);
     // here, logits_dequantized containes the estimated depth of each pixel in meters.
 
-    // allocate and memcpy to a new memory so it points to the right data
-    std::vector<float> data(logits_dequantized.size());
-    memcpy(data.data(), logits_dequantized.data(), sizeof(float) * logits_dequantized.size());
+    // de-quantize straight into the mask's memory
+    std::vector<float> data(logits_dequantized.begin(), logits_dequantized.end());
 
     hailo_common::add_object(roi, std::make_shared<HailoDepthMask>(std::move(data), tensor_ptr->width(), tensor_ptr->height(), 1.0));
 }
@@ -10,28 +10,9 @@
 #include <vector>
 
 #include "common/math.hpp"
-#include "common/tensors.hpp"
 #include "common/nms.hpp"
 #include "json_config.hpp"
 #include "face_detection.hpp"
-#include "xtensor/xadapt.hpp"
-#include "xtensor/xarray.hpp"
-#include "xtensor/xbuilder.hpp"
-#include "xtensor/xcontainer.hpp"
-#include "xtensor/xeval.hpp"
-#include "xtensor/xtensor.hpp"
-#include "xtensor/xindex_view.hpp"
-#include "xtensor/xio.hpp"
-#include "xtensor/xmanipulation.hpp"
-#include "xtensor/xmath.hpp"
-#include "xtensor/xoperation.hpp"
-#include "xtensor/xpad.hpp"
-#include "xtensor/xrandom.hpp"
-#include "xtensor/xshape.hpp"
-#include "xtensor/xsort.hpp"
-#include "xtensor/xstrided_view.hpp"
-#include "xtensor/xview.hpp"
-#include "hailo_xtensor.hpp"
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/error/en.h"
@@ -72,8 +53,8 @@ FaceDetectionParams *init(const std::string config_path, const std::string funct
 {
     int image_width;
     int image_height;
-    xt::xarray<float> anchor_variance;
-    xt::xarray<int> anchor_steps;
+    std::vector<float> anchor_variance;
+    std::vector<int> anchor_steps;
     std::vector<std::vector<int>> anchor_min_size;
     float score_threshold;
     float iou_threshold;
@@ -176,17 +157,14 @@ FaceDetectionParams *init(const std::string config_path, const std::string funct
             auto config_anchor_min_size = doc_config_json["anchor_min_size"].GetArray();
 
             // parse anchors
-            std::vector<float> anchor_variance_vector;
-            std::vector<int> anchor_steps_vector;
-
             for (uint i = 0; i < config_anchor_variance.Size(); i++)
             {
-                anchor_variance_vector.emplace_back(config_anchor_variance[i].GetFloat());
+                anchor_variance.emplace_back(config_anchor_variance[i].GetFloat());
             }
 
             for (uint i = 0; i < config_anchor_steps.Size(); i++)
             {
-                anchor_steps_vector.emplace_back(config_anchor_steps[i].GetInt());
+                anchor_steps.emplace_back(config_anchor_steps[i].GetInt());
             }
             for (uint i = 0; i < config_anchor_min_size.Size(); i++)
             {
@@ -198,8 +176,6 @@ FaceDetectionParams *init(const std::string config_path, const std::string funct
                 }
                 anchor_min_size.emplace_back(anchor);
             }
-            anchor_variance = xt::adapt(anchor_variance_vector);
-            anchor_steps = xt::adapt(anchor_steps_vector);
             image_width = doc_config_json["image_width"].GetInt();
             image_height = doc_config_json["image_height"].GetInt();
             score_threshold = doc_config_json["score_threshold"].GetFloat();
@@ -212,12 +188,13 @@ FaceDetectionParams *init(const std::string config_path, const std::string funct
         }
     }
 
+    if (anchor_variance.size() < 2)
+        throw std::runtime_error("anchor_variance should have 2 values");
     // Calculate the anchors based on the image size, step size, and feature map.
-    xt::xarray<float> anchors;
-    anchors = get_anchors(anchor_min_size, anchor_steps, image_width, image_height);
-    // Using the anchors, create a multiplier that will be used against the tensor results.
-    const xt::xarray<float> anchors_multiplier = anchor_variance(0) * xt::view(anchors, xt::all(), xt::range(2, _));
-    FaceDetectionParams *params = new FaceDetectionParams(anchors, anchors_multiplier, anchor_variance, anchor_min_size, score_threshold, iou_threshold, num_branches);
+    // Streams with the same configuration share them.
+    FacePriorsPtr anchors = get_cached_face_priors("face_detection", anchor_min_size, anchor_steps, image_width, image_height, [&]()
+                                                   { return get_anchors(anchor_min_size, anchor_steps, image_width, image_height); });
+    FaceDetectionParams *params = new FaceDetectionParams(anchors, anchor_variance, anchor_min_size, score_threshold, iou_threshold, num_branches);
     return params;
 }
 
@@ -230,42 +207,37 @@ void free_resources(void *params_void_ptr)
 //******************************************************************
 // SETUP - ANCHOR EXTRACTION
 //******************************************************************
-xt::xarray<float> get_anchors(const std::vector<std::vector<int>> &anchor_min_sizes,
-                              const xt::xarray<int> &anchor_steps,
-                              const int width,
-                              const int height)
+FacePriors get_anchors(const std::vector<std::vector<int>> &anchor_min_sizes,
+                       const std::vector<int> &anchor_steps,
+                       const int width,
+                       const int height)
 {
     // Here we need to calculate the anchors of the image so we can extract faces later.
     // We start by calculating the feature map sizes based on the anchor steps.
-    xt::xarray<int> feature_maps_height = xt::ceil(height / xt::cast<float>(anchor_steps));
-    xt::xarray<int> feature_maps_width = xt::ceil(width / xt::cast<float>(anchor_steps));
-    xt::xarray<int> feature_maps = xt::stack(xt::xtuple(feature_maps_height, feature_maps_width), 1);
-
-    // Use the feature map to pre-emptively calculate the size of the anchors.
-    int num_anchors = 0;
-    xt::xarray<int> feature_area = feature_maps_height * feature_maps_width;
+    FacePriors anchors;
+    std::vector<int> feature_maps_height, feature_maps_width;
+    std::size_t num_anchors = 0;
     for (uint index = 0; index < anchor_min_sizes.size(); index++)
-        num_anchors += feature_area(index) * anchor_min_sizes[index].size();
-    // Now initialize the anchors to the given size. This way we can fill them in-place
-    // instead of concatenating, saving lots of time.
-    xt::xarray<float> anchors = xt::zeros<float>({num_anchors, 4});
+    {
+        feature_maps_height.push_back(std::ceil(height / (float)anchor_steps[index]));
+        feature_maps_width.push_back(std::ceil(width / (float)anchor_steps[index]));
+        num_anchors += feature_maps_height[index] * feature_maps_width[index] * anchor_min_sizes[index].size();
+    }
+    anchors.reserve(num_anchors);
 
     // Calculate the anchors.
-    int counter = 0;
-    for (uint index = 0; index < feature_maps.shape(0); index++)
+    for (uint index = 0; index < anchor_min_sizes.size(); index++)
     {
-        auto current_min_sizes = anchor_min_sizes[index];
-        for (int i = 0; i < feature_maps(index, 0); i++)
+        for (int i = 0; i < feature_maps_height[index]; i++)
         {
-            for (int j = 0; j < feature_maps(index, 1); j++)
+            for (int j = 0; j < feature_maps_width[index]; j++)
             {
-                for (const float &min_size : current_min_sizes)
+                for (const float &min_size : anchor_min_sizes[index])
                 {
-                    anchors(counter, 0) = CLAMP((j + 0.5) / feature_maps(index, 1), 0.0, 1.0);
-                    anchors(counter, 1) = CLAMP((i + 0.5) / feature_maps(index, 0), 0.0, 1.0);
-                    anchors(counter, 2) = CLAMP(min_size / width, 0.0, 1.0);
-                    anchors(counter, 3) = CLAMP(min_size / height, 0.0, 1.0);
-                    counter++;
+                    anchors.add(CLAMP((j + 0.5) / feature_maps_width[index], 0.0, 1.0),
+                                CLAMP((i + 0.5) / feature_maps_height[index], 0.0, 1.0),
+                                CLAMP(min_size / width, 0.0, 1.0),
+                                CLAMP(min_size / height, 0.0, 1.0));
                 }
             }
         }
@@ -276,112 +248,47 @@ xt::xarray<float> get_anchors(const std::vector<std::vector<int>> &anchor_min_si
 //******************************************************************
 // BOX/LANDMARK DECODING
 //******************************************************************
-xt::xarray<float> decode_landmarks(const xt::xarray<float> &landmark_detections,
-                                   const xt::xarray<float> &anchors,
-                                   const xt::xarray<float> &anchors_multiplier)
-{
-    // Decode the boxes relative to their anchors.
-    // There are 5 landmarks paired in sets of 2 (x and y values),
-    // so we need to tile our anchors by 5
-    xt::xarray<float> landmarks = xt::tile(xt::view(anchors, xt::all(), xt::range(0, 2)), {1, 5}) + landmark_detections * xt::tile(anchors_multiplier, {1, 5});
-    return landmarks;
-}
-
-xt::xarray<float> decode_boxes(const xt::xarray<float> &box_detections,
-                               const xt::xarray<float> &anchors,
-                               const xt::xarray<float> &anchors_multiplier,
-                               const xt::xarray<float> &anchor_variance)
+/**
+ * @brief An output layer of one kind (boxes, classes or landmarks), and the number of anchors it covers.
+ */
+struct FaceOutputLayer
 {
-    // Decode the boxes relative to their anchors
-    xt::xarray<float> anchored_boxes_1 = xt::view(anchors, xt::all(), xt::range(0, 2)) + xt::view(box_detections, xt::all(), xt::range(0, 2)) * anchors_multiplier;
-    xt::xarray<float> anchored_boxes_2 = xt::view(anchors, xt::all(), xt::range(2, 4)) * xt::exp(xt::view(box_detections, xt::all(), xt::range(2, 4)) * anchor_variance(1));
-    xt::xarray<float> boxes = xt::concatenate(xt::xtuple(anchored_boxes_1, anchored_boxes_2), 1);
-
-    // We use view assignment to perform operations on just those slices
-    auto front_slice = xt::view(boxes, xt::all(), xt::range(0, 2));
-    front_slice -= xt::view(boxes, xt::all(), xt::range(2, 4)) / 2;
-    auto back_slice = xt::view(boxes, xt::all(), xt::range(2, 4));
-    back_slice += xt::view(boxes, xt::all(), xt::range(0, 2));
-    return boxes;
-}
+    HailoTensorPtr tensor;
+    uint32_t num_anchors;
+    uint32_t first_anchor;
+};
 
-std::tuple<xt::xarray<float>, xt::xarray<float>, xt::xarray<float>> detect_boxes_and_landmarks(const xt::xarray<float> &box_outputs,
-                                                                                               const xt::xarray<float> &class_scores,
-                                                                                               const xt::xarray<float> &landmark_ouputs,
-                                                                                               const xt::xarray<float> &anchors,
-                                                                                               const xt::xarray<float> &anchors_multiplier,
-                                                                                               const xt::xarray<float> &anchor_variance,
-                                                                                               const float score_threshold,
-                                                                                               const network_type network)
+/**
+ * @brief Order the layers like the pre-calculated anchors, and number the anchors they start at.
+ */
+void place_layers(std::vector<FaceOutputLayer> &layers, bool sort_by_size)
 {
-    xt::xarray<float> boxes, landmarks;
-    // Decode the boxes and get the face scores (we don't care about unlabeled scores)
-    boxes = decode_boxes(xt::squeeze(box_outputs), anchors, anchors_multiplier, anchor_variance);
-    xt::xarray<float> scores = xt::col(xt::squeeze(class_scores), 1);
-
-    // Filter out low scores
-    // Note: xt::where returns a vector of vectors (one for each dim) of indices where condition is true
-    auto higher_scores = xt::where(scores > score_threshold);
-    boxes = xt::view(boxes, xt::keep(higher_scores[0]), xt::all());
-    scores = xt::view(scores, xt::keep(higher_scores[0]));
-
-    // If landmarks are available, then decode those too.
-    if (landmark_ouputs.dimension() > 0)
+    // The anchors go from the largest feature map to the smallest
+    if (sort_by_size)
+        std::stable_sort(layers.begin(), layers.end(), [](const FaceOutputLayer &lhs, const FaceOutputLayer &rhs)
+                         { return rhs.num_anchors < lhs.num_anchors; });
+    uint32_t first_anchor = 0;
+    for (FaceOutputLayer &layer : layers)
     {
-        auto cropped_landmarks = xt::view(xt::squeeze(landmark_ouputs), xt::keep(higher_scores[0]), xt::all());
-        auto cropped_anchors = xt::view(anchors, xt::keep(higher_scores[0]), xt::all());
-        auto cropped_anchors_mul = xt::view(anchors_multiplier, xt::keep(higher_scores[0]), xt::all());
-        landmarks = decode_landmarks(cropped_landmarks, cropped_anchors, cropped_anchors_mul);
+        layer.first_anchor = first_anchor;
+        first_anchor += layer.num_anchors;
     }
+}
 
-    return std::tuple<xt::xarray<float>, xt::xarray<float>, xt::xarray<float>>(std::move(boxes), std::move(scores), std::move(landmarks));
+/**
+ * @brief Quantized values of an anchor in a layer.
+ */
+inline const uint8_t *anchor_values(const FaceOutputLayer &layer, uint32_t anchor, uint32_t values_per_anchor)
+{
+    return layer.tensor->data() + (std::size_t)(anchor - layer.first_anchor) * values_per_anchor;
 }
 
 //******************************************************************
 // DETECTION/LANDMARKS EXTRACTION & ENCODING
 //******************************************************************
-void encode_detections(std::vector<HailoDetection> &objects,
-                       xt::xarray<float> &detection_boxes,
-                       xt::xarray<float> &scores,
-                       xt::xarray<float> &landmarks,
-                       network_type network)
-{
-    // Here we will package the processed detections into the HailoDetection meta
-    // The detection meta will hold the following items:
-    float confidence, w, h, xmin, ymin = 0.0f;
-    // There is only 1 class in this network (face) so there is no need for label.
-    std::string label = "face";
-    // Iterate over our results
-    for (uint index = 0; index < scores.size(); ++index)
-    {
-        confidence = scores(index);                                  // Get the score for this detection
-        xmin = detection_boxes(index, 0);                            // Box xmin, relative to image size
-        ymin = detection_boxes(index, 1);                            // Box ymin, relative to image size
-        w = (detection_boxes(index, 2) - detection_boxes(index, 0)); // Box width, relative to image size
-        h = (detection_boxes(index, 3) - detection_boxes(index, 1)); // Box height, relative to image size
-
-        // Once all parameters are calculated, push them into the meta
-        // Class = 1 since centerpose only detects people
-        HailoBBox bbox(xmin, ymin, w, h);
-        HailoDetection detected_face(bbox, label, confidence);
-
-        if (landmarks.dimension() > 0)
-        {
-            xt::xarray<float> keypoints_raw = xt::row(landmarks, index);
-            // The keypoints are flatten, reshape them to 2 * num_keypoints.
-            int num_keypoints = keypoints_raw.shape(0) / 2;
-            auto face_keypoints = xt::reshape_view(keypoints_raw, {num_keypoints, 2});
-            hailo_common::add_landmarks_to_detection(detected_face, ToString(network), face_keypoints);
-        }
-
-        objects.push_back(detected_face); // Push the detection to the objects vector
-    }
-}
-
 std::vector<HailoDetection> face_detection_postprocess(std::vector<HailoTensorPtr> &tensors,
-                                                       const xt::xarray<float> &anchors,
-                                                       const xt::xarray<float> &anchors_multiplier,
-                                                       const xt::xarray<float> &anchor_variance,
+                                                       const FacePriors &anchors,
+                                                       const std::vector<float> &anchor_variance,
                                                        const float score_threshold,
                                                        const float iou_threshold,
                                                        const int num_branches,
@@ -397,113 +304,99 @@ std::vector<HailoDetection> face_detection_postprocess(std::vector<HailoTensorPt
 
     int num_outputs = tensors.size();
     int outputs_per_branch = num_outputs / num_branches;
-    // The output layers fall into hree categories: boxes, classes(scores), and lanmarks(x,y for each)
-    std::vector<xt::xarray<float>> box_layers;
-    std::vector<xt::xarray<float>> class_layers;
-    std::vector<xt::xarray<float>> landmarks_layers;
-
-    std::size_t boxes_reshaped_size = 0;
-    std::size_t landmarks_reshaped_size = 0;
-    std::size_t classes_reshaped_size = 0;
-
-    // Separate the layers by outs_per_branch steps
+    // The output layers fall into three categories: boxes, classes(scores), and landmarks(x,y for each)
+    std::vector<FaceOutputLayer> box_layers, class_layers, landmarks_layers;
     for (uint i = 0; i < tensors.size(); ++i)
     {
-        // While we're here, adapt the tensor into an xarray of float (dequantized).
-        xt::xarray<uint8_t> xdata = common::get_xtensor(tensors[i]);
-        xt::xarray<float> xdata_rescaled = common::dequantize(xdata, tensors[i]->vstream_info().quant_info.qp_scale, tensors[i]->vstream_info().quant_info.qp_zp);
         // output layers are paired: boxes:classes:landmarks, boxes:classes:landmarks, boxes:classes:landmarks, etc...
+        uint32_t cells = tensors[i]->height() * tensors[i]->width();
         if (i % outputs_per_branch == 0)
-        {
-            auto num_boxes = (int)xdata_rescaled.shape(0) * (int)xdata_rescaled.shape(1) * ((int)xdata_rescaled.shape(2) / 4);
-            auto xdata_reshaped = xt::reshape_view(xdata_rescaled, {1, num_boxes, 4}); // Resize to be by the 4 parameters for a box
-            box_layers.emplace_back(std::move(xdata_reshaped));
-            boxes_reshaped_size += num_boxes;
-        }
+            box_layers.push_back({tensors[i], cells * (tensors[i]->features() / 4), 0});
         else if (i % outputs_per_branch == 1)
-        {
-            auto num_classes = (int)xdata_rescaled.shape(0) * (int)xdata_rescaled.shape(1) * ((int)xdata_rescaled.shape(2) / total_classes);
-            auto xdata_reshaped = xt::reshape_view(xdata_rescaled, {1, num_classes, total_classes}); // Resize to be by the total_classes available classes
-            class_layers.emplace_back(std::move(xdata_reshaped));
-            classes_reshaped_size += num_classes;
-        }
+            class_layers.push_back({tensors[i], cells * (tensors[i]->features() / total_classes), 0});
         else
-        {
-            auto num_landmarks = (int)xdata_rescaled.shape(0) * (int)xdata_rescaled.shape(1) * ((int)xdata_rescaled.shape(2) / 10);
-            auto xdata_reshaped = xt::reshape_view(xdata_rescaled, {1, num_landmarks, 10}); // Resize to be by the (x,y) for each of the 5 landmarks (2*5=10)
-            landmarks_layers.emplace_back(std::move(xdata_reshaped));
-            landmarks_reshaped_size += num_landmarks;
-        }
-    }
-
-    // Sort the two sets in descending order so their order lines up with the pre-calculated anchors.
-    std::sort(box_layers.begin(), box_layers.end(), [](const auto &lhs, const auto &rhs)
-              { return rhs.shape(1) < lhs.shape(1); });
-    std::sort(class_layers.begin(), class_layers.end(), [](const auto &lhs, const auto &rhs)
-              { return rhs.shape(1) < lhs.shape(1); });
-
-    // Concatenate the different output layers together. second dim (1, N, 4) or (1, N, 2) should
-    // now match the anchors_multipler devised earlier.
-    int index = 0;
-    std::vector<std::size_t> boxes_shape = {1, boxes_reshaped_size, 4};
-    xt::xarray<float> stacked_boxes(boxes_shape);
-    for (uint i = 0; i < box_layers.size(); ++i)
-    {
-        xt::view(stacked_boxes, xt::all(), xt::range(index, index + box_layers[i].shape(1)), xt::all()) = box_layers[i];
-        index += box_layers[i].shape(1);
-    }
-
-    std::vector<std::size_t> classes_shape = {1, classes_reshaped_size, 2};
-    // We tell xtensor to explicitly layout the memory by rows, in order to perform math ops faster, e.g. softmax.
-    xt::xarray<float, xt::layout_type::row_major> stacked_classes(classes_shape);
-    index = 0;
-    for (uint i = 0; i < class_layers.size(); ++i)
-    {
-        xt::view(stacked_classes, xt::all(), xt::range(index, index + class_layers[i].shape(1)), xt::all()) = class_layers[i];
-        index += class_layers[i].shape(1);
-    }
-
-    // If there are landmarks, concat those too.
-    std::vector<std::size_t> landmarks_shape = {};
-    if (landmarks_reshaped_size > 0)
-        landmarks_shape = {1, landmarks_reshaped_size, 10};
-    xt::xarray<float> stacked_landmarks(landmarks_shape);
-    index = 0;
-    if (landmarks_layers.size() > 0)
-    {
-        for (uint i = 0; i < landmarks_layers.size(); ++i)
-        {
-            xt::view(stacked_landmarks, xt::all(), xt::range(index, index + landmarks_layers[i].shape(1)), xt::all()) = landmarks_layers[i];
-            index += landmarks_layers[i].shape(1);
-        }
+            landmarks_layers.push_back({tensors[i], cells * (tensors[i]->features() / 10), 0}); // (x,y) for each of the 5 landmarks
     }
+    // Boxes and classes are sorted so their order lines up with the pre-calculated anchors, landmarks are kept in order.
+    place_layers(box_layers, true);
+    place_layers(class_layers, true);
+    place_layers(landmarks_layers, false);
+    if (class_layers.empty() || class_layers.back().first_anchor + class_layers.back().num_anchors != anchors.size())
+        throw std::runtime_error("Face detection output layers don't match the anchors of the configuration");
 
     //-------------------------------
     // CALCULATION AND EXTRACTION
     //-------------------------------
 
-    // Run softmax on the scores to get the relevant class
-    // xt::xarray<float> class_scores = common::softmax_xtensor(stacked_classes);
-    if (requires_softmax)
-        common::softmax_2D(stacked_classes.data(), stacked_classes.shape(1), stacked_classes.shape(2));
+    // There is only 1 class in this network (face) so there is no need for label.
+    std::string label = "face";
+    const int score_column = (total_classes > 1) ? 1 : 0;
+    for (uint layer_index = 0; layer_index < class_layers.size(); layer_index++)
+    {
+        const FaceOutputLayer &classes = class_layers[layer_index];
+        const FaceOutputLayer &boxes = box_layers[layer_index];
+        auto &class_quant = classes.tensor->vstream_info().quant_info;
+        auto &box_quant = boxes.tensor->vstream_info().quant_info;
 
-    // Extract boxes and landmarks
-    auto boxes_and_landmarks = detect_boxes_and_landmarks(stacked_boxes, stacked_classes, stacked_landmarks,
-                                                          anchors, anchors_multiplier, anchor_variance,
-                                                          score_threshold, network);
+        // With softmax over (background, face) the face score is sigmoid(face - background),
+        // so low scores are dropped on the quantized difference first, with a margin for float rounding.
+        bool prefilter = requires_softmax && total_classes == 2 && class_quant.qp_scale > 0 && score_threshold > 0 && score_threshold < 1;
+        int min_difference = prefilter ? (int)std::floor(std::log(score_threshold / (1 - score_threshold)) / class_quant.qp_scale) - 2 : 0;
 
-    // //-------------------------------
-    // // RESULTS ENCODING
-    // //-------------------------------
+        for (uint32_t anchor = classes.first_anchor; anchor < classes.first_anchor + classes.num_anchors; anchor++)
+        {
+            const uint8_t *class_values = anchor_values(classes, anchor, total_classes);
+            if (prefilter && (int)class_values[1] - (int)class_values[0] <= min_difference)
+                continue;
+
+            // Get the face score exactly like the softmax of the dequantized classes
+            float scores[2];
+            for (int c = 0; c < total_classes && c < 2; c++)
+                scores[c] = (class_values[c] - class_quant.qp_zp) * class_quant.qp_scale;
+            if (requires_softmax)
+                common::softmax_1D(scores, std::min(total_classes, 2));
+            float confidence = scores[score_column];
+            if (!(confidence > score_threshold))
+                continue;
+
+            // Decode the box relative to its anchor
+            const uint8_t *box_values = anchor_values(boxes, anchor, 4);
+            float multiplier_w = anchor_variance[0] * anchors.w[anchor];
+            float multiplier_h = anchor_variance[0] * anchors.h[anchor];
+            float box_w = anchors.w[anchor] * std::exp(((box_values[2] - box_quant.qp_zp) * box_quant.qp_scale) * anchor_variance[1]);
+            float box_h = anchors.h[anchor] * std::exp(((box_values[3] - box_quant.qp_zp) * box_quant.qp_scale) * anchor_variance[1]);
+            float xmin = (anchors.cx[anchor] + ((box_values[0] - box_quant.qp_zp) * box_quant.qp_scale) * multiplier_w) - box_w / 2;
+            float ymin = (anchors.cy[anchor] + ((box_values[1] - box_quant.qp_zp) * box_quant.qp_scale) * multiplier_h) - box_h / 2;
+            float xmax = box_w + xmin;
+            float ymax = box_h + ymin;
+
+            HailoBBox bbox(xmin, ymin, xmax - xmin, ymax - ymin);
+            HailoDetection detected_face(bbox, label, confidence);
+
+            // If landmarks are available, then decode those too.
+            if (!landmarks_layers.empty())
+            {
+                auto layer = std::upper_bound(landmarks_layers.begin(), landmarks_layers.end(), anchor, [](uint32_t value, const FaceOutputLayer &l)
+                                              { return value < l.first_anchor; }) - 1;
+                const uint8_t *landmark_values = anchor_values(*layer, anchor, 10);
+                auto &landmark_quant = layer->tensor->vstream_info().quant_info;
+                std::vector<HailoPoint> points;
+                points.reserve(5);
+                for (int point = 0; point < 5; point++)
+                {
+                    float x = anchors.cx[anchor] + ((landmark_values[2 * point] - landmark_quant.qp_zp) * landmark_quant.qp_scale) * multiplier_w;
+                    float y = anchors.cy[anchor] + ((landmark_values[2 * point + 1] - landmark_quant.qp_zp) * landmark_quant.qp_scale) * multiplier_h;
+                    // Make the points relative to the box they belong to
+                    points.emplace_back((x - bbox.xmin()) / bbox.width(), (y - bbox.ymin()) / bbox.height());
+                }
+                detected_face.add_object(hailo_make_shared<HailoLandmarks>(ToString(network), points, 1.0f));
+            }
 
-    // // Encode the individual boxes/keypoints and package them into the meta
-    encode_detections(objects,
-                      std::get<0>(boxes_and_landmarks),
-                      std::get<1>(boxes_and_landmarks),
-                      std::get<2>(boxes_and_landmarks),
-                      network);
+            objects.push_back(detected_face); // Push the detection to the objects vector
+        }
+    }
 
-    // // Perform nms to throw out similar detections
+    // Perform nms to throw out similar detections
     common::nms(objects, iou_threshold);
 
     return objects;
@@ -533,7 +426,7 @@ void retinaface(HailoROIPtr roi, void *params_void_ptr)
     std::rotate(tensors.begin() + 3, tensors.begin() + 6, tensors.end());
 
     // Extract the detection objects using the given parameters.
-    std::vector<HailoDetection> detections = face_detection_postprocess(tensors, params->anchors, params->anchors_multiplier, params->anchor_variance,
+    std::vector<HailoDetection> detections = face_detection_postprocess(tensors, *params->anchors, params->anchor_variance,
                                                                         params->score_threshold, params->iou_threshold, params->num_branches,
                                                                         2, true, RETINAFACE);
 
@@ -564,7 +457,7 @@ std::vector<HailoDetection> lightface_post(std::vector<HailoTensorPtr> &tensors,
     std::reverse(tensors.begin(), tensors.end());
 
     // Extract the detection objects using the given parameters.
-    detections = face_detection_postprocess(tensors, params->anchors, params->anchors_multiplier, params->anchor_variance,
+    detections = face_detection_postprocess(tensors, *params->anchors, params->anchor_variance,
                                             params->score_threshold, params->iou_threshold, params->num_branches,
                                             2, true, LIGHTFACE);
 
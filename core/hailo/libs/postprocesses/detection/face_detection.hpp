@@ -5,28 +5,25 @@
 #pragma once
 #include "hailo_objects.hpp"
 #include "hailo_common.hpp"
-#include "xtensor/xarray.hpp"
+#include "face_priors.hpp"
 
 class FaceDetectionParams
 {
 public:
-    xt::xarray<float> anchors;
-    xt::xarray<float> anchors_multiplier;
-    xt::xarray<float> anchor_variance;
+    FacePriorsPtr anchors;
+    std::vector<float> anchor_variance;
     std::vector<std::vector<int>> anchor_min_size;
     float score_threshold;
     float iou_threshold;
     int num_branches;
 
-    FaceDetectionParams(xt::xarray<float> anchors,
-    xt::xarray<float> anchors_multiplier,
-    xt::xarray<float> anchor_variance,
+    FaceDetectionParams(FacePriorsPtr anchors,
+    std::vector<float> anchor_variance,
     std::vector<std::vector<int>> anchor_min_size,
     float score_threshold,
     float iou_threshold,
     int num_branches) {
         this->anchors = anchors;
-        this->anchors_multiplier =anchors_multiplier;
         this->anchor_variance = anchor_variance;
         this->anchor_min_size = anchor_min_size;
         this->score_threshold = score_threshold;
@@ -41,9 +38,9 @@ void lightface(HailoROIPtr roi, void *params_void_ptr);
 void filter(HailoROIPtr roi, void *params_void_ptr);
 FaceDetectionParams *init(const std::string config_path, const std::string function_name);
 void free_resources(void *params_void_ptr);
-xt::xarray<float> get_anchors(const std::vector<std::vector<int>> &anchor_min_sizes,
-                              const xt::xarray<int> &anchor_steps,
-                              const int width,
-                              const int height);
+FacePriors get_anchors(const std::vector<std::vector<int>> &anchor_min_sizes,
+                       const std::vector<int> &anchor_steps,
+                       const int width,
+                       const int height);
 
 __END_DECLS
\ No newline at end of file
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The prior (anchor) boxes of an SSD-style face detector, in structure-of-arrays layout.
+ *        Prior i is (cx[i], cy[i], w[i], h[i]), priors are ordered branch after branch.
+ */
+struct FacePriors
+{
+    std::vector<float> cx;
+    std::vector<float> cy;
+    std::vector<float> w;
+    std::vector<float> h;
+
+    std::size_t size() const { return cx.size(); }
+
+    void reserve(std::size_t size)
+    {
+        cx.reserve(size);
+        cy.reserve(size);
+        w.reserve(size);
+        h.reserve(size);
+    }
+
+    void add(float prior_cx, float prior_cy, float prior_w, float prior_h)
+    {
+        cx.push_back(prior_cx);
+        cy.push_back(prior_cy);
+        w.push_back(prior_w);
+        h.push_back(prior_h);
+    }
+};
+using FacePriorsPtr = std::shared_ptr<const FacePriors>;
+
+/**
+ * @brief Get the priors of a network configuration, building them only if no live instance has them already.
+ *        Every stream runs its own postprocess instance, so instances with the same configuration share one table.
+ *
+ * @param generator  -  std::string
+ *        Name of the prior generation scheme, priors of different schemes are never shared.
+ * @param anchor_min_sizes  -  std::vector<std::vector<int>>
+ *        The anchor sizes of every branch.
+ * @param anchor_steps  -  std::vector<int>
+ *        The stride of every branch.
+ * @param width  -  int
+ *        The network input width.
+ * @param height  -  int
+ *        The network input height.
+ * @param build  -  std::function<FacePriors()>
+ *        Builds the priors on a cache miss.
+ */
+inline FacePriorsPtr get_cached_face_priors(const std::string &generator,
+                                            const std::vector<std::vector<int>> &anchor_min_sizes,
+                                            const std::vector<int> &anchor_steps,
+                                            const int width,
+                                            const int height,
+                                            const std::function<FacePriors()> &build)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::weak_ptr<const FacePriors>> cache;
+
+    std::ostringstream key;
+    key << generator << ":" << width << "x" << height << ":";
+    for (int step : anchor_steps)
+        key << step << ",";
+    key << ":";
+    for (const auto &sizes : anchor_min_sizes)
+    {
+        for (int size : sizes)
+            key << size << ",";
+        key << ";";
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::weak_ptr<const FacePriors> &entry = cache[key.str()];
+    FacePriorsPtr priors = entry.lock();
+    if (!priors)
+    {
+        priors = std::make_shared<const FacePriors>(build());
+        entry = priors;
+    }
+    return priors;
+}
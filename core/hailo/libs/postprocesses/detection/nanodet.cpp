@@ -7,159 +7,112 @@
 #include <cmath>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <string>
 #include <tuple>
 #include <vector>
 
 // Hailo includes
-#include "common/math.hpp"
 #include "hailo_objects.hpp"
-#include "common/tensors.hpp"
 #include "common/nms.hpp"
+#include "common/quantized_kernels.hpp"
 #include "common/labels/coco_eighty.hpp"
 #include "nanodet.hpp"
 
-// xtensor includes
-#include "xtensor/xadapt.hpp"
-#include "xtensor/xarray.hpp"
-#include "xtensor/xtensor.hpp"
-#include "xtensor/xio.hpp"
-#include "xtensor/xsort.hpp"
-#include "xtensor/xview.hpp"
-using namespace xt::placeholders;
-
 #define SCORE_THRESHOLD 0.5
 #define IOU_THRESHOLD 0.6
 #define NUM_CLASSES 80
 
 /**
- * @brief Split the raw output tensors into boxes and scores
- * 
- * @param tensors  -  std::vector<HailoTensorPtr>
- *        The network output tensors
- * 
- * @param num_classes  -  int
- *        Number of classes
- * 
- * @param regression_length  -  int
- *        Regression length of anchors
- *  
- * @return std::pair<std::vector<xt::xarray<float>>, xt::xarray<float>> 
- *         The separated score and box vectors
- */
-std::pair<std::vector<xt::xarray<float>>, xt::xarray<float>> get_boxes_and_scores(std::vector<HailoTensorPtr> &tensors,
-                                                                                  int num_classes,
-                                                                                  int regression_length)
-{
-    // The boxes we will return
-    std::vector<xt::xarray<float>> boxes(tensors.size());
-    
-    // Prepare the scores xarray at the size we will fill in in-place
-    int total_scores = 0;
-    for (uint i=0; i < tensors.size(); i++) { total_scores += tensors[i]->width() * tensors[i]->height(); }
-    std::vector<size_t> shape = { (long unsigned int)total_scores, (long unsigned int)num_classes };
-    xt::xarray<float> scores(shape);
-    int view_index = 0;
-
-    for (uint i=0; i < tensors.size(); i++)
-    {
-        // Extract and dequantize the layer
-        auto layer = common::dequantize(common::get_xtensor(tensors[i]), tensors[i]->vstream_info().quant_info.qp_scale, tensors[i]->vstream_info().quant_info.qp_zp);
-        int num_proposals = layer.shape(0)*layer.shape(1);
-
-        // From the layer extract the scores
-        auto layer_scores = xt::view(layer, xt::all(), xt::all(), xt::range(_, num_classes));
-        xt::view(scores, xt::range(view_index, view_index + num_proposals), xt::all()) = xt::reshape_view(layer_scores, {num_proposals, num_classes});
-        view_index += num_proposals;
-
-        // From the layer extract the bounding boxes
-        auto layer_boxes = xt::view(layer, xt::all(), xt::all(), xt::range(num_classes, _));
-        boxes[i] = xt::reshape_view(layer_boxes, {num_proposals, 4, regression_length + 1});
-    }
-
-    return std::pair<std::vector<xt::xarray<float>>, xt::xarray<float>>( boxes, scores );
-}
-
-/**
- * @brief Decodes the box tensors into HailoDetections
- * 
- * @param raw_boxes  -  std::vector<xt::xarray<float>>
- *        The unprocessed box tensors
- * 
- * @param scores  -  xt::xarray<float>
- *        The stacked and processed (sigmoid) scores
- * 
+ * @brief Decode the detections of one output layer.
+ *        Every cell holds num_classes scores followed by 4 box side distributions of regression_length + 1 bins.
+ *        The scores are thresholded and argmaxed on their quantized values (the sigmoid keeps their order),
+ *        so only the boxes of cells that pass are decoded.
+ *
+ * @param tensor  -  HailoTensor
+ *        The output layer
+ *
+ * @param stride  -  int
+ *        The stride of the layer
+ *
  * @param network_dims  -  std::vector<int>
  *        The input dimensions of the network ex: {416,416}
- * 
- * @param strides  -  std::vector<int>
- *        The strides of each layer
- * 
+ *
  * @param regression_length  -  int
  *        Regression length of anchors
- * 
- * @return std::vector<HailoDetection> 
- *         The vector of detected objects before NMS
+ *
+ * @param num_classes  -  int
+ *        Number of classes
+ *
+ * @param detections  -  std::vector<HailoDetection>
+ *        The detections of the layer are added to it
  */
-std::vector<HailoDetection> decode_boxes(std::vector<xt::xarray<float>> raw_boxes,
-                                            xt::xarray<float> scores,
-                                            std::vector<int> network_dims,
-                                            std::vector<int> strides,
-                                            int regression_length)
+template <typename T>
+void decode_layer(HailoTensor &tensor,
+                  int stride,
+                  const std::vector<int> &network_dims,
+                  int regression_length,
+                  int num_classes,
+                  std::vector<HailoDetection> &detections)
 {
-    int strided_width, strided_height, class_index;
-    std::vector<HailoDetection> detections;
-    int instance_index = 0;
-    float confidence = 0.0;
-    std::string label;
-    for (uint i=0; i < raw_boxes.size(); i++)
+    TypedTensor<T> layer(tensor);
+    auto score_lut = layer.make_lut(SigmoidActivation());
+    auto exp_lut = layer.make_lut(ExpActivation());
+    const int num_bins = regression_length + 1;
+
+    // The smallest quantized score whose sigmoid passes the threshold. The bound on the logit is only a
+    // starting point, it is settled on the sigmoid LUT, which also decides whether any score passes.
+    const float score_threshold = SCORE_THRESHOLD;
+    T min_score;
+    common::quantized_lower_bound<T>(std::log(score_threshold / (1.0f - score_threshold)), layer.qp_zp(), layer.qp_scale(), min_score);
+    while (min_score > 0 && score_lut[min_score - 1] >= score_threshold)
+        min_score--;
+    while (min_score < std::numeric_limits<T>::max() && score_lut[min_score] < score_threshold)
+        min_score++;
+    if (score_lut[min_score] < score_threshold)
+        return;
+
+    for (uint row = 0; row < layer.height(); row++)
     {
-        strided_width = network_dims[0] / strides[i];
-        strided_height = network_dims[1] / strides[i];
-
-        // Create a meshgrid of the proper strides
-        xt::xarray<int> grid_x = xt::arange(0, strided_width);
-        xt::xarray<int> grid_y = xt::arange(0, strided_height);
-        auto mesh = xt::meshgrid(grid_x, grid_y);
-        grid_x = std::get<1>(mesh);
-        grid_y = std::get<0>(mesh);
-
-        // Use the meshgrid to build up box center prototypes
-        auto ct_row = (xt::flatten(grid_y) + 0.5) * strides[i];
-        auto ct_col = (xt::flatten(grid_x) + 0.5) * strides[i];
-        auto centers = xt::stack(xt::xtuple(ct_col, ct_row, ct_col, ct_row), 1);
-
-        // Box distribution to distance
-        auto regression_distance =  xt::reshape_view(xt::arange(0, regression_length + 1), {1, 1, regression_length + 1});
-        common::softmax_3D(raw_boxes[i].data(), raw_boxes[i].shape(0), raw_boxes[i].shape(1), raw_boxes[i].shape(2));
-        auto box_distance = raw_boxes[i] * regression_distance;
-        xt::xarray<float> reduced_distances = xt::sum(box_distance, {2});
-        auto strided_distances = reduced_distances * strides[i];
-
-        // Decode boxes
-        auto distance_view1 = xt::view(strided_distances, xt::all(), xt::range(_, 2)) * -1;
-        auto distance_view2 = xt::view(strided_distances, xt::all(), xt::range(2, _));
-        auto distance_view = xt::concatenate(xt::xtuple(distance_view1, distance_view2), 1);
-        auto decoded_boxes = centers + distance_view;
-
-        for (uint j=0; j < decoded_boxes.shape(0); j++)
+        for (uint col = 0; col < layer.width(); col++)
         {
-            HailoBBox bbox(decoded_boxes(j, 0) / network_dims[0],
-                           decoded_boxes(j, 1) / network_dims[1],
-                           (decoded_boxes(j, 2) - decoded_boxes(j, 0)) / network_dims[0],
-                           (decoded_boxes(j, 3) - decoded_boxes(j, 1)) / network_dims[1]);
-            class_index = xt::argmax(xt::row(scores, instance_index))(0);
-            confidence = scores(instance_index, class_index);
-            instance_index++;
-            if (confidence < SCORE_THRESHOLD)
+            const T *cell = layer.cell(row, col);
+            T max_score = 0;
+            std::size_t class_index = common::argmax_quantized(cell, num_classes, min_score, max_score);
+            if (class_index == (std::size_t)num_classes)
                 continue;
-
-            label = common::coco_eighty[class_index + 1];
-            HailoDetection detected_instance(bbox, class_index, label, confidence);
-            detections.push_back(detected_instance);
+            float confidence = score_lut[max_score];
+
+            // Box distribution to distance: the expectation of the softmax over the bins of every side
+            float distances[4];
+            const T *bins = cell + num_classes;
+            for (int side = 0; side < 4; side++, bins += num_bins)
+            {
+                float sum = 0.0f;
+                for (int bin = 0; bin < num_bins; bin++)
+                    sum += exp_lut[bins[bin]];
+                float distance = 0.0f;
+                for (int bin = 0; bin < num_bins; bin++)
+                    distance += (exp_lut[bins[bin]] / sum) * bin;
+                distances[side] = distance * stride;
+            }
+
+            // Decode the box around the center of the cell
+            float center_x = (col + 0.5f) * stride;
+            float center_y = (row + 0.5f) * stride;
+            float xmin = center_x - distances[0];
+            float ymin = center_y - distances[1];
+            float xmax = center_x + distances[2];
+            float ymax = center_y + distances[3];
+            HailoBBox bbox(xmin / network_dims[0],
+                           ymin / network_dims[1],
+                           (xmax - xmin) / network_dims[0],
+                           (ymax - ymin) / network_dims[1]);
+
+            std::string label = common::coco_eighty[class_index + 1];
+            detections.push_back(HailoDetection(bbox, class_index, label, confidence));
         }
     }
-    return detections;
 }
 
 /**
@@ -195,15 +148,12 @@ std::vector<HailoDetection> nanodet_postprocess(std::vector<HailoTensorPtr> &ten
         return detections;
     }
 
-    auto boxes_and_scores = get_boxes_and_scores(tensors, num_classes, regression_length);
-    std::vector<xt::xarray<float>> raw_boxes = boxes_and_scores.first;
-    xt::xarray<float> scores = boxes_and_scores.second;
-
-    // Calculate the sigmoid of the scores
-    common::sigmoid(scores.data(), scores.size());
-
-    // Decode the boxes
-    detections = decode_boxes(raw_boxes, scores, network_dims, strides, regression_length);
+    // Decode every layer with the kernel of its format
+    for (uint i = 0; i < tensors.size(); i++)
+    {
+        dispatch_by_format(*tensors[i], [&](auto tag)
+                           { decode_layer<decltype(tag)>(*tensors[i], strides[i], network_dims, regression_length, num_classes, detections); });
+    }
 
     // Filter with NMS
     common::nms(detections, IOU_THRESHOLD, true);
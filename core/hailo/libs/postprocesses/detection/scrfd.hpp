@@ -5,20 +5,20 @@
 #pragma once
 #include "hailo_objects.hpp"
 #include "hailo_common.hpp"
-#include "xtensor/xarray.hpp"
+#include "face_priors.hpp"
 
 class ScrfdParams
 {
 public:
-    xt::xarray<float> anchors;
-    xt::xarray<float> anchor_variance;
+    FacePriorsPtr anchors;
+    std::vector<float> anchor_variance;
     std::vector<std::vector<int>> anchor_min_size;
     float score_threshold;
     float iou_threshold;
     int num_branches;
 
-    ScrfdParams(xt::xarray<float> anchors,
-    xt::xarray<float> anchor_variance,
+    ScrfdParams(FacePriorsPtr anchors,
+    std::vector<float> anchor_variance,
     std::vector<std::vector<int>> anchor_min_size,
     float score_threshold,
     float iou_threshold,
@@ -38,9 +38,9 @@ void scrfd_10g(HailoROIPtr roi, void *params_void_ptr);
 void filter(HailoROIPtr roi, void *params_void_ptr);
 ScrfdParams *init(const std::string config_path, const std::string function_name);
 void free_resources(void *params_void_ptr);
-xt::xarray<float> get_anchors_scrfd(const std::vector<std::vector<int>> &anchor_min_sizes,
-                              const xt::xarray<int> &anchor_steps,
-                              const int width,
-                              const int height);
+FacePriors get_anchors_scrfd(const std::vector<std::vector<int>> &anchor_min_sizes,
+                             const std::vector<int> &anchor_steps,
+                             const int width,
+                             const int height);
 
 __END_DECLS
\ No newline at end of file
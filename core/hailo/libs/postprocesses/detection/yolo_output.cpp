@@ -5,22 +5,67 @@
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include "yolo_output.hpp"
+#include "common/quantized_kernels.hpp"
+
+template <typename T>
+bool YoloOutputLayer::class_argmax(uint row, uint col, uint anchor, uint min_quantized, std::pair<uint, float> &cls)
+{
+    // Class ids run from label_offset to _num_classes, class id 1 is at the start of the plane.
+    ClassPlane plane = get_class_plane();
+    uint channel = plane.channel_offset + plane.anchor_stride * anchor + label_offset - 1;
+    const T *probs = TypedTensor<T>(plane.tensor).cell(row, col, channel);
+    std::size_t count = _num_classes + 1 - label_offset;
+    if (min_quantized > std::numeric_limits<T>::max())
+        return false;
+    T prob_max = 0;
+    std::size_t index = common::argmax_quantized(probs, count, T(min_quantized), prob_max);
+    if (index == count)
+        return false;
+    // A cell with all zero probabilities is reported as class 1.
+    uint selected_class_id = (prob_max == 0) ? 1 : index + label_offset;
+    cls = std::pair<uint, float>(selected_class_id, get_class_conf(prob_max));
+    return true;
+}
 
 std::pair<uint, float> YoloOutputLayer::get_class(uint row, uint col, uint anchor)
 {
-    uint cls_prob, prob_max = 0;
-    uint selected_class_id = 1;
-    for (uint class_id = label_offset; class_id <= _num_classes; class_id++)
+    std::pair<uint, float> cls;
+    dispatch_by_format(get_class_plane().is_uint16, [&](auto tag)
+                       { return class_argmax<decltype(tag)>(row, col, anchor, 0, cls); });
+    return cls;
+}
+
+bool YoloOutputLayer::try_get_class(uint row, uint col, uint anchor, std::pair<uint, float> &cls)
+{
+    return dispatch_by_format(get_class_plane().is_uint16, [&](auto tag)
+                              { return class_argmax<decltype(tag)>(row, col, anchor, _quantized_class_thr, cls); });
+}
+
+void YoloOutputLayer::set_class_threshold(float detection_threshold)
+{
+    _quantized_class_thr = 0;
+    ClassPlane class_plane = get_class_plane();
+    HailoTensorPtr obj_tensor = get_objectness_plane().tensor;
+    if (obj_tensor == nullptr || !(obj_tensor->vstream_info().quant_info.qp_scale > 0.0f) ||
+        !(class_plane.tensor->vstream_info().quant_info.qp_scale > 0.0f) || detection_threshold < 0.0f)
+        return;
+
+    // Both confidence and class probability are monotonic in their quantized values,
+    // so binary search the smallest class probability that may still pass with the highest confidence.
+    float max_confidence = quantized_confidence(_is_uint16 ? UINT16_MAX : UINT8_MAX);
+    uint low = 0;
+    uint high = (class_plane.is_uint16 ? UINT16_MAX : UINT8_MAX) + 1;
+    while (low < high)
     {
-        cls_prob = get_class_prob(row, col, anchor, class_id);
-        if (cls_prob > prob_max)
-        {
-            selected_class_id = class_id;
-            prob_max = cls_prob;
-        }
+        uint mid = (low + high) / 2;
+        if (max_confidence * get_class_conf(mid) > detection_threshold)
+            high = mid;
+        else
+            low = mid + 1;
     }
-    return std::pair<uint, float>(selected_class_id, get_class_conf(prob_max));
+    _quantized_class_thr = low;
 }
 
 float YoloOutputLayer::get_confidence(uint row, uint col, uint anchor)
@@ -32,6 +77,49 @@ float YoloOutputLayer::get_confidence(uint row, uint col, uint anchor)
     return confidence;
 }
 
+YoloOutputLayer::ObjectnessPlane YoloOutputLayer::get_objectness_plane()
+{
+    return ObjectnessPlane{_tensor, CONF_CHANNEL_OFFSET, _tensor->features() / NUM_ANCHORS, NUM_ANCHORS};
+}
+
+YoloOutputLayer::ClassPlane YoloOutputLayer::get_class_plane()
+{
+    return ClassPlane{_tensor, CLASS_CHANNEL_OFFSET, _tensor->features() / NUM_ANCHORS, _is_uint16};
+}
+
+float YoloOutputLayer::quantized_confidence(uint quantized)
+{
+    // Same arithmetic as get_confidence, so comparisons against it match bit for bit.
+    HailoTensorPtr tensor = get_objectness_plane().tensor;
+    float confidence = _is_uint16 ? tensor->fix_scale(uint16_t(quantized)) : tensor->fix_scale(uint8_t(quantized));
+    if (_perform_sigmoid)
+        confidence = sigmoid(confidence);
+    return confidence;
+}
+
+int YoloOutputLayer::get_quantized_confidence_threshold(float threshold)
+{
+    HailoTensorPtr tensor = get_objectness_plane().tensor;
+    if (tensor == nullptr || !(tensor->vstream_info().quant_info.qp_scale > 0.0f))
+        return -1;
+    const int max_quantized = _is_uint16 ? UINT16_MAX : UINT8_MAX;
+    auto confidence_of = [&](int quantized)
+    { return quantized_confidence(quantized); };
+
+    // Initial guess through the inverse of the activation, then fix rounding errors by walking
+    // to the exact boundary - the confidence is monotonic in the quantized value.
+    float pre_activation = threshold;
+    if (_perform_sigmoid)
+        pre_activation = logf(threshold / (1.0f - threshold));
+    float guess = tensor->quantize(pre_activation);
+    int quantized = std::isfinite(guess) ? int(CLAMP(floorf(guess), 0.0f, float(max_quantized))) : (guess > 0 ? max_quantized : 0);
+    while (quantized > 0 && confidence_of(quantized - 1) >= threshold)
+        quantized--;
+    while (quantized <= max_quantized && confidence_of(quantized) < threshold)
+        quantized++;
+    return quantized;
+}
+
 float YoloOutputLayer::sigmoid(float x)
 {
     // returns the value of the sigmoid function f(x) = 1/(1 + e^-x)
@@ -107,6 +195,16 @@ float Yolov4OL::get_confidence(uint row, uint col, uint anchor)
     return confidence;
 }
 
+YoloOutputLayer::ObjectnessPlane Yolov4OL::get_objectness_plane()
+{
+    return ObjectnessPlane{_obj, 0, 1, NUM_ANCHORS};
+}
+
+YoloOutputLayer::ClassPlane Yolov4OL::get_class_plane()
+{
+    return ClassPlane{_cls, 0, _num_classes, false};
+}
+
 uint Yolov4OL::get_class_prob(uint row, uint col, uint anchor, uint class_id)
 {
     uint channel = _num_classes * anchor + class_id - 1;
@@ -179,6 +277,16 @@ float YoloXOL::get_confidence(uint row, uint col, uint anchor)
     return confidence;
 }
 
+YoloOutputLayer::ObjectnessPlane YoloXOL::get_objectness_plane()
+{
+    return ObjectnessPlane{_obj, 0, 0, NUM_ANCHORS};
+}
+
+YoloOutputLayer::ClassPlane YoloXOL::get_class_plane()
+{
+    return ClassPlane{_cls, 0, 0, false};
+}
+
 uint YoloXOL::get_class_prob(uint row, uint col, uint anchor, uint class_id)
 {
     return _cls->get(row, col, class_id - 1);
@@ -51,6 +51,26 @@ public:
      * @return std::pair<uint, float> class id and class probability.
      */
     std::pair<uint, float> get_class(uint row, uint col, uint anchor);
+    /**
+     * @brief Get the class object, unless the cell can't pass the class threshold.
+     *        Cells whose best quantized class score is below the threshold set by
+     *        set_class_threshold are rejected before anything is dequantized.
+     *
+     * @param row
+     * @param col
+     * @param anchor
+     * @param cls output, class id and class probability (same as get_class).
+     * @return bool false if the cell was rejected.
+     */
+    bool try_get_class(uint row, uint col, uint anchor, std::pair<uint, float> &cls);
+    /**
+     * @brief Set the class threshold used by try_get_class.
+     *        Derived from the detection threshold and the highest confidence this layer can output,
+     *        a cell below it can't satisfy (confidence * class probability > detection threshold).
+     *
+     * @param detection_threshold
+     */
+    void set_class_threshold(float detection_threshold);
     /**
      * @brief Get the confidence object
      *
@@ -81,11 +101,64 @@ public:
      */
     virtual std::pair<float, float> get_shape(uint row, uint col, uint anchor, uint image_width, uint image_height) = 0;
 
+    /**
+     * @brief Location of the objectness channel of every (row, col, anchor) in memory.
+     *        The objectness of cell (row, col) and anchor a is at
+     *        tensor channel (channel_offset + a * anchor_stride).
+     */
+    struct ObjectnessPlane
+    {
+        HailoTensorPtr tensor;
+        uint channel_offset;
+        uint anchor_stride;
+        uint num_anchors;
+    };
+    /**
+     * @brief Get the objectness plane object
+     *
+     * @return ObjectnessPlane describing where get_confidence reads from.
+     */
+    virtual ObjectnessPlane get_objectness_plane();
+    /**
+     * @brief Get the smallest quantized objectness value whose confidence passes the threshold.
+     *        Computed with the same arithmetic as get_confidence, so
+     *        (quantized >= result)  <=>  (get_confidence() >= threshold).
+     *
+     * @param threshold confidence threshold (dequantized, after activation).
+     * @return int the quantized threshold, max quantized value + 1 if nothing can pass,
+     *         or -1 if the quantization is not monotonic and the threshold can't be quantized.
+     */
+    int get_quantized_confidence_threshold(float threshold);
+    bool is_uint16() { return _is_uint16; }
+
+    /**
+     * @brief Location of the class probabilities of every (row, col, anchor) in memory.
+     *        The probabilities of anchor a are a contiguous run of _num_classes channels,
+     *        starting at tensor channel (channel_offset + a * anchor_stride) for class id 1.
+     */
+    struct ClassPlane
+    {
+        HailoTensorPtr tensor;
+        uint channel_offset;
+        uint anchor_stride;
+        bool is_uint16;
+    };
+    /**
+     * @brief Get the class plane object
+     *
+     * @return ClassPlane describing where get_class_prob reads from.
+     */
+    virtual ClassPlane get_class_plane();
+
 protected:
     bool _perform_sigmoid;
     bool _is_uint16;
     HailoTensorPtr _tensor;
+    uint _quantized_class_thr = 0;
     float sigmoid(float x);
+    float quantized_confidence(uint quantized);
+    template <typename T>
+    bool class_argmax(uint row, uint col, uint anchor, uint min_quantized, std::pair<uint, float> &cls);
     /**
      * @brief Get the class channel object
      *
@@ -176,6 +249,8 @@ public:
     virtual uint get_class_prob(uint row, uint col, uint anchor, uint channel);
     virtual float get_class_conf(uint prob_max);
     virtual std::pair<float, float> get_shape(uint row, uint col, uint anchor, uint image_width, uint image_height);
+    virtual ObjectnessPlane get_objectness_plane();
+    virtual ClassPlane get_class_plane();
 
 protected:
     HailoTensorPtr _center;
@@ -227,6 +302,8 @@ public:
     virtual float get_class_conf(uint prob_max);
     virtual std::pair<float, float> get_center(uint row, uint col, uint anchor);
     virtual std::pair<float, float> get_shape(uint row, uint col, uint anchor, uint image_width, uint image_height);
+    virtual ObjectnessPlane get_objectness_plane();
+    virtual ClassPlane get_class_plane();
 
 protected:
     HailoTensorPtr _bbox;
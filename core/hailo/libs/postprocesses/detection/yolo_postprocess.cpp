@@ -6,10 +6,12 @@
 #include <cmath>
 #include <vector>
 #include <algorithm>
+#include <limits>
 #include <sstream>
 
 #include "yolo_postprocess.hpp"
 #include "common/nms.hpp"
+#include "common/quantized_kernels.hpp"
 #include "json_config.hpp"
 
 #include "rapidjson/document.h"
@@ -54,7 +56,9 @@ public:
         {
             extract_boxes(layer, objects);
         }
-        common::nms(objects, _iou_thr);
+        common::NmsParams nms_params(_iou_thr);
+        nms_params.top_k = _max_boxes;
+        common::nms(objects, nms_params);
         if (objects.size() > _max_boxes)
         {
             HailoBBox bbox(0, 0, 1, 1);
@@ -72,47 +76,139 @@ public:
 
     /**
      * @brief Extract the boxes of generic yolo output layer.
+     *        The objectness plane is scanned once in the quantized domain,
+     *        and only the surviving (row, col, anchor) cells are decoded.
      *
-     * @param[in] image_size Network's input image width/height.
-     * @param[in] thr Postprocess threshold.
+     * @param[in] layer The output layer to decode.
      * @param[out] objects Reference to vector of detections.
      */
     void extract_boxes(std::shared_ptr<YoloOutputLayer> layer,
                        std::vector<HailoDetection> &objects);
+
+protected:
+    /**
+     * @brief Extract the boxes by decoding every cell of the layer,
+     *        used when the objectness threshold can't be quantized.
+     *
+     * @param[in] layer The output layer to decode.
+     * @param[out] objects Reference to vector of detections.
+     */
+    void extract_boxes_per_cell(std::shared_ptr<YoloOutputLayer> layer,
+                                std::vector<HailoDetection> &objects);
+    /**
+     * @brief Decode a single (row, col, anchor) cell and add it to objects if it passes the threshold.
+     */
+    void decode_cell(std::shared_ptr<YoloOutputLayer> &layer, uint row, uint col, uint anchor,
+                     std::vector<HailoDetection> &objects);
+
+    /**
+     * @brief Collect the (cell * num_anchors + anchor) indices whose quantized objectness reaches quantized_thr,
+     *        in the order of the per-cell loop.
+     *
+     * @return bool false if no quantized value can pass the threshold.
+     */
+    template <typename T>
+    bool collect_candidates(const YoloOutputLayer::ObjectnessPlane &plane, uint num_cells, int quantized_thr);
+
+    std::vector<uint32_t> m_candidates;
 };
 
-void YoloPost::extract_boxes(std::shared_ptr<YoloOutputLayer> layer,
-                             std::vector<HailoDetection> &objects)
+template <typename T>
+bool YoloPost::collect_candidates(const YoloOutputLayer::ObjectnessPlane &plane, uint num_cells, int quantized_thr)
+{
+    if (quantized_thr > std::numeric_limits<T>::max())
+        return false;
+
+    TypedTensor<T> objectness(plane.tensor);
+    const uint features = objectness.features();
+    const uint num_anchors = plane.num_anchors;
+    if (features == num_anchors && plane.anchor_stride == 1 && plane.channel_offset == 0)
+    {
+        // The objectness plane is a dense tensor of its own - scan it as one contiguous run.
+        common::collect_above_threshold<T>(objectness.data(), num_cells * num_anchors, 1, T(quantized_thr), 1, 0, m_candidates);
+    }
+    else
+    {
+        // The objectness is interleaved with the other channels - one strided pass per anchor.
+        for (uint anchor = 0; anchor < num_anchors; ++anchor)
+        {
+            uint channel = plane.channel_offset + anchor * plane.anchor_stride;
+            common::collect_above_threshold<T>(objectness.data() + channel, num_cells, features,
+                                               T(quantized_thr), num_anchors, anchor, m_candidates);
+        }
+        if (num_anchors > 1)
+            std::sort(m_candidates.begin(), m_candidates.end());
+    }
+    return true;
+}
+
+void YoloPost::decode_cell(std::shared_ptr<YoloOutputLayer> &layer, uint row, uint col, uint anchor,
+                           std::vector<HailoDetection> &objects)
 {
     uint class_id = 0;
     float x, y, h, w, confidence, class_confidence = 0.0f;
     float xmin, ymin = 0.0f;
+    std::pair<uint, float> cls;
+    confidence = layer->get_confidence(row, col, anchor);
+    if (confidence < _detection_thr)
+        return;
+    if (!layer->try_get_class(row, col, anchor, cls))
+        return;
+    std::tie(class_id, class_confidence) = cls;
+    // Final confidence: box confidence * class probability
+    confidence = confidence * class_confidence;
+    if (confidence > _detection_thr)
+    {
+        std::tie(x, y) = layer->get_center(row, col, anchor);
+        std::tie(w, h) = layer->get_shape(row, col, anchor, m_image_width, m_image_height);
+        // Get the top left corner of the object.
+        xmin = (x - (w / 2.0f));
+        ymin = (y - (h / 2.0f));
+        objects.push_back(HailoDetection(HailoBBox(xmin, ymin, w, h), class_id, m_dataset[class_id], confidence));
+    }
+}
+
+void YoloPost::extract_boxes_per_cell(std::shared_ptr<YoloOutputLayer> layer,
+                                      std::vector<HailoDetection> &objects)
+{
+    uint num_anchors = layer->get_objectness_plane().num_anchors;
     for (uint row = 0; row < layer->_height; ++row)
     {
         for (uint col = 0; col < layer->_width; ++col)
         {
-            for (uint anchor = 0; anchor < layer->NUM_ANCHORS; ++anchor)
+            for (uint anchor = 0; anchor < num_anchors; ++anchor)
             {
-                confidence = layer->get_confidence(row, col, anchor);
-                if (confidence < _detection_thr)
-                    continue;
-                std::tie(class_id, class_confidence) = layer->get_class(row, col, anchor);
-                // Final confidence: box confidence * class probability
-                confidence = confidence * class_confidence;
-                if (confidence > _detection_thr)
-                {
-                    std::tie(x, y) = layer->get_center(row, col, anchor);
-                    std::tie(w, h) = layer->get_shape(row, col, anchor, m_image_width, m_image_height);
-                    // Get the top left corner of the object.
-                    xmin = (x - (w / 2.0f));
-                    ymin = (y - (h / 2.0f));
-                    objects.push_back(HailoDetection(HailoBBox(xmin, ymin, w, h), class_id, m_dataset[class_id], confidence));
-                }
+                decode_cell(layer, row, col, anchor, objects);
             }
         }
     }
 }
 
+void YoloPost::extract_boxes(std::shared_ptr<YoloOutputLayer> layer,
+                             std::vector<HailoDetection> &objects)
+{
+    YoloOutputLayer::ObjectnessPlane plane = layer->get_objectness_plane();
+    int quantized_thr = layer->get_quantized_confidence_threshold(_detection_thr);
+    layer->set_class_threshold(_detection_thr);
+    if (quantized_thr < 0)
+    {
+        extract_boxes_per_cell(layer, objects);
+        return;
+    }
+
+    m_candidates.clear();
+    bool passes = dispatch_by_format(layer->is_uint16(), [&](auto tag)
+                                     { return collect_candidates<decltype(tag)>(plane, layer->_width * layer->_height, quantized_thr); });
+    if (!passes)
+        return; // No quantized value can pass the threshold.
+
+    for (uint32_t candidate : m_candidates)
+    {
+        uint cell = candidate / plane.num_anchors;
+        decode_cell(layer, cell / layer->_width, cell % layer->_width, candidate % plane.num_anchors, objects);
+    }
+}
+
 class Yolov5 : public YoloPost
 {
 public:
@@ -300,7 +396,7 @@ void yolov5_no_faces(HailoROIPtr roi, void *params_void_ptr)
     for (auto &det : detections)
     {
         if (det.get_label() == "person")
-            hailo_common::add_object(roi, std::make_shared<HailoDetection>(det));
+            hailo_common::add_object(roi, hailo_make_shared<HailoDetection>(det));
     }
 }
 
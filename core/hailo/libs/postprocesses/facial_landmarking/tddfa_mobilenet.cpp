@@ -9,24 +9,25 @@
 #include <vector>
 #include <sys/stat.h>
 
-#include "xtensor/xio.hpp"
 #include "xtensor/xarray.hpp"
-#include "xtensor/xtensor.hpp"
-#include "xtensor/xpad.hpp"
-#include "xtensor/xshape.hpp"
-#include "xtensor/xsort.hpp"
-#include "xtensor/xstrided_view.hpp"
-#include "xtensor/xview.hpp"
 #include "xtensor/xnpy.hpp"
 #include "tddfa_mobilenet.hpp"
-#include "common/math.hpp"
-#include "common/tensors.hpp"
 #include "const_tensors.hpp"
 
 const char *output_layer_name = "tddfa_mobilenet_v1/fc1"; // there are 62 params
 #define TRANS_DIM (12)
 #define SHAPE_DIM (40)
+#define EXP_DIM (10)
+#define ALPHA_DIM (SHAPE_DIM + EXP_DIM)
+#define PARAMS_DIM (TRANS_DIM + ALPHA_DIM)
 #define OUTPUT_SIZE (68)
+#define VERTICES_SIZE (OUTPUT_SIZE * 3)
+// Rows of the bases are padded to a whole number of cache lines
+#define CACHE_LINE_FLOATS (16)
+#define VERTICES_STRIDE ((VERTICES_SIZE + CACHE_LINE_FLOATS - 1) / CACHE_LINE_FLOATS * CACHE_LINE_FLOATS)
+// Register block of the reconstruction, in faces and vertex coordinates
+#define FACES_BLOCK (4)
+#define COLUMNS_BLOCK (8)
 #define FACE_HEIGHT (120)
 #define FACE_WIDTH (FACE_HEIGHT)
 
@@ -62,141 +63,189 @@ std::string get_post_proc_data_dir()
 }
 
 std::string post_proc_data_dir = get_post_proc_data_dir();
-// read large const arrays from memory
-xt::xarray<float> W_EXP_BASE =
-  xt::load_npy<float>(post_proc_data_dir + "/w_exp_base.npy");
-xt::xarray<float> W_SHP_BASE =
-  xt::load_npy<float>(post_proc_data_dir + "/w_shp_base.npy");
-xt::xarray<float> trans_bfm_u_base = xt::transpose(bfm_u_base);
-
-xt::xarray<float> calc_params_view(xt::xarray<float> face_3dmm_params)
+
+/**
+ * @brief The rescaling parameters and landmark bases of the 3DMM, in the layout of the reconstruction.
+ *        The shape and expression bases are stacked and transposed: basis[k] holds the x,y,z offsets of all the
+ *        landmarks for alpha coefficient k, so reconstructing a face is a sum of contiguous, aligned rows.
+ *        The bases are the sparse ones of the 68 landmarks, there is no dense mesh to reconstruct.
+ */
+struct TddfaBases
 {
-    xt::xarray<float> face_params_view = xt::view(face_3dmm_params, xt::range(0, TRANS_DIM));
-    return xt::reshape_view(face_params_view, {3, 4});
-}
+    float params_std[PARAMS_DIM];
+    float params_mean[PARAMS_DIM];
+    alignas(64) float mean_vertices[VERTICES_STRIDE];
+    alignas(64) float basis[ALPHA_DIM][VERTICES_STRIDE];
+};
 
-xt::xarray<float> calc_offset(xt::xarray<float> face_3dmm_params, xt::xarray<float> R_)
+void fill_basis(TddfaBases &bases, const xt::xarray<float> &w_base, std::size_t first_alpha, std::size_t alphas)
 {
-    xt::xarray<float> offset_ = xt::view(R_, xt::all(), -1);
-    xt::xarray<float> offset = xt::reshape_view(offset_, {3, 1});
-    return offset;
+    if (w_base.dimension() != 2 || w_base.shape(0) != VERTICES_SIZE || w_base.shape(1) != alphas)
+        throw std::invalid_argument("tddfa: unexpected shape of the landmark bases");
+
+    for (std::size_t k = 0; k < alphas; k++)
+        for (std::size_t v = 0; v < VERTICES_SIZE; v++)
+            bases.basis[first_alpha + k][v] = w_base(v, k);
 }
 
-// Compute tensor dot product along specified axes for arrays.
-// In this case along axis 1 of the first matrix and axis 0 of the second.
-xt::xarray<float> two_dim_dot_product(xt::xarray<float, xt::layout_type::row_major> matrix_1,
-                                      xt::xarray<float, xt::layout_type::row_major> matrix_2)
+/**
+ * @brief Get the bases, they are loaded and laid out on the first call only.
+ */
+const TddfaBases &get_tddfa_bases()
 {
-    uint axis_length = matrix_1.shape(1);
-    if (axis_length != matrix_2.shape(0))
+    static const TddfaBases *bases = []()
     {
-        throw std::invalid_argument("two_dim_dot_product error: axis don't match!");
-    }
+        TddfaBases *loaded = new TddfaBases();
+        if (TDDFA_RESCALE_PARAMS_STD.size() != PARAMS_DIM || TDDFA_RESCALE_PARAMS_MEAN.size() != PARAMS_DIM ||
+            bfm_u_base.size() != VERTICES_SIZE)
+            throw std::invalid_argument("tddfa: unexpected size of the 3DMM parameters");
 
-    float row_sum;
-    xt::xarray<float>::shape_type shape = {matrix_1.shape(0), matrix_2.shape(1)};
-    xt::xarray<float, xt::layout_type::row_major> product_matrix(shape);
-    for (uint i = 0; i < matrix_1.shape(0); ++i)
+        std::copy(TDDFA_RESCALE_PARAMS_STD.begin(), TDDFA_RESCALE_PARAMS_STD.end(), loaded->params_std);
+        std::copy(TDDFA_RESCALE_PARAMS_MEAN.begin(), TDDFA_RESCALE_PARAMS_MEAN.end(), loaded->params_mean);
+        std::copy(bfm_u_base.begin(), bfm_u_base.end(), loaded->mean_vertices);
+        fill_basis(*loaded, xt::load_npy<float>(post_proc_data_dir + "/w_shp_base.npy"), 0, SHAPE_DIM);
+        fill_basis(*loaded, xt::load_npy<float>(post_proc_data_dir + "/w_exp_base.npy"), SHAPE_DIM, EXP_DIM);
+        return loaded;
+    }();
+    return *bases;
+}
+
+/**
+ * @brief Reconstruct the landmark vertices of a batch of faces: vertices = mean + alphas * basis.
+ *        A small GEMM blocked for registers: FACES_BLOCK faces by COLUMNS_BLOCK vertex coordinates are accumulated
+ *        over all the coefficients before being stored, so every basis row is read once per block of faces and
+ *        the inner loops are fixed size multiply-adds the compiler vectorizes.
+ *
+ * @param bases  -  TddfaBases
+ * @param alphas  -  const float *
+ *        The rescaled shape and expression coefficients, ALPHA_DIM per face
+ * @param faces  -  std::size_t
+ *        Number of faces
+ * @param vertices  -  float *
+ *        The x,y,z of every landmark, VERTICES_STRIDE per face
+ */
+void reconstruct_vertices(const TddfaBases &bases, const float *alphas, std::size_t faces, float *vertices)
+{
+    for (std::size_t block = 0; block < faces; block += FACES_BLOCK)
     {
-        for (uint j = 0; j < matrix_2.shape(1); ++j)
+        const std::size_t block_faces = std::min<std::size_t>(FACES_BLOCK, faces - block);
+
+        // The coefficients of the block, interleaved by face (missing faces of the last block are zero)
+        float block_alphas[ALPHA_DIM][FACES_BLOCK] = {};
+        for (std::size_t f = 0; f < block_faces; f++)
+            for (std::size_t k = 0; k < ALPHA_DIM; k++)
+                block_alphas[k][f] = alphas[(block + f) * ALPHA_DIM + k];
+
+        for (std::size_t column = 0; column < VERTICES_STRIDE; column += COLUMNS_BLOCK)
         {
-            row_sum = 0.0;
-            for (uint k = 0; k < axis_length; ++k)
+            float sums[FACES_BLOCK][COLUMNS_BLOCK];
+            for (int f = 0; f < FACES_BLOCK; f++)
+                for (int c = 0; c < COLUMNS_BLOCK; c++)
+                    sums[f][c] = bases.mean_vertices[column + c];
+
+            for (std::size_t k = 0; k < ALPHA_DIM; k++)
             {
-                row_sum += matrix_1(i, k) * matrix_2(k, j);
+                const float *basis_row = bases.basis[k] + column;
+                for (int f = 0; f < FACES_BLOCK; f++)
+                    for (int c = 0; c < COLUMNS_BLOCK; c++)
+                        sums[f][c] += block_alphas[k][f] * basis_row[c];
             }
-            product_matrix(i, j) = row_sum;
+
+            for (std::size_t f = 0; f < block_faces; f++)
+                std::copy(sums[f], sums[f] + COLUMNS_BLOCK, vertices + (block + f) * VERTICES_STRIDE + column);
         }
     }
-    return product_matrix;
-}
-
-xt::xarray<float> calc_trans_sum(xt::xarray<float> face_3dmm_params)
-{
-    xt::xarray<float> raw_alpha_shp = xt::view(face_3dmm_params, xt::range(TRANS_DIM, TRANS_DIM + SHAPE_DIM));
-    xt::xarray<float> alpha_shape = xt::reshape_view(raw_alpha_shp, {40, 1});
-
-    xt::xarray<float> raw_alpha_exp = xt::view(face_3dmm_params, xt::range(TRANS_DIM + SHAPE_DIM, _));
-    xt::xarray<float> alpha_exp = xt::reshape_view(raw_alpha_exp, {10, 1});
-    xt::xarray<float> shape_mul = two_dim_dot_product(W_SHP_BASE, alpha_shape);
-    xt::xarray<float> exp_mul = two_dim_dot_product(W_EXP_BASE, alpha_exp);
-
-    xt::xarray<float> sum = trans_bfm_u_base + shape_mul + exp_mul;
-    xt::xarray<float> reshape_sum = xt::reshape_view(sum, {OUTPUT_SIZE, 3});
-    xt::xarray<float> trans_sum = xt::transpose(reshape_sum);
-    return trans_sum;
-}
-
-xt::xarray<float> BFM(xt::xarray<float> bfm_params_xarray)
-{
-    // this is the implementation of the Basel face model
-
-    // normalization:
-    xt::xarray<float> face_3dmm_params = (bfm_params_xarray * TDDFA_RESCALE_PARAMS_STD) + TDDFA_RESCALE_PARAMS_MEAN;
-    xt::xarray<float> face_params_view = calc_params_view(face_3dmm_params);
-    xt::xarray<float> offset = calc_offset(face_3dmm_params, face_params_view);
-    xt::xarray<float> transposed_sum = calc_trans_sum(face_3dmm_params);
-    xt::xarray<float> reshaped_params = xt::view(face_params_view, xt::all(), xt::range(0, 3));
-    // perform normal tensor dot operation- one the first tensor iterate the colums ({1}) and
-    // on the second tensor iterate the rows ({0})
-    xt::xarray<float> mul = two_dim_dot_product(reshaped_params, transposed_sum);
-    xt::xarray<float> trans_raw_landmarks = mul + offset;
-    return trans_raw_landmarks;
 }
 
 //******************************************************************
 // FACE LANDMARKS SPECIFIC PARAMETERS
 //******************************************************************
 
-xt::xarray<float> calc_bfm_params_xarray(HailoTensorPtr bfm_params)
+/**
+ * @brief Dequantize and rescale the 3DMM parameters of a face.
+ *        The 3x4 pose goes to pose, the shape and expression coefficients to alphas.
+ */
+template <typename T>
+void read_face_params(HailoTensor &tensor, const TddfaBases &bases, float *pose, float *alphas)
 {
-    xt::xarray<uint8_t> bfm_params_xarray = common::get_xtensor(bfm_params);
-    xt::xarray<uint8_t> flatten_bfm_params = xt::flatten(bfm_params_xarray);
-    auto qp_zp = bfm_params->vstream_info().quant_info.qp_zp;
-    auto qp_scale = bfm_params->vstream_info().quant_info.qp_scale;
-    xt::xarray<float> bfm_params_dequantize = common::dequantize(flatten_bfm_params, qp_scale, qp_zp);
-    return bfm_params_dequantize;
+    if (tensor.size() < PARAMS_DIM)
+        throw std::invalid_argument("tddfa: the output layer has less than 62 parameters");
+
+    TypedTensor<T> params(tensor);
+    const T *data = params.data();
+    for (int i = 0; i < TRANS_DIM; i++)
+        pose[i] = params.fix_scale(data[i]) * bases.params_std[i] + bases.params_mean[i];
+    for (int i = TRANS_DIM; i < PARAMS_DIM; i++)
+        alphas[i - TRANS_DIM] = params.fix_scale(data[i]) * bases.params_std[i] + bases.params_mean[i];
 }
 
-xt::xarray<float> calc_landmarks(xt::xarray<float> sum3, int face_height)
+/**
+ * @brief Project the vertices of a face with its pose, into landmarks relative to the face.
+ *        Only x,y are needed, the original model draws upside down so y is flipped.
+ */
+std::vector<HailoPoint> project_landmarks(const float *pose, const float *vertices)
 {
-    xt::xarray<float> landmarks_raw = xt::transpose(sum3);
-    // each row consist 3 values which are the x,y,z values of the dots that we will draw.
-    // we want to draw only in 2D - so we need only x,y values but not z.
-    // cut out the third value in each row
-    xt::xarray<float> landmarks_without_z = xt::view(landmarks_raw, xt::all(), xt::range(0, 2));
-    // construct empty array it the shape we need and modify it
-    xt::xarray<float> landmarks = xt::zeros<float>({OUTPUT_SIZE, 2});
-    xt::col(landmarks, 0) = xt::col(landmarks_without_z, 0);
-    // the original repo assumes drawing is upside down so here we need to flip it:
-    xt::col(landmarks, 1) = face_height - xt::col(landmarks_without_z, 1);
-    return landmarks;
+    std::vector<HailoPoint> points;
+    points.reserve(OUTPUT_SIZE);
+    for (int i = 0; i < OUTPUT_SIZE; i++)
+    {
+        const float *vertex = vertices + i * 3;
+        float x = pose[0] * vertex[0] + pose[1] * vertex[1] + pose[2] * vertex[2] + pose[3];
+        float y = pose[4] * vertex[0] + pose[5] * vertex[1] + pose[6] * vertex[2] + pose[7];
+        points.emplace_back(HailoPoint(x / FACE_WIDTH, (FACE_HEIGHT - y) / FACE_HEIGHT));
+    }
+    return points;
 }
 
-xt::xarray<float> facial_landmark_postprocess(HailoTensorPtr bfm_params)
+/**
+ * @brief Add the landmarks of every face to its roi, reconstructing all the faces in one batch.
+ *
+ * @param faces  -  std::vector<HailoROIPtr>
+ *        The rois holding the output layer of their face
+ */
+void facial_landmarks_batch(const std::vector<HailoROIPtr> &faces)
 {
-    xt::xarray<float> bfm_params_xarray = calc_bfm_params_xarray(bfm_params);
-    xt::xarray<float> transposed_raw_landmarks = BFM(bfm_params_xarray);
-    xt::xarray<float> landmarks = calc_landmarks(transposed_raw_landmarks, FACE_HEIGHT);
-    // Make landmarks relative to the face instead of absulute.
-    xt::view(landmarks, xt::all(), 0) = xt::view(landmarks, xt::all(), 0) / FACE_WIDTH;
-    xt::view(landmarks, xt::all(), 1) = xt::view(landmarks, xt::all(), 1) / FACE_HEIGHT;
-    return landmarks;
+    if (faces.empty())
+        return;
+
+    const TddfaBases &bases = get_tddfa_bases();
+    std::vector<float> poses(faces.size() * TRANS_DIM);
+    std::vector<float> alphas(faces.size() * ALPHA_DIM);
+    std::vector<float> vertices(faces.size() * VERTICES_STRIDE);
+
+    for (std::size_t f = 0; f < faces.size(); f++)
+    {
+        HailoTensorPtr tensor = faces[f]->get_tensor(output_layer_name);
+        dispatch_by_format(*tensor, [&](auto tag)
+                           { read_face_params<decltype(tag)>(*tensor, bases, &poses[f * TRANS_DIM], &alphas[f * ALPHA_DIM]); });
+    }
+
+    reconstruct_vertices(bases, alphas.data(), faces.size(), vertices.data());
+
+    for (std::size_t f = 0; f < faces.size(); f++)
+    {
+        std::vector<HailoPoint> points = project_landmarks(&poses[f * TRANS_DIM], &vertices[f * VERTICES_STRIDE]);
+        faces[f]->add_object(hailo_make_shared<HailoLandmarks>("landmarks", points));
+    }
 }
 
 void facial_landmark(HailoROIPtr roi)
 {
-    std::vector<HailoPoint> points;
     if (roi->has_tensors())
     {
-        xt::xarray<float> landmarks = facial_landmark_postprocess(roi->get_tensor(output_layer_name));
-        points.reserve(landmarks.shape(0));
-        for (uint i = 0; i < landmarks.shape(0); i++)
-        {
-            points.emplace_back(HailoPoint(landmarks(i, 0), landmarks(i, 1)));
-        }
-        roi->add_object(std::make_shared<HailoLandmarks>("landmarks", points));
+        facial_landmarks_batch({roi});
+    }
+}
+
+void facial_landmarks_frame(HailoROIPtr roi)
+{
+    std::vector<HailoROIPtr> faces;
+    for (HailoDetectionPtr &detection : hailo_common::get_hailo_detections(roi))
+    {
+        if (detection->has_tensors())
+            faces.emplace_back(detection);
     }
+    facial_landmarks_batch(faces);
 }
 
 void filter(HailoROIPtr roi)
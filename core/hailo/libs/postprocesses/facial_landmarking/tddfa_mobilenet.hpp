@@ -12,4 +12,7 @@ void filter(HailoROIPtr roi);
 // Used for Face Detection + Face Landmarks app.
 void facial_landmarks_merged(HailoROIPtr roi);
 void facial_landmarks_yuy2(HailoROIPtr roi);
+// Adds landmarks to every face detection of a frame that holds the output layer, all the faces are reconstructed
+// in one batch. Used after the aggregator of a cascade instead of running per crop.
+void facial_landmarks_frame(HailoROIPtr roi);
 __END_DECLS
\ No newline at end of file
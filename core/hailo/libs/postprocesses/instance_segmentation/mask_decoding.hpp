@@ -1,16 +1,11 @@
 #pragma once
 
-#include "xtensor/xmath.hpp"
-#include "xtensor/xadapt.hpp"
-
-
-/**
- * @brief  Compute sigmoid, not in-place (lazy)
- */
-auto xtensor_sigmoid(auto &tensor)
-{
-    return 1 / (1 + xt::exp(-tensor));
-}
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "hailo_objects.hpp"
 
 /*
  * @brief sigmoid on a single float
@@ -19,90 +14,175 @@ auto xtensor_sigmoid(auto &tensor)
 inline float sigmoid(float x) { return 1.0f / (1.0f + std::exp(-1.0 * x)); }
 
 /**
- * @brief  Compute tensor dot product along specified axes for arrays.
-            In this case along axis 2 of the first matrix and axis 0 of the second.
- *
- * @param matrix_1 left matrix in the dot product
- * @param matrix_2 right matrix in the dot product
- * @return xt::xarray<float> the dot product result
+ * @brief  Dot product of two float vectors, with independent partial sums so the compiler can vectorize it.
+ */
+inline float dot_product(const float *a, const float *b, int length)
+{
+    float sums[8] = {0.0f};
+    int k = 0;
+    for (; k + 8 <= length; k += 8)
+        for (int j = 0; j < 8; j++)
+            sums[j] += a[k + j] * b[k + j];
+    float sum = ((sums[0] + sums[4]) + (sums[1] + sums[5])) + ((sums[2] + sums[6]) + (sums[3] + sums[7]));
+    for (; k < length; k++)
+        sum += a[k] * b[k];
+    return sum;
+}
+
+/**
+ * @brief Decodes the masks of all the instances of a frame together, when the first of them is read.
+ * The mask of an instance is the sigmoid of the product of its coefficients with the proto layer, computed only inside its box.
+ * The proto layer is read quantized: dequantization is folded into the coefficients, and every proto pixel
+ * is converted to float once, for all the boxes covering it, one row at a time.
+ * The decoder keeps the proto tensor (and so its buffer) until the masks are decoded.
  */
-xt::xarray<float> dot_product_axis_2(xt::xarray<float, xt::layout_type::row_major> matrix_1,
-                                     xt::xarray<float, xt::layout_type::row_major> matrix_2)
+template <typename T>
+class InstanceMaskDecoder
 {
-    uint axis_length = matrix_1.shape(2);
-    if (axis_length != matrix_2.shape(0))
+private:
+    struct MaskJob
     {
-        throw std::invalid_argument("dot_product_axis_2 error: axis don't match!");
-    }
-    float row_sum;
-    xt::xarray<float>::shape_type shape = {matrix_1.shape(0), matrix_1.shape(1)};
-    xt::xarray<float, xt::layout_type::row_major> product_matrix(shape);
-    for (uint i = 0; i < matrix_1.shape(0); ++i)
+        int xmin, ymin, xmax, ymax;
+        std::vector<float> coefficients; // Scaled by qp_scale
+        float bias;                      // The zero point's part of the product
+        std::vector<float> data;
+    };
+
+    HailoTensorPtr m_proto;
+    int m_num_protos;
+    std::vector<MaskJob> m_jobs;
+    std::once_flag m_decoded;
+
+    void decode_all()
     {
-        for (uint j = 0; j < matrix_1.shape(1); ++j)
+        const T *proto = reinterpret_cast<const T *>(m_proto->data());
+        int proto_width = m_proto->width();
+        int num_protos = m_num_protos;
+        int rows_begin = m_proto->height(), rows_end = 0;
+        for (const MaskJob &job : m_jobs)
         {
-            row_sum = 0.0;
-            for (uint k = 0; k < axis_length; ++k)
+            if (job.xmax > job.xmin && job.ymax > job.ymin)
             {
-                row_sum += matrix_1(i, j, k) * matrix_2(k);
+                rows_begin = std::min(rows_begin, job.ymin);
+                rows_end = std::max(rows_end, job.ymax);
             }
-            product_matrix(i, j) = row_sum;
         }
-    }
-    return product_matrix;
-}
 
-/*
- * @brief Decode the mask coefficients of yolov5seg results into a format that makes sense
- * and add it to the detected instance for future calculation of the final mask
- *
- * @param objects vector of the detected instances
- * @param proto the 32 mask prototypes that the coefficients select portions of to form the mask
- */
-void decode_masks(std::vector<HailoDetection> &objects, const xt::xarray<float> &proto)
-{
-    xt::xarray<float>::shape_type mask_shape = {proto.shape(0), proto.shape(1)};
-    int proto_width = proto.shape(0);
-    int proto_height = proto.shape(1);
-    int xmin, ymin, xmax, ymax;
-    for (auto &instance : objects)
-    {
-        // Gather the detection bounds for this instance,
-        // they are relative scale so multiply by proto size
-        HailoBBox bbox = instance.get_bbox();
-        xmin = CLAMP(bbox.xmin() * proto_width, 0, proto_width);
-        xmax = CLAMP(bbox.xmax() * proto_width, 0, proto_width);
-        ymin = CLAMP(bbox.ymin() * proto_height, 0, proto_height);
-        ymax = CLAMP(bbox.ymax() * proto_height, 0, proto_height);
-        // Crop a view of the proto layer of just this instance's detection area
-        auto cropped_proto = xt::view(proto, xt::range(ymin, ymax), xt::range(xmin, xmax));
-        HailoMatrixPtr matrix = NULL;
-        for (auto obj : instance.get_objects())
+        std::vector<float> proto_row;
+        for (int y = rows_begin; y < rows_end; y++)
         {
-            if (obj->get_type() == HAILO_MATRIX)
+            // Convert the part of the proto row covered by any box
+            int cols_begin = proto_width, cols_end = 0;
+            for (const MaskJob &job : m_jobs)
+            {
+                if (y >= job.ymin && y < job.ymax && job.xmax > job.xmin)
+                {
+                    cols_begin = std::min(cols_begin, job.xmin);
+                    cols_end = std::max(cols_end, job.xmax);
+                }
+            }
+            if (cols_begin >= cols_end)
+                continue;
+            proto_row.resize((cols_end - cols_begin) * num_protos);
+            const T *quantized = proto + ((size_t)y * proto_width + cols_begin) * num_protos;
+            for (size_t j = 0; j < proto_row.size(); j++)
+                proto_row[j] = quantized[j];
+
+            for (MaskJob &job : m_jobs)
             {
-                matrix = std::dynamic_pointer_cast<HailoMatrix>(obj);
+                if (y < job.ymin || y >= job.ymax)
+                    continue;
+                float *out = job.data.data() + (y - job.ymin) * (job.xmax - job.xmin);
+                for (int x = job.xmin; x < job.xmax; x++)
+                {
+                    float value = dot_product(proto_row.data() + (x - cols_begin) * num_protos, job.coefficients.data(), num_protos) + job.bias;
+                    *out++ = 1.0f / (1.0f + std::exp(-value));
+                }
             }
         }
-        if (matrix == NULL) // no mask attached
+        // Let go of the proto tensor's buffer
+        m_proto.reset();
+    }
+
+public:
+    InstanceMaskDecoder(HailoTensorPtr proto) : m_proto(proto), m_num_protos(proto->features()) {}
+
+    /**
+     * @brief Add an instance to decode.
+     *
+     * @param bbox  -  HailoBBox
+     *        The box of the instance, relative to the proto layer.
+     * @param coefficients  -  const float *
+     *        The mask coefficients of the instance (one per proto).
+     * @return size_t  The index of the instance's mask.
+     */
+    size_t add(const HailoBBox &bbox, const float *coefficients)
+    {
+        int proto_width = m_proto->width();
+        int proto_height = m_proto->height();
+        float qp_zp = m_proto->vstream_info().quant_info.qp_zp;
+        float qp_scale = m_proto->vstream_info().quant_info.qp_scale;
+
+        // Gather the detection bounds for this instance,
+        // they are relative scale so multiply by proto size
+        MaskJob job;
+        job.xmin = CLAMP(bbox.xmin() * proto_width, 0, proto_width);
+        job.xmax = CLAMP(bbox.xmax() * proto_width, 0, proto_width);
+        job.ymin = CLAMP(bbox.ymin() * proto_height, 0, proto_height);
+        job.ymax = CLAMP(bbox.ymax() * proto_height, 0, proto_height);
+        job.xmax = std::max(job.xmax, job.xmin);
+        job.ymax = std::max(job.ymax, job.ymin);
+        job.coefficients.resize(m_num_protos);
+        float coefficients_sum = 0.0f;
+        for (int k = 0; k < m_num_protos; k++)
         {
-            return;
+            job.coefficients[k] = coefficients[k] * qp_scale;
+            coefficients_sum += job.coefficients[k];
         }
-        xt::xarray<int>::shape_type shape = {matrix->height()};
-        xt::xarray<float> mask_coefficients = xt::adapt(matrix->get_data().data(), matrix->height(), xt::no_ownership(), shape);
+        job.bias = -qp_zp * coefficients_sum;
+        m_jobs.push_back(std::move(job));
+        return m_jobs.size() - 1;
+    }
 
-        // Calculate a matrix multiplication of the instance's coefficients and the cropped proto layer and transpose it
-        xt::xarray<float, xt::layout_type::column_major> cropped_mask = xt::transpose(dot_product_axis_2(cropped_proto, mask_coefficients));
-        instance.remove_object(matrix); // not needed anymore
+    int width(size_t index) const { return m_jobs[index].xmax - m_jobs[index].xmin; }
+    int height(size_t index) const { return m_jobs[index].ymax - m_jobs[index].ymin; }
 
-        // Calculate the sigmoid of the mask
-        cropped_mask = xtensor_sigmoid(cropped_mask);
+    /**
+     * @brief Hand over the mask of an instance, decoding all the masks on the first call.
+     */
+    void take(size_t index, std::vector<float> &data)
+    {
+        std::call_once(m_decoded, [this]()
+                       {
+                           for (MaskJob &job : m_jobs)
+                               job.data.resize((job.xmax - job.xmin) * (job.ymax - job.ymin));
+                           decode_all(); });
+        data = std::move(m_jobs[index].data);
+    }
+};
 
-        // allocate and memcpy to a new memory so it points to the right data
-        std::vector<float> data(cropped_mask.shape(0) * cropped_mask.shape(1));
-        memcpy(data.data(), cropped_mask.data(), sizeof(float) * cropped_mask.shape(0) * cropped_mask.shape(1));
-        
+/*
+ * @brief Attach the masks of yolov5seg results to the detected instances.
+ * The masks are decoded lazily: nothing is computed until one of them is read (e.g. by hailooverlay or an export),
+ * then all of them are decoded in one pass over the proto layer.
+ *
+ * @param objects vector of the detected instances
+ * @param coefficients the mask coefficients of each instance (one float per proto)
+ * @param proto the quantized proto layer (height x width x num_protos), the prototypes that the coefficients select portions of to form the mask
+ */
+template <typename T>
+void decode_masks(std::vector<HailoDetection> &objects, const std::vector<const float *> &coefficients, HailoTensorPtr proto)
+{
+    if (objects.empty())
+        return;
+    auto decoder = std::make_shared<InstanceMaskDecoder<T>>(proto);
+    for (uint i = 0; i < objects.size(); i++)
+    {
+        size_t index = decoder->add(objects[i].get_bbox(), coefficients[i]);
         // Add the mask to the object meta
-        instance.add_object(std::make_shared<HailoConfClassMask>(std::move(data), cropped_mask.shape(0), cropped_mask.shape(1), 0.3, instance.get_class_id()));
+        objects[i].add_object(std::make_shared<HailoConfClassMask>(
+            [decoder, index](std::vector<float> &data)
+            { decoder->take(index, data); },
+            decoder->width(index), decoder->height(index), 0.3, objects[i].get_class_id()));
     }
 }
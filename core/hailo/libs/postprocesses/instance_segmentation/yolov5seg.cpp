@@ -1,11 +1,10 @@
 #include "yolov5seg.hpp"
-#include "xtensor/xsort.hpp"
-#include "xtensor/xpad.hpp"
 #include "hailo_common.hpp"
-#include "common/tensors.hpp"
 #include "common/nms.hpp"
+#include "common/quantized_kernels.hpp"
 #include "common/labels/coco_eighty.hpp"
 #include "mask_decoding.hpp"
+#include "xtensor/xadapt.hpp"
 
 #include "json_config.hpp"
 #include "rapidjson/document.h"
@@ -14,8 +13,6 @@
 #include "rapidjson/filereadstream.h"
 #include "rapidjson/schema.h"
 
-#include <thread>
-#include <future>
 #include <iterator>
 #if __GNUC__ > 8
 #include <filesystem>
@@ -44,196 +41,172 @@ inline uint16_t quant(float num, float qp_zp, float qp_scale) { return uint16_t(
  */
 inline float dequant(uint16_t num, float qp_zp, float qp_scale) { return (float(num) - qp_zp) * qp_scale;}
 
-/*
- * @brief Creates the grid and the anchor grid that will be used for each decoding
- *
- * @param anchors xarray, initialized in creation of Yolov5segParams
- * @param stride
- * @param nx shape[0] of the branch
- * @param ny shape[1] of the branch
- * @param num_anchors is the number of anchors per branch / 2
+/**
+ * @brief  sigmoid in float arithmetic, for the box coordinates
  */
-std::tuple<xt::xarray<float>, xt::xarray<float>> make_grid(xt::xarray<float> &anchors, const int stride, const int nx, const int ny, const int num_anchors)
-{
-    xt::xarray<int> x = xt::arange(nx);
-    xt::xarray<int> y = xt::arange(ny);
-    auto mesh = xt::meshgrid(y, x);
-    auto yv = std::get<0>(mesh);
-    auto xv = std::get<1>(mesh);
-    // making grid
-    auto stack = xt::stack(xt::xtuple(xv, yv), 2);
-    stack.reshape({1, ny, nx, 2});
-    xt::xarray<float> grid = xt::broadcast(stack, {num_anchors, ny, nx, 2}) - 0.5;
-    xt::xarray<float> transposed_grid = xt::transpose(grid, {1, 2, 0, 3}); // num_anchors, h, w, features
-    // making anchor grid
-    anchors *= stride;
-    anchors.reshape({num_anchors, 1, 1, 2});
-    xt::xarray<float> anchor_grid = xt::broadcast(anchors, {num_anchors, ny, nx, 2});
-    xt::xarray<float> transposed_anchor_grid = xt::transpose(anchor_grid, {1, 2, 0, 3}); // num_anchors, h, w, features
-    return std::tuple<xt::xarray<float>, xt::xarray<float>>(std::move(transposed_grid), std::move(transposed_anchor_grid));
-}
+inline float sigmoid_float(float x) { return 1 / (1 + std::exp(-x)); }
 
-/*
- * @brief Returns a vector of indices, of detections that have: is_object * max(class_confidence) > score_threshold
- *
- * @param all_scores an xview with the confidence scores for each class, for each detection
- * @param all_is_object an xview with the confidence that this detection is an object, for each detection
- * @param score_threshold float
+/**
+ * @brief Boxes of all the branches that passed the score threshold, in SoA layout.
+ *        Kept between frames, so decoding does not allocate.
  */
-auto filter_above_threshold(auto &all_scores, auto &is_object_threshold, const float score_threshold, const uint16_t threshold_quantized, const float qp_zp, const float qp_scale)
+struct Yolov5segCandidates
 {
-    std::vector<uint> indices;
-    std::vector<float> scores;
-    std::vector<uint> classes;
-    int this_index;
-    float conf_deq, is_object_deq;
-    uint16_t is_object;
-    for (uint i = 0; i < is_object_threshold.size(); i++)
+    std::vector<float> x; // Box center and size, in input pixels
+    std::vector<float> y;
+    std::vector<float> w;
+    std::vector<float> h;
+    std::vector<float> score;
+    std::vector<int> class_id;
+    std::vector<float> mask_coefficients; // MASK_CO dequantized coefficients per box
+    std::vector<uint32_t> indices;        // Scratch, rows with objectness above the threshold
+
+    void clear()
     {
-        // first check if the object parameter is bigger than threshold
-        is_object = is_object_threshold(i, 0);
-        if (is_object > threshold_quantized)
-        {
-            this_index = xt::argmax(xt::row(all_scores, i))(0) + 1;
-            // dequantize and decode
-            conf_deq = sigmoid(dequant(all_scores(i, this_index - 1), qp_zp, qp_scale));
-            is_object_deq = sigmoid(dequant(is_object, qp_zp, qp_scale));
-            if (conf_deq*is_object_deq > score_threshold)
-            {
-                indices.emplace_back(i);
-                scores.emplace_back(conf_deq * is_object_deq);
-                classes.emplace_back(this_index);
-        }
-    }
+        x.clear();
+        y.clear();
+        w.clear();
+        h.clear();
+        score.clear();
+        class_id.clear();
+        mask_coefficients.clear();
     }
-    return std::tuple<std::vector<uint>, std::vector<float>, std::vector<uint>>(std::move(indices), std::move(scores), std::move(classes));
-}
+
+    std::size_t size() const { return score.size(); }
+};
 
 /*
- * @brief Gets the xviews of the decoded and filtered results, and adds them to a vector of HailoDetections
+ * @brief Creates the grid and the anchor sizes that will be used for each decoding
  *
- * @param size int representing amount of detections
- * @param boxes xview of (x, y, w, h), x and y are the center of the box
- * @param is_object an xview with the confidence that this detection is an object, for each detection
- * @param scores an xview with the confidence scores for each class, for each detection
- * @param masks an xview with 32 coefficients representing a mask per detection
- * @param objects a vecor of HailoDetections, to which the detections will be added
- *  */
-std::vector<HailoDetection> create_hailo_detections(auto &scores_vec, auto &classes_vec, auto &xy, auto wh, auto &masks, const int input_width, const int input_height)
+ * @param grid the grid to fill
+ * @param anchors xarray, initialized in creation of Yolov5segParams
+ * @param nx shape[1] of the branch
+ * @param ny shape[0] of the branch
+ * @param num_anchors is the number of anchors per branch
+ */
+void make_grid(Yolov5segGrid &grid, const xt::xarray<float> &anchors, const int nx, const int ny, const int num_anchors)
 {
-    int class_index;
-    float confidence, w, h, x, y = 0.0;
-    std::vector<HailoDetection> objects;
-    for (uint i = 0; i < scores_vec.size(); i++)
+    grid.width = nx;
+    grid.height = ny;
+    grid.grid_x.resize(nx);
+    grid.grid_y.resize(ny);
+    for (int x = 0; x < nx; x++)
+        grid.grid_x[x] = x - 0.5f;
+    for (int y = 0; y < ny; y++)
+        grid.grid_y[y] = y - 0.5f;
+    grid.anchor_w.resize(num_anchors);
+    grid.anchor_h.resize(num_anchors);
+    for (int a = 0; a < num_anchors; a++)
     {
-        // Get the box parameters for this box
-        x = (xy(i, 0)) / input_width;
-        y = (xy(i, 1)) / input_height;
-        w = (wh(i, 0)) / input_width;
-        h = (wh(i, 1)) / input_height;
-        // x and y represented center of box, so they need to be changed to left bottom corner
-        HailoBBox bbox(x - w / 2, y - h / 2, w, h);
-        class_index = classes_vec[i];
-        std::string label = common::coco_eighty[class_index];
-        confidence = scores_vec[i];
-        // create mask
-        xt::xarray<float> mask_coefficients = xt::squeeze(xt::view(masks, xt::keep(i), xt::all()));
-        HailoDetection detected_instance(bbox, class_index, label, confidence);
-        std::vector<float> data(mask_coefficients.shape(0));
-        memcpy(data.data(), mask_coefficients.data(), sizeof(float) * mask_coefficients.shape(0));
-        // create the detection itself
-        detected_instance.add_object((std::make_shared<HailoMatrix>(data, mask_coefficients.shape(0), 1)));
-        objects.push_back(detected_instance);
+        grid.anchor_w[a] = anchors(2 * a);
+        grid.anchor_h[a] = anchors(2 * a + 1);
     }
-    return objects;
 }
 
 /*
- * @brief Does the decoding and the filtering for the output, and adds the results to the HailoDetections vector
+ * @brief Decodes one output in a single pass over the quantized data, and appends the boxes that pass the
+ * score threshold to the candidates.
+ * The objectness channel is compared to the threshold in the quantized domain, only the cells above it are
+ * dequantized: their best class, box and mask coefficients.
  *
  *  */
-std::vector<HailoDetection> yolov5_decoding(xt::xarray<uint16_t> &output, const int stride, xt::xarray<float> &anchors, xt::xarray<float> &grid, xt::xarray<float> &anchor_grid, const int num_anchors, const float score_threshold, float qp_zp, float qp_scale, const int input_width, const int input_height)
+void yolov5_decoding(HailoTensorPtr &tensor, const int stride, Yolov5segGrid &grid, const xt::xarray<float> &anchors, const int num_anchors, const float score_threshold, Yolov5segCandidates &candidates)
 {
-    int h = output.shape()[0];
-    int w = output.shape()[1];
-    int num_classes = (output.shape()[2] / 3) - BOX_CO - 1 - MASK_CO;
+    const uint16_t *output = reinterpret_cast<const uint16_t *>(tensor->data());
+    const int h = tensor->height();
+    const int w = tensor->width();
+    const int features = tensor->features() / num_anchors; // Per anchor: box, objectness, classes, mask coefficients
+    const int num_classes = features - BOX_CO - 1 - MASK_CO;
+    const float qp_zp = tensor->vstream_info().quant_info.qp_zp;
+    const float qp_scale = tensor->vstream_info().quant_info.qp_scale;
+    if (grid.width != (uint)w || grid.height != (uint)h)
+        make_grid(grid, anchors, w, h, num_anchors);
 
-    // prepare data for filter function
-    auto all_decoded = xt::reshape_view(output, {num_anchors * h * w, BOX_CO + 1 + num_classes + MASK_CO}); // {number of detections, 117}
-    auto all_is_object = xt::view(all_decoded, xt::all(), xt::range(4, 5));
-    auto all_scores = xt::view(all_decoded, xt::all(), xt::range(5, num_classes + 5));
     // quantize the score threshold + "undecode" it (do inverse of sigmoid), to avoid doing dequantization and decoding on all class scores
     uint16_t threshold_quantized = quant(inverse_sigmoid(score_threshold), qp_zp, qp_scale);
-    auto filtered = filter_above_threshold(all_scores, all_is_object, score_threshold, threshold_quantized, qp_zp, qp_scale);
-    std::vector<uint> indices = std::get<0>(filtered);
-    std::vector<float> scores_vec = std::get<1>(filtered);
-    std::vector<uint> classes_vec = std::get<2>(filtered);
-
-    // filter xy and grid
-    auto xy = xt::view(all_decoded, xt::all(), xt::range(_, 2));
-    auto reshaped_grid = xt::reshape_view(grid, xy.shape());
-    auto filtered_xy = xt::view(xy, xt::keep(indices), xt::all());
-    auto filtered_grid = xt::view(reshaped_grid, xt::keep(indices), xt::all());
-    // dequantize and decode xy
-    xt::xarray<float> deq_xy = (filtered_xy - qp_zp) * qp_scale;
-    deq_xy = (xtensor_sigmoid(deq_xy) * 2 + filtered_grid) * stride;
-
-    // filter wh and anchor grid
-    auto wh = xt::view(all_decoded, xt::all(), xt::range(2, 4));
-    auto reshaped_anchor_grid = xt::reshape_view(anchor_grid, wh.shape());
-    auto filtered_wh = xt::view(wh, xt::keep(indices), xt::all());
-    auto filtered_anchor_grid = xt::view(reshaped_anchor_grid, xt::keep(indices), xt::all());
-    // dequantize and decode wh
-    xt::xarray<float> deq_wh = (filtered_wh - qp_zp) * qp_scale;
-    deq_wh = xt::square(xtensor_sigmoid(deq_wh) * 2) * filtered_anchor_grid;
+    if (threshold_quantized == UINT16_MAX)
+        return;
+    // Every row is a (cell, anchor) pair, the objectness of row i is at output[i * features + BOX_CO]
+    candidates.indices.clear();
+    common::collect_above_threshold(output + BOX_CO, (std::size_t)h * w * num_anchors, features, uint16_t(threshold_quantized + 1), 1, 0, candidates.indices);
 
-    // filter and dequantize masks
-    auto filtered_masks = xt::view(all_decoded, xt::keep(indices), xt::range(num_classes + 5, _));
-    xt::xarray<float> masks = (filtered_masks - qp_zp) * qp_scale;
-
-    // create HailoDetections for the NMS and the mask decoding
-    std::vector<HailoDetection> objects = create_hailo_detections(scores_vec, classes_vec, deq_xy, deq_wh, masks, input_width, input_height);
-    return objects;
-}
+    for (uint32_t index : candidates.indices)
+    {
+        const uint16_t *row = output + (std::size_t)index * features;
+        uint16_t class_max = 0;
+        std::size_t class_index = common::argmax_quantized(row + BOX_CO + 1, num_classes, uint16_t(0), class_max);
+        // dequantize and decode
+        float confidence = sigmoid(dequant(class_max, qp_zp, qp_scale)) * sigmoid(dequant(row[BOX_CO], qp_zp, qp_scale));
+        if (!(confidence > score_threshold))
+            continue;
 
-/*
- * @brief Does dequantize and decoding for each output seperately
- *
- *  */
-std::vector<HailoDetection> post_per_branch(std::string branch_name, const int index, std::map<std::string, HailoTensorPtr> tensors, std::vector<xt::xarray<float>> anchor_list, std::vector<int> stride_list, const float iou_threshold, const float score_threshold, std::vector<xt::xarray<float>> grids, std::vector<xt::xarray<float>> anchor_grids, const int num_anchors, const int input_width, const int input_height)
-{
-    auto output = common::get_xtensor_uint16(tensors[branch_name]);
-    float qp_zp = tensors[branch_name]->vstream_info().quant_info.qp_zp;
-    float qp_scale = tensors[branch_name]->vstream_info().quant_info.qp_scale;
-    return yolov5_decoding(output, stride_list[index], anchor_list[index], grids[index], anchor_grids[index], num_anchors, score_threshold, qp_zp, qp_scale, input_width, input_height);
+        const int anchor = index % num_anchors;
+        const int cell = index / num_anchors;
+        candidates.x.push_back((sigmoid_float(dequant(row[0], qp_zp, qp_scale)) * 2 + grid.grid_x[cell % w]) * stride);
+        candidates.y.push_back((sigmoid_float(dequant(row[1], qp_zp, qp_scale)) * 2 + grid.grid_y[cell / w]) * stride);
+        float box_w = sigmoid_float(dequant(row[2], qp_zp, qp_scale)) * 2;
+        float box_h = sigmoid_float(dequant(row[3], qp_zp, qp_scale)) * 2;
+        candidates.w.push_back(box_w * box_w * grid.anchor_w[anchor]);
+        candidates.h.push_back(box_h * box_h * grid.anchor_h[anchor]);
+        candidates.score.push_back(confidence);
+        candidates.class_id.push_back(class_index + 1);
+        const uint16_t *mask = row + BOX_CO + 1 + num_classes;
+        for (int k = 0; k < MASK_CO; k++)
+            candidates.mask_coefficients.push_back(dequant(mask[k], qp_zp, qp_scale));
+    }
 }
 
 /*
  * @brief Does dequantize and decoding for each output, and then calls nms and decode masks
  *
  *  */
-std::vector<HailoDetection> yolov5seg_post(auto &tensors, auto &anchor_list, auto &stride_list, const float iou_threshold, const float score_threshold, auto &grids, auto &anchor_grids, const int num_anchors, const int input_width, const int input_height, auto &outputs_name)
+std::vector<HailoDetection> yolov5seg_post(std::map<std::string, HailoTensorPtr> &tensors, Yolov5segParams *params)
 {
-    auto proto_tensor = common::dequantize(common::get_xtensor(tensors[outputs_name[0]]), tensors[outputs_name[0]]->vstream_info().quant_info.qp_scale, tensors[outputs_name[0]]->vstream_info().quant_info.qp_zp);
+    // Reused between calls, so the buffers are allocated only once per thread.
+    thread_local Yolov5segCandidates candidates;
+    thread_local common::NmsEngine nms_engine;
+    const int input_width = params->input_shape[0];
+    const int input_height = params->input_shape[1];
 
-    // run the postprocess for each branch seperately
-    std::future<std::vector<HailoDetection>> t2 = std::async(post_per_branch, outputs_name[1], 2, tensors, anchor_list, stride_list, iou_threshold, score_threshold, grids, anchor_grids, num_anchors, input_width, input_height);
-    std::future<std::vector<HailoDetection>> t1 = std::async(post_per_branch, outputs_name[2], 1, tensors, anchor_list, stride_list, iou_threshold, score_threshold, grids, anchor_grids, num_anchors, input_width, input_height);
-    std::future<std::vector<HailoDetection>> t0 = std::async(post_per_branch, outputs_name[3], 0, tensors, anchor_list, stride_list, iou_threshold, score_threshold, grids, anchor_grids, num_anchors, input_width, input_height);
-    std::vector<HailoDetection> d2 = t2.get();
-    std::vector<HailoDetection> d1 = t1.get();
-    std::vector<HailoDetection> d0 = t0.get();
+    // decode every branch, from the largest stride to the smallest
+    candidates.clear();
+    for (int index = 0; index < (int)params->strides.size(); index++)
+        yolov5_decoding(tensors[params->outputs_name[params->strides.size() - index]], params->strides[index], params->grids[index],
+                        params->anchors[index], params->num_anchors, params->score_threshold, candidates);
 
-    // concatenate all detections
-    std::vector<HailoDetection> all_detections;
-    all_detections.reserve(d0.size() + d1.size() + d2.size());
-    all_detections.insert(all_detections.end(), d0.begin(), d0.end());
-    all_detections.insert(all_detections.end(), d1.begin(), d1.end());
-    all_detections.insert(all_detections.end(), d2.begin(), d2.end());
+    // x and y represented center of box, so they need to be changed to left bottom corner
+    nms_engine.clear();
+    nms_engine.reserve(candidates.size());
+    for (std::size_t i = 0; i < candidates.size(); i++)
+    {
+        float x = candidates.x[i] / input_width;
+        float y = candidates.y[i] / input_height;
+        float w = candidates.w[i] / input_width;
+        float h = candidates.h[i] / input_height;
+        nms_engine.add(HailoBBox(x - w / 2, y - h / 2, w, h), candidates.score[i], candidates.class_id[i]);
+    }
+    const std::vector<uint32_t> &kept = nms_engine.run(common::NmsParams(params->iou_threshold));
 
-    common::nms(all_detections, iou_threshold);
-    decode_masks(all_detections, proto_tensor);
-    return all_detections;
+    // create HailoDetections only for the boxes that survived the NMS
+    std::vector<HailoDetection> detections;
+    std::vector<const float *> mask_coefficients;
+    detections.reserve(kept.size());
+    mask_coefficients.reserve(kept.size());
+    for (uint32_t i : kept)
+    {
+        float x = candidates.x[i] / input_width;
+        float y = candidates.y[i] / input_height;
+        float w = candidates.w[i] / input_width;
+        float h = candidates.h[i] / input_height;
+        int class_index = candidates.class_id[i];
+        detections.emplace_back(HailoBBox(x - w / 2, y - h / 2, w, h), class_index, common::coco_eighty[class_index], candidates.score[i]);
+        mask_coefficients.push_back(candidates.mask_coefficients.data() + (std::size_t)i * MASK_CO);
+    }
+
+    HailoTensorPtr proto = tensors[params->outputs_name[0]];
+    dispatch_by_format(*proto, [&](auto tag)
+                       { decode_masks<decltype(tag)>(detections, mask_coefficients, proto); });
+    return detections;
 }
 
 Yolov5segParams *init(const std::string config_path, const std::string function_name)
@@ -368,26 +341,11 @@ Yolov5segParams *init(const std::string config_path, const std::string function_
 
         fclose(fp);
     } }
-    std::vector<int> outputs_size = params->outputs_size;
-    std::vector<xt::xarray<float>> anchors = params->anchors;
-    std::vector<int> strides = params->strides;
-    std::vector<xt::xarray<float>> grids;
-    std::vector<xt::xarray<float>> anchor_grids;
-    int num_anchors = 0;
-    // create grid and anchor grid
-    for (uint index = 0; index < outputs_size.size(); index++)
-    {
-        anchors[index] /= strides[index];
-        num_anchors = floor(anchors[index].size() / 2);
-        auto both_grids = make_grid(anchors[index], strides[index], outputs_size[index], outputs_size[index], num_anchors);
-        xt::xarray<float> grid = std::get<0>(both_grids);
-        xt::xarray<float> anchor_grid = std::get<1>(both_grids);
-        grids.emplace_back(grid);
-        anchor_grids.emplace_back(anchor_grid);
-    }
-    params->grids = grids;
-    params->anchor_grids = anchor_grids;
-    params->num_anchors = num_anchors;
+    // create the grids, they are rebuilt if an output has another shape
+    params->num_anchors = params->anchors.empty() ? 0 : params->anchors[0].size() / 2;
+    params->grids.resize(params->outputs_size.size());
+    for (uint index = 0; index < params->outputs_size.size(); index++)
+        make_grid(params->grids[index], params->anchors[index], params->outputs_size[index], params->outputs_size[index], params->num_anchors);
     return params;
 }
 
@@ -406,7 +364,7 @@ void yolov5seg(HailoROIPtr roi, void *params_void_ptr)
 {
     Yolov5segParams *params = reinterpret_cast<Yolov5segParams *>(params_void_ptr);
     std::map<std::string, HailoTensorPtr> tensors = roi->get_tensors_by_name();
-    std::vector<HailoDetection> detections = yolov5seg_post(tensors, params->anchors, params->strides, params->iou_threshold, params->score_threshold, params->grids, params->anchor_grids, params->num_anchors, params->input_shape[0], params->input_shape[1], params->outputs_name);
+    std::vector<HailoDetection> detections = yolov5seg_post(tensors, params);
     hailo_common::add_detections(roi, detections);
 }
 
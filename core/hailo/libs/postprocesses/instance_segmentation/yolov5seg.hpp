@@ -8,6 +8,20 @@
 #include "xtensor/xio.hpp"
 
 __BEGIN_DECLS
+/**
+ * @brief Decoding constants of one output branch, for the output shape it was built for.
+ *        Rebuilt only when the shape of the branch changes.
+ */
+struct Yolov5segGrid
+{
+    uint height = 0;
+    uint width = 0;
+    std::vector<float> grid_x;   // Column - 0.5, per column
+    std::vector<float> grid_y;   // Row - 0.5, per row
+    std::vector<float> anchor_w; // In input pixels, per anchor
+    std::vector<float> anchor_h;
+};
+
 class Yolov5segParams
 {
 public:
@@ -19,8 +33,7 @@ public:
     std::vector<xt::xarray<float>> anchors;
     std::vector<int> input_shape;
     std::vector<int> strides;
-    std::vector<xt::xarray<float>> grids;
-    std::vector<xt::xarray<float>> anchor_grids;
+    std::vector<Yolov5segGrid> grids;
 
     Yolov5segParams() {
         iou_threshold = 0.6;
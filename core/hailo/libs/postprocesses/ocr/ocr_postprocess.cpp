@@ -26,8 +26,8 @@ void OCR_postprocess(HailoROIPtr roi)
     if (nullptr == net_output)
         return;
 
-    xt::xarray<float> output_dequantize;
-    output_dequantize = common::get_xtensor_float(net_output);
+    // Average over the rows while dequantizing, the output itself is never copied
+    auto output_dequantize = common::dequantized_view<uint8_t>(net_output);
 
     xt::xarray<float> prebs = xt::mean(output_dequantize, 0);
     xt::xarray<int> preb_label = xt::argmax(prebs, 1);
@@ -9,6 +9,7 @@
 
 #include "mspn.hpp"
 #include "common/tensors.hpp"
+#include "common/heatmap_peaks.hpp"
 #include "json_config.hpp"
 
 #include "rapidjson/document.h"
@@ -141,6 +142,45 @@ void calculate_joints_and_resize(xt::xarray<float> &heatmaps, xt::xarray<float>
     }
 }
 
+/**
+ * @brief Get the max predictions straight from the quantized heatmaps, and refine and resize them like
+ *        get_max_predictions and calculate_joints_and_resize do (dequantization keeps the order of the scores).
+ *
+ * @param tensor the tensor containing the heatmaps (height x width x joints)
+ * @return xt::xarray<float> the predictions, x, y and confidence for every joint
+ */
+xt::xarray<float> get_predictions_quantized(HailoTensorPtr tensor)
+{
+    static thread_local common::HeatmapPeakEngine<uint8_t> peak_engine;
+    const uint8_t *data = tensor->data();
+    int num_joints = tensor->features();
+    int height = tensor->height();
+    int width = tensor->width();
+    auto at = [&](int joint, int y, int x)
+    { return data[((std::size_t)y * width + x) * num_joints + joint]; };
+
+    peak_engine.run(data, height, width, num_joints, 1);
+    xt::xarray<float> preds = xt::zeros<float>({num_joints, 3});
+    for (int k = 0; k < num_joints; k++)
+    {
+        const common::HeatmapPeak<uint8_t> &peak = peak_engine.peaks(k)[0];
+        float max_val = std::min(tensor->fix_scale(peak.value), 1.0f); // tappas doesn't allow confidence to be greater than 1
+        int px = (max_val > 0.0) ? peak.index % width : -1;
+        int py = (max_val > 0.0) ? peak.index / width : -1;
+        preds(k, 0) = px;
+        preds(k, 1) = py;
+        preds(k, 2) = max_val / 255 + 0.5;
+        if (px < width - 1 && px > 1 && py < height - 1 && py > 1)
+        {
+            preds(k, 0) += (at(k, py, px + 1) > at(k, py, px - 1)) ? 0.75 : 0.25;
+            preds(k, 0) += (at(k, py + 1, px) > at(k, py - 1, px)) ? 0.75 : 0.25;
+        }
+        preds(k, 0) = preds(k, 0) / 48;
+        preds(k, 1) = preds(k, 1) / 64;
+    }
+    return preds;
+}
+
 /**
  * @brief mspn post process
  *
@@ -153,20 +193,26 @@ void mspn_postprocess(HailoROIPtr roi, const float score_threshold, bool perform
 {
     std::vector<HailoDetection> objects; // The detection meta we will eventually return
     HailoTensorPtr tensor = roi->get_tensors()[0];
-    auto tensor_xarray = common::get_xtensor_float(tensor);
-    xt::xarray<float> heatmaps = xt::transpose(tensor_xarray, {2, 0, 1});
-    int num_joints = heatmaps.shape()[0];
-    int height = heatmaps.shape()[1];
-    int width = heatmaps.shape()[2];
+    int num_joints = tensor->features();
+    xt::xarray<float> preds;
 
     if (perform_gaussian_blur)
     {
+        xt::xarray<float> heatmaps = xt::transpose(common::dequantized_view<uint8_t>(tensor), {2, 0, 1});
+        int height = heatmaps.shape()[1];
+        int width = heatmaps.shape()[2];
+
         gaussian_blur(heatmaps, num_joints, width, height);
-    }
 
-    xt::xarray<float> preds = get_max_predictions(heatmaps, num_joints, width, height);
+        preds = get_max_predictions(heatmaps, num_joints, width, height);
 
-    calculate_joints_and_resize(heatmaps, preds, num_joints, width, height);
+        calculate_joints_and_resize(heatmaps, preds, num_joints, width, height);
+    }
+    else
+    {
+        // Without the blur the heatmaps are never needed in float
+        preds = get_predictions_quantized(tensor);
+    }
 
     std::vector<HailoPoint> points;
     points.reserve(num_joints);
@@ -174,7 +220,7 @@ void mspn_postprocess(HailoROIPtr roi, const float score_threshold, bool perform
     {
         points.emplace_back(HailoPoint(preds(i, 0), preds(i, 1), preds(i, 2)));
     }
-    roi->add_object(std::make_shared<HailoLandmarks>("centerpose", points, score_threshold, centerpose_joint_pairs));
+    roi->add_object(hailo_make_shared<HailoLandmarks>("centerpose", points, score_threshold, centerpose_joint_pairs));
 }
 
 /**
@@ -31,9 +31,9 @@ void arcface(HailoROIPtr roi, std::string layer_name)
         roi->remove_objects_typed(HAILO_MATRIX);
     else
         HailoTracker::GetInstance().remove_matrices_from_track(jde_tracker_name, unique_ids[0]->get_id());
-    // Convert the tensor to xarray.
+    // Dequantize the tensor to xarray.
     auto tensor = roi->get_tensor(layer_name);
-    xt::xarray<float> embeddings = common::get_xtensor_float(tensor);
+    xt::xarray<float> embeddings = common::dequantized_view<uint8_t>(tensor);
 
     // vector normalization
     auto normalized_embedding = common::vector_normalization(embeddings);
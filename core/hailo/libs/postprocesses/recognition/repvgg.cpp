@@ -24,9 +24,9 @@ void re_id(HailoROIPtr roi)
     // Remove previous matrices
     roi->remove_objects_typed(HAILO_MATRIX);
 
-    // Convert the tensor to xarray.
+    // Dequantize the tensor to xarray.
     auto tensor = roi->get_tensor(OUTPUT_LAYER_NAME);
-    xt::xarray<float> embedding = common::get_xtensor_float(tensor);
+    xt::xarray<float> embedding = common::dequantized_view<uint8_t>(tensor);
 
     // vector normalization
     auto normalized_embedding = common::vector_normalization(embedding);
@@ -157,7 +157,7 @@ HailoROIPtr get_hailo_main_roi(GstBuffer *buffer, gboolean create_if_missing)
     }
     if ((!roi) && (create_if_missing))
     {
-        roi = std::make_shared<HailoROI>(HailoROI(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f)));
+        roi = hailo_make_shared<HailoROI>(HailoROI(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f)));
         gst_buffer_add_hailo_meta(buffer, roi);
     }
 
@@ -0,0 +1,204 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file hailo_binary_format.hpp
+ * @brief Compact binary wire format of a HailoROI tree, used by hailoexportzmq/hailoimportzmq
+ *        as an alternative to JSON.
+ *
+ * Layout (native little-endian, every field 4 byte aligned):
+ *
+ *   header     HailoBinaryHeader, 32 bytes
+ *   roi        bbox (4 x float), object list, tensor list
+ *
+ *   object list   uint32 count, then count records of:
+ *                 uint32 type (hailo_object_t), uint32 body size in bytes, body
+ *   tensor list   uint32 count, then count tensors
+ *   string        uint32 length, bytes, zero padded to 4
+ *   array         uint32 count, elements, zero padded to 4
+ *
+ * Records carry their size, so a reader skips object types it does not know.
+ * Tensor data is 8 byte aligned from the start of the message, so it can be used in place.
+ **/
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#define HAILO_BINARY_MAGIC "HROI"
+#define HAILO_BINARY_VERSION (1)
+
+typedef enum
+{
+    HAILO_METADATA_FORMAT_JSON,
+    HAILO_METADATA_FORMAT_BINARY,
+} hailo_metadata_format_t;
+
+struct HailoBinaryHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t payload_size; // Bytes following the header
+    uint32_t reserved;
+    int64_t timestamp;     // ms since epoch
+    uint64_t buffer_offset;
+};
+static_assert(sizeof(HailoBinaryHeader) == 32, "HailoBinaryHeader must be 32 bytes");
+
+/**
+ * @brief Appends binary fields to a growing byte vector.
+ */
+class HailoBinaryWriter
+{
+private:
+    std::vector<uint8_t> *m_out;
+
+public:
+    explicit HailoBinaryWriter(std::vector<uint8_t> &out) : m_out(&out) {}
+
+    size_t position() const { return m_out->size(); }
+
+    void write_bytes(const void *data, size_t size)
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        m_out->insert(m_out->end(), bytes, bytes + size);
+    }
+
+    void pad(size_t alignment)
+    {
+        m_out->resize((m_out->size() + alignment - 1) / alignment * alignment, 0);
+    }
+
+    template <typename T>
+    void write(T value)
+    {
+        write_bytes(&value, sizeof(T));
+    }
+
+    void write_string(const std::string &value)
+    {
+        write<uint32_t>(value.size());
+        write_bytes(value.data(), value.size());
+        pad(4);
+    }
+
+    template <typename T>
+    void write_array(const T *data, size_t count)
+    {
+        write<uint32_t>(count);
+        write_bytes(data, count * sizeof(T));
+        pad(4);
+    }
+
+    /**
+     * @brief Reserve a uint32 to be filled later by patch(), returns its position.
+     */
+    size_t reserve_u32()
+    {
+        size_t position = m_out->size();
+        write<uint32_t>(0);
+        return position;
+    }
+
+    void patch(size_t position, uint32_t value)
+    {
+        std::memcpy(m_out->data() + position, &value, sizeof(value));
+    }
+};
+
+/**
+ * @brief Reads binary fields in place from a message, without allocating.
+ *        Every read is bounds checked, a read past the end marks the reader as failed
+ *        and returns zeros from then on.
+ */
+class HailoBinaryReader
+{
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_base = 0; // Offset of m_data in the whole message, for alignment
+    size_t m_position = 0;
+    bool m_ok = true;
+
+public:
+    HailoBinaryReader(const void *data, size_t size) : m_data(static_cast<const uint8_t *>(data)), m_size(size) {}
+
+    bool ok() const { return m_ok; }
+    size_t position() const { return m_position; }
+    size_t remaining() const { return m_size - m_position; }
+
+    /**
+     * @brief Take size bytes in place, returns nullptr if the message is too short.
+     */
+    const uint8_t *take(size_t size)
+    {
+        if (!m_ok || size > m_size - m_position)
+        {
+            m_ok = false;
+            return nullptr;
+        }
+        const uint8_t *bytes = m_data + m_position;
+        m_position += size;
+        return bytes;
+    }
+
+    void align(size_t alignment)
+    {
+        size_t offset = m_base + m_position;
+        take((offset + alignment - 1) / alignment * alignment - offset);
+    }
+
+    template <typename T>
+    T read()
+    {
+        T value{};
+        const uint8_t *bytes = take(sizeof(T));
+        if (bytes)
+            std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    std::string read_string()
+    {
+        uint32_t length = read<uint32_t>();
+        const uint8_t *bytes = take(length);
+        align(4);
+        return bytes ? std::string(reinterpret_cast<const char *>(bytes), length) : std::string();
+    }
+
+    /**
+     * @brief Read an array into a vector (the HailoObjects own their data).
+     */
+    template <typename T>
+    std::vector<T> read_array()
+    {
+        uint32_t count = read<uint32_t>();
+        std::vector<T> values;
+        if (!m_ok || count > remaining() / sizeof(T))
+        {
+            m_ok = false;
+            return values;
+        }
+        values.resize(count);
+        std::memcpy(values.data(), take((size_t)count * sizeof(T)), (size_t)count * sizeof(T));
+        align(4);
+        return values;
+    }
+
+    /**
+     * @brief A reader over the next size bytes, this reader skips past them.
+     */
+    HailoBinaryReader sub_reader(size_t size)
+    {
+        const uint8_t *bytes = take(size);
+        HailoBinaryReader reader(bytes, bytes ? size : 0);
+        reader.m_base = m_base + m_position - (bytes ? size : 0);
+        reader.m_ok = bytes != nullptr;
+        return reader;
+    }
+};
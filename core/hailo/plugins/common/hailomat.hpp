@@ -106,6 +106,8 @@ public:
     uint height() { return m_height; };
     uint native_width() { return m_native_width; };
     uint native_height() { return m_native_height; };
+    int line_thickness() { return m_line_thickness; };
+    int font_thickness() { return m_font_thickness; };
     std::vector<cv::Mat> &get_matrices() { return m_matrices; }
     virtual void draw_rectangle(cv::Rect rect, const cv::Scalar color) = 0;
     virtual void draw_text(std::string text, cv::Point position, double font_scale, const cv::Scalar color) = 0;
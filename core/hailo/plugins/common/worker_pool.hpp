@@ -0,0 +1,173 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file worker_pool.hpp
+ * @brief A small fixed pool of worker threads for splitting per-frame work (e.g. many crops)
+ *        across cores, without leaving the calling streaming thread idle.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class HailoWorkerPool
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_batch_mutex; // Serializes parallel_for callers
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    const std::function<void(std::size_t)> *m_task = nullptr;
+    std::size_t m_count = 0;
+    std::atomic<std::size_t> m_next{0};
+    std::size_t m_done = 0;
+    unsigned int m_active = 0;      // Workers currently inside the open batch
+    unsigned long m_generation = 0;
+    bool m_open = false;            // A batch is running, m_task is valid
+    bool m_stop = false;
+    std::exception_ptr m_error;
+
+    // Pull task indices until the batch is exhausted, returns how many were run.
+    std::size_t run_tasks(const std::function<void(std::size_t)> &task, std::size_t count)
+    {
+        std::size_t ran = 0;
+        for (std::size_t i = m_next.fetch_add(1); i < count; i = m_next.fetch_add(1))
+        {
+            try
+            {
+                task(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_error)
+                    m_error = std::current_exception();
+            }
+            ran++;
+        }
+        return ran;
+    }
+
+    void worker_loop()
+    {
+        unsigned long seen_generation = 0;
+        while (true)
+        {
+            const std::function<void(std::size_t)> *task;
+            std::size_t count;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_work_cv.wait(lock, [&]
+                               { return m_stop || (m_open && m_generation != seen_generation); });
+                if (m_stop)
+                    return;
+                seen_generation = m_generation;
+                task = m_task;
+                count = m_count;
+                m_active++;
+            }
+            std::size_t ran = run_tasks(*task, count);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_done += ran;
+                m_active--;
+                if (m_done == m_count && m_active == 0)
+                    m_done_cv.notify_one();
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Construct a new worker pool.
+     *
+     * @param num_threads  -  unsigned int
+     *        Total number of threads working on a batch, including the calling thread.
+     *        0 means one per hardware thread.
+     */
+    explicit HailoWorkerPool(unsigned int num_threads)
+    {
+        if (num_threads == 0)
+            num_threads = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned int i = 1; i < num_threads; i++)
+            m_workers.emplace_back(&HailoWorkerPool::worker_loop, this);
+    }
+
+    ~HailoWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_work_cv.notify_all();
+        for (std::thread &worker : m_workers)
+            worker.join();
+    }
+
+    HailoWorkerPool(const HailoWorkerPool &) = delete;
+    HailoWorkerPool &operator=(const HailoWorkerPool &) = delete;
+
+    unsigned int num_threads() const { return m_workers.size() + 1; }
+
+    /**
+     * @brief Run task(0) ... task(count - 1) on the pool and the calling thread, and wait for all of them.
+     *        Tasks may run in any order. If any task throws, the first exception is rethrown here
+     *        after the whole batch finished.
+     *
+     * @param count  -  std::size_t
+     *        Number of tasks.
+     *
+     * @param task  -  std::function<void(std::size_t)>
+     *        The task, called with the task index.
+     */
+    void parallel_for(std::size_t count, const std::function<void(std::size_t)> &task)
+    {
+        if (count == 0)
+            return;
+        if (count == 1 || m_workers.empty())
+        {
+            for (std::size_t i = 0; i < count; i++)
+                task(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> batch_lock(m_batch_mutex);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_task = &task;
+            m_count = count;
+            m_done = 0;
+            m_error = nullptr;
+            m_next.store(0);
+            m_generation++;
+            m_open = true;
+        }
+        m_work_cv.notify_all();
+
+        std::size_t ran = run_tasks(task, count);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done += ran;
+        m_done_cv.wait(lock, [&]
+                       { return m_done == m_count && m_active == 0; });
+        // Workers that did not wake up in time skip this batch, they will never touch the task.
+        m_open = false;
+        m_task = nullptr;
+        if (m_error)
+        {
+            std::exception_ptr error = m_error;
+            m_error = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+};
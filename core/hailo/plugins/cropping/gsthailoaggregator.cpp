@@ -11,7 +11,12 @@
  */
 #include "cropping/gsthailoaggregator.hpp"
 #include <gst/video/video.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <iostream>
+#include <thread>
+#include <unordered_map>
 #include "gst_hailo_cropping_meta.hpp"
 #include "hailo_objects.hpp"
 #include "hailo_common.hpp"
@@ -26,11 +31,15 @@ static void gst_hailoaggregator_handle_sub_frame_roi(GstHailoAggregator *hailoag
 static GstStateChangeReturn gst_hailoaggregator_change_state(GstElement *element, GstStateChange transition);
 
 #define DEFAULT_FORWARD_STICKY_EVENTS TRUE
+#define DEFAULT_MAX_IN_FLIGHT (1)
+#define DEFAULT_LATENCY_DEADLINE (0)
 
 enum
 {
     PROP_0,
     PROP_FLATTEN_DETECTIONS,
+    PROP_MAX_IN_FLIGHT,
+    PROP_LATENCY_DEADLINE,
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink",
@@ -90,6 +99,19 @@ gst_hailoaggregator_class_init(GstHailoAggregatorClass *klass)
     g_object_class_install_property(gobject_class, PROP_FLATTEN_DETECTIONS,
                                     g_param_spec_boolean("flatten-detections", "Flatten detections", "perform a 'flattening' functionality on the detection metadata when receiving each frame", false,
                                                          (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_MAX_IN_FLIGHT,
+                                    g_param_spec_uint("max-in-flight", "Max in flight",
+                                                      "Maximum number of main frames waiting for their crops at the same time. "
+                                                      "With more than 1, new main frames are accepted while the crops of previous frames are still in inference, "
+                                                      "and frames are pushed in order from an output thread once all their crops returned.",
+                                                      1, G_MAXUINT, DEFAULT_MAX_IN_FLIGHT,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_LATENCY_DEADLINE,
+                                    g_param_spec_uint("latency-deadline", "Latency deadline",
+                                                      "Time in milliseconds a main frame may wait for its crops, after which it is pushed with the results received so far. "
+                                                      "Crops that arrive later are dropped. 0 waits until all the crops returned.",
+                                                      0, G_MAXUINT, DEFAULT_LATENCY_DEADLINE,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 }
 
 static void
@@ -119,6 +141,9 @@ gst_hailoaggregator_init(GstHailoAggregator *hailoaggregator)
     hailoaggregator->mainframe = NULL;
 
     hailoaggregator->flatten_detections = false;
+    hailoaggregator->max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+    hailoaggregator->latency_deadline = DEFAULT_LATENCY_DEADLINE;
+    hailoaggregator->window = nullptr;
     hailoaggregator->eos_main = false;
     hailoaggregator->eos_sub = false;
 }
@@ -134,6 +159,12 @@ gst_hailoaggregator_set_property(GObject *object, guint prop_id,
     case PROP_FLATTEN_DETECTIONS:
         hailoaggregator->flatten_detections = g_value_get_boolean(value);
         break;
+    case PROP_MAX_IN_FLIGHT:
+        hailoaggregator->max_in_flight = g_value_get_uint(value);
+        break;
+    case PROP_LATENCY_DEADLINE:
+        hailoaggregator->latency_deadline = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -151,6 +182,12 @@ gst_hailoaggregator_get_property(GObject *object, guint prop_id, GValue *value,
     case PROP_FLATTEN_DETECTIONS:
         g_value_set_boolean(value, hailoaggregator->flatten_detections);
         break;
+    case PROP_MAX_IN_FLIGHT:
+        g_value_set_uint(value, hailoaggregator->max_in_flight);
+        break;
+    case PROP_LATENCY_DEADLINE:
+        g_value_set_uint(value, hailoaggregator->latency_deadline);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -176,6 +213,266 @@ forward_events(GstPad *pad, GstEvent **event, gpointer user_data)
     return TRUE;
 }
 
+/**
+ * Finish the aggregation of a main frame and push it into the src pad.
+ *
+ * @param[in] hailoaggregator   GstHailoAggregator.
+ * @param[in] buf               GstBuffer, the main frame. The reference is taken.
+ * @return the flow return of the push.
+ */
+static GstFlowReturn
+gst_hailoaggregator_push_main(GstHailoAggregator *hailoaggregator, GstBuffer *buf)
+{
+    GstHailoAggregatorClass *hailoaggregator_class = GST_HAILO_AGGREGATOR_GET_CLASS(hailoaggregator);
+
+    hailoaggregator_class->handle_main_roi_post_aggregation(hailoaggregator, get_hailo_main_roi(buf));
+
+    gst_pad_sticky_events_foreach(hailoaggregator->sinkpad_main, forward_events, hailoaggregator->srcpad);
+
+    // Remove the cropping meta from the main frame.
+    if (! gst_buffer_remove_hailo_cropping_meta(buf))
+    {
+        GST_ERROR_OBJECT(hailoaggregator, "Failed to remove cropping meta from main frame");
+    }
+
+    // Push main buffer into the src pad.
+    return gst_pad_push(hailoaggregator->srcpad, buf);
+}
+
+/**
+ * A main frame waiting in the window for the crops taken from it.
+ */
+struct HailoAggregatorFrame
+{
+    GstBuffer *buffer;
+    guint64 offset;
+    uint expected_frames;
+    uint received_frames;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+/**
+ * A bounded window of main frames that are aggregated at the same time.
+ * The cropper gives every crop the offset of its main frame, so sub frames are matched to their
+ * main frame by offset, in any order. An output thread pushes the main frames in the order they
+ * arrived, once all their crops returned or their latency deadline passed.
+ */
+class HailoAggregatorWindow
+{
+private:
+    GstHailoAggregator *m_element;
+    std::mutex m_mutex;
+    std::condition_variable m_room_cv;   // Main chain and drain, a frame left the window
+    std::condition_variable m_sub_cv;    // Sub chain, a new main frame arrived
+    std::condition_variable m_output_cv; // Output thread, the oldest frame may be ready
+    std::deque<HailoAggregatorFrame> m_pending; // Main frames in arrival order, not yet pushed
+    // Crops still to come for frames that were pushed without them, they are dropped on arrival
+    std::unordered_map<guint64, uint> m_stale_crops;
+    size_t m_max_pending;
+    std::chrono::milliseconds m_latency_deadline;
+    bool m_pushing = false; // The output thread is pushing a frame it already popped
+    bool m_sub_eos = false;
+    bool m_flushing = false;
+    bool m_stop = false;
+    GstFlowReturn m_flow_return = GST_FLOW_OK;
+    std::thread m_output_thread;
+
+    bool frame_ready(const HailoAggregatorFrame &frame, std::chrono::steady_clock::time_point now) const
+    {
+        return frame.received_frames >= frame.expected_frames || m_sub_eos || now >= frame.deadline;
+    }
+
+    void output_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_pending.empty())
+            {
+                m_output_cv.wait(lock);
+                continue;
+            }
+            const HailoAggregatorFrame &head = m_pending.front();
+            if (!frame_ready(head, std::chrono::steady_clock::now()))
+            {
+                if (head.deadline == std::chrono::steady_clock::time_point::max())
+                    m_output_cv.wait(lock);
+                else
+                    m_output_cv.wait_until(lock, head.deadline);
+                continue;
+            }
+
+            HailoAggregatorFrame frame = head;
+            m_pending.pop_front();
+            if (frame.received_frames < frame.expected_frames)
+            {
+                GST_INFO_OBJECT(m_element, "Pushing frame with offset %" G_GUINT64_FORMAT " with %u of %u crops",
+                                frame.offset, frame.received_frames, frame.expected_frames);
+                if (!m_sub_eos)
+                    m_stale_crops[frame.offset] += frame.expected_frames - frame.received_frames;
+            }
+            m_pushing = true;
+            m_room_cv.notify_all();
+            lock.unlock();
+
+            GstFlowReturn ret = gst_hailoaggregator_push_main(m_element, frame.buffer);
+
+            lock.lock();
+            m_pushing = false;
+            if (ret != GST_FLOW_OK)
+                m_flow_return = ret;
+            m_room_cv.notify_all();
+        }
+    }
+
+    void clear_unlocked()
+    {
+        for (HailoAggregatorFrame &frame : m_pending)
+            gst_buffer_unref(frame.buffer);
+        m_pending.clear();
+        m_stale_crops.clear();
+    }
+
+public:
+    HailoAggregatorWindow(GstHailoAggregator *element, uint max_in_flight, uint latency_deadline)
+        : m_element(element), m_max_pending(std::max(1u, max_in_flight)), m_latency_deadline(latency_deadline)
+    {
+        m_output_thread = std::thread(&HailoAggregatorWindow::output_loop, this);
+    }
+
+    ~HailoAggregatorWindow()
+    {
+        stop();
+        m_output_thread.join();
+        clear_unlocked();
+    }
+
+    /**
+     * @brief Wake up every waiting chain function and the output thread, and stop accepting frames.
+     *        Frames still in the window are not pushed.
+     */
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_room_cv.notify_all();
+        m_sub_cv.notify_all();
+        m_output_cv.notify_all();
+    }
+
+    /**
+     * @brief Add a main frame to the window, blocks while the window is full.
+     *        The buffer reference is taken, the frame is pushed downstream by the output thread.
+     *
+     * @return GstFlowReturn the last failed downstream flow return, GST_FLOW_OK otherwise.
+     */
+    GstFlowReturn submit(GstBuffer *buf)
+    {
+        HailoAggregatorFrame frame;
+        frame.buffer = buf;
+        frame.offset = buf->offset;
+        frame.expected_frames = gst_buffer_get_hailo_cropping_meta(buf)->num_of_crops;
+        frame.received_frames = 0;
+        frame.deadline = std::chrono::steady_clock::time_point::max();
+        if (m_latency_deadline.count() > 0)
+            frame.deadline = std::chrono::steady_clock::now() + m_latency_deadline;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_room_cv.wait(lock, [this]
+                       { return m_pending.size() < m_max_pending || m_stop || m_flushing; });
+        if (m_stop || m_flushing)
+        {
+            lock.unlock();
+            gst_buffer_unref(buf);
+            return GST_FLOW_FLUSHING;
+        }
+        m_pending.push_back(frame);
+        m_sub_cv.notify_all();
+        m_output_cv.notify_one();
+
+        GstFlowReturn ret = m_flow_return;
+        m_flow_return = GST_FLOW_OK;
+        return ret;
+    }
+
+    /**
+     * @brief Aggregate a sub frame into its main frame, blocks until the main frame arrived.
+     *        The buffer reference is not taken.
+     */
+    void add_sub_frame(GstBuffer *buf)
+    {
+        GstHailoAggregatorClass *hailoaggregator_class = GST_HAILO_AGGREGATOR_GET_CLASS(m_element);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop && !m_flushing)
+        {
+            // Crops of a frame arrive in order, so crops of a frame already pushed come before those of a
+            // newer frame with the same offset.
+            auto stale = m_stale_crops.find(buf->offset);
+            if (stale != m_stale_crops.end())
+            {
+                if (--stale->second == 0)
+                    m_stale_crops.erase(stale);
+                GST_DEBUG_OBJECT(m_element, "Dropping late crop of frame with offset %" G_GUINT64_FORMAT, buf->offset);
+                return;
+            }
+
+            auto frame = std::find_if(m_pending.begin(), m_pending.end(), [buf](const HailoAggregatorFrame &pending)
+                                      { return pending.offset == buf->offset && pending.received_frames < pending.expected_frames; });
+            if (frame != m_pending.end())
+            {
+                // handle_sub_frame_roi reads the main frame from the element
+                m_element->mainframe = frame->buffer;
+                hailoaggregator_class->handle_sub_frame_roi(m_element, get_hailo_main_roi(buf));
+                m_element->mainframe = NULL;
+                if (++frame->received_frames >= frame->expected_frames)
+                    m_output_cv.notify_one();
+                return;
+            }
+
+            // The main frame of this crop did not arrive yet.
+            m_sub_cv.wait(lock);
+        }
+    }
+
+    /**
+     * @brief Wait until every frame in the window was pushed downstream.
+     *        Called before serialized events of the main stream, so they do not overtake buffers.
+     */
+    void drain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_room_cv.wait(lock, [this]
+                       { return (m_pending.empty() && !m_pushing) || m_stop || m_flushing; });
+    }
+
+    /**
+     * @brief Mark whether the sub stream ended, frames still missing crops are then pushed right away.
+     */
+    void set_sub_eos(bool eos)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sub_eos = eos;
+        m_output_cv.notify_one();
+    }
+
+    void flush_start()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flushing = true;
+        clear_unlocked();
+        m_room_cv.notify_all();
+        m_sub_cv.notify_all();
+    }
+
+    void flush_stop()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_flushing = false;
+        m_sub_eos = false;
+        m_flow_return = GST_FLOW_OK;
+    }
+};
+
 static gboolean gst_hailoaggregator_sink_query(GstPad *pad,
                                                  GstObject *parent, GstQuery *query)
 {
@@ -240,6 +537,20 @@ gst_hailoaggregator_sink_event(GstPad *pad, GstObject *parent, GstEvent *event)
 
     GST_DEBUG_OBJECT(pad, "received event %" GST_PTR_FORMAT, event);
 
+    if (hailoaggregator->window)
+    {
+        if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_START)
+            hailoaggregator->window->flush_start();
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+            hailoaggregator->window->flush_stop();
+        else if (GST_EVENT_TYPE(event) == GST_EVENT_EOS && pad == hailoaggregator->sinkpad_sub)
+            hailoaggregator->window->set_sub_eos(true);
+
+        // Frames still waiting for crops must be pushed before any serialized event of the main stream
+        if (pad == hailoaggregator->sinkpad_main && GST_EVENT_IS_SERIALIZED(event))
+            hailoaggregator->window->drain();
+    }
+
     if (GST_EVENT_IS_STICKY(event))
     {
         unlock = TRUE;
@@ -300,6 +611,14 @@ gst_hailoaggregator_chain_sub(GstPad *pad, GstObject *parent, GstBuffer *buf)
     GstHailoAggregator *hailoaggregator = GST_HAILO_AGGREGATOR_CAST(parent);
     GstHailoAggregatorClass *hailoaggregator_class = GST_HAILO_AGGREGATOR_GET_CLASS(hailoaggregator);
 
+    if (hailoaggregator->window)
+    {
+        hailoaggregator->window->add_sub_frame(buf);
+        gst_buffer_remove_hailo_meta(buf);
+        gst_buffer_unref(buf);
+        return GST_FLOW_OK;
+    }
+
     std::unique_lock<std::mutex> lock(hailoaggregator->mutex);
 
     // Wait until main frame is not null & the offset of main frame is not smaller.
@@ -331,13 +650,13 @@ gst_hailoaggregator_chain_sub(GstPad *pad, GstObject *parent, GstBuffer *buf)
 static GstFlowReturn
 gst_hailoaggregator_chain_main(GstPad *pad, GstObject *parent, GstBuffer *buf)
 {
-    GstFlowReturn ret = GST_FLOW_ERROR;
     GstHailoAggregator *hailoaggregator = GST_HAILO_AGGREGATOR_CAST(parent);
-    GstHailoAggregatorClass *hailoaggregator_class = GST_HAILO_AGGREGATOR_GET_CLASS(hailoaggregator);
-    std::unique_lock<std::mutex> lock(hailoaggregator->mutex);
 
-    // Get excpected frames from the main frame ROI
-    HailoROIPtr hailo_roi = get_hailo_main_roi(buf);
+    // Aggregate in the window, the frame is pushed by its output thread once its crops returned
+    if (hailoaggregator->window)
+        return hailoaggregator->window->submit(buf);
+
+    std::unique_lock<std::mutex> lock(hailoaggregator->mutex);
 
     hailoaggregator->expected_frames = gst_buffer_get_hailo_cropping_meta(buf)->num_of_crops;
 
@@ -350,20 +669,7 @@ gst_hailoaggregator_chain_main(GstPad *pad, GstObject *parent, GstBuffer *buf)
     }
     lock.unlock();
 
-    
-    hailoaggregator_class->handle_main_roi_post_aggregation(hailoaggregator, hailo_roi);
-
-    gst_pad_sticky_events_foreach(hailoaggregator->sinkpad_main, forward_events, hailoaggregator->srcpad);
-
-    // Remove the cropping meta from the main frame.
-    if (! gst_buffer_remove_hailo_cropping_meta(buf))
-    {
-        GST_ERROR_OBJECT(hailoaggregator, "Failed to remove cropping meta from main frame");
-    }
-
-    // Push main buffer into the src pad.
-    ret = gst_pad_push(hailoaggregator->srcpad, buf);
-    return ret;
+    return gst_hailoaggregator_push_main(hailoaggregator, buf);
 }
 
 /**
@@ -405,12 +711,20 @@ gst_hailoaggregator_change_state(GstElement *element, GstStateChange transition)
     GstHailoAggregator *aggregator = GST_HAILO_AGGREGATOR(element);
     switch (transition)
     {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    {
+        if (aggregator->max_in_flight > 1 || aggregator->latency_deadline > 0)
+            aggregator->window = new HailoAggregatorWindow(aggregator, aggregator->max_in_flight, aggregator->latency_deadline);
+        break;
+    }
     case GST_STATE_CHANGE_PAUSED_TO_READY:
     {
         // Unlocking both condition variables in order to finish the chain function.
         // After that the pads can be freed by the change_state of base class.
         aggregator->cv_main.notify_all();
         aggregator->cv_sub.notify_all();
+        if (aggregator->window)
+            aggregator->window->stop();
         break;
     }
     default:
@@ -422,5 +736,12 @@ gst_hailoaggregator_change_state(GstElement *element, GstStateChange transition)
     if (ret == GST_STATE_CHANGE_FAILURE)
         return ret;
 
+    // The pads are deactivated, no chain function can use the window anymore
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY && aggregator->window)
+    {
+        delete aggregator->window;
+        aggregator->window = nullptr;
+    }
+
     return ret;
 }
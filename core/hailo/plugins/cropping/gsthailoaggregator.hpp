@@ -33,6 +33,7 @@ G_BEGIN_DECLS
 
 typedef struct _GstHailoAggregator GstHailoAggregator;
 typedef struct _GstHailoAggregatorClass GstHailoAggregatorClass;
+class HailoAggregatorWindow;
 
 struct _GstHailoAggregator
 {
@@ -49,6 +50,9 @@ struct _GstHailoAggregator
     uint expected_frames;
     uint last_offset;
     gboolean flatten_detections;
+    uint max_in_flight;
+    uint latency_deadline;
+    HailoAggregatorWindow *window; // Pending main frames, used when more than one frame may be in flight
 
     std::mutex mutex;
     std::condition_variable cv_main;
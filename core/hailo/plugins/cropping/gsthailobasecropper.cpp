@@ -33,6 +33,8 @@ enum
     PROP_DROP_UNCROPPED_BUFFERS,
     PROP_CROPPING_PERIOD,
     PROP_FILTER_STREAMS,
+    PROP_BATCH_CROPS,
+    PROP_CROP_THREADS,
 #ifdef HAILO15_TARGET
     PROP_USE_DSP,
     PROP_POOL_SIZE,
@@ -119,6 +121,16 @@ gst_hailo_basecropper_class_init(GstHailoBaseCropperClass *klass)
                                                                              "Filter stream", "",
                                                                              (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)),
                                                          (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_BATCH_CROPS,
+                                    g_param_spec_boolean("batch-crops", "Batch Crops",
+                                                         "If true, all the crops of a frame are prepared and processed together (OpenCV crops run on a pool of worker threads, DSP crops are submitted back to back), "
+                                                         "and then pushed in ROI order. Default false.", false,
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_CROP_THREADS,
+                                    g_param_spec_uint("crop-threads", "Crop Threads",
+                                                      "Number of threads (including the streaming thread) used for batched OpenCV crops. 0 uses one thread per CPU core. Default 0",
+                                                      0, G_MAXINT, 0,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
 #ifdef HAILO15_TARGET
     g_object_class_install_property(gobject_class, PROP_USE_DSP,
@@ -171,6 +183,9 @@ gst_hailo_basecropper_init(GstHailoBaseCropper *hailo_basecropper)
     hailo_basecropper->use_internal_offset = false;
     hailo_basecropper->internal_offset = 0;
     hailo_basecropper->cropping_period = 1;
+    hailo_basecropper->batch_crops = false;
+    hailo_basecropper->crop_threads = 0;
+    hailo_basecropper->worker_pool = nullptr;
     hailo_basecropper->num_streams_to_filter = 0;
     hailo_basecropper->drop_uncropped_buffers = false;
     hailo_basecropper->buffer_pool = NULL;
@@ -204,6 +219,13 @@ static void gst_hailo_basecropper_dispose(GObject *object)
         hailo_basecropper->buffer_pool = NULL;
     }
 
+    if (hailo_basecropper->worker_pool)
+    {
+        GST_DEBUG_OBJECT(hailo_basecropper, "Stopping crop worker threads");
+        delete hailo_basecropper->worker_pool;
+        hailo_basecropper->worker_pool = nullptr;
+    }
+
     G_OBJECT_CLASS(gst_hailo_basecropper_parent_class)->dispose(object);
 }
 
@@ -301,6 +323,12 @@ gst_hailo_basecropper_set_property(GObject *object, guint prop_id,
     case PROP_FILTER_STREAMS:
         set_filter_streams(hailo_basecropper, value);
         break;
+    case PROP_BATCH_CROPS:
+        hailo_basecropper->batch_crops = g_value_get_boolean(value);
+        break;
+    case PROP_CROP_THREADS:
+        hailo_basecropper->crop_threads = g_value_get_uint(value);
+        break;
 #ifdef HAILO15_TARGET
     case PROP_USE_DSP:
         hailo_basecropper->use_dsp = g_value_get_boolean(value);
@@ -335,6 +363,12 @@ gst_hailo_basecropper_get_property(GObject *object, guint prop_id,
     case PROP_FILTER_STREAMS:
         get_filter_streams(hailo_basecropper, value);
         break;
+    case PROP_BATCH_CROPS:
+        g_value_set_boolean(value, hailo_basecropper->batch_crops);
+        break;
+    case PROP_CROP_THREADS:
+        g_value_set_uint(value, hailo_basecropper->crop_threads);
+        break;
 #ifdef HAILO15_TARGET
     case PROP_USE_DSP:
         g_value_set_boolean(value, hailo_basecropper->use_dsp);
@@ -797,6 +831,286 @@ static GstBuffer *handle_one_crop(GstHailoBaseCropper *hailo_basecropper, GstBuf
     return output_buffer;
 }
 
+/**
+ * A single crop of a batch, prepared by handle_crops_batched.
+ * resized_image is null when the crop is the whole input buffer and needs no resize.
+ */
+typedef struct
+{
+    HailoROIPtr crop_roi;
+    GstBuffer *output_buffer;
+    std::shared_ptr<HailoMat> resized_image;
+} CropJob;
+
+#ifdef HAILO15_TARGET
+/**
+ * Crop and resize all the jobs of a frame on the DSP.
+ * The input frame is mapped, and its DSP image properties are built, once for the whole batch,
+ * and the crop commands are then submitted back to back.
+ *
+ * @param[in] hailo_basecropper  Cropping element.
+ * @param[in] input_buffer       Buffer to crop from.
+ * @param[in] input_video_info   Video info of the input buffer.
+ * @param[in] jobs               Crops to perform, jobs without a resized image are skipped.
+ * @param[in] output_video_info  Video info of the output buffers.
+ * @return boolean, whether all the crops were successful.
+ */
+static gboolean dsp_crop_and_resize_batch(GstHailoBaseCropper *hailo_basecropper, GstBuffer *input_buffer, GstVideoInfo *input_video_info,
+                                          std::vector<CropJob> &jobs, GstVideoInfo *output_video_info)
+{
+    GstVideoFrame input_video_frame;
+    if (!gst_video_frame_map(&input_video_frame, input_video_info, input_buffer, GST_MAP_READ))
+    {
+        GST_ERROR_OBJECT(hailo_basecropper, "Cannot map input buffer to frame");
+        return FALSE;
+    }
+    int input_width = GST_VIDEO_INFO_WIDTH(input_video_info);
+    int input_height = GST_VIDEO_INFO_HEIGHT(input_video_info);
+    dsp_image_properties_t input_image_properties = create_image_properties_from_video_frame(&input_video_frame);
+    dsp_interpolation_type_t interpolation = get_dsp_interpolation_type_from_cv(hailo_basecropper, cv::InterpolationFlags::INTER_LINEAR);
+    std::shared_ptr<HailoMat> full_image = get_mat_by_format(input_buffer, input_video_info);
+
+    gboolean ret = TRUE;
+    for (CropJob &job : jobs)
+    {
+        if (!job.resized_image)
+            continue;
+
+        GstVideoFrame output_video_frame;
+        if (!gst_video_frame_map(&output_video_frame, output_video_info, job.output_buffer, GST_MAP_READWRITE))
+        {
+            GST_ERROR_OBJECT(hailo_basecropper, "Cannot map output buffer to frame");
+            ret = FALSE;
+            break;
+        }
+
+        cv::Rect crop_rect = full_image->get_crop_rect(job.crop_roi);
+        crop_resize_dims_t crop_resize_dims = {
+            .perform_crop = 1,
+            .crop_start_x = (size_t)crop_rect.x,
+            .crop_end_x = (size_t)crop_rect.x + crop_rect.width,
+            .crop_start_y = (size_t)crop_rect.y,
+            .crop_end_y = (size_t)crop_rect.y + crop_rect.height,
+            .destination_width = (size_t)job.resized_image->native_width(),
+            .destination_height = (size_t)job.resized_image->native_height(),
+        };
+        // If the crop rect is the same as the input image (whole buffer), we request a resize only
+        if (crop_rect.x == 0 && crop_rect.y == 0 && crop_rect.width == input_width && crop_rect.height == input_height)
+            crop_resize_dims.perform_crop = 0;
+
+        dsp_image_properties_t output_image_properties = create_image_properties_from_video_frame(&output_video_frame);
+        dsp_status result = perform_dsp_crop_and_resize(&input_image_properties, &output_image_properties, crop_resize_dims, interpolation);
+        free_image_property_planes(&output_image_properties);
+        gst_video_frame_unmap(&output_video_frame);
+
+        if (result != DSP_SUCCESS)
+        {
+            GST_ERROR_OBJECT(hailo_basecropper, "Failed to perform dsp resize. return status: %d", result);
+            ret = FALSE;
+            break;
+        }
+    }
+
+    free_image_property_planes(&input_image_properties);
+    gst_video_frame_unmap(&input_video_frame);
+    return ret;
+}
+#endif
+
+/**
+ * Crop and resize all the jobs of a frame with OpenCV, spread over the element's worker pool.
+ * The streaming thread takes part in the work, so a pool of 1 thread behaves like the serial path.
+ *
+ * @param[in] hailo_basecropper  Cropping element.
+ * @param[in] input_buffer       Buffer to crop from.
+ * @param[in] input_video_info   Video info of the input buffer.
+ * @param[in] jobs               Crops to perform, jobs without a resized image are skipped.
+ * @return boolean, whether all the crops were successful.
+ */
+static gboolean opencv_crop_and_resize_batch(GstHailoBaseCropper *hailo_basecropper, GstBuffer *input_buffer, GstVideoInfo *input_video_info,
+                                             std::vector<CropJob> &jobs)
+{
+    if (!hailo_basecropper->worker_pool)
+    {
+        hailo_basecropper->worker_pool = new HailoWorkerPool(hailo_basecropper->crop_threads);
+        GST_INFO_OBJECT(hailo_basecropper, "Started crop worker pool with %u threads", hailo_basecropper->worker_pool->num_threads());
+    }
+
+    std::shared_ptr<HailoMat> full_image = get_mat_by_format(input_buffer, input_video_info);
+    hailo_basecropper->worker_pool->parallel_for(jobs.size(), [&](std::size_t i)
+                                                 {
+                                                     if (jobs[i].resized_image)
+                                                         opencv_crop_and_resize(hailo_basecropper, jobs[i].resized_image, full_image, input_video_info, jobs[i].crop_roi); });
+    return TRUE;
+}
+
+/**
+ * The number of crops that can be allocated together. DSP crops are acquired from the
+ * buffer pool, which blocks once all of its buffers are out: a batch can't hold more
+ * buffers than the pool has, or it would wait forever for buffers that only it can release.
+ *
+ * @param[in] hailo_basecropper  Cropping element.
+ * @param[in] num_crops          Number of crops of the frame.
+ * @return the batch size, at least 1.
+ */
+static size_t get_crops_batch_size(GstHailoBaseCropper *hailo_basecropper, size_t num_crops)
+{
+    size_t batch_size = num_crops;
+#ifdef HAILO15_TARGET
+    if (hailo_basecropper->use_dsp && hailo_basecropper->buffer_pool)
+    {
+        guint max_buffers = 0;
+        GstStructure *config = gst_buffer_pool_get_config(hailo_basecropper->buffer_pool);
+        gst_buffer_pool_config_get_params(config, NULL, NULL, NULL, &max_buffers);
+        gst_structure_free(config);
+        // A max of 0 means the pool is unlimited
+        if (max_buffers > 0)
+            batch_size = std::min(batch_size, (size_t)max_buffers);
+    }
+#endif
+    return std::max(batch_size, (size_t)1);
+}
+
+/**
+ * Allocates, crops and pushes one batch of crops of a frame: every output buffer is
+ * allocated first, all the crops are then performed together, and finally the buffers
+ * are pushed in ROI order.
+ *
+ * @param[in] hailo_basecropper   Cropping element.
+ * @param[in] buf                 Buffer to crop.
+ * @param[in] full_image_info     Video info of buf.
+ * @param[in] resized_image_info  Video info of the crop buffers.
+ * @param[in] buffer_size         Size of the crop buffers.
+ * @param[in] first               First crop of the batch.
+ * @param[in] last                End of the batch.
+ * @return boolean, whether all cropping were successful.
+ */
+static gboolean handle_crops_batch(GstHailoBaseCropper *hailo_basecropper, GstBuffer *buf, GstVideoInfo *full_image_info, GstVideoInfo *resized_image_info, size_t buffer_size,
+                                   std::vector<HailoROIPtr>::iterator first, std::vector<HailoROIPtr>::iterator last)
+{
+    bool input_res_equals_output_res = (full_image_info->width == resized_image_info->width && full_image_info->height == resized_image_info->height);
+
+    // Allocate all the output buffers of the batch
+    gboolean ret = TRUE;
+    size_t num_crops = std::distance(first, last);
+    std::vector<CropJob> jobs;
+    jobs.reserve(num_crops);
+    for (auto it = first; it != last; ++it)
+    {
+        HailoROIPtr &crop_roi = *it;
+        HailoBBox roi_bbox = crop_roi->get_bbox();
+        bool crop_roi_is_whole_buffer = (roi_bbox.width() == 1.0f && roi_bbox.height() == 1.0f && roi_bbox.xmin() == 0.0f && roi_bbox.ymin() == 0.0f);
+        if (crop_roi_is_whole_buffer && input_res_equals_output_res)
+        {
+            jobs.push_back({crop_roi, gst_buffer_ref(buf), nullptr});
+            continue;
+        }
+        GstBuffer *output_buffer = gst_hailo_basecropper_allocate_new_buffer(hailo_basecropper, buffer_size);
+        if (!output_buffer)
+        {
+            GST_ERROR_OBJECT(hailo_basecropper, "Failed to allocate crop buffer %zu of %zu", jobs.size(), num_crops);
+            ret = FALSE;
+            break;
+        }
+        jobs.push_back({crop_roi, output_buffer, get_mat_by_format(output_buffer, resized_image_info)});
+    }
+    GST_DEBUG_OBJECT(hailo_basecropper, "Batch of %zu crops allocated", jobs.size());
+
+    // Crop and resize the whole batch
+    if (ret)
+    {
+        try
+        {
+#ifdef HAILO15_TARGET
+            if (hailo_basecropper->use_dsp)
+                ret = dsp_crop_and_resize_batch(hailo_basecropper, buf, full_image_info, jobs, resized_image_info);
+            else
+                ret = opencv_crop_and_resize_batch(hailo_basecropper, buf, full_image_info, jobs);
+#else
+            ret = opencv_crop_and_resize_batch(hailo_basecropper, buf, full_image_info, jobs);
+#endif
+        }
+        catch (const std::exception &e)
+        {
+            GST_ERROR_OBJECT(hailo_basecropper, "Batched crop and resize failed: %s", e.what());
+            ret = FALSE;
+        }
+    }
+
+    // Push the cropped buffers into the crop src pad, in ROI order
+    for (CropJob &job : jobs)
+    {
+        job.resized_image.reset();
+        if (!ret)
+        {
+            gst_buffer_unref(job.output_buffer);
+            continue;
+        }
+        gst_buffer_add_hailo_meta(job.output_buffer, job.crop_roi);
+        job.output_buffer->offset = buf->offset;
+        gst_pad_push(hailo_basecropper->srcpad_crop, job.output_buffer);
+    }
+    return ret;
+}
+
+/**
+ * Creates new crop buffers from given HailoROIs, processing the crops of the frame in batches
+ * (as many as the buffer pool allows, the whole frame when it doesn't limit them). The buffers
+ * are pushed in ROI order (as handle_crops does), so hailoaggregator sees exactly the same
+ * stream of crops.
+ *
+ * @param[in] hailo_basecropper cropping element.
+ * @param[in] buf               Buffer to crop.
+ * @param[in] crop_rois         Vector of HailoROI of buf to crop from.
+ * @return boolean, whether all cropping were successful.
+ */
+static gboolean handle_crops_batched(GstHailoBaseCropper *hailo_basecropper, GstBuffer *buf, std::vector<HailoROIPtr> &crop_rois)
+{
+    if (!gst_pad_is_active(hailo_basecropper->srcpad_crop))
+    {
+        GST_INFO_OBJECT(hailo_basecropper, "Crop src pad is not active, dropping buffer");
+        return TRUE;
+    }
+
+    GstCaps *incaps = gst_pad_get_current_caps(hailo_basecropper->sinkpad);
+    if (!incaps)
+    {
+        GST_ERROR_OBJECT(hailo_basecropper, "Failed to get input CAPS from sinkpad");
+        return FALSE;
+    }
+    GstCaps *outcaps = gst_pad_get_current_caps(hailo_basecropper->srcpad_crop);
+    if (!outcaps)
+    {
+        GST_ERROR_OBJECT(hailo_basecropper, "Failed to get output CAPS from srcpad (crop)");
+        gst_caps_unref(incaps);
+        return FALSE;
+    }
+
+    GstVideoInfo *full_image_info = gst_video_info_new();
+    gst_video_info_from_caps(full_image_info, incaps);
+    GstVideoInfo *resized_image_info = gst_video_info_new();
+    gst_video_info_from_caps(resized_image_info, outcaps);
+    size_t buffer_size = get_size(outcaps);
+
+    gboolean ret = TRUE;
+    size_t batch_size = get_crops_batch_size(hailo_basecropper, crop_rois.size());
+    for (size_t first = 0; ret && first < crop_rois.size(); first += batch_size)
+    {
+        size_t last = std::min(first + batch_size, crop_rois.size());
+        ret = handle_crops_batch(hailo_basecropper, buf, full_image_info, resized_image_info, buffer_size,
+                                 crop_rois.begin() + first, crop_rois.begin() + last);
+    }
+
+    gst_video_info_free(full_image_info);
+    gst_video_info_free(resized_image_info);
+    gst_caps_unref(incaps);
+    gst_caps_unref(outcaps);
+
+    if (!ret)
+        GST_WARNING_OBJECT(hailo_basecropper, "Could not crop buffer with offset %jd", buf->offset);
+    return ret;
+}
+
 /**
  * Creates new crop buffers from given HailoROIs
  *
@@ -807,6 +1121,9 @@ static GstBuffer *handle_one_crop(GstHailoBaseCropper *hailo_basecropper, GstBuf
  */
 static gboolean handle_crops(GstHailoBaseCropper *hailo_basecropper, GstBuffer *buf, std::vector<HailoROIPtr> &crop_rois)
 {
+    if (hailo_basecropper->batch_crops)
+        return handle_crops_batched(hailo_basecropper, buf, crop_rois);
+
     for (HailoROIPtr &crop_roi : crop_rois)
     {
         if (!gst_pad_is_active(hailo_basecropper->srcpad_crop))
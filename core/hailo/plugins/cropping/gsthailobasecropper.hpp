@@ -8,6 +8,7 @@
 #include <gst/video/video-format.h>
 #include <opencv2/opencv.hpp>
 #include "hailo_objects.hpp"
+#include "common/worker_pool.hpp"
 
 G_BEGIN_DECLS
 
@@ -35,6 +36,9 @@ struct _GstHailoBaseCropper
     gboolean drop_uncropped_buffers;
     uint internal_offset;
     uint cropping_period;
+    gboolean batch_crops;
+    uint crop_threads;
+    HailoWorkerPool *worker_pool;
     #ifdef HAILO15_TARGET
     bool use_dsp;
     guint bufferpool_max_size;
@@ -0,0 +1,268 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+#pragma once
+
+// General cpp includes
+#include <vector>
+
+// Tappas includes
+#include "hailo_objects.hpp"
+#include "hailo_common.hpp"
+#include "common/hailo_binary_format.hpp"
+
+namespace encode_binary
+{
+    void encode_bbox(HailoBinaryWriter &writer, HailoBBox bbox);
+    void encode_detection(HailoBinaryWriter &writer, HailoDetectionPtr detection, bool with_tensors);
+    void encode_classification(HailoBinaryWriter &writer, HailoClassificationPtr classification);
+    void encode_landmarks(HailoBinaryWriter &writer, HailoLandmarksPtr landmarks);
+    void encode_tile(HailoBinaryWriter &writer, HailoTileROIPtr tile, bool with_tensors);
+    void encode_unique_id(HailoBinaryWriter &writer, HailoUniqueIDPtr id);
+    void encode_matrix(HailoBinaryWriter &writer, HailoMatrixPtr matrix);
+    void encode_tensors(HailoBinaryWriter &writer, HailoROIPtr roi, bool with_tensors);
+    void encode_hailo_objects(HailoBinaryWriter &writer, HailoROIPtr roi, bool with_tensors);
+}
+
+namespace encode_binary
+{
+    inline void encode_bbox(HailoBinaryWriter &writer, HailoBBox bbox)
+    {
+        writer.write<float>(bbox.xmin());
+        writer.write<float>(bbox.ymin());
+        writer.write<float>(bbox.width());
+        writer.write<float>(bbox.height());
+    }
+
+    inline void encode_detection(HailoBinaryWriter &writer, HailoDetectionPtr detection, bool with_tensors)
+    {
+        encode_bbox(writer, detection->get_bbox());
+        writer.write<float>(detection->get_confidence());
+        writer.write<int32_t>(detection->get_class_id());
+        writer.write_string(detection->get_label());
+
+        // Recurse this object
+        encode_hailo_objects(writer, detection, with_tensors);
+        encode_tensors(writer, detection, with_tensors);
+    }
+
+    inline void encode_classification(HailoBinaryWriter &writer, HailoClassificationPtr classification)
+    {
+        writer.write<float>(classification->get_confidence());
+        writer.write<int32_t>(classification->get_class_id());
+        writer.write_string(classification->get_classification_type());
+        writer.write_string(classification->get_label());
+    }
+
+    inline void encode_landmarks(HailoBinaryWriter &writer, HailoLandmarksPtr landmarks)
+    {
+        writer.write<float>(landmarks->get_threshold());
+        writer.write_string(landmarks->get_landmarks_type());
+
+        std::vector<HailoPoint> points = landmarks->get_points();
+        writer.write<uint32_t>(points.size());
+        for (HailoPoint &point : points)
+        {
+            writer.write<float>(point.x());
+            writer.write<float>(point.y());
+            writer.write<float>(point.confidence());
+        }
+
+        std::vector<std::pair<int, int>> pairs = landmarks->get_pairs();
+        writer.write<uint32_t>(pairs.size());
+        for (auto &pair : pairs)
+        {
+            writer.write<int32_t>(pair.first);
+            writer.write<int32_t>(pair.second);
+        }
+    }
+
+    inline void encode_tile(HailoBinaryWriter &writer, HailoTileROIPtr tile, bool with_tensors)
+    {
+        encode_bbox(writer, tile->get_bbox());
+        writer.write<uint32_t>(tile->get_index());
+        writer.write<uint32_t>(tile->get_layer());
+        writer.write<uint32_t>(tile->get_mode());
+        writer.write<float>(tile->get_overlap_x_axis());
+        writer.write<float>(tile->get_overlap_y_axis());
+
+        // Recurse this object
+        encode_hailo_objects(writer, tile, with_tensors);
+        encode_tensors(writer, tile, with_tensors);
+    }
+
+    inline void encode_unique_id(HailoBinaryWriter &writer, HailoUniqueIDPtr id)
+    {
+        writer.write<int32_t>(id->get_id());
+        writer.write<int32_t>(id->get_mode());
+    }
+
+    template <class T>
+    void encode_mask(HailoBinaryWriter &writer, T mask)
+    {
+        writer.write<int32_t>(mask->get_width());
+        writer.write<int32_t>(mask->get_height());
+        writer.write<float>(mask->get_transparency());
+    }
+
+    inline void encode_matrix(HailoBinaryWriter &writer, HailoMatrixPtr matrix)
+    {
+        writer.write<uint32_t>(matrix->width());
+        writer.write<uint32_t>(matrix->height());
+        writer.write<uint32_t>(matrix->features());
+        const std::vector<float> &data = matrix->get_data();
+        writer.write_array(data.data(), data.size());
+    }
+
+    /**
+     * @brief Size in bytes of one element of a tensor, 0 for formats that are not exported.
+     */
+    inline size_t tensor_element_size(HailoTensorPtr tensor)
+    {
+        if (tensor->vstream_info().format.order == HAILO_FORMAT_ORDER_HAILO_NMS)
+            return 0;
+        switch (tensor->vstream_info().format.type)
+        {
+        case HAILO_FORMAT_TYPE_UINT8:
+            return sizeof(uint8_t);
+        case HAILO_FORMAT_TYPE_UINT16:
+            return sizeof(uint16_t);
+        case HAILO_FORMAT_TYPE_FLOAT32:
+            return sizeof(float);
+        default:
+            return 0;
+        }
+    }
+
+    inline void encode_tensors(HailoBinaryWriter &writer, HailoROIPtr roi, bool with_tensors)
+    {
+        size_t count_position = writer.reserve_u32();
+        if (!with_tensors)
+            return;
+
+        uint32_t count = 0;
+        for (HailoTensorPtr &tensor : roi->get_tensors())
+        {
+            size_t element_size = tensor_element_size(tensor);
+            if (element_size == 0)
+                continue;
+            hailo_vstream_info_t &info = tensor->vstream_info();
+            writer.write_string(tensor->name());
+            writer.write<uint32_t>(info.format.type);
+            writer.write<uint32_t>(info.format.order);
+            writer.write<uint32_t>(info.format.flags);
+            writer.write<uint32_t>(tensor->height());
+            writer.write<uint32_t>(tensor->width());
+            writer.write<uint32_t>(tensor->features());
+            writer.write<float>(info.quant_info.qp_zp);
+            writer.write<float>(info.quant_info.qp_scale);
+            writer.write<float>(info.quant_info.limvals_min);
+            writer.write<float>(info.quant_info.limvals_max);
+            size_t data_size = tensor->size() * element_size;
+            writer.write<uint32_t>(data_size);
+            writer.pad(8);
+            writer.write_bytes(tensor->data(), data_size);
+            writer.pad(4);
+            count++;
+        }
+        writer.patch(count_position, count);
+    }
+
+    inline void encode_hailo_objects(HailoBinaryWriter &writer, HailoROIPtr roi, bool with_tensors)
+    {
+        size_t count_position = writer.reserve_u32();
+        uint32_t count = 0;
+        for (auto obj : roi->get_objects())
+        {
+            hailo_object_t type = obj->get_type();
+            writer.write<uint32_t>(type);
+            size_t size_position = writer.reserve_u32();
+            size_t body_start = writer.position();
+            switch (type)
+            {
+            case HAILO_DETECTION:
+                encode_detection(writer, std::dynamic_pointer_cast<HailoDetection>(obj), with_tensors);
+                break;
+            case HAILO_CLASSIFICATION:
+                encode_classification(writer, std::dynamic_pointer_cast<HailoClassification>(obj));
+                break;
+            case HAILO_LANDMARKS:
+                encode_landmarks(writer, std::dynamic_pointer_cast<HailoLandmarks>(obj));
+                break;
+            case HAILO_TILE:
+                encode_tile(writer, std::dynamic_pointer_cast<HailoTileROI>(obj), with_tensors);
+                break;
+            case HAILO_UNIQUE_ID:
+                encode_unique_id(writer, std::dynamic_pointer_cast<HailoUniqueID>(obj));
+                break;
+            case HAILO_DEPTH_MASK:
+            {
+                HailoDepthMaskPtr mask = std::dynamic_pointer_cast<HailoDepthMask>(obj);
+                encode_mask(writer, mask);
+                writer.write_array(mask->get_data().data(), mask->get_data().size());
+                break;
+            }
+            case HAILO_CLASS_MASK:
+            {
+                HailoClassMaskPtr mask = std::dynamic_pointer_cast<HailoClassMask>(obj);
+                encode_mask(writer, mask);
+                writer.write_array(mask->get_data().data(), mask->get_data().size());
+                break;
+            }
+            case HAILO_CONF_CLASS_MASK:
+            {
+                HailoConfClassMaskPtr mask = std::dynamic_pointer_cast<HailoConfClassMask>(obj);
+                encode_mask(writer, mask);
+                writer.write<int32_t>(mask->get_class_id());
+                writer.write_array(mask->get_data().data(), mask->get_data().size());
+                break;
+            }
+            case HAILO_MATRIX:
+                encode_matrix(writer, std::dynamic_pointer_cast<HailoMatrix>(obj));
+                break;
+            default:
+                // Not exported, the record is left empty
+                break;
+            }
+            writer.patch(size_position, writer.position() - body_start);
+            count++;
+        }
+        writer.patch(count_position, count);
+    }
+
+    /**
+     * @brief Encode a whole HailoROI tree into a binary message.
+     *
+     * @param out  -  std::vector<uint8_t>
+     *        The message, cleared first. Its capacity is reused.
+     *
+     * @param roi  -  HailoROIPtr
+     * @param timestamp  -  int64_t
+     *        Timestamp in ms.
+     * @param buffer_offset  -  uint64_t
+     *
+     * @param with_tensors  -  bool
+     *        Also encode the output tensors attached to the ROIs.
+     */
+    inline void encode_hailo_roi(std::vector<uint8_t> &out, HailoROIPtr roi, int64_t timestamp, uint64_t buffer_offset,
+                                 bool with_tensors = false)
+    {
+        out.clear();
+        HailoBinaryWriter writer(out);
+
+        HailoBinaryHeader header = {};
+        std::memcpy(header.magic, HAILO_BINARY_MAGIC, sizeof(header.magic));
+        header.version = HAILO_BINARY_VERSION;
+        header.header_size = sizeof(HailoBinaryHeader);
+        header.timestamp = timestamp;
+        header.buffer_offset = buffer_offset;
+        writer.write(header);
+
+        encode_bbox(writer, roi->get_bbox());
+        encode_hailo_objects(writer, roi, with_tensors);
+        encode_tensors(writer, roi, with_tensors);
+
+        writer.patch(offsetof(HailoBinaryHeader, payload_size), writer.position() - sizeof(HailoBinaryHeader));
+    }
+}
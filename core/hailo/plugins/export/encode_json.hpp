@@ -188,7 +188,7 @@ namespace encode_json
         entry_object.AddMember( "transparency", transparency, allocator );
 
         rapidjson::Value data_array(rapidjson::kArrayType);
-        auto data = mask->get_data();
+        const auto &data = mask->get_data();
         for (uint i=0; i < data.size(); i++)
             data_array.PushBack(rapidjson::Value(data[i]), allocator);
         entry_object.AddMember( "data", data_array, allocator );
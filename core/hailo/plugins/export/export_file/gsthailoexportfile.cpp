@@ -5,9 +5,17 @@
 #include "gsthailoexportfile.hpp"
 #include "gst_hailo_meta.hpp"
 #include "hailo/hailort.h"
+#include "export/encode_binary.hpp"
+#include "import/decode_binary.hpp"
 #include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <ctime>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gst/video/video.h>
 #include <gst/gst.h>
 
@@ -22,6 +30,9 @@
 GST_DEBUG_CATEGORY_STATIC(gst_hailoexportfile_debug_category);
 #define GST_CAT_DEFAULT gst_hailoexportfile_debug_category
 
+#define DEFAULT_QUEUE_SIZE (64)
+#define FILE_BUFFER_SIZE (1 << 20)
+
 /* prototypes */
 
 static void gst_hailoexportfile_set_property(GObject *object,
@@ -33,6 +44,7 @@ static void gst_hailoexportfile_finalize(GObject *object);
 
 static gboolean gst_hailoexportfile_start(GstBaseTransform *trans);
 static gboolean gst_hailoexportfile_stop(GstBaseTransform *trans);
+static gboolean gst_hailoexportfile_sink_event(GstBaseTransform *trans, GstEvent *event);
 static GstFlowReturn gst_hailoexportfile_transform_ip(GstBaseTransform *trans,
                                                    GstBuffer *buffer);
 
@@ -46,6 +58,384 @@ enum
 {
     PROP_0,
     PROP_FIlE_PATH,
+    PROP_FORMAT,
+    PROP_QUEUE_SIZE,
+    PROP_DROP_WHEN_FULL,
+    PROP_MAX_FILE_SIZE,
+    PROP_MAX_FILE_DURATION,
+};
+
+#define GST_TYPE_HAILO_EXPORT_FILE_FORMAT (gst_hailoexportfile_format_get_type())
+static GType
+gst_hailoexportfile_format_get_type(void)
+{
+    static GType hailoexportfile_format_type = 0;
+    static const GEnumValue hailoexportfile_formats[] = {
+        {HAILO_EXPORT_FILE_FORMAT_JSON, "One JSON array, valid after every write", "json"},
+        {HAILO_EXPORT_FILE_FORMAT_JSON_LINES, "One compact JSON object per line", "json-lines"},
+        {HAILO_EXPORT_FILE_FORMAT_BINARY, "Concatenated binary messages, see hailo_binary_format.hpp", "binary"},
+        {0, NULL, NULL},
+    };
+    if (!hailoexportfile_format_type)
+    {
+        hailoexportfile_format_type =
+            g_enum_register_static("GstHailoExportFileFormat", hailoexportfile_formats);
+    }
+    return hailoexportfile_format_type;
+}
+
+/**
+ * A frame waiting to be written. The ROI is encoded to the binary format on the streaming thread,
+ * which is cheap and leaves the writer thread its own copy, whatever happens to the buffer later.
+ */
+struct HailoExportFileEntry
+{
+    std::vector<uint8_t> message;
+    std::string stream_id;
+};
+
+/**
+ * Writes the exported frames to disk from a background thread.
+ * Frames are queued by the streaming thread and written in batches through a large stdio buffer,
+ * the JSON formats are serialized on the writer thread as well.
+ * The output is split into several files when a size or duration limit is set.
+ */
+class HailoExportFileWriter
+{
+private:
+    GstHailoExportFile *m_element;
+    std::string m_location;
+    hailo_export_file_format_t m_format;
+    size_t m_queue_size;
+    bool m_drop_when_full;
+    guint64 m_max_file_size;
+    std::chrono::seconds m_max_file_duration;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<HailoExportFileEntry> m_queue;
+    std::vector<HailoExportFileEntry> m_free; // Written entries, their buffers are reused
+    bool m_writing = false;                   // The writer thread holds a batch
+    bool m_stop = false;
+    bool m_failed = false;
+    guint64 m_dropped = 0;
+    std::thread m_thread;
+
+    // Writer thread only
+    FILE *m_file = nullptr;
+    std::vector<char> m_file_buffer;
+    uint m_file_index = 0;
+    guint64 m_file_bytes = 0;
+    uint m_file_entries = 0;
+    bool m_file_terminated = false; // The JSON array is closed, the next entry overwrites the ']'
+    std::chrono::steady_clock::time_point m_file_opened;
+    rapidjson::StringBuffer m_json;
+
+    bool rotating() const
+    {
+        return m_max_file_size > 0 || m_max_file_duration.count() > 0;
+    }
+
+    /**
+     * @brief The name of the index'th file. With rotation, the index is added before the extension:
+     *        hailo_meta.json -> hailo_meta_00000.json
+     */
+    std::string file_name(uint index) const
+    {
+        if (!rotating())
+            return m_location;
+        size_t slash = m_location.find_last_of('/');
+        size_t dot = m_location.find_last_of('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            dot = m_location.size();
+        char suffix[16];
+        std::snprintf(suffix, sizeof(suffix), "_%05u", index);
+        return m_location.substr(0, dot) + suffix + m_location.substr(dot);
+    }
+
+    bool write_bytes(const void *data, size_t size)
+    {
+        if (std::fwrite(data, 1, size, m_file) != size)
+            return false;
+        m_file_bytes += size;
+        return true;
+    }
+
+    bool open_file()
+    {
+        std::string name = file_name(m_file_index);
+        m_file = std::fopen(name.c_str(), "wb");
+        if (!m_file)
+        {
+            GST_ERROR_OBJECT(m_element, "Failed to open %s", name.c_str());
+            return false;
+        }
+        std::setvbuf(m_file, m_file_buffer.data(), _IOFBF, m_file_buffer.size());
+        m_file_bytes = 0;
+        m_file_entries = 0;
+        m_file_opened = std::chrono::steady_clock::now();
+
+        // An empty array, as a file that was never written to
+        m_file_terminated = false;
+        if (m_format == HAILO_EXPORT_FILE_FORMAT_JSON)
+            return terminate_file();
+        return true;
+    }
+
+    /**
+     * @brief Close the JSON array and flush, the file is complete on disk after every batch.
+     */
+    bool terminate_file()
+    {
+        if (m_format == HAILO_EXPORT_FILE_FORMAT_JSON && !m_file_terminated)
+        {
+            if (!write_bytes(m_file_entries == 0 ? "[]" : "]", m_file_entries == 0 ? 2 : 1))
+                return false;
+            m_file_terminated = true;
+        }
+        return std::fflush(m_file) == 0;
+    }
+
+    bool close_file()
+    {
+        bool ok = terminate_file();
+        ok = (std::fclose(m_file) == 0) && ok;
+        m_file = nullptr;
+        return ok;
+    }
+
+    bool rotate_if_needed(size_t size)
+    {
+        if (!rotating() || m_file_entries == 0)
+            return true;
+        bool too_big = m_max_file_size > 0 && m_file_bytes + size > m_max_file_size;
+        bool too_old = m_max_file_duration.count() > 0 &&
+                       std::chrono::steady_clock::now() - m_file_opened >= m_max_file_duration;
+        if (!too_big && !too_old)
+            return true;
+        if (!close_file())
+            return false;
+        m_file_index++;
+        return open_file();
+    }
+
+    /**
+     * @brief Serialize the entry to JSON into m_json, with the same fields as the JSON array always had.
+     */
+    bool serialize_json(const HailoExportFileEntry &entry)
+    {
+        HailoBinaryHeader header;
+        HailoROIPtr roi = std::make_shared<HailoROI>(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f));
+        if (!decode_binary::decode_hailo_roi(entry.message.data(), entry.message.size(), roi, header, nullptr))
+            return false;
+        HailoBinaryReader payload(entry.message.data() + header.header_size, header.payload_size);
+        roi->set_bbox(decode_binary::decode_bbox(payload));
+
+        rapidjson::Document encoded_roi = encode_json::encode_hailo_roi(roi);
+        rapidjson::Document::AllocatorType &allocator = encoded_roi.GetAllocator();
+        encoded_roi.AddMember("timestamp (ms)", rapidjson::Value(header.timestamp), allocator);
+        encoded_roi.AddMember("buffer_offset", rapidjson::Value((uint)header.buffer_offset), allocator);
+        encoded_roi.AddMember("stream_id", entry.stream_id, allocator);
+
+        m_json.Clear();
+        if (m_format == HAILO_EXPORT_FILE_FORMAT_JSON)
+        {
+            rapidjson::PrettyWriter<rapidjson::StringBuffer> writer(m_json);
+            encoded_roi.Accept(writer);
+        }
+        else
+        {
+            rapidjson::Writer<rapidjson::StringBuffer> writer(m_json);
+            encoded_roi.Accept(writer);
+            m_json.Put('\n');
+        }
+        return true;
+    }
+
+    bool write_entry(const HailoExportFileEntry &entry)
+    {
+        const void *data = entry.message.data();
+        size_t size = entry.message.size();
+        if (m_format != HAILO_EXPORT_FILE_FORMAT_BINARY)
+        {
+            if (!serialize_json(entry))
+            {
+                GST_WARNING_OBJECT(m_element, "Skipping a frame that failed to encode");
+                return true;
+            }
+            data = m_json.GetString();
+            size = m_json.GetSize();
+        }
+
+        if (!rotate_if_needed(size))
+            return false;
+
+        if (m_format == HAILO_EXPORT_FILE_FORMAT_JSON)
+        {
+            // Reopen the array, its ']' is overwritten by this entry
+            if (m_file_terminated)
+            {
+                if (std::fseek(m_file, -1, SEEK_CUR) != 0)
+                    return false;
+                m_file_bytes--;
+                m_file_terminated = false;
+            }
+            if (m_file_entries > 0 && !write_bytes(",", 1))
+                return false;
+        }
+        if (!write_bytes(data, size))
+            return false;
+        m_file_entries++;
+        return true;
+    }
+
+    void writer_loop()
+    {
+        std::vector<HailoExportFileEntry> batch;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break;
+
+            // Take everything that is queued, the streaming thread is never held while writing
+            for (HailoExportFileEntry &entry : m_queue)
+                batch.emplace_back(std::move(entry));
+            m_queue.clear();
+            m_writing = true;
+            m_cv.notify_all();
+            lock.unlock();
+
+            bool ok = !m_failed;
+            for (HailoExportFileEntry &entry : batch)
+            {
+                if (!ok)
+                    break;
+                ok = write_entry(entry);
+            }
+            ok = ok && terminate_file();
+
+            lock.lock();
+            if (!ok && !m_failed)
+            {
+                GST_ERROR_OBJECT(m_element, "Failed writing to %s", file_name(m_file_index).c_str());
+                m_failed = true;
+            }
+            for (HailoExportFileEntry &entry : batch)
+            {
+                if (m_free.size() >= m_queue_size)
+                    break;
+                m_free.emplace_back(std::move(entry));
+            }
+            batch.clear();
+            m_writing = false;
+            m_cv.notify_all();
+        }
+    }
+
+public:
+    HailoExportFileWriter(GstHailoExportFile *element, const std::string &location, hailo_export_file_format_t format,
+                          size_t queue_size, bool drop_when_full, guint64 max_file_size, guint max_file_duration)
+        : m_element(element), m_location(location), m_format(format), m_queue_size(std::max<size_t>(queue_size, 1)),
+          m_drop_when_full(drop_when_full), m_max_file_size(max_file_size), m_max_file_duration(max_file_duration),
+          m_file_buffer(FILE_BUFFER_SIZE)
+    {
+    }
+
+    ~HailoExportFileWriter()
+    {
+        stop();
+    }
+
+    /**
+     * @brief Open the first file and start the writer thread.
+     *
+     * @return false if the file can't be opened.
+     */
+    bool start()
+    {
+        if (!open_file())
+            return false;
+        m_thread = std::thread(&HailoExportFileWriter::writer_loop, this);
+        return true;
+    }
+
+    /**
+     * @brief Write everything that is still queued and close the file.
+     */
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        if (m_thread.joinable())
+            m_thread.join();
+        if (m_file && !close_file())
+            m_failed = true;
+    }
+
+    /**
+     * @brief An entry to fill, its buffers are reused from entries that were already written.
+     */
+    HailoExportFileEntry acquire()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_free.empty())
+            return HailoExportFileEntry();
+        HailoExportFileEntry entry = std::move(m_free.back());
+        m_free.pop_back();
+        return entry;
+    }
+
+    /**
+     * @brief Queue an entry to be written. When the queue is full, blocks until there is room,
+     *        or drops the entry if drop-when-full is set.
+     *
+     * @return false if the entry was dropped.
+     */
+    bool push(HailoExportFileEntry &&entry)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_queue_size)
+        {
+            if (m_drop_when_full)
+            {
+                m_dropped++;
+                if (m_free.size() < m_queue_size)
+                    m_free.emplace_back(std::move(entry));
+                return false;
+            }
+            m_cv.wait(lock, [this] { return m_queue.size() < m_queue_size || m_stop; });
+        }
+        m_queue.emplace_back(std::move(entry));
+        lock.unlock();
+        m_cv.notify_all();
+        return true;
+    }
+
+    /**
+     * @brief Wait until everything queued is written and flushed to the file.
+     */
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return (m_queue.empty() && !m_writing) || m_failed; });
+    }
+
+    bool failed()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_failed;
+    }
+
+    guint64 dropped()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
 };
 
 static void
@@ -55,9 +445,9 @@ gst_hailoexportfile_class_init(GstHailoExportFileClass *klass)
     GstBaseTransformClass *base_transform_class =
         GST_BASE_TRANSFORM_CLASS(klass);
 
-    const char *description = "Exports HailoObjects in JSON format to a file."
+    const char *description = "Exports HailoObjects in JSON or binary format to a file."
                               "\n\t\t\t   "
-                              "Encodes classes contained by HailoROI objects to JSON.";
+                              "Encodes classes contained by HailoROI objects to JSON, the file is written from a background thread.";
     /* Setting up pads and setting metadata should be moved to
        base_class_init if you intend to subclass this class. */
     gst_element_class_add_pad_template(GST_ELEMENT_CLASS(klass),
@@ -79,11 +469,36 @@ gst_hailoexportfile_class_init(GstHailoExportFileClass *klass)
                                     g_param_spec_string("location", "Path to export file.",
                                                         "Location of the JSON file to save", "hailo_meta.json",
                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_FORMAT,
+                                    g_param_spec_enum("format", "File format",
+                                                      "Format of the saved metadata. json-lines and binary can be appended to without rewriting the file.",
+                                                      GST_TYPE_HAILO_EXPORT_FILE_FORMAT, HAILO_EXPORT_FILE_FORMAT_JSON,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_QUEUE_SIZE,
+                                    g_param_spec_uint("queue-size", "Queue size",
+                                                      "Frames waiting to be written before the queue is full.",
+                                                      1, G_MAXUINT, DEFAULT_QUEUE_SIZE,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_DROP_WHEN_FULL,
+                                    g_param_spec_boolean("drop-when-full", "Drop when full",
+                                                         "Drop the metadata of new frames while the queue is full, instead of blocking the pipeline.", false,
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_MAX_FILE_SIZE,
+                                    g_param_spec_uint64("max-file-size", "Max file size",
+                                                        "Start a new file once this many bytes were written, 0 to disable. The files are numbered: <location>_00000.<ext>.",
+                                                        0, G_MAXUINT64, 0,
+                                                        (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_MAX_FILE_DURATION,
+                                    g_param_spec_uint("max-file-duration", "Max file duration",
+                                                      "Start a new file after this many seconds, 0 to disable. The files are numbered: <location>_00000.<ext>.",
+                                                      0, G_MAXUINT, 0,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
     gobject_class->dispose = gst_hailoexportfile_dispose;
     gobject_class->finalize = gst_hailoexportfile_finalize;
     base_transform_class->start = GST_DEBUG_FUNCPTR(gst_hailoexportfile_start);
     base_transform_class->stop = GST_DEBUG_FUNCPTR(gst_hailoexportfile_stop);
+    base_transform_class->sink_event = GST_DEBUG_FUNCPTR(gst_hailoexportfile_sink_event);
     base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_hailoexportfile_transform_ip);
 }
 
@@ -91,7 +506,13 @@ static void
 gst_hailoexportfile_init(GstHailoExportFile *hailoexportfile)
 {
     hailoexportfile->file_path = g_strdup("hailo_meta.json");
+    hailoexportfile->format = HAILO_EXPORT_FILE_FORMAT_JSON;
+    hailoexportfile->queue_size = DEFAULT_QUEUE_SIZE;
+    hailoexportfile->drop_when_full = false;
+    hailoexportfile->max_file_size = 0;
+    hailoexportfile->max_file_duration = 0;
     hailoexportfile->buffer_offset = 0;
+    hailoexportfile->writer = nullptr;
 }
 
 void gst_hailoexportfile_set_property(GObject *object, guint property_id,
@@ -104,8 +525,24 @@ void gst_hailoexportfile_set_property(GObject *object, guint property_id,
     switch (property_id)
     {
     case PROP_FIlE_PATH:
+        g_free(hailoexportfile->file_path);
         hailoexportfile->file_path = g_strdup(g_value_get_string(value));
         break;
+    case PROP_FORMAT:
+        hailoexportfile->format = (hailo_export_file_format_t)g_value_get_enum(value);
+        break;
+    case PROP_QUEUE_SIZE:
+        hailoexportfile->queue_size = g_value_get_uint(value);
+        break;
+    case PROP_DROP_WHEN_FULL:
+        hailoexportfile->drop_when_full = g_value_get_boolean(value);
+        break;
+    case PROP_MAX_FILE_SIZE:
+        hailoexportfile->max_file_size = g_value_get_uint64(value);
+        break;
+    case PROP_MAX_FILE_DURATION:
+        hailoexportfile->max_file_duration = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -124,6 +561,21 @@ void gst_hailoexportfile_get_property(GObject *object, guint property_id,
     case PROP_FIlE_PATH:
         g_value_set_string(value, hailoexportfile->file_path);
         break;
+    case PROP_FORMAT:
+        g_value_set_enum(value, hailoexportfile->format);
+        break;
+    case PROP_QUEUE_SIZE:
+        g_value_set_uint(value, hailoexportfile->queue_size);
+        break;
+    case PROP_DROP_WHEN_FULL:
+        g_value_set_boolean(value, hailoexportfile->drop_when_full);
+        break;
+    case PROP_MAX_FILE_SIZE:
+        g_value_set_uint64(value, hailoexportfile->max_file_size);
+        break;
+    case PROP_MAX_FILE_DURATION:
+        g_value_set_uint(value, hailoexportfile->max_file_duration);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -136,6 +588,11 @@ void gst_hailoexportfile_dispose(GObject *object)
     GST_DEBUG_OBJECT(hailoexportfile, "dispose");
 
     /* clean up as possible.  may be called multiple times */
+    if (hailoexportfile->writer)
+    {
+        delete hailoexportfile->writer;
+        hailoexportfile->writer = nullptr;
+    }
 
     G_OBJECT_CLASS(gst_hailoexportfile_parent_class)->dispose(object);
 }
@@ -146,6 +603,8 @@ void gst_hailoexportfile_finalize(GObject *object)
     GST_DEBUG_OBJECT(hailoexportfile, "finalize");
 
     /* clean up object here */
+    g_free(hailoexportfile->file_path);
+    hailoexportfile->file_path = NULL;
 
     G_OBJECT_CLASS(gst_hailoexportfile_parent_class)->finalize(object);
 }
@@ -156,9 +615,18 @@ gst_hailoexportfile_start(GstBaseTransform *trans)
     GstHailoExportFile *hailoexportfile = GST_HAILO_EXPORT_FILE(trans);
     GST_DEBUG_OBJECT(hailoexportfile, "start");
 
-    hailoexportfile->json_file = fopen(hailoexportfile->file_path, "w");
-    fputs("[]", hailoexportfile->json_file);
-    fclose(hailoexportfile->json_file);
+    hailoexportfile->buffer_offset = 0;
+    hailoexportfile->writer = new HailoExportFileWriter(hailoexportfile, hailoexportfile->file_path, hailoexportfile->format,
+                                                        hailoexportfile->queue_size, hailoexportfile->drop_when_full,
+                                                        hailoexportfile->max_file_size, hailoexportfile->max_file_duration);
+    if (!hailoexportfile->writer->start())
+    {
+        delete hailoexportfile->writer;
+        hailoexportfile->writer = nullptr;
+        GST_ELEMENT_ERROR(hailoexportfile, RESOURCE, OPEN_WRITE,
+                          ("Could not open file \"%s\" for writing.", hailoexportfile->file_path), (NULL));
+        return FALSE;
+    }
 
     return TRUE;
 }
@@ -169,56 +637,64 @@ gst_hailoexportfile_stop(GstBaseTransform *trans)
     GstHailoExportFile *hailoexportfile = GST_HAILO_EXPORT_FILE(trans);
     GST_DEBUG_OBJECT(hailoexportfile, "stop");
 
+    if (hailoexportfile->writer)
+    {
+        hailoexportfile->writer->stop();
+        guint64 dropped = hailoexportfile->writer->dropped();
+        if (dropped > 0)
+            GST_WARNING_OBJECT(hailoexportfile, "Dropped the metadata of %" G_GUINT64_FORMAT " frames, the queue was full", dropped);
+        delete hailoexportfile->writer;
+        hailoexportfile->writer = nullptr;
+    }
+
     return TRUE;
 }
 
+static gboolean
+gst_hailoexportfile_sink_event(GstBaseTransform *trans, GstEvent *event)
+{
+    GstHailoExportFile *hailoexportfile = GST_HAILO_EXPORT_FILE(trans);
+
+    // The file is complete once EOS goes downstream
+    if (GST_EVENT_TYPE(event) == GST_EVENT_EOS && hailoexportfile->writer)
+        hailoexportfile->writer->flush();
+
+    return GST_BASE_TRANSFORM_CLASS(gst_hailoexportfile_parent_class)->sink_event(trans, event);
+}
+
 static GstFlowReturn
 gst_hailoexportfile_transform_ip(GstBaseTransform *trans,
                                  GstBuffer *buffer)
 {
     GstHailoExportFile *hailoexportfile = GST_HAILO_EXPORT_FILE(trans);
 
-    // Get the roi from the current buffer and encode it to a JSON entry
+    if (hailoexportfile->writer->failed())
+    {
+        GST_ELEMENT_ERROR(hailoexportfile, RESOURCE, WRITE,
+                          ("Could not write to file \"%s\".", hailoexportfile->file_path), (NULL));
+        return GST_FLOW_ERROR;
+    }
+
+    // Get the roi from the current buffer, the writer thread encodes it to JSON from a binary copy
     HailoROIPtr hailo_roi = get_hailo_main_roi(buffer, true);
-    rapidjson::Document encoded_roi = encode_json::encode_hailo_roi(hailo_roi);
+    HailoExportFileEntry entry = hailoexportfile->writer->acquire();
 
     // Add a timestamp
     auto timenow = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-    encoded_roi.AddMember("timestamp (ms)", rapidjson::Value(timenow), encoded_roi.GetAllocator());
-    encoded_roi.AddMember("buffer_offset", rapidjson::Value(hailoexportfile->buffer_offset), encoded_roi.GetAllocator());
+    encode_binary::encode_hailo_roi(entry.message, hailo_roi, timenow, hailoexportfile->buffer_offset);
 
     // Add the stream-id
-    std::string stream_id = hailo_roi->get_stream_id();
+    entry.stream_id = hailo_roi->get_stream_id();
 
-    if (stream_id.length() == 0)
+    if (entry.stream_id.length() == 0)
     {
-        gchar * id = gst_pad_get_stream_id(trans->srcpad);
-        stream_id = std::string(reinterpret_cast<char *>(id));
+        gchar *id = gst_pad_get_stream_id(trans->srcpad);
+        if (id)
+            entry.stream_id = id;
         g_free(id);
     }
 
-    encoded_roi.AddMember("stream_id", stream_id, encoded_roi.GetAllocator() );
-
-    // Open the file 
-    hailoexportfile->json_file = fopen(hailoexportfile->file_path, "rb+");
-
-    // Replace the "]" terminator with "," (if not empty)
-    if (std::getc(hailoexportfile->json_file) == '[' && std::getc(hailoexportfile->json_file) != ']') {
-        std::fseek(hailoexportfile->json_file, -1, SEEK_END);
-        std::fputc(',', hailoexportfile->json_file);
-    } else {
-        std::fseek(hailoexportfile->json_file, -1, SEEK_END);
-    }
-
-    // Append the new entry to the document
-    char writeBuffer[65536];
-    rapidjson::FileWriteStream write_stream(hailoexportfile->json_file, writeBuffer, sizeof(writeBuffer));
-    rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(write_stream);
-    encoded_roi.Accept(writer);
-
-    // Close the array
-    std::fputc(']', hailoexportfile->json_file);
-    fclose(hailoexportfile->json_file);
+    hailoexportfile->writer->push(std::move(entry));
 
     hailoexportfile->buffer_offset++;
     GST_DEBUG_OBJECT(hailoexportfile, "transform_ip");
@@ -9,6 +9,15 @@
 #include "export/encode_json.hpp"
 #include <cstdio>
 
+typedef enum
+{
+    HAILO_EXPORT_FILE_FORMAT_JSON,       // One pretty printed JSON array, always a valid document
+    HAILO_EXPORT_FILE_FORMAT_JSON_LINES, // One compact JSON object per line
+    HAILO_EXPORT_FILE_FORMAT_BINARY,     // Concatenated binary messages, see hailo_binary_format.hpp
+} hailo_export_file_format_t;
+
+class HailoExportFileWriter;
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_HAILO_EXPORT_FILE (gst_hailoexportfile_get_type())
@@ -24,8 +33,13 @@ struct _GstHailoExportFile
 {
     GstBaseTransform base_hailoexportfile;
     gchar *file_path;
-    FILE* json_file;
+    hailo_export_file_format_t format;
+    guint queue_size;
+    gboolean drop_when_full;
+    guint64 max_file_size;
+    guint max_file_duration;
     uint buffer_offset;
+    HailoExportFileWriter *writer;
 };
 
 struct _GstHailoExportFileClass
@@ -45,8 +45,28 @@ enum
 {
     PROP_0,
     PROP_ADDRESS,
+    PROP_FORMAT,
+    PROP_INCLUDE_TENSORS,
 };
 
+#define GST_TYPE_HAILO_EXPORT_ZMQ_FORMAT (gst_hailoexportzmq_format_get_type())
+static GType
+gst_hailoexportzmq_format_get_type(void)
+{
+    static GType hailoexportzmq_format_type = 0;
+    static const GEnumValue hailoexportzmq_formats[] = {
+        {HAILO_METADATA_FORMAT_JSON, "JSON text", "json"},
+        {HAILO_METADATA_FORMAT_BINARY, "Compact binary format, see hailo_binary_format.hpp", "binary"},
+        {0, NULL, NULL},
+    };
+    if (!hailoexportzmq_format_type)
+    {
+        hailoexportzmq_format_type =
+            g_enum_register_static("GstHailoExportZMQFormat", hailoexportzmq_formats);
+    }
+    return hailoexportzmq_format_type;
+}
+
 static void
 gst_hailoexportzmq_class_init(GstHailoExportZMQClass *klass)
 {
@@ -54,9 +74,9 @@ gst_hailoexportzmq_class_init(GstHailoExportZMQClass *klass)
     GstBaseTransformClass *base_transform_class =
         GST_BASE_TRANSFORM_CLASS(klass);
 
-    const char *description = "Exports HailoObjects in JSON format to a ZMQ socket."
+    const char *description = "Exports HailoObjects in JSON or binary format to a ZMQ socket."
                               "\n\t\t\t   "
-                              "Encodes classes contained by HailoROI objects to JSON.";
+                              "Encodes classes contained by HailoROI objects to JSON or binary.";
     /* Setting up pads and setting metadata should be moved to
        base_class_init if you intend to subclass this class. */
     gst_element_class_add_pad_template(GST_ELEMENT_CLASS(klass),
@@ -78,6 +98,15 @@ gst_hailoexportzmq_class_init(GstHailoExportZMQClass *klass)
                                     g_param_spec_string("address", "Endpoint address.",
                                                         "Address to bind the socket to.", "tcp://*:5555",
                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_FORMAT,
+                                    g_param_spec_enum("format", "Message format",
+                                                      "Format of the sent metadata. binary is a compact versioned layout that is sent without copying, hailoimportzmq must use the same format.",
+                                                      GST_TYPE_HAILO_EXPORT_ZMQ_FORMAT, HAILO_METADATA_FORMAT_JSON,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_INCLUDE_TENSORS,
+                                    g_param_spec_boolean("include-tensors", "Include tensors",
+                                                         "Also send the output tensors attached to the ROIs. Only with the binary format.", false,
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
     gobject_class->dispose = gst_hailoexportzmq_dispose;
     gobject_class->finalize = gst_hailoexportzmq_finalize;
@@ -90,7 +119,10 @@ static void
 gst_hailoexportzmq_init(GstHailoExportZMQ *hailoexportzmq)
 {
     hailoexportzmq->address = g_strdup("tcp://*:5555");
+    hailoexportzmq->format = HAILO_METADATA_FORMAT_JSON;
+    hailoexportzmq->include_tensors = false;
     hailoexportzmq->buffer_offset = 0;
+    hailoexportzmq->last_message_size = 0;
 }
 
 void gst_hailoexportzmq_set_property(GObject *object, guint property_id,
@@ -105,6 +137,12 @@ void gst_hailoexportzmq_set_property(GObject *object, guint property_id,
     case PROP_ADDRESS:
         hailoexportzmq->address = g_strdup(g_value_get_string(value));
         break;
+    case PROP_FORMAT:
+        hailoexportzmq->format = (hailo_metadata_format_t)g_value_get_enum(value);
+        break;
+    case PROP_INCLUDE_TENSORS:
+        hailoexportzmq->include_tensors = g_value_get_boolean(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -123,6 +161,12 @@ void gst_hailoexportzmq_get_property(GObject *object, guint property_id,
     case PROP_ADDRESS:
         g_value_set_string(value, hailoexportzmq->address);
         break;
+    case PROP_FORMAT:
+        g_value_set_enum(value, hailoexportzmq->format);
+        break;
+    case PROP_INCLUDE_TENSORS:
+        g_value_set_boolean(value, hailoexportzmq->include_tensors);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -178,18 +222,31 @@ gst_hailoexportzmq_stop(GstBaseTransform *trans)
     return TRUE;
 }
 
-static GstFlowReturn
-gst_hailoexportzmq_transform_ip(GstBaseTransform *trans,
-                                 GstBuffer *buffer)
+// Called by zmq once a binary message was sent, frees the encoded message.
+static void
+gst_hailoexportzmq_free_message(void *data, void *hint)
 {
-    GstHailoExportZMQ *hailoexportzmq = GST_HAILO_EXPORT_ZMQ(trans);
+    delete static_cast<std::vector<uint8_t> *>(hint);
+}
 
-    // Get the roi from the current buffer and encode it to a JSON entry
-    HailoROIPtr hailo_roi = get_hailo_main_roi(buffer, true);
+static zmq::message_t
+gst_hailoexportzmq_encode_binary(GstHailoExportZMQ *hailoexportzmq, HailoROIPtr hailo_roi, int64_t timenow)
+{
+    // The message takes ownership of the encoded bytes, so they are sent without a copy
+    std::vector<uint8_t> *encoded = new std::vector<uint8_t>();
+    encoded->reserve(hailoexportzmq->last_message_size);
+    encode_binary::encode_hailo_roi(*encoded, hailo_roi, timenow, hailoexportzmq->buffer_offset, hailoexportzmq->include_tensors);
+    hailoexportzmq->last_message_size = encoded->size();
+    return zmq::message_t(encoded->data(), encoded->size(), gst_hailoexportzmq_free_message, encoded);
+}
+
+static zmq::message_t
+gst_hailoexportzmq_encode_json(GstHailoExportZMQ *hailoexportzmq, HailoROIPtr hailo_roi, int64_t timenow)
+{
+    // Encode the roi to a JSON entry
     rapidjson::Document encoded_roi = encode_json::encode_hailo_roi(hailo_roi);
 
     // Add a timestamp
-    auto timenow = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
     encoded_roi.AddMember("timestamp (ms)", rapidjson::Value(timenow), encoded_roi.GetAllocator());
     encoded_roi.AddMember("buffer_offset", rapidjson::Value(hailoexportzmq->buffer_offset), encoded_roi.GetAllocator());
 
@@ -198,17 +255,34 @@ gst_hailoexportzmq_transform_ip(GstBaseTransform *trans,
     rapidjson::Writer<rapidjson::StringBuffer> writer(json_buffer);
     encoded_roi.Accept(writer);
 
-    // Send the message
     zmq::message_t json_message(json_buffer.GetSize());
     // Copy is required since zmq::message_t would only wrap the data, so if the buffer is freed/overwritten
     // while the message is sending you will get garbage data or a segfault.
     std::memcpy(json_message.data(), json_buffer.GetString(), json_buffer.GetSize()); 
+    return json_message;
+}
+
+static GstFlowReturn
+gst_hailoexportzmq_transform_ip(GstBaseTransform *trans,
+                                 GstBuffer *buffer)
+{
+    GstHailoExportZMQ *hailoexportzmq = GST_HAILO_EXPORT_ZMQ(trans);
+
+    // Get the roi from the current buffer and encode it
+    HailoROIPtr hailo_roi = get_hailo_main_roi(buffer, true);
+    auto timenow = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    zmq::message_t message = (hailoexportzmq->format == HAILO_METADATA_FORMAT_BINARY) ?
+                                 gst_hailoexportzmq_encode_binary(hailoexportzmq, hailo_roi, timenow) :
+                                 gst_hailoexportzmq_encode_json(hailoexportzmq, hailo_roi, timenow);
+    size_t message_size = message.size();
+
+    // Send the message
 #if (CPPZMQ_VERSION_MAJOR >= 4 && CPPZMQ_VERSION_MINOR >= 6 && CPPZMQ_VERSION_PATCH >= 0)
-    zmq::send_result_t result = hailoexportzmq->socket->send(json_message, zmq::send_flags(ZMQ_DONTWAIT));
+    zmq::send_result_t result = hailoexportzmq->socket->send(message, zmq::send_flags(ZMQ_DONTWAIT));
 #else
-    zmq::detail::send_result_t result = hailoexportzmq->socket->send(json_message, zmq::send_flags(ZMQ_DONTWAIT));
+    zmq::detail::send_result_t result = hailoexportzmq->socket->send(message, zmq::send_flags(ZMQ_DONTWAIT));
 #endif
-    if (result != json_message.size())
+    if (result != message_size)
         GST_WARNING("hailoexportzmq failed to send buffer!");
 
     hailoexportzmq->buffer_offset++;
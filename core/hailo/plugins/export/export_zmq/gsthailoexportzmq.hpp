@@ -7,6 +7,7 @@
 #include <gst/base/gstbasetransform.h>
 #include "hailo_objects.hpp"
 #include "export/encode_json.hpp"
+#include "export/encode_binary.hpp"
 #include <cstdio>
 #include <zmq.hpp>
 
@@ -25,7 +26,10 @@ struct _GstHailoExportZMQ
 {
     GstBaseTransform base_hailoexportzmq;
     gchar *address;
+    hailo_metadata_format_t format;
+    gboolean include_tensors;
     uint buffer_offset;
+    size_t last_message_size;
     zmq::context_t *context;
     zmq::socket_t *socket;
 };
@@ -275,6 +275,26 @@ gst_hailofilter_stop(GstBaseTransform *trans)
     return TRUE;
 }
 
+/**
+ * @brief A tensor together with the buffer holding its data.
+ *        The buffer stays referenced and mapped as long as the tensor is alive, so objects decoded lazily
+ *        from the tensor (e.g. masks) can still read it after the tensor meta is removed from the frame.
+ */
+struct BufferTensor
+{
+    GstBuffer *buffer;
+    GstMapInfo info;
+    HailoTensor tensor;
+
+    BufferTensor(GstBuffer *mapped_buffer, const GstMapInfo &map_info, const hailo_vstream_info_t &vstream_info)
+        : buffer(gst_buffer_ref(mapped_buffer)), info(map_info), tensor(map_info.data, vstream_info) {}
+    ~BufferTensor()
+    {
+        gst_buffer_unmap(buffer, &info);
+        gst_buffer_unref(buffer);
+    }
+};
+
 /**
  * @brief Get the tensors from meta object
  *
@@ -291,16 +311,16 @@ void get_tensors_from_meta(GstBuffer *buffer, HailoROIPtr roi)
     while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_PARENT_BUFFER_META_API_TYPE)))
     {
         pmeta = reinterpret_cast<GstParentBufferMeta *>(meta);
-        (void)gst_buffer_map(pmeta->buffer, &info, GST_MAP_READWRITE);
         // check if the buffer has tensor metadata
-        if (!gst_buffer_get_meta(pmeta->buffer, g_type_from_name(TENSOR_META_API_NAME)))
-        {
-            gst_buffer_unmap(pmeta->buffer, &info);
+        GstMeta *tensor_meta = gst_buffer_get_meta(pmeta->buffer, g_type_from_name(TENSOR_META_API_NAME));
+        if (!tensor_meta)
             continue;
-        }
-        const hailo_vstream_info_t vstream_info = reinterpret_cast<GstHailoTensorMeta *>(gst_buffer_get_meta(pmeta->buffer, g_type_from_name(TENSOR_META_API_NAME)))->info;
-        roi->add_tensor(std::make_shared<HailoTensor>(reinterpret_cast<uint8_t *>(info.data), vstream_info));
-        gst_buffer_unmap(pmeta->buffer, &info);
+        // Mapped for reading only: a tensor may still hold a reference from an earlier filter, which makes the buffer not writable
+        if (!gst_buffer_map(pmeta->buffer, &info, GST_MAP_READ))
+            continue;
+        const hailo_vstream_info_t vstream_info = reinterpret_cast<GstHailoTensorMeta *>(tensor_meta)->info;
+        auto buffer_tensor = std::make_shared<BufferTensor>(pmeta->buffer, info, vstream_info);
+        roi->add_tensor(HailoTensorPtr(buffer_tensor, &buffer_tensor->tensor));
     }
 }
 
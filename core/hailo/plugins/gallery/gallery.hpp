@@ -8,11 +8,9 @@
 #include <string>
 #include <ostream>
 #include <filesystem>
-#include "xtensor/xarray.hpp"
-#include "xtensor/xadapt.hpp"
-#include "xtensor/xsort.hpp"
-#include "xtensor/xio.hpp"
+#include <memory>
 #include "hailo_objects.hpp"
+#include "gallery_index.hpp"
 #include "export/encode_json.hpp"
 #include "import/decode_json.hpp"
 
@@ -24,35 +22,17 @@
 #include "rapidjson/writer.h"
 #include "rapidjson/prettywriter.h"
 
-static xt::xarray<float> gallery_get_xtensor(HailoMatrixPtr matrix)
+static bool gallery_is_json_file(const char *file_path)
 {
-    // Adapt a HailoTensorPtr to an xarray (quantized)
-    xt::xarray<float> xtensor = xt::adapt(matrix->get_data().data(), matrix->size(), xt::no_ownership(), matrix->shape());
-    return xt::squeeze(xtensor);
-}
-
-static float gallery_one_dim_dot_product(xt::xarray<float> array1, xt::xarray<float> array2)
-{
-    if (array1.dimension() > 1 || array2.dimension() > 1)
-    {
-        throw std::runtime_error("One of the arrays has more than 1 dimension");
-    }
-    if (array1.shape(0) != array2.shape(0))
-    {
-        throw std::runtime_error("Arrays are with different shape");
-    }
-    return xt::sum(array1 * array2)[0];
+    return std::filesystem::path(file_path).extension() == ".json";
 }
 
 class Gallery
 {
 private:
-    // Each embedding is represented by HailoMatrixPtr
-    // Each global_id has a vector of embeddings (I.e. vector of HailoMatrixPtr)
-    // of all the embeddings related to this ID.
-    // For the whole gallery there is a vector of global id's (i.e. vector of vectors of HailoMatrixPtr)
-    // where the global ID is represented by the outer vector's index.
-    std::vector<std::vector<HailoMatrixPtr>> m_embeddings;
+    // All the embeddings of all the global IDs, in one contiguous (optionally indexed) matrix.
+    // Global IDs are 1 based, index IDs are 0 based.
+    GalleryIndex m_index;
     std::map<int, int> tracking_id_to_global_id;
     std::vector<std::string> m_embedding_names;
     float m_similarity_thr;
@@ -61,38 +41,25 @@ private:
     bool m_save_new_embeddings;
     char *m_json_file_path;
     bool m_load_local_embeddings;
+    // Binary (non JSON) gallery files
+    std::unique_ptr<GalleryFileWriter> m_gallery_writer;
 
 public:
     Gallery(float similarity_thr = 0.15, uint queue_size = 100) : m_similarity_thr(similarity_thr), m_queue_size(queue_size),
                                                                   m_json_file(nullptr), m_save_new_embeddings(false),
                                                                   m_json_file_path(nullptr), m_load_local_embeddings(false){};
 
-    static float get_distance(std::vector<HailoMatrixPtr> embeddings_queue, HailoMatrixPtr matrix)
-    {
-        xt::xarray<float> new_embedding = gallery_get_xtensor(matrix);
-        float max_thr = 0.0f;
-        float thr;
-        for (HailoMatrixPtr embedding_mat : embeddings_queue)
-        {
-            xt::xarray<float> embedding = gallery_get_xtensor(embedding_mat);
-            thr = gallery_one_dim_dot_product(embedding, new_embedding);
-            max_thr = thr > max_thr ? thr : max_thr;
-        }
-        return 1.0f - max_thr;
-    }
-
-    xt::xarray<float> get_embeddings_distances(HailoMatrixPtr matrix)
+    void init_local_gallery_file(const char *file_path)
     {
-        std::vector<float> distances;
-        for (auto embeddings_queue : m_embeddings)
+        if (!gallery_is_json_file(file_path))
         {
-            distances.push_back(get_distance(embeddings_queue, matrix));
+            this->m_gallery_writer = std::make_unique<GalleryFileWriter>();
+            this->m_gallery_writer->open(file_path);
+            this->m_json_file_path = strdup(file_path);
+            this->m_save_new_embeddings = true;
+            return;
         }
-        return xt::adapt(distances);
-    }
 
-    void init_local_gallery_file(const char *file_path)
-    {
         if (!std::filesystem::exists(file_path))
         {
             this->m_json_file = fopen(file_path, "w");
@@ -108,7 +75,13 @@ public:
     void load_local_gallery_from_json(const char *file_path)
     {
         if (!std::filesystem::exists(file_path))
-            throw std::runtime_error("Gallery JSON file does not exist");
+            throw std::runtime_error("Gallery file does not exist");
+
+        if (!gallery_is_json_file(file_path))
+        {
+            load_local_gallery_from_binary(file_path);
+            return;
+        }
 
         this->m_json_file = fopen(file_path, "r");
         if (this->m_json_file == nullptr)
@@ -117,7 +90,7 @@ public:
         this->m_json_file_path = strdup(file_path);
 
         char read_buffer[4096];
-        HailoROIPtr roi = std::make_shared<HailoROI>(HailoROI(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f)));
+        HailoROIPtr roi = hailo_make_shared<HailoROI>(HailoROI(HailoBBox(0.0f, 0.0f, 1.0f, 1.0f)));
         rapidjson::FileReadStream stream(this->m_json_file, read_buffer, sizeof(read_buffer));
         rapidjson::Document doc_config_json;
         doc_config_json.ParseStream(stream);
@@ -137,14 +110,25 @@ public:
         this->m_json_file = nullptr;
     }
 
+    void load_local_gallery_from_binary(const char *file_path)
+    {
+        // The embeddings are used straight from the mapped file
+        auto mapped = std::make_shared<GalleryMappedFile>(file_path);
+        for (uint i = 0; i < mapped->count(); i++)
+            this->m_embedding_names.emplace_back(mapped->name(i));
+        this->m_json_file_path = strdup(file_path);
+        this->m_load_local_embeddings = true;
+        m_index.add_mapped(mapped);
+    }
+
+    void close_local_gallery()
+    {
+        this->m_gallery_writer.reset();
+    }
+
     void add_embedding(uint global_id, HailoMatrixPtr matrix)
     {
-        global_id--;
-        if (m_embeddings[global_id].size() >= m_queue_size)
-        {
-            m_embeddings[global_id].pop_back();
-        }
-        m_embeddings[global_id].insert(m_embeddings[global_id].begin(), matrix);
+        m_index.add(global_id - 1, matrix->get_data().data(), matrix->size(), m_queue_size);
     }
 
     void write_to_json_file(rapidjson::Document document)
@@ -180,23 +164,33 @@ public:
         if (this->m_save_new_embeddings)
         {
             std::string name = "Unknown" + std::to_string(global_id);
-            write_to_json_file(encode_json::encode_hailo_face_recognition_result(matrix, name.c_str()));
+            if (this->m_gallery_writer)
+                this->m_gallery_writer->append(name, matrix->get_data().data(), matrix->size());
+            else
+                write_to_json_file(encode_json::encode_hailo_face_recognition_result(matrix, name.c_str()));
         }
     }
 
     uint create_new_global_id()
     {
-        std::vector<HailoMatrixPtr> queue;
-        m_embeddings.push_back(queue);
-        uint global_id = m_embeddings.size();
+        uint global_id = m_index.add_id() + 1;
         return global_id;
     }
 
+    std::vector<GalleryIndex::Match> get_closest_global_ids(HailoMatrixPtr matrix, uint k)
+    {
+        auto matches = m_index.search(matrix->get_data().data(), matrix->size(), k);
+        for (auto &match : matches)
+            match.id++;
+        return matches;
+    }
+
     std::pair<uint, float> get_closest_global_id(HailoMatrixPtr matrix)
     {
-        auto distances = get_embeddings_distances(matrix);
-        auto global_id = xt::argpartition(distances, 1, xt::xnone())[0];
-        return std::pair<uint, float>(global_id + 1, distances[global_id]);
+        auto matches = get_closest_global_ids(matrix, 1);
+        if (matches.empty())
+            return std::pair<uint, float>(1, 1.0f); // No global id has an embedding yet
+        return std::pair<uint, float>(matches[0].id, matches[0].distance);
     }
 
     HailoMatrixPtr get_embedding_matrix(HailoDetectionPtr detection)
@@ -224,7 +218,7 @@ public:
             auto existing_recognitions = hailo_common::get_hailo_classifications(detection, classification_type);
             if (existing_recognitions.size() == 0 ||  existing_recognitions[0]->get_classification_type() != classification_type)
             {
-                detection->add_object(std::make_shared<HailoClassification>(classification_type, this->m_embedding_names[global_id - 1]));
+                detection->add_object(hailo_make_shared<HailoClassification>(classification_type, this->m_embedding_names[global_id - 1]));
             }
         }
     }
@@ -241,7 +235,7 @@ public:
         // Add global id to detection.
         auto global_ids = hailo_common::get_hailo_global_id(detection);
         if (global_ids.size() == 0)
-            detection->add_object(std::make_shared<HailoUniqueID>(global_id, GLOBAL_ID));
+            detection->add_object(hailo_make_shared<HailoUniqueID>(global_id, GLOBAL_ID));
     }
 
     void new_embedding_to_global_id(HailoMatrixPtr new_embedding, HailoDetectionPtr detection, const int track_id)
@@ -261,7 +255,7 @@ public:
             return;
         }
 
-        if (m_embeddings.empty())
+        if (m_index.num_ids() == 0)
         {
             // Gallery is empty, adding new global id
             uint global_id = create_new_global_id();
@@ -306,6 +300,11 @@ public:
     };
     void set_similarity_threshold(float thr) { this->m_similarity_thr = thr; };
     void set_queue_size(uint size) { m_queue_size = size; };
+    void set_quantize_embeddings(bool quantize) { m_index.set_quantize(quantize); };
+    void set_ivf(uint lists, uint probes) { m_index.set_ivf(lists, probes); };
+    bool get_quantize_embeddings() { return m_index.get_quantize(); };
+    uint get_ivf_lists() { return m_index.get_ivf_lists(); };
+    uint get_ivf_probes() { return m_index.get_ivf_probes(); };
     float get_similarity_threshold() { return m_similarity_thr; };
     uint get_queue_size() { return m_queue_size; };
 };
@@ -0,0 +1,700 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file gallery_index.hpp
+ * @brief Contiguous embedding storage and nearest neighbour search for the Gallery,
+ *        plus the binary (memory mapped) gallery file format.
+ **/
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+//******************************************************************
+// DOT PRODUCT KERNELS
+//******************************************************************
+inline float gallery_dot(const float *a, const float *b, uint32_t dim)
+{
+    uint32_t i = 0;
+    float sum = 0.0f;
+#if defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= dim; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__aarch64__)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    for (; i + 8 <= dim; i += 8)
+    {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+#endif
+    for (; i < dim; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+inline int32_t gallery_dot(const int8_t *a, const int8_t *b, uint32_t dim)
+{
+    uint32_t i = 0;
+    int32_t sum = 0;
+#if defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= dim; i += 16)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+        // Sign extend to 16 bit: duplicate every byte into both halves of a lane, then shift it down
+        __m128i a_lo = _mm_srai_epi16(_mm_unpacklo_epi8(va, va), 8);
+        __m128i a_hi = _mm_srai_epi16(_mm_unpackhi_epi8(va, va), 8);
+        __m128i b_lo = _mm_srai_epi16(_mm_unpacklo_epi8(vb, vb), 8);
+        __m128i b_hi = _mm_srai_epi16(_mm_unpackhi_epi8(vb, vb), 8);
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_lo, b_lo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(a_hi, b_hi));
+    }
+    int32_t lanes[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__aarch64__)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (; i + 16 <= dim; i += 16)
+    {
+        int8x16_t va = vld1q_s8(a + i);
+        int8x16_t vb = vld1q_s8(b + i);
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_high_s8(va, vb));
+    }
+    sum = vaddvq_s32(acc);
+#endif
+    for (; i < dim; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+inline void gallery_normalize(const float *src, float *dst, uint32_t dim)
+{
+    float norm = std::sqrt(gallery_dot(src, src, dim));
+    float scale = norm > 0.0f ? 1.0f / norm : 0.0f;
+    for (uint32_t k = 0; k < dim; k++)
+        dst[k] = src[k] * scale;
+}
+
+//******************************************************************
+// BINARY GALLERY FILE
+//******************************************************************
+// Layout: a 64 byte header, followed by fixed size records of
+// <char name[GALLERY_FILE_NAME_SIZE], float embedding[dim]>, embeddings are stored normalized.
+// New identities are appended as records, and the record count is derived from the file size,
+// so an interrupted append never corrupts the records before it.
+#define GALLERY_FILE_MAGIC "HAILOGAL"
+#define GALLERY_FILE_VERSION (1)
+#define GALLERY_FILE_NAME_SIZE (64)
+
+struct GalleryFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dim;
+    uint32_t name_size;
+    uint32_t reserved[11];
+};
+static_assert(sizeof(GalleryFileHeader) == 64, "Gallery file header must be 64 bytes");
+
+/**
+ * @brief A read only memory mapping of a binary gallery file.
+ *        The embeddings are used in place, without being copied.
+ */
+class GalleryMappedFile
+{
+private:
+    void *m_map = MAP_FAILED;
+    size_t m_map_size = 0;
+    const GalleryFileHeader *m_header = nullptr;
+    size_t m_record_size = 0;
+    uint32_t m_count = 0;
+
+public:
+    explicit GalleryMappedFile(const char *file_path)
+    {
+        int fd = open(file_path, O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Gallery file could not be opened");
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(GalleryFileHeader))
+        {
+            close(fd);
+            throw std::runtime_error("Gallery file is not valid");
+        }
+        m_map_size = file_stat.st_size;
+        m_map = mmap(nullptr, m_map_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (m_map == MAP_FAILED)
+            throw std::runtime_error("Gallery file could not be mapped");
+
+        m_header = static_cast<const GalleryFileHeader *>(m_map);
+        if (std::memcmp(m_header->magic, GALLERY_FILE_MAGIC, sizeof(m_header->magic)) != 0 ||
+            m_header->version != GALLERY_FILE_VERSION || m_header->dim == 0 || m_header->name_size % sizeof(float) != 0)
+        {
+            munmap(m_map, m_map_size);
+            m_map = MAP_FAILED;
+            throw std::runtime_error("Gallery file is not valid");
+        }
+        m_record_size = m_header->name_size + m_header->dim * sizeof(float);
+        m_count = (m_map_size - sizeof(GalleryFileHeader)) / m_record_size;
+    }
+
+    ~GalleryMappedFile()
+    {
+        if (m_map != MAP_FAILED)
+            munmap(m_map, m_map_size);
+    }
+
+    GalleryMappedFile(const GalleryMappedFile &) = delete;
+    GalleryMappedFile &operator=(const GalleryMappedFile &) = delete;
+
+    uint32_t count() const { return m_count; }
+    uint32_t dim() const { return m_header->dim; }
+    // Distance (in floats) between two consecutive embeddings
+    size_t stride() const { return m_record_size / sizeof(float); }
+
+    const char *record(uint32_t index) const
+    {
+        return static_cast<const char *>(m_map) + sizeof(GalleryFileHeader) + index * m_record_size;
+    }
+
+    std::string name(uint32_t index) const
+    {
+        const char *name = record(index);
+        return std::string(name, strnlen(name, m_header->name_size));
+    }
+
+    const float *embeddings() const
+    {
+        return reinterpret_cast<const float *>(record(0) + m_header->name_size);
+    }
+};
+
+/**
+ * @brief Appends records to a binary gallery file, creating it (and its header) when needed.
+ */
+class GalleryFileWriter
+{
+private:
+    FILE *m_file = nullptr;
+    uint32_t m_dim = 0;
+
+public:
+    GalleryFileWriter() = default;
+    ~GalleryFileWriter() { close(); }
+    GalleryFileWriter(const GalleryFileWriter &) = delete;
+    GalleryFileWriter &operator=(const GalleryFileWriter &) = delete;
+
+    void open(const char *file_path)
+    {
+        close();
+        m_file = fopen(file_path, "a+b");
+        if (m_file == nullptr)
+            throw std::runtime_error("Gallery file could not be opened for writing");
+
+        GalleryFileHeader header;
+        std::fseek(m_file, 0, SEEK_SET);
+        if (std::fread(&header, sizeof(header), 1, m_file) == 1)
+        {
+            if (std::memcmp(header.magic, GALLERY_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+                header.version != GALLERY_FILE_VERSION || header.name_size != GALLERY_FILE_NAME_SIZE)
+                throw std::runtime_error("Gallery file is not valid");
+            m_dim = header.dim;
+        }
+    }
+
+    void close()
+    {
+        if (m_file != nullptr)
+            fclose(m_file);
+        m_file = nullptr;
+        m_dim = 0;
+    }
+
+    void append(const std::string &name, const float *embedding, uint32_t dim)
+    {
+        if (m_dim == 0)
+        {
+            // First record of a new file
+            GalleryFileHeader header = {};
+            std::memcpy(header.magic, GALLERY_FILE_MAGIC, sizeof(header.magic));
+            header.version = GALLERY_FILE_VERSION;
+            header.dim = dim;
+            header.name_size = GALLERY_FILE_NAME_SIZE;
+            std::fwrite(&header, sizeof(header), 1, m_file);
+            m_dim = dim;
+        }
+        if (dim != m_dim)
+            throw std::runtime_error("Embedding size does not match the gallery file");
+
+        char name_field[GALLERY_FILE_NAME_SIZE] = {};
+        std::strncpy(name_field, name.c_str(), GALLERY_FILE_NAME_SIZE - 1);
+        std::vector<float> normalized(dim);
+        gallery_normalize(embedding, normalized.data(), dim);
+        std::fwrite(name_field, sizeof(name_field), 1, m_file);
+        std::fwrite(normalized.data(), sizeof(float), dim, m_file);
+        std::fflush(m_file);
+    }
+};
+
+//******************************************************************
+// GALLERY INDEX
+//******************************************************************
+/**
+ * @brief Normalized embeddings of all the global IDs in one contiguous matrix.
+ *        Each ID owns up to queue_size rows, once full its oldest row is overwritten in place.
+ *        A query is a single matrix-vector product over the (float or int8) rows.
+ *        For large galleries an inverted file index (IVF) can be enabled: the rows are clustered
+ *        with spherical k-means, and a query only scores the rows of its closest clusters.
+ */
+class GalleryIndex
+{
+public:
+    struct Match
+    {
+        uint32_t id;    // 0 based
+        float distance; // 1 - cosine similarity, in [0, 1]
+    };
+
+private:
+    static constexpr float QUANTIZATION_SCALE = 127.0f;
+    static constexpr uint32_t IVF_MIN_ROWS_PER_LIST = 16;
+    static constexpr uint32_t IVF_TRAIN_ROWS_PER_LIST = 64;
+    static constexpr uint32_t IVF_TRAIN_ITERATIONS = 8;
+
+    uint32_t m_dim = 0;
+    uint32_t m_num_rows = 0;
+    bool m_quantize = false;
+    std::vector<float> m_rows;   // m_num_rows x m_dim, when not quantized
+    std::vector<int8_t> m_qrows; // m_num_rows x m_dim, when quantized
+    std::shared_ptr<GalleryMappedFile> m_mapped; // Read only rows, used in place until the first add
+    std::vector<uint32_t> m_row_id;
+    std::vector<std::vector<uint32_t>> m_id_rows;
+    std::vector<uint32_t> m_id_cursor; // Next row to overwrite once an ID's queue is full
+
+    // Inverted file index
+    uint32_t m_ivf_lists = 0;
+    uint32_t m_ivf_probes = 8;
+    uint32_t m_trained_rows = 0;
+    std::vector<float> m_centroids; // m_ivf_lists x m_dim
+    std::vector<std::vector<uint32_t>> m_lists;
+    std::vector<uint32_t> m_row_list;
+    std::vector<uint32_t> m_row_pos;
+
+    // Query scratch, reused across queries
+    std::vector<float> m_query;
+    std::vector<int8_t> m_qquery;
+    std::vector<float> m_row_scratch;
+    std::vector<float> m_best;
+    std::vector<uint32_t> m_touched;
+    std::vector<std::pair<float, uint32_t>> m_centroid_scores;
+
+    const float *float_row(uint32_t row) const
+    {
+        if (m_mapped)
+            return m_mapped->embeddings() + row * m_mapped->stride();
+        return m_rows.data() + (size_t)row * m_dim;
+    }
+
+    const int8_t *quantized_row(uint32_t row) const
+    {
+        return m_qrows.data() + (size_t)row * m_dim;
+    }
+
+    // A row as floats, dequantizing into scratch if needed
+    const float *row_as_float(uint32_t row)
+    {
+        if (!m_quantize)
+            return float_row(row);
+        m_row_scratch.resize(m_dim);
+        const int8_t *qrow = quantized_row(row);
+        for (uint32_t k = 0; k < m_dim; k++)
+            m_row_scratch[k] = qrow[k] / QUANTIZATION_SCALE;
+        return m_row_scratch.data();
+    }
+
+    static void quantize(const float *src, int8_t *dst, uint32_t dim)
+    {
+        for (uint32_t k = 0; k < dim; k++)
+            dst[k] = (int8_t)std::max(-QUANTIZATION_SCALE, std::min(QUANTIZATION_SCALE, std::round(src[k] * QUANTIZATION_SCALE)));
+    }
+
+    void check_dim(uint32_t dim)
+    {
+        if (m_dim == 0)
+            m_dim = dim;
+        else if (dim != m_dim)
+            throw std::runtime_error("Embedding size does not match the gallery");
+    }
+
+    // Move mapped rows into owned storage, before the first write
+    void materialize()
+    {
+        if (!m_mapped)
+            return;
+        m_rows.resize((size_t)m_num_rows * m_dim);
+        for (uint32_t row = 0; row < m_num_rows; row++)
+            std::memcpy(m_rows.data() + (size_t)row * m_dim, float_row(row), m_dim * sizeof(float));
+        m_mapped.reset();
+    }
+
+    void write_row(uint32_t row, const float *embedding)
+    {
+        if (m_quantize)
+        {
+            m_row_scratch.resize(m_dim);
+            gallery_normalize(embedding, m_row_scratch.data(), m_dim);
+            quantize(m_row_scratch.data(), m_qrows.data() + (size_t)row * m_dim, m_dim);
+        }
+        else
+        {
+            gallery_normalize(embedding, m_rows.data() + (size_t)row * m_dim, m_dim);
+        }
+    }
+
+    uint32_t append_row(uint32_t id)
+    {
+        uint32_t row = m_num_rows++;
+        if (m_quantize)
+            m_qrows.resize((size_t)m_num_rows * m_dim);
+        else
+            m_rows.resize((size_t)m_num_rows * m_dim);
+        m_row_id.push_back(id);
+        m_row_list.push_back(0);
+        m_row_pos.push_back(0);
+        return row;
+    }
+
+    float score(uint32_t row) const
+    {
+        if (m_quantize)
+            return gallery_dot(quantized_row(row), m_qquery.data(), m_dim) / (QUANTIZATION_SCALE * QUANTIZATION_SCALE);
+        return gallery_dot(float_row(row), m_query.data(), m_dim);
+    }
+
+    //******************************************************************
+    // IVF
+    //******************************************************************
+    uint32_t nearest_list(const float *embedding) const
+    {
+        uint32_t best_list = 0;
+        float best_score = -std::numeric_limits<float>::infinity();
+        for (uint32_t list = 0; list < m_ivf_lists; list++)
+        {
+            float list_score = gallery_dot(m_centroids.data() + (size_t)list * m_dim, embedding, m_dim);
+            if (list_score > best_score)
+            {
+                best_score = list_score;
+                best_list = list;
+            }
+        }
+        return best_list;
+    }
+
+    void list_insert(uint32_t row, uint32_t list)
+    {
+        m_row_list[row] = list;
+        m_row_pos[row] = m_lists[list].size();
+        m_lists[list].push_back(row);
+    }
+
+    void list_remove(uint32_t row)
+    {
+        std::vector<uint32_t> &list = m_lists[m_row_list[row]];
+        uint32_t moved = list.back();
+        list[m_row_pos[row]] = moved;
+        m_row_pos[moved] = m_row_pos[row];
+        list.pop_back();
+    }
+
+    bool ivf_trained() const { return m_trained_rows > 0; }
+
+    void maybe_train()
+    {
+        if (m_ivf_lists == 0 || m_num_rows < m_ivf_lists * IVF_MIN_ROWS_PER_LIST)
+            return;
+        // Retrain whenever the gallery doubled, so the clusters follow its content at an amortized cost
+        if (ivf_trained() && m_num_rows < 2 * m_trained_rows)
+            return;
+        train();
+    }
+
+    void train()
+    {
+        // Spherical k-means over an evenly strided sample of the rows
+        uint32_t sample_size = std::min(m_num_rows, m_ivf_lists * IVF_TRAIN_ROWS_PER_LIST);
+        std::vector<float> sample((size_t)sample_size * m_dim);
+        for (uint32_t i = 0; i < sample_size; i++)
+        {
+            uint32_t row = (uint64_t)i * m_num_rows / sample_size;
+            std::memcpy(sample.data() + (size_t)i * m_dim, row_as_float(row), m_dim * sizeof(float));
+        }
+
+        m_centroids.resize((size_t)m_ivf_lists * m_dim);
+        for (uint32_t list = 0; list < m_ivf_lists; list++)
+        {
+            uint32_t i = (uint64_t)list * sample_size / m_ivf_lists;
+            std::memcpy(m_centroids.data() + (size_t)list * m_dim, sample.data() + (size_t)i * m_dim, m_dim * sizeof(float));
+        }
+
+        std::vector<float> sums((size_t)m_ivf_lists * m_dim);
+        std::vector<uint32_t> counts(m_ivf_lists);
+        for (uint32_t iteration = 0; iteration < IVF_TRAIN_ITERATIONS; iteration++)
+        {
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (uint32_t i = 0; i < sample_size; i++)
+            {
+                const float *embedding = sample.data() + (size_t)i * m_dim;
+                uint32_t list = nearest_list(embedding);
+                float *sum = sums.data() + (size_t)list * m_dim;
+                for (uint32_t k = 0; k < m_dim; k++)
+                    sum[k] += embedding[k];
+                counts[list]++;
+            }
+            for (uint32_t list = 0; list < m_ivf_lists; list++)
+            {
+                // An empty cluster keeps its previous centroid
+                if (counts[list] > 0)
+                    gallery_normalize(sums.data() + (size_t)list * m_dim, m_centroids.data() + (size_t)list * m_dim, m_dim);
+            }
+        }
+
+        m_lists.assign(m_ivf_lists, std::vector<uint32_t>());
+        for (uint32_t row = 0; row < m_num_rows; row++)
+            list_insert(row, nearest_list(row_as_float(row)));
+        m_trained_rows = m_num_rows;
+    }
+
+public:
+    /**
+     * @brief Store the embeddings as int8 instead of float (4x smaller, faster queries).
+     *        Only takes effect while the index is empty.
+     */
+    void set_quantize(bool quantize)
+    {
+        if (m_num_rows == 0)
+            m_quantize = quantize;
+    }
+
+    /**
+     * @brief Configure the approximate (IVF) search.
+     *
+     * @param lists  -  uint32_t
+     *        Number of clusters, 0 disables the index and every query is exact.
+     *        The index is built once the gallery holds 16 rows per cluster.
+     *
+     * @param probes  -  uint32_t
+     *        Number of closest clusters scored by each query.
+     */
+    void set_ivf(uint32_t lists, uint32_t probes)
+    {
+        m_ivf_lists = lists;
+        m_ivf_probes = std::max(1u, probes);
+        m_trained_rows = 0;
+        m_lists.clear();
+        maybe_train();
+    }
+
+    bool get_quantize() const { return m_quantize; }
+    uint32_t get_ivf_lists() const { return m_ivf_lists; }
+    uint32_t get_ivf_probes() const { return m_ivf_probes; }
+    uint32_t num_ids() const { return m_id_rows.size(); }
+    uint32_t num_rows() const { return m_num_rows; }
+
+    /**
+     * @brief Create a new (empty) ID.
+     *
+     * @return uint32_t the 0 based index of the new ID.
+     */
+    uint32_t add_id()
+    {
+        m_id_rows.emplace_back();
+        m_id_cursor.push_back(0);
+        return m_id_rows.size() - 1;
+    }
+
+    /**
+     * @brief Add an embedding to an ID, overwriting its oldest embedding when it already has queue_size.
+     *
+     * @param id  -  uint32_t
+     *        0 based ID index.
+     *
+     * @param embedding  -  const float *
+     *        The embedding, normalized on insertion.
+     *
+     * @param dim  -  uint32_t
+     *        Embedding size, must be the same for all the embeddings.
+     *
+     * @param queue_size  -  uint32_t
+     *        Maximal number of embeddings kept for the ID.
+     */
+    void add(uint32_t id, const float *embedding, uint32_t dim, uint32_t queue_size)
+    {
+        check_dim(dim);
+        materialize();
+        std::vector<uint32_t> &id_rows = m_id_rows[id];
+        uint32_t row;
+        if (id_rows.size() < std::max(1u, queue_size))
+        {
+            row = append_row(id);
+            id_rows.push_back(row);
+            write_row(row, embedding);
+            if (ivf_trained())
+                list_insert(row, nearest_list(row_as_float(row)));
+        }
+        else
+        {
+            uint32_t &cursor = m_id_cursor[id];
+            row = id_rows[cursor % id_rows.size()];
+            cursor = (cursor + 1) % id_rows.size();
+            write_row(row, embedding);
+            if (ivf_trained())
+            {
+                list_remove(row);
+                list_insert(row, nearest_list(row_as_float(row)));
+            }
+        }
+        maybe_train();
+    }
+
+    /**
+     * @brief Use all the embeddings of a mapped gallery file, one new ID per record.
+     *        Float embeddings are used in place, int8 ones are quantized into the index.
+     *
+     * @param mapped  -  std::shared_ptr<GalleryMappedFile>
+     *        The mapped file, kept alive by the index while its rows are in use.
+     */
+    void add_mapped(std::shared_ptr<GalleryMappedFile> mapped)
+    {
+        check_dim(mapped->dim());
+        if (m_quantize || m_num_rows > 0)
+        {
+            for (uint32_t i = 0; i < mapped->count(); i++)
+                add(add_id(), mapped->embeddings() + i * mapped->stride(), m_dim, 1);
+            return;
+        }
+        m_mapped = mapped;
+        for (uint32_t i = 0; i < mapped->count(); i++)
+        {
+            uint32_t id = add_id();
+            m_id_rows[id].push_back(m_num_rows++);
+            m_row_id.push_back(id);
+            m_row_list.push_back(0);
+            m_row_pos.push_back(0);
+        }
+        maybe_train();
+    }
+
+    /**
+     * @brief Find the k closest IDs to a query embedding.
+     *        The distance of an ID is its closest embedding's, 1 - max(0, cosine similarity).
+     *
+     * @param embedding  -  const float *
+     *        The query embedding.
+     *
+     * @param dim  -  uint32_t
+     *        Embedding size.
+     *
+     * @param k  -  uint32_t
+     *        Number of IDs to return.
+     *
+     * @return std::vector<Match> up to k matches, closest first (ties by lower ID).
+     *         IDs that have no embedding are not returned.
+     */
+    std::vector<Match> search(const float *embedding, uint32_t dim, uint32_t k)
+    {
+        std::vector<Match> matches;
+        if (m_num_rows == 0 || k == 0)
+            return matches;
+        if (dim != m_dim)
+            throw std::runtime_error("Embedding size does not match the gallery");
+
+        m_query.resize(m_dim);
+        gallery_normalize(embedding, m_query.data(), m_dim);
+        if (m_quantize)
+        {
+            m_qquery.resize(m_dim);
+            quantize(m_query.data(), m_qquery.data(), m_dim);
+        }
+
+        m_best.resize(m_id_rows.size(), -std::numeric_limits<float>::infinity());
+        m_touched.clear();
+        auto visit = [&](uint32_t row)
+        {
+            uint32_t id = m_row_id[row];
+            float row_score = score(row);
+            if (m_best[id] == -std::numeric_limits<float>::infinity())
+                m_touched.push_back(id);
+            m_best[id] = std::max(m_best[id], row_score);
+        };
+
+        if (ivf_trained())
+        {
+            m_centroid_scores.resize(m_ivf_lists);
+            for (uint32_t list = 0; list < m_ivf_lists; list++)
+                m_centroid_scores[list] = {gallery_dot(m_centroids.data() + (size_t)list * m_dim, m_query.data(), m_dim), list};
+            uint32_t probes = std::min(m_ivf_probes, m_ivf_lists);
+            std::partial_sort(m_centroid_scores.begin(), m_centroid_scores.begin() + probes, m_centroid_scores.end(),
+                              [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b)
+                              { return a.first > b.first; });
+            for (uint32_t probe = 0; probe < probes; probe++)
+            {
+                for (uint32_t row : m_lists[m_centroid_scores[probe].second])
+                    visit(row);
+            }
+        }
+        else
+        {
+            for (uint32_t row = 0; row < m_num_rows; row++)
+                visit(row);
+        }
+
+        matches.reserve(m_touched.size());
+        for (uint32_t id : m_touched)
+        {
+            matches.push_back({id, 1.0f - std::max(0.0f, m_best[id])});
+            m_best[id] = -std::numeric_limits<float>::infinity();
+        }
+        uint32_t count = std::min<size_t>(k, matches.size());
+        std::partial_sort(matches.begin(), matches.begin() + count, matches.end(),
+                          [](const Match &a, const Match &b)
+                          { return a.distance < b.distance || (a.distance == b.distance && a.id < b.id); });
+        matches.resize(count);
+        return matches;
+    }
+};
@@ -32,6 +32,9 @@ enum
     PROP_LOAD_GALLERY,
     PROP_SAVE_GALLERY,
     PROP_LOCAL_GALLERY_FILE_PATH,
+    PROP_QUANTIZE_EMBEDDINGS,
+    PROP_IVF_LISTS,
+    PROP_IVF_PROBES,
 };
 
 //******************************************************************
@@ -96,7 +99,8 @@ gst_hailo_gallery_class_init(GstHailoGalleryClass *klass)
 
     g_object_class_install_property(gobject_class, PROP_LOCAL_GALLERY_FILE_PATH,
                                     g_param_spec_string("gallery-file-path", "Load Gallery",
-                                                        "Gallery JSON file path to load",
+                                                        "Gallery file path to load/save. A .json path uses the JSON format, "
+                                                        "any other path uses the binary format, which is appended to in place and memory mapped on load.",
                                                         "",
                                                         (GParamFlags)(GST_PARAM_CONTROLLABLE | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
@@ -112,6 +116,24 @@ gst_hailo_gallery_class_init(GstHailoGalleryClass *klass)
                                                          FALSE,
                                                          (GParamFlags)(GST_PARAM_CONTROLLABLE | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 
+    g_object_class_install_property(gobject_class, PROP_QUANTIZE_EMBEDDINGS,
+                                    g_param_spec_boolean("quantize-embeddings", "Quantize Embeddings",
+                                                         "Keep the gallery embeddings as int8 instead of float. 4x less memory and faster search, "
+                                                         "at a small accuracy cost.",
+                                                         FALSE,
+                                                         (GParamFlags)(GST_PARAM_MUTABLE_READY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_IVF_LISTS,
+                                    g_param_spec_uint("ivf-lists", "IVF Lists",
+                                                      "Number of clusters of the approximate search index. 0 searches the whole gallery (exact). "
+                                                      "Worth enabling for galleries of many thousands of embeddings, for example sqrt(gallery size).",
+                                                      0, G_MAXUINT16, 0,
+                                                      (GParamFlags)(GST_PARAM_MUTABLE_READY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_IVF_PROBES,
+                                    g_param_spec_uint("ivf-probes", "IVF Probes",
+                                                      "Number of closest clusters searched per query when ivf-lists is set. Higher is more accurate and slower.",
+                                                      1, G_MAXUINT16, 8,
+                                                      (GParamFlags)(GST_PARAM_MUTABLE_READY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+
     // Set virtual functions
     gobject_class->dispose = gst_hailo_gallery_dispose;
     base_transform_class->transform_ip = GST_DEBUG_FUNCPTR(gst_hailo_gallery_transform_ip);
@@ -184,6 +206,15 @@ void gst_hailo_gallery_set_property(GObject *object, guint property_id,
     case PROP_SAVE_GALLERY:
         hailogallery->save_gallery = g_value_get_boolean(value);
         break;
+    case PROP_QUANTIZE_EMBEDDINGS:
+        hailogallery->gallery.set_quantize_embeddings(g_value_get_boolean(value));
+        break;
+    case PROP_IVF_LISTS:
+        hailogallery->gallery.set_ivf(g_value_get_uint(value), hailogallery->gallery.get_ivf_probes());
+        break;
+    case PROP_IVF_PROBES:
+        hailogallery->gallery.set_ivf(hailogallery->gallery.get_ivf_lists(), g_value_get_uint(value));
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -218,6 +249,15 @@ void gst_hailo_gallery_get_property(GObject *object, guint property_id,
     case PROP_SAVE_GALLERY:
         g_value_set_boolean(value, hailogallery->save_gallery);
         break;
+    case PROP_QUANTIZE_EMBEDDINGS:
+        g_value_set_boolean(value, hailogallery->gallery.get_quantize_embeddings());
+        break;
+    case PROP_IVF_LISTS:
+        g_value_set_uint(value, hailogallery->gallery.get_ivf_lists());
+        break;
+    case PROP_IVF_PROBES:
+        g_value_set_uint(value, hailogallery->gallery.get_ivf_probes());
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -234,6 +274,7 @@ void gst_hailo_gallery_dispose(GObject *object)
     GstHailoGallery *hailogallery = GST_HAILO_GALLERY(object);
 
     GST_DEBUG_OBJECT(hailogallery, "dispose");
+    hailogallery->gallery.close_local_gallery();
 
     G_OBJECT_CLASS(gst_hailo_gallery_parent_class)->dispose(object);
 }
@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+#pragma once
+
+// General cpp includes
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Tappas includes
+#include "hailo_objects.hpp"
+#include "hailo_common.hpp"
+#include "common/hailo_binary_format.hpp"
+
+namespace decode_binary
+{
+    HailoBBox decode_bbox(HailoBinaryReader &reader);
+    void decode_detection(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner);
+    void decode_classification(HailoBinaryReader &reader, HailoROIPtr roi);
+    void decode_landmarks(HailoBinaryReader &reader, HailoROIPtr roi);
+    void decode_tile(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner);
+    void decode_unique_id(HailoBinaryReader &reader, HailoROIPtr roi);
+    void decode_matrix(HailoBinaryReader &reader, HailoROIPtr roi);
+    void decode_tensors(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner);
+    bool decode_hailo_objects(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner);
+}
+
+namespace decode_binary
+{
+    /**
+     * @brief A tensor decoded in place, together with the message holding its data.
+     */
+    struct MessageTensor
+    {
+        std::shared_ptr<void> owner;
+        HailoTensor tensor;
+
+        MessageTensor(const std::shared_ptr<void> &message, uint8_t *data, const hailo_vstream_info_t &info) : owner(message), tensor(data, info) {}
+    };
+
+    inline HailoBBox decode_bbox(HailoBinaryReader &reader)
+    {
+        float xmin = reader.read<float>();
+        float ymin = reader.read<float>();
+        float width = reader.read<float>();
+        float height = reader.read<float>();
+        return HailoBBox(xmin, ymin, width, height);
+    }
+
+    inline void decode_detection(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner)
+    {
+        HailoBBox bbox = decode_bbox(reader);
+        float confidence = reader.read<float>();
+        int class_id = reader.read<int32_t>();
+        std::string label = reader.read_string();
+        if (!reader.ok())
+            return;
+
+        HailoDetectionPtr detection = hailo_make_shared<HailoDetection>(bbox, class_id, label, confidence);
+
+        // Add this detection object to the parent
+        roi->add_object(detection);
+
+        // Recurse this object
+        decode_hailo_objects(reader, detection, owner);
+        decode_tensors(reader, detection, owner);
+    }
+
+    inline void decode_classification(HailoBinaryReader &reader, HailoROIPtr roi)
+    {
+        float confidence = reader.read<float>();
+        int class_id = reader.read<int32_t>();
+        std::string classification_type = reader.read_string();
+        std::string label = reader.read_string();
+        if (!reader.ok())
+            return;
+
+        // Add this classification object to the parent
+        roi->add_object(hailo_make_shared<HailoClassification>(classification_type, class_id, label, confidence));
+    }
+
+    inline void decode_landmarks(HailoBinaryReader &reader, HailoROIPtr roi)
+    {
+        float threshold = reader.read<float>();
+        std::string landmarks_type = reader.read_string();
+
+        // Decode points
+        uint32_t num_points = reader.read<uint32_t>();
+        std::vector<HailoPoint> decoded_points;
+        decoded_points.reserve(std::min<size_t>(num_points, reader.remaining() / (3 * sizeof(float))));
+        for (uint32_t i = 0; i < num_points && reader.ok(); i++)
+        {
+            float x = reader.read<float>();
+            float y = reader.read<float>();
+            float confidence = reader.read<float>();
+            decoded_points.emplace_back(x, y, confidence);
+        }
+
+        // Decode point pairs
+        uint32_t num_pairs = reader.read<uint32_t>();
+        std::vector<std::pair<int, int>> decoded_pairs;
+        decoded_pairs.reserve(std::min<size_t>(num_pairs, reader.remaining() / (2 * sizeof(int32_t))));
+        for (uint32_t i = 0; i < num_pairs && reader.ok(); i++)
+        {
+            int first = reader.read<int32_t>();
+            int second = reader.read<int32_t>();
+            decoded_pairs.emplace_back(first, second);
+        }
+        if (!reader.ok())
+            return;
+
+        // Add this landmarks object to the parent
+        roi->add_object(hailo_make_shared<HailoLandmarks>(landmarks_type, decoded_points, threshold, decoded_pairs));
+    }
+
+    inline void decode_tile(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner)
+    {
+        HailoBBox bbox = decode_bbox(reader);
+        uint index = reader.read<uint32_t>();
+        uint layer = reader.read<uint32_t>();
+        uint mode = reader.read<uint32_t>();
+        float overlap_x_axis = reader.read<float>();
+        float overlap_y_axis = reader.read<float>();
+        if (!reader.ok())
+            return;
+
+        HailoTileROIPtr tile = hailo_make_shared<HailoTileROI>(bbox, index, overlap_x_axis, overlap_y_axis, layer,
+                                                               (hailo_tiling_mode_t)mode);
+
+        // Add this tile object to the parent
+        roi->add_object(tile);
+
+        // Recurse this object
+        decode_hailo_objects(reader, tile, owner);
+        decode_tensors(reader, tile, owner);
+    }
+
+    inline void decode_unique_id(HailoBinaryReader &reader, HailoROIPtr roi)
+    {
+        int unique_id = reader.read<int32_t>();
+        int mode = reader.read<int32_t>();
+        if (!reader.ok())
+            return;
+
+        // Add this unique id object to the parent
+        roi->add_object(hailo_make_shared<HailoUniqueID>(unique_id, (hailo_unique_id_mode_t)mode));
+    }
+
+    inline void decode_matrix(HailoBinaryReader &reader, HailoROIPtr roi)
+    {
+        uint32_t width = reader.read<uint32_t>();
+        uint32_t height = reader.read<uint32_t>();
+        uint32_t features = reader.read<uint32_t>();
+        std::vector<float> matrix_data = reader.read_array<float>();
+        if (!reader.ok())
+            return;
+
+        // Add this matrix object to the parent
+        roi->add_object(hailo_make_shared<HailoMatrix>(std::move(matrix_data), height, width, features));
+    }
+
+    /**
+     * @brief Decode the tensors of a ROI. The tensors point into the message without copying,
+     *        and keep owner (the storage of the message) alive.
+     */
+    inline void decode_tensors(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner)
+    {
+        uint32_t count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < count && reader.ok(); i++)
+        {
+            hailo_vstream_info_t info;
+            std::memset(&info, 0, sizeof(info));
+            std::string name = reader.read_string();
+            std::strncpy(info.name, name.c_str(), sizeof(info.name) - 1);
+            info.format.type = (hailo_format_type_t)reader.read<uint32_t>();
+            info.format.order = (hailo_format_order_t)reader.read<uint32_t>();
+            info.format.flags = (hailo_format_flags_t)reader.read<uint32_t>();
+            info.shape.height = reader.read<uint32_t>();
+            info.shape.width = reader.read<uint32_t>();
+            info.shape.features = reader.read<uint32_t>();
+            info.quant_info.qp_zp = reader.read<float>();
+            info.quant_info.qp_scale = reader.read<float>();
+            info.quant_info.limvals_min = reader.read<float>();
+            info.quant_info.limvals_max = reader.read<float>();
+            uint32_t data_size = reader.read<uint32_t>();
+            reader.align(8);
+            const uint8_t *data = reader.take(data_size);
+            reader.align(4);
+            if (!reader.ok())
+                return;
+
+            auto message_tensor = std::make_shared<MessageTensor>(owner, const_cast<uint8_t *>(data), info);
+            roi->add_tensor(HailoTensorPtr(message_tensor, &message_tensor->tensor));
+        }
+    }
+
+    /**
+     * @brief Decode an object list into roi.
+     *
+     * @return false if the message is malformed, objects decoded so far are kept.
+     */
+    inline bool decode_hailo_objects(HailoBinaryReader &reader, HailoROIPtr roi, const std::shared_ptr<void> &owner)
+    {
+        uint32_t count = reader.read<uint32_t>();
+        for (uint32_t i = 0; i < count && reader.ok(); i++)
+        {
+            uint32_t type = reader.read<uint32_t>();
+            uint32_t size = reader.read<uint32_t>();
+            // Each record is read on its own, unknown types are skipped
+            HailoBinaryReader record = reader.sub_reader(size);
+            if (!reader.ok() || size == 0)
+                continue;
+
+            switch (type)
+            {
+            case HAILO_DETECTION:
+                decode_detection(record, roi, owner);
+                break;
+            case HAILO_CLASSIFICATION:
+                decode_classification(record, roi);
+                break;
+            case HAILO_LANDMARKS:
+                decode_landmarks(record, roi);
+                break;
+            case HAILO_TILE:
+                decode_tile(record, roi, owner);
+                break;
+            case HAILO_UNIQUE_ID:
+                decode_unique_id(record, roi);
+                break;
+            case HAILO_DEPTH_MASK:
+            {
+                int width = record.read<int32_t>();
+                int height = record.read<int32_t>();
+                float transparency = record.read<float>();
+                std::vector<float> data = record.read_array<float>();
+                if (record.ok())
+                    roi->add_object(hailo_make_shared<HailoDepthMask>(std::move(data), width, height, transparency));
+                break;
+            }
+            case HAILO_CLASS_MASK:
+            {
+                int width = record.read<int32_t>();
+                int height = record.read<int32_t>();
+                float transparency = record.read<float>();
+                std::vector<uint8_t> data = record.read_array<uint8_t>();
+                if (record.ok())
+                    roi->add_object(hailo_make_shared<HailoClassMask>(std::move(data), width, height, transparency));
+                break;
+            }
+            case HAILO_CONF_CLASS_MASK:
+            {
+                int width = record.read<int32_t>();
+                int height = record.read<int32_t>();
+                float transparency = record.read<float>();
+                int class_id = record.read<int32_t>();
+                std::vector<float> data = record.read_array<float>();
+                if (record.ok())
+                    roi->add_object(hailo_make_shared<HailoConfClassMask>(std::move(data), width, height, transparency, class_id));
+                break;
+            }
+            case HAILO_MATRIX:
+                decode_matrix(record, roi);
+                break;
+            default:
+                // continue
+                break;
+            }
+            if (!record.ok())
+                return false;
+        }
+        return reader.ok();
+    }
+
+    /**
+     * @brief Decode a binary message into a HailoROI.
+     *
+     * @param data  -  const void *
+     * @param size  -  size_t
+     *        The message.
+     *
+     * @param roi  -  HailoROIPtr
+     *        The sub objects (and tensors) of the message are added to this ROI.
+     *
+     * @param header  -  HailoBinaryHeader
+     *        Output, the header of the message.
+     *
+     * @param owner  -  std::shared_ptr<void>
+     *        The storage of data. Decoded tensors point into the message and hold a reference to it.
+     *
+     * @return false if the message is not a valid binary message.
+     */
+    inline bool decode_hailo_roi(const void *data, size_t size, HailoROIPtr roi, HailoBinaryHeader &header, const std::shared_ptr<void> &owner)
+    {
+        HailoBinaryReader reader(data, size);
+        header = reader.read<HailoBinaryHeader>();
+        if (!reader.ok() || std::memcmp(header.magic, HAILO_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != HAILO_BINARY_VERSION || header.header_size < sizeof(HailoBinaryHeader))
+            return false;
+        reader.take(header.header_size - sizeof(HailoBinaryHeader));
+        HailoBinaryReader payload = reader.sub_reader(header.payload_size);
+        if (!reader.ok())
+            return false;
+
+        // The bbox of the main ROI is kept, as with JSON
+        decode_bbox(payload);
+        if (!decode_hailo_objects(payload, roi, owner))
+            return false;
+        decode_tensors(payload, roi, owner);
+        return payload.ok();
+    }
+}
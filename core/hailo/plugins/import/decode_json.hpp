@@ -65,7 +65,7 @@ namespace decode_json
     {
         HailoBBox bbox = decode_bbox(object_json["HailoBBox"]);
 
-        HailoDetectionPtr detection = std::make_shared<HailoDetection>(bbox,
+        HailoDetectionPtr detection = hailo_make_shared<HailoDetection>(bbox,
                                                                     object_json["class_id"].GetInt(),
                                                                     object_json["label"].GetString(),
                                                                     object_json["confidence"].GetFloat());
@@ -80,7 +80,7 @@ namespace decode_json
     inline void decode_classification(rapidjson::Value& object_json, HailoROIPtr roi)
     {
         // Add this classification object to the parent
-        roi->add_object(std::make_shared<HailoClassification>(object_json["classification_type"].GetString(),
+        roi->add_object(hailo_make_shared<HailoClassification>(object_json["classification_type"].GetString(),
                                                                 object_json["class_id"].GetInt(),
                                                                 object_json["label"].GetString(),
                                                                 object_json["confidence"].GetFloat()));
@@ -115,7 +115,7 @@ namespace decode_json
         }
 
         // Add this landmarks object to the parent
-        roi->add_object(std::make_shared<HailoLandmarks>(object_json["landmarks_type"].GetString(),
+        roi->add_object(hailo_make_shared<HailoLandmarks>(object_json["landmarks_type"].GetString(),
                                                         decoded_points,
                                                         object_json["threshold"].GetFloat(),
                                                         decoded_pairs));
@@ -125,7 +125,7 @@ namespace decode_json
     {
         HailoBBox bbox = decode_bbox(object_json["HailoBBox"]);
 
-        HailoTileROIPtr tile = std::make_shared<HailoTileROI>(bbox,
+        HailoTileROIPtr tile = hailo_make_shared<HailoTileROI>(bbox,
                                                             object_json["index"].GetInt(),
                                                             object_json["overlap_x_axis"].GetFloat(),
                                                             object_json["overlap_y_axis"].GetFloat(),
@@ -142,7 +142,7 @@ namespace decode_json
     inline void decode_unique_id(rapidjson::Value& object_json, HailoROIPtr roi)
     {
         // Add this classification object to the parent
-        roi->add_object(std::make_shared<HailoUniqueID>(object_json["unique_id"].GetInt(),
+        roi->add_object(hailo_make_shared<HailoUniqueID>(object_json["unique_id"].GetInt(),
                                                         (hailo_unique_id_mode_t)object_json["mode"].GetInt()));
     }
 
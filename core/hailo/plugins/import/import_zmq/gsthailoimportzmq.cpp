@@ -49,8 +49,27 @@ enum
 {
     PROP_0,
     PROP_ADDRESS,
+    PROP_FORMAT,
 };
 
+#define GST_TYPE_HAILO_IMPORT_ZMQ_FORMAT (gst_hailoimportzmq_format_get_type())
+static GType
+gst_hailoimportzmq_format_get_type(void)
+{
+    static GType hailoimportzmq_format_type = 0;
+    static const GEnumValue hailoimportzmq_formats[] = {
+        {HAILO_METADATA_FORMAT_JSON, "JSON text", "json"},
+        {HAILO_METADATA_FORMAT_BINARY, "Compact binary format, see hailo_binary_format.hpp", "binary"},
+        {0, NULL, NULL},
+    };
+    if (!hailoimportzmq_format_type)
+    {
+        hailoimportzmq_format_type =
+            g_enum_register_static("GstHailoImportZMQFormat", hailoimportzmq_formats);
+    }
+    return hailoimportzmq_format_type;
+}
+
 // Default import node
 const gchar *DEFAULT_ADDRESS = "tcp://localhost:5555";
 
@@ -61,9 +80,9 @@ gst_hailoimportzmq_class_init(GstHailoImportZMQClass *klass)
     GstBaseTransformClass *base_transform_class =
         GST_BASE_TRANSFORM_CLASS(klass);
 
-    const char *description = "Imports HailoObjects in JSON format from a ZMQ socket."
+    const char *description = "Imports HailoObjects in JSON or binary format from a ZMQ socket."
                               "\n\t\t\t   "
-                              "Decodes classes contained by JSON to HailoROI objects.";
+                              "Decodes classes contained by JSON or binary messages to HailoROI objects.";
     /* Setting up pads and setting metadata should be moved to
        base_class_init if you intend to subclass this class. */
     gst_element_class_add_pad_template(GST_ELEMENT_CLASS(klass),
@@ -85,6 +104,11 @@ gst_hailoimportzmq_class_init(GstHailoImportZMQClass *klass)
                                     g_param_spec_string("address", "Endpoint address.",
                                                         "Address to bind the socket to.", "tcp://localhost:5555",
                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class, PROP_FORMAT,
+                                    g_param_spec_enum("format", "Message format",
+                                                      "Format of the received metadata, must match the format of hailoexportzmq.",
+                                                      GST_TYPE_HAILO_IMPORT_ZMQ_FORMAT, HAILO_METADATA_FORMAT_JSON,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 
     gobject_class->dispose = gst_hailoimportzmq_dispose;
     gobject_class->finalize = gst_hailoimportzmq_finalize;
@@ -97,6 +121,7 @@ static void
 gst_hailoimportzmq_init(GstHailoImportZMQ *hailoimportzmq)
 {
     hailoimportzmq->address = g_strdup(DEFAULT_ADDRESS);
+    hailoimportzmq->format = HAILO_METADATA_FORMAT_JSON;
 }
 
 void gst_hailoimportzmq_set_property(GObject *object, guint property_id,
@@ -111,6 +136,9 @@ void gst_hailoimportzmq_set_property(GObject *object, guint property_id,
     case PROP_ADDRESS:
         hailoimportzmq->address = g_strdup(g_value_get_string(value));
         break;
+    case PROP_FORMAT:
+        hailoimportzmq->format = (hailo_metadata_format_t)g_value_get_enum(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -129,6 +157,9 @@ void gst_hailoimportzmq_get_property(GObject *object, guint property_id,
     case PROP_ADDRESS:
         g_value_set_string(value, hailoimportzmq->address);
         break;
+    case PROP_FORMAT:
+        g_value_set_enum(value, hailoimportzmq->format);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -202,8 +233,9 @@ gst_hailoimportzmq_transform_ip(GstBaseTransform *trans,
     // Get the roi from the current buffer and decode it to a JSON entry
     HailoROIPtr hailo_roi = get_hailo_main_roi(buffer, true);
 
-    // Recv the message
-    zmq::message_t recv_message;
+    // Recv the message, it is shared so tensors decoded from a binary message can point into it
+    std::shared_ptr<zmq::message_t> message = std::make_shared<zmq::message_t>();
+    zmq::message_t &recv_message = *message;
 #if (CPPZMQ_VERSION_MAJOR >= 4 && CPPZMQ_VERSION_MINOR >= 6 && CPPZMQ_VERSION_PATCH >= 0)
     zmq::recv_result_t recv_succeeded = 0;
 #else
@@ -217,6 +249,15 @@ gst_hailoimportzmq_transform_ip(GstBaseTransform *trans,
     if (recv_succeeded <= 0)
         GST_WARNING("hailoimportzmq failed to send buffer!");
 
+    if (hailoimportzmq->format == HAILO_METADATA_FORMAT_BINARY)
+    {
+        HailoBinaryHeader header;
+        if (!decode_binary::decode_hailo_roi(recv_message.data(), recv_message.size(), hailo_roi, header, message))
+            GST_ERROR("hailoimportzmq failed to decode binary message!");
+        GST_DEBUG_OBJECT(hailoimportzmq, "transform_ip");
+        return GST_FLOW_OK;
+    }
+
     // Decode the recvd JSON
     std::string rx_str;
     rx_str.assign(static_cast<char *>(recv_message.data()), recv_message.size());
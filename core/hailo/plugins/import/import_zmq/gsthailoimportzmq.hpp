@@ -7,6 +7,7 @@
 #include <gst/base/gstbasetransform.h>
 #include "hailo_objects.hpp"
 #include "import/decode_json.hpp"
+#include "import/decode_binary.hpp"
 #include <cstdio>
 #include <zmq.hpp>
 
@@ -25,6 +26,7 @@ struct _GstHailoImportZMQ
 {
     GstBaseTransform base_hailoimportzmq;
     gchar *address;
+    hailo_metadata_format_t format;
     zmq::context_t *context;
     zmq::socket_t *socket;
 };
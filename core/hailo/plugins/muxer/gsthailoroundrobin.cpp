@@ -9,6 +9,7 @@
  */
 
 #include "gsthailoroundrobin.hpp"
+#include <algorithm>
 #include "gst_hailo_meta.hpp"
 #include "gst_hailo_stream_meta.hpp"
 
@@ -45,6 +46,12 @@ GType gst_hailo_round_robin_pad_get_type(void);
 #define MAX_PREROLL_FRAMES 30
 #define MIN_PREROLL_FRAMES 1
 
+#define DEFAULT_MAX_LATENCY 33
+#define MAX_MAX_LATENCY 10000
+#define MIN_MAX_LATENCY 0
+
+#define GST_HAILO_ROUND_ROBIN_MAX_PAD_WEIGHT 100
+
 typedef struct _GstHailoRoundRobinPad GstHailoRoundRobinPad;
 typedef struct _GstHailoRoundRobinPadClass GstHailoRoundRobinPadClass;
 
@@ -67,10 +74,31 @@ gst_hailoroundrobin_mode_get_type(void)
     return hailoroundrobin_mode_type;
 }
 
+#define GST_TYPE_HAILOROUNDROBIN_SCHEDULE_POLICY (gst_hailoroundrobin_schedule_policy_get_type())
+static GType
+gst_hailoroundrobin_schedule_policy_get_type(void)
+{
+    static GType hailoroundrobin_schedule_policy_type = 0;
+    static const GEnumValue hailoroundrobin_schedule_policies[] = {
+        {GST_HAILO_ROUND_ROBIN_SCHEDULE_ROUND_ROBIN, "Round Robin (one buffer per pad in pad order, wait up to retries-num * wait-time for a missing buffer)", "round-robin"},
+        {GST_HAILO_ROUND_ROBIN_SCHEDULE_FAIR_SHARE, "Fair Share (one buffer per ready pad per round, never wait for a pad)", "fair-share"},
+        {GST_HAILO_ROUND_ROBIN_SCHEDULE_WEIGHTED, "Weighted (up to pad-weights[i] buffers from ready pad i per round, never wait for a pad)", "weighted"},
+        {GST_HAILO_ROUND_ROBIN_SCHEDULE_LATENCY_BOUNDED, "Latency Bounded (round robin, but pads that are not ready within max-latency of the round start are skipped)", "latency-bounded"},
+        {0, NULL, NULL},
+    };
+    if (!hailoroundrobin_schedule_policy_type)
+    {
+        hailoroundrobin_schedule_policy_type =
+            g_enum_register_static("GstHailoRoundRobinSchedulePolicy", hailoroundrobin_schedule_policies);
+    }
+    return hailoroundrobin_schedule_policy_type;
+}
+
 struct _GstHailoRoundRobinPad
 {
     GstPad parent;
     gboolean got_eos;
+    size_t pad_num;
 };
 
 struct _GstHailoRoundRobinPadClass
@@ -100,6 +128,9 @@ enum
     PROP_QUEUE_SIZE,
     PROP_WAIT_TIME,
     PROP_PREROLL_FRAMES,
+    PROP_SCHEDULE_POLICY,
+    PROP_PAD_WEIGHTS,
+    PROP_MAX_LATENCY,
 };
 
 static void
@@ -111,6 +142,7 @@ static void
 gst_hailo_round_robin_pad_init(GstHailoRoundRobinPad *pad)
 {
     pad->got_eos = FALSE;
+    pad->pad_num = 0;
 }
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE("sink_%u",
@@ -156,6 +188,32 @@ static GstPad *gst_hailo_round_robin_request_new_pad(GstElement *element,
 static void gst_hailo_round_robin_release_pad(GstElement *element, GstPad *pad);
 static void gst_hailo_round_robin_dispose(GObject *object);
 
+static void
+set_pad_weights(GstHailoRoundRobin *hailo_round_robin, const GValue *value)
+{
+    if (value == NULL)
+    {
+        GST_ERROR("initialization of element property pad-weights: value is NULL");
+        return;
+    }
+    guint len = gst_value_array_get_size(value);
+    hailo_round_robin->pad_weights.clear();
+    for (guint i = 0; i < len; i++)
+        hailo_round_robin->pad_weights.push_back(g_value_get_uint(gst_value_array_get_value(value, i)));
+}
+
+static void
+get_pad_weights(GstHailoRoundRobin *hailo_round_robin, GValue *value)
+{
+    for (uint weight : hailo_round_robin->pad_weights)
+    {
+        GValue val = G_VALUE_INIT;
+        g_value_init(&val, G_TYPE_UINT);
+        g_value_set_uint(&val, weight);
+        gst_value_array_append_and_take_value(value, &val);
+    }
+}
+
 static void
 gst_hailo_round_robin_set_property(GObject *object, guint prop_id,
                                    const GValue *value, GParamSpec *pspec)
@@ -187,6 +245,21 @@ gst_hailo_round_robin_set_property(GObject *object, guint prop_id,
         GST_HAILO_ROUND_ROBIN(object)->preroll_frames = g_value_get_uint(value);
         break;
     }
+    case PROP_SCHEDULE_POLICY:
+    {
+        GST_HAILO_ROUND_ROBIN(object)->schedule_policy = (GstHailoRoundRobinSchedulePolicy)g_value_get_enum(value);
+        break;
+    }
+    case PROP_PAD_WEIGHTS:
+    {
+        set_pad_weights(GST_HAILO_ROUND_ROBIN(object), value);
+        break;
+    }
+    case PROP_MAX_LATENCY:
+    {
+        GST_HAILO_ROUND_ROBIN(object)->max_latency = g_value_get_uint(value);
+        break;
+    }
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -214,6 +287,15 @@ gst_hailo_round_robin_get_property(GObject *object, guint prop_id, GValue *value
     case PROP_PREROLL_FRAMES:
         g_value_set_uint(value, GST_HAILO_ROUND_ROBIN(object)->preroll_frames);
         break;
+    case PROP_SCHEDULE_POLICY:
+        g_value_set_enum(value, GST_HAILO_ROUND_ROBIN(object)->schedule_policy);
+        break;
+    case PROP_PAD_WEIGHTS:
+        get_pad_weights(GST_HAILO_ROUND_ROBIN(object), value);
+        break;
+    case PROP_MAX_LATENCY:
+        g_value_set_uint(value, GST_HAILO_ROUND_ROBIN(object)->max_latency);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -265,70 +347,219 @@ forward_events(GstPad *pad, GstEvent **event, gpointer user_data)
     return res;
 }
 
+/**
+ * Wake the scheduler thread, called whenever a buffer was queued or the thread should stop.
+ */
+static void notify_scheduler(GstHailoRoundRobin *hailo_round_robin)
+{
+    {
+        std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+        hailo_round_robin->schedule_seq++;
+    }
+    hailo_round_robin->schedule_cv->notify_one();
+}
+
+static guint64 get_schedule_seq(GstHailoRoundRobin *hailo_round_robin)
+{
+    std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+    return hailo_round_robin->schedule_seq;
+}
+
+/**
+ * Block the scheduler thread until a buffer was queued after seen_seq was read, or until the deadline.
+ *
+ * @return false if the deadline passed without any new buffer.
+ */
+static bool wait_for_buffers(GstHailoRoundRobin *hailo_round_robin, guint64 seen_seq,
+                             std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+{
+    std::unique_lock<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+    auto woken = [hailo_round_robin, seen_seq]
+    { return hailo_round_robin->stop_thread || hailo_round_robin->schedule_seq != seen_seq; };
+    if (deadline == std::chrono::steady_clock::time_point::max())
+    {
+        hailo_round_robin->schedule_cv->wait(lock, woken);
+        return true;
+    }
+    return hailo_round_robin->schedule_cv->wait_until(lock, deadline, woken);
+}
+
+/**
+ * Pop the next buffer of a pad queue, and let the pad's chain function queue another one.
+ *
+ * @return The buffer, or NULL if the queue is empty.
+ */
+static GstBuffer *pop_pad_buffer(GstHailoRoundRobin *hailo_round_robin, size_t pad_num)
+{
+    GstBuffer *buf = NULL;
+    {
+        std::lock_guard<std::mutex> lock(*hailo_round_robin->mutexes_non_blocking[pad_num]);
+        if (hailo_round_robin->pad_queues[pad_num] == NULL || hailo_round_robin->pad_queues[pad_num]->empty())
+            return NULL;
+        buf = hailo_round_robin->pad_queues[pad_num]->front();
+        hailo_round_robin->pad_queues[pad_num]->pop();
+    }
+    if (hailo_round_robin->condition_vars_non_blocking[pad_num] != NULL)
+        hailo_round_robin->condition_vars_non_blocking[pad_num]->notify_one();
+    return buf;
+}
+
+/**
+ * Push a buffer that was queued on a sink pad to the src pad.
+ */
+static void push_pad_buffer(GstHailoRoundRobin *hailo_round_robin, size_t pad_num, GstBuffer *buf)
+{
+    GstPad *pad = NULL;
+    {
+        std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+        if (pad_num < hailo_round_robin->sink_pads.size() && hailo_round_robin->sink_pads[pad_num] != NULL)
+            pad = GST_PAD_CAST(gst_object_ref(hailo_round_robin->sink_pads[pad_num]));
+    }
+    if (pad == NULL)
+    {
+        GST_ERROR_OBJECT(hailo_round_robin, "Failed to get pad %zu", pad_num);
+        gst_buffer_unref(buf);
+        return;
+    }
+    set_current_pad_num(hailo_round_robin, pad_num);
+
+    buf = gst_buffer_make_writable(buf);
+    gchar *stream_id = gst_pad_get_stream_id(pad);
+
+    // Add stream meta to the buffer including the pad name and stream id.
+    gst_buffer_add_hailo_stream_meta(buf, GST_PAD_NAME(pad), stream_id);
+
+    // Forward sticky events.
+    gst_pad_sticky_events_foreach(pad, forward_events, hailo_round_robin->srcpad);
+
+    // Push out_buffer forward.
+    GstFlowReturn res = gst_pad_push(hailo_round_robin->srcpad, buf);
+    if (res != GST_FLOW_OK)
+    {
+        GST_ERROR_OBJECT(hailo_round_robin, "Failed to push buffer to srcpad");
+    }
+    gst_object_unref(pad);
+    g_free(stream_id);
+}
+
+/**
+ * Wait for a buffer on one pad until a deadline, and push it.
+ * Any queued buffer (on any pad) wakes the wait, so the pad is re-checked without polling.
+ *
+ * @return Whether a buffer was pushed.
+ */
+static bool push_pad_buffer_until(GstHailoRoundRobin *hailo_round_robin, size_t pad_num, std::chrono::steady_clock::time_point deadline)
+{
+    while (!hailo_round_robin->stop_thread)
+    {
+        guint64 seq = get_schedule_seq(hailo_round_robin);
+        GstBuffer *buf = pop_pad_buffer(hailo_round_robin, pad_num);
+        if (buf != NULL)
+        {
+            push_pad_buffer(hailo_round_robin, pad_num, buf);
+            return true;
+        }
+        if (std::chrono::steady_clock::now() >= deadline || !wait_for_buffers(hailo_round_robin, seq, deadline))
+            return false;
+    }
+    return false;
+}
+
+/**
+ * Round robin: push one buffer per pad, in pad order.
+ * A pad that has no buffer is waited for up to retries-num * wait-time ms before it is skipped.
+ */
+static size_t schedule_round_robin(GstHailoRoundRobin *hailo_round_robin)
+{
+    size_t pushed = 0;
+    for (size_t i = 0; i < hailo_round_robin->pad_queues.size() && !hailo_round_robin->stop_thread; i++)
+    {
+        if (hailo_round_robin->pad_queues[i] == NULL)
+            continue;
+        auto deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(hailo_round_robin->wait_time * hailo_round_robin->retries_num);
+        if (push_pad_buffer_until(hailo_round_robin, i, deadline))
+            pushed++;
+    }
+    return pushed;
+}
+
+/**
+ * Fair share / weighted: push only what is ready, never wait for a pad.
+ * Every pad gets up to its weight of buffers per round (1 in fair share mode), and the first pad
+ * of the round rotates so no pad is always served first.
+ */
+static size_t schedule_weighted(GstHailoRoundRobin *hailo_round_robin, size_t first_pad, bool use_weights)
+{
+    size_t pushed = 0;
+    size_t num_pads = hailo_round_robin->pad_queues.size();
+    for (size_t n = 0; n < num_pads && !hailo_round_robin->stop_thread; n++)
+    {
+        size_t i = (first_pad + n) % num_pads;
+        uint weight = 1;
+        if (use_weights && i < hailo_round_robin->pad_weights.size())
+            weight = std::max(1u, hailo_round_robin->pad_weights[i]);
+        for (uint w = 0; w < weight; w++)
+        {
+            GstBuffer *buf = pop_pad_buffer(hailo_round_robin, i);
+            if (buf == NULL)
+                break;
+            push_pad_buffer(hailo_round_robin, i, buf);
+            pushed++;
+        }
+    }
+    return pushed;
+}
+
+/**
+ * Latency bounded: push one buffer per pad in pad order, like round robin, but the whole round
+ * shares a single deadline of max-latency ms. Once it passed, stalled pads are skipped at once
+ * instead of holding back the rest of the sources.
+ */
+static size_t schedule_latency_bounded(GstHailoRoundRobin *hailo_round_robin)
+{
+    size_t pushed = 0;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(hailo_round_robin->max_latency);
+    for (size_t i = 0; i < hailo_round_robin->pad_queues.size() && !hailo_round_robin->stop_thread; i++)
+    {
+        if (hailo_round_robin->pad_queues[i] == NULL)
+            continue;
+        if (push_pad_buffer_until(hailo_round_robin, i, deadline))
+            pushed++;
+        else
+            GST_DEBUG_OBJECT(hailo_round_robin, "Pad %zu missed the round deadline, skipping it", i);
+    }
+    return pushed;
+}
+
 void schedule(GstHailoRoundRobin *hailo_round_robin)
 {
-    GstFlowReturn res;
+    size_t first_pad = 0;
     while (!hailo_round_robin->stop_thread)
     {
-        // iterate the pad queues and push the first buffer in each queueq
-        for (uint i = 0; i < hailo_round_robin->pad_queues.size(); i++)
+        // Read before the round, so a buffer queued during the round is not missed by the idle wait below.
+        guint64 seq = get_schedule_seq(hailo_round_robin);
+        size_t pushed = 0;
+        switch (hailo_round_robin->schedule_policy)
         {
-            if (hailo_round_robin->pad_queues[i] != NULL)
-            {
-                for (uint j = 0; j <= hailo_round_robin->retries_num; j++)
-                {
-                    if (hailo_round_robin->pad_queues[i]->empty())
-                    {
-                        if (j < hailo_round_robin->retries_num) // don't sleep on the last iteration
-                        {
-                            sleep((float)hailo_round_robin->wait_time / 1000.0);
-                        }
-                    }
-                    else
-                    {
-                        set_current_pad_num(hailo_round_robin, i);
-                        GstBuffer *buf = hailo_round_robin->pad_queues[i]->front();
-                        hailo_round_robin->pad_queues[i]->pop();
-                        if (hailo_round_robin->condition_vars_non_blocking[i] == NULL)
-                        {
-                            continue;
-                        }
-                        hailo_round_robin->condition_vars_non_blocking[i]->notify_one();
-
-                        GstPad *pad = gst_element_get_static_pad(GST_ELEMENT_CAST(hailo_round_robin), ("sink_" + std::to_string(i)).c_str());
-
-                        if (pad == NULL) // not found, will try different method - maybe the pad names are hailoroundrobinpad0, hailoroundrobinpad1, etc.
-                        {
-                            pad = gst_element_get_static_pad(GST_ELEMENT_CAST(hailo_round_robin), ("hailoroundrobinpad" + std::to_string(i)).c_str());
-                            if (pad == NULL)
-                            {
-                                GST_ERROR_OBJECT(hailo_round_robin, "Failed to get pad %d", i);
-                                continue;
-                            }
-                        }
-                        gchar *pad_name = gst_pad_get_name(pad);
-                        gchar *stream_id = gst_pad_get_stream_id(pad);
-
-                        // Add stream meta to the buffer including the pad name and stream id.
-                        gst_buffer_add_hailo_stream_meta(buf, pad_name, stream_id);
-
-                        // Forward sticky events.
-                        gst_pad_sticky_events_foreach(pad, forward_events, hailo_round_robin->srcpad);
-
-                        // Push out_buffer forward.
-                        res = gst_pad_push(hailo_round_robin->srcpad, buf);
-                        if (res != GST_FLOW_OK)
-                        {
-                            GST_ERROR_OBJECT(hailo_round_robin, "Failed to push buffer to srcpad");
-                        }
-                        gst_object_unref(pad);
-                        g_free(pad_name);
-                        g_free(stream_id);
-                        break; // make sure it only pushes 1 buffer per pad
-                    }
-                }
-            }
+        case GST_HAILO_ROUND_ROBIN_SCHEDULE_FAIR_SHARE:
+            pushed = schedule_weighted(hailo_round_robin, first_pad++, false);
+            break;
+        case GST_HAILO_ROUND_ROBIN_SCHEDULE_WEIGHTED:
+            pushed = schedule_weighted(hailo_round_robin, first_pad++, true);
+            break;
+        case GST_HAILO_ROUND_ROBIN_SCHEDULE_LATENCY_BOUNDED:
+            pushed = schedule_latency_bounded(hailo_round_robin);
+            break;
+        case GST_HAILO_ROUND_ROBIN_SCHEDULE_ROUND_ROBIN:
+        default:
+            pushed = schedule_round_robin(hailo_round_robin);
+            break;
         }
+
+        // Nothing is queued on any pad, sleep until a buffer arrives.
+        if (pushed == 0)
+            wait_for_buffers(hailo_round_robin, seq);
     }
 }
 
@@ -400,6 +631,32 @@ gst_hailo_round_robin_class_init(GstHailoRoundRobinClass *klass)
                                                       MAX_PREROLL_FRAMES,
                                                       DEFAULT_PREROLL_FRAMES,
                                                       (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class,
+                                    PROP_SCHEDULE_POLICY,
+                                    g_param_spec_enum("schedule-policy",
+                                                      "Schedule policy",
+                                                      "How buffers are picked from the pad queues (only relevant when using non-blocking mode)",
+                                                      GST_TYPE_HAILOROUNDROBIN_SCHEDULE_POLICY,
+                                                      (gint)GST_HAILO_ROUND_ROBIN_SCHEDULE_ROUND_ROBIN,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class,
+                                    PROP_PAD_WEIGHTS,
+                                    gst_param_spec_array("pad-weights",
+                                                         "Pad weights",
+                                                         "Maximal number of buffers taken from each pad per round, by pad number (only relevant when using weighted schedule policy). Missing weights default to 1. \nExample usage: pad-weights=\'<2, 1, 1>\'",
+                                                         g_param_spec_uint("pad-weight", "Pad weight",
+                                                                           "Pad weight", 1, GST_HAILO_ROUND_ROBIN_MAX_PAD_WEIGHT, 1,
+                                                                           (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)),
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+    g_object_class_install_property(gobject_class,
+                                    PROP_MAX_LATENCY,
+                                    g_param_spec_uint("max-latency",
+                                                      "Max latency",
+                                                      "Time in ms from the start of a round after which pads that have no buffer are skipped (only relevant when using latency-bounded schedule policy)",
+                                                      MIN_MAX_LATENCY,
+                                                      MAX_MAX_LATENCY,
+                                                      DEFAULT_MAX_LATENCY,
+                                                      (GParamFlags)(GST_PARAM_CONTROLLABLE | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
 }
 
 static void
@@ -417,6 +674,14 @@ gst_hailo_round_robin_init(GstHailoRoundRobin *hailo_round_robin)
     hailo_round_robin->wait_time = DEFAULT_WAIT_TIME;
     hailo_round_robin->preroll_frames = DEFAULT_PREROLL_FRAMES;
     hailo_round_robin->stop_thread = false;
+    hailo_round_robin->thread = NULL;
+    hailo_round_robin->schedule_policy = GST_HAILO_ROUND_ROBIN_SCHEDULE_ROUND_ROBIN;
+    hailo_round_robin->pad_weights.clear();
+    hailo_round_robin->max_latency = DEFAULT_MAX_LATENCY;
+    hailo_round_robin->sink_pads.clear();
+    hailo_round_robin->schedule_mutex = std::make_unique<std::mutex>();
+    hailo_round_robin->schedule_cv = std::make_unique<std::condition_variable>();
+    hailo_round_robin->schedule_seq = 0;
     hailo_round_robin->srcpad = gst_pad_new_from_static_template(&src_template, "src");
     hailo_round_robin->mode = GST_HAILO_ROUND_ROBIN_MODE_BLOCKING;
     hailo_round_robin->current_pad_mutex = std::make_unique<std::shared_mutex>();
@@ -437,6 +702,12 @@ gst_hailo_round_robin_dispose(GObject *object)
     hailo_round_robin->mutexes_non_blocking.clear();
     hailo_round_robin->condition_vars_blocking.clear();
     hailo_round_robin->condition_vars_non_blocking.clear();
+    for (GstPad *pad : hailo_round_robin->sink_pads)
+    {
+        if (pad != NULL)
+            gst_object_unref(pad);
+    }
+    hailo_round_robin->sink_pads.clear();
     G_OBJECT_CLASS(parent_class)->dispose(object);
 }
 
@@ -490,6 +761,16 @@ gst_hailo_round_robin_request_new_pad(GstElement *element, GstPadTemplate *templ
     GST_OBJECT_FLAG_SET(sinkpad, GST_PAD_FLAG_PROXY_CAPS);
     GST_OBJECT_FLAG_SET(sinkpad, GST_PAD_FLAG_PROXY_ALLOCATION);
 
+    // Cache the pad number and the pad itself, so they are not parsed / looked up by name per buffer.
+    size_t pad_num = get_pad_num(sinkpad);
+    GST_HAILO_ROUND_ROBIN_PAD_CAST(sinkpad)->pad_num = pad_num;
+    {
+        std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+        if (hailo_round_robin->sink_pads.size() <= pad_num)
+            hailo_round_robin->sink_pads.resize(pad_num + 1, NULL);
+        hailo_round_robin->sink_pads[pad_num] = GST_PAD_CAST(gst_object_ref(sinkpad));
+    }
+
     hailo_round_robin->mutexes_blocking.emplace_back(std::make_unique<std::mutex>());
     hailo_round_robin->mutexes_non_blocking.emplace_back(std::make_unique<std::mutex>());
 
@@ -543,12 +824,22 @@ gst_hailo_round_robin_release_pad(GstElement *element, GstPad *pad)
     GstHailoRoundRobin *hailo_round_robin = GST_HAILO_ROUND_ROBIN_CAST(element);
     GST_DEBUG_OBJECT(hailo_round_robin, "releasing pad %s:%s", GST_DEBUG_PAD_NAME(pad));
     gst_pad_set_active(pad, FALSE);
+    size_t pad_num = GST_HAILO_ROUND_ROBIN_PAD_CAST(pad)->pad_num;
+
+    if (hailo_round_robin->condition_vars_blocking[pad_num] != NULL)
+        hailo_round_robin->condition_vars_blocking[pad_num]->notify_all();
 
-    if (hailo_round_robin->condition_vars_blocking[get_pad_num(pad)] != NULL)
-        hailo_round_robin->condition_vars_blocking[get_pad_num(pad)]->notify_all();
+    if (hailo_round_robin->condition_vars_non_blocking[pad_num] != NULL)
+        hailo_round_robin->condition_vars_non_blocking[pad_num]->notify_all();
 
-    if (hailo_round_robin->condition_vars_non_blocking[get_pad_num(pad)] != NULL)
-        hailo_round_robin->condition_vars_non_blocking[get_pad_num(pad)]->notify_all();
+    {
+        std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+        if (pad_num < hailo_round_robin->sink_pads.size() && hailo_round_robin->sink_pads[pad_num] != NULL)
+        {
+            gst_object_unref(hailo_round_robin->sink_pads[pad_num]);
+            hailo_round_robin->sink_pads[pad_num] = NULL;
+        }
+    }
     gst_element_remove_pad(GST_ELEMENT_CAST(hailo_round_robin), pad);
 }
 
@@ -558,7 +849,7 @@ gst_hailo_round_robin_sink_chain_preroll(GstPad *pad, GstObject *parent, GstBuff
     GstFlowReturn ret = GST_FLOW_ERROR;
     GstHailoRoundRobin *hailo_round_robin = GST_HAILO_ROUND_ROBIN_CAST(parent);
 
-    size_t pad_num = get_pad_num(pad);
+    size_t pad_num = GST_HAILO_ROUND_ROBIN_PAD_CAST(pad)->pad_num;
     if (hailo_round_robin->current_pad_num != pad_num)
     {
         // Wait for the turn of this pad.
@@ -603,9 +894,8 @@ gst_hailo_round_robin_sink_chain_preroll(GstPad *pad, GstObject *parent, GstBuff
     if (get_buffer_counter_value(hailo_round_robin) == (int)(hailo_round_robin->mutexes_blocking.size() * hailo_round_robin->preroll_frames))
     {
         set_buffer_counter_value(hailo_round_robin, -1); // don't use it anymore
-        std::thread schedule_thread(schedule, hailo_round_robin);
-        hailo_round_robin->thread = std::move(&schedule_thread);
-        hailo_round_robin->thread->detach();
+        hailo_round_robin->stop_thread = false;
+        hailo_round_robin->thread = new std::thread(schedule, hailo_round_robin);
         set_chain_to_all_pads(hailo_round_robin, gst_hailo_round_robin_sink_chain_non_blocking_mode);
         hailo_round_robin->current_pad_num = 0;
 
@@ -643,7 +933,7 @@ gst_hailo_round_robin_sink_chain_blocking_mode(GstPad *pad, GstObject *parent, G
     GstFlowReturn ret = GST_FLOW_ERROR;
     GstHailoRoundRobin *hailo_round_robin = GST_HAILO_ROUND_ROBIN_CAST(parent);
 
-    size_t pad_num = get_pad_num(pad);
+    size_t pad_num = GST_HAILO_ROUND_ROBIN_PAD_CAST(pad)->pad_num;
     if (hailo_round_robin->current_pad_num != pad_num)
     {
         // Wait for the turn of this pad.
@@ -726,7 +1016,7 @@ gst_hailo_round_robin_sink_chain_non_blocking_mode(GstPad *pad, GstObject *paren
 {
     GstFlowReturn ret = GST_FLOW_ERROR;
     GstHailoRoundRobin *hailo_round_robin = GST_HAILO_ROUND_ROBIN_CAST(parent);
-    size_t pad_num = get_pad_num(pad);
+    size_t pad_num = GST_HAILO_ROUND_ROBIN_PAD_CAST(pad)->pad_num;
 
     if (hailo_round_robin->condition_vars_non_blocking[pad_num] != NULL)
     {
@@ -741,6 +1031,7 @@ gst_hailo_round_robin_sink_chain_non_blocking_mode(GstPad *pad, GstObject *paren
         gst_buffer_unref(buf);
         return ret;
     }
+    notify_scheduler(hailo_round_robin);
     ret = GST_FLOW_OK;
     return ret;
 }
@@ -754,7 +1045,7 @@ gst_hailo_round_robin_sink_event(GstPad *pad, GstObject *parent, GstEvent *event
     gboolean forward = TRUE;
     gboolean res = TRUE;
     gboolean unlock = FALSE;
-    size_t pad_num = get_pad_num(pad);
+    size_t pad_num = GST_HAILO_ROUND_ROBIN_PAD_CAST(pad)->pad_num;
 
     GST_DEBUG_OBJECT(pad, "received event %" GST_PTR_FORMAT, event);
 
@@ -828,7 +1119,11 @@ gst_hailo_round_robin_change_state(GstElement *element, GstStateChange transitio
     {
         if (hailo_round_robin->mode != GST_HAILO_ROUND_ROBIN_MODE_FUNNEL_MODE)
         {
-            hailo_round_robin->stop_thread = true;
+            {
+                std::lock_guard<std::mutex> lock(*hailo_round_robin->schedule_mutex);
+                hailo_round_robin->stop_thread = true;
+            }
+            hailo_round_robin->schedule_cv->notify_all();
             for (uint i = 0; i < hailo_round_robin->condition_vars_blocking.size(); i++)
             {
                 if (hailo_round_robin->condition_vars_blocking[i] != NULL)
@@ -839,6 +1134,12 @@ gst_hailo_round_robin_change_state(GstElement *element, GstStateChange transitio
                 if (hailo_round_robin->condition_vars_non_blocking[i] != NULL)
                     hailo_round_robin->condition_vars_non_blocking[i]->notify_all();
             }
+            if (hailo_round_robin->thread != NULL)
+            {
+                hailo_round_robin->thread->join();
+                delete hailo_round_robin->thread;
+                hailo_round_robin->thread = NULL;
+            }
             break;
         }
     }
@@ -19,6 +19,8 @@
 #include <condition_variable>
 #include <pthread.h>
 #include <thread>
+#include <chrono>
+#include <memory>
 
 G_BEGIN_DECLS
 
@@ -44,6 +46,14 @@ typedef enum
     GST_HAILO_ROUND_ROBIN_MODE_NON_BLOCKING = 2,
 } GstHailoRoundRobinMode;
 
+typedef enum
+{
+    GST_HAILO_ROUND_ROBIN_SCHEDULE_ROUND_ROBIN = 0,
+    GST_HAILO_ROUND_ROBIN_SCHEDULE_FAIR_SHARE = 1,
+    GST_HAILO_ROUND_ROBIN_SCHEDULE_WEIGHTED = 2,
+    GST_HAILO_ROUND_ROBIN_SCHEDULE_LATENCY_BOUNDED = 3,
+} GstHailoRoundRobinSchedulePolicy;
+
 /**
  * GstHailoRoundRobin:
  *
@@ -69,6 +79,15 @@ struct _GstHailoRoundRobin
     std::thread *thread;
     gboolean stop_thread;
     std::unique_ptr<std::shared_mutex> current_pad_mutex;
+    GstHailoRoundRobinSchedulePolicy schedule_policy;
+    std::vector<uint> pad_weights;
+    uint max_latency;
+    // Sink pads indexed by pad number, so the scheduler does not look them up by name.
+    std::vector<GstPad *> sink_pads;
+    // Wakes the scheduler thread when a buffer is queued (schedule_seq is bumped under schedule_mutex).
+    std::unique_ptr<std::mutex> schedule_mutex;
+    std::unique_ptr<std::condition_variable> schedule_cv;
+    guint64 schedule_seq;
 };
 
 struct _GstHailoRoundRobinClass
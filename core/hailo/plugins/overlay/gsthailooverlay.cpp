@@ -113,6 +113,7 @@ gst_hailooverlay_init(GstHailoOverlay *hailooverlay)
     hailooverlay->local_gallery = false;
     hailooverlay->landmark_point_radius = 3;
     hailooverlay->mask_overlay_n_threads = 0;
+    hailooverlay->renderer = nullptr;
 }
 
 void gst_hailooverlay_set_property(GObject *object, guint property_id,
@@ -193,6 +194,11 @@ void gst_hailooverlay_dispose(GObject *object)
     GST_DEBUG_OBJECT(hailooverlay, "dispose");
 
     /* clean up as possible.  may be called multiple times */
+    if (hailooverlay->renderer)
+    {
+        delete hailooverlay->renderer;
+        hailooverlay->renderer = nullptr;
+    }
 
     G_OBJECT_CLASS(gst_hailooverlay_parent_class)->dispose(object);
 }
@@ -213,6 +219,9 @@ gst_hailooverlay_start(GstBaseTransform *trans)
     GstHailoOverlay *hailooverlay = GST_HAILO_OVERLAY(trans);
     GST_DEBUG_OBJECT(hailooverlay, "start");
 
+    // Keeps the rasterized labels between frames
+    hailooverlay->renderer = new OverlayRenderer();
+
     return TRUE;
 }
 
@@ -222,6 +231,12 @@ gst_hailooverlay_stop(GstBaseTransform *trans)
     GstHailoOverlay *hailooverlay = GST_HAILO_OVERLAY(trans);
     GST_DEBUG_OBJECT(hailooverlay, "stop");
 
+    if (hailooverlay->renderer)
+    {
+        delete hailooverlay->renderer;
+        hailooverlay->renderer = nullptr;
+    }
+
     return TRUE;
 }
 
@@ -260,7 +275,7 @@ gst_hailooverlay_transform_ip(GstBaseTransform *trans,
             face_blur(*hmat.get(), hailo_roi);
         }
         // Draw all results of the given roi on mat.
-        ret = draw_all(*hmat.get(), hailo_roi, hailooverlay->landmark_point_radius, hailooverlay->show_confidence, hailooverlay->local_gallery, hailooverlay->mask_overlay_n_threads);
+        ret = hailooverlay->renderer->draw(*hmat.get(), hailo_roi, hailooverlay->landmark_point_radius, hailooverlay->show_confidence, hailooverlay->local_gallery, hailooverlay->mask_overlay_n_threads);
     }
     if (ret != OVERLAY_STATUS_OK)
     {
@@ -8,6 +8,8 @@
 #include <vector>
 #include "hailo_objects.hpp"
 
+class OverlayRenderer;
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_HAILO_OVERLAY (gst_hailooverlay_get_type())
@@ -29,6 +31,7 @@ struct _GstHailoOverlay
     gboolean show_confidence;
     gboolean local_gallery;
     guint mask_overlay_n_threads;
+    OverlayRenderer *renderer;
 };
 
 struct _GstHailoOverlayClass
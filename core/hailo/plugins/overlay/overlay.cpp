@@ -39,6 +39,8 @@
 
 #define DEPTH_MIN_DISTANCE 0.5
 #define DEPTH_MAX_DISTANCE 3
+// Cached labels are rasterized at font scales rounded to 1/TEXT_SCALE_STEPS
+#define TEXT_SCALE_STEPS (20)
 
 static const std::vector<cv::Scalar> tile_layer_color_table = {
     cv::Scalar(0, 0, 255), cv::Scalar(200, 100, 120), cv::Scalar(255, 0, 0), cv::Scalar(120, 0, 0), cv::Scalar(0, 0, 120)};
@@ -72,7 +74,17 @@ std::string confidence_to_string(float confidence)
     return std::to_string(confidence_percentage) + "%";
 }
 
-static overlay_status_t draw_classification(HailoMat &mat, HailoROIPtr roi, std::string text, uint number_of_classifications, size_t color_id = NULL_COLOR_ID)
+static void add_text(OverlayDrawList &draw_list, std::string text, cv::Point position, double font_scale, const cv::Scalar color)
+{
+    draw_list.texts.push_back({std::move(text), position, font_scale, color});
+}
+
+static void add_shape(OverlayDrawList &draw_list, overlay_shape_t type, cv::Point point1, cv::Point point2, cv::Size axes, const cv::Scalar color, int thickness = 1, int line_type = cv::LINE_8)
+{
+    draw_list.shapes.push_back({type, point1, point2, axes, color, thickness, line_type});
+}
+
+static overlay_status_t draw_classification(HailoMat &mat, OverlayDrawList &draw_list, HailoROIPtr roi, std::string text, uint number_of_classifications, size_t color_id = NULL_COLOR_ID)
 {
     auto bbox = hailo_common::create_flattened_bbox(roi->get_bbox(), roi->get_scaling_bbox());
     int roi_xmin = bbox.xmin() * mat.native_width();
@@ -82,7 +94,7 @@ static overlay_status_t draw_classification(HailoMat &mat, HailoROIPtr roi, std:
     auto text_position = cv::Point(roi_xmin, roi_ymin + (TEXT_DEFAULT_HEIGHT * number_of_classifications * roi_height) + log(roi_height));
     double font_scale = TEXT_CLS_FONT_SCALE_FACTOR * roi_width;
     font_scale = (font_scale < MINIMUM_TEXT_CLS_FONT_SCALE) ? MINIMUM_TEXT_CLS_FONT_SCALE : font_scale;
-    mat.draw_text(text, text_position, font_scale, get_color(color_id));
+    add_text(draw_list, std::move(text), text_position, font_scale, get_color(color_id));
     return OVERLAY_STATUS_OK;
 }
 
@@ -97,7 +109,7 @@ static std::string get_classification_text(HailoClassificationPtr result, bool s
     return text;
 }
 
-static overlay_status_t draw_landmarks(HailoMat &hmat, HailoLandmarksPtr landmarks, HailoROIPtr roi, float landmark_point_radius)
+static overlay_status_t draw_landmarks(HailoMat &hmat, OverlayDrawList &draw_list, HailoLandmarksPtr landmarks, HailoROIPtr roi, float landmark_point_radius)
 {
     HailoBBox bbox = roi->get_bbox();
     int thickness;
@@ -123,7 +135,7 @@ static overlay_status_t draw_landmarks(HailoMat &hmat, HailoLandmarksPtr landmar
             cv::Point joint2 = cv::Point(x2, y2);
 
             thickness = (bbox.width() < 0.05) ? 1 : 2;
-            hmat.draw_line(joint1, joint2, get_color(4), thickness, cv::LINE_4);
+            add_shape(draw_list, OVERLAY_SHAPE_LINE, joint1, joint2, cv::Size(), get_color(4), thickness, cv::LINE_4);
         }
     }
     for (auto &point : points)
@@ -134,7 +146,7 @@ static overlay_status_t draw_landmarks(HailoMat &hmat, HailoLandmarksPtr landmar
             uint y = ((point.y() * bbox.height()) + bbox.ymin()) * hmat.native_height();
             // Draw the keypoint (multiply x,y values by the sizes of the frame)
             auto center = cv::Point(x, y);
-            hmat.draw_ellipse(center, {R, R}, 0, 0, 360, get_color(7), landmark_point_radius);
+            add_shape(draw_list, OVERLAY_SHAPE_ELLIPSE, center, center, {R, R}, get_color(7), landmark_point_radius);
         }
     }
     return OVERLAY_STATUS_OK;
@@ -170,12 +182,11 @@ static std::string get_detection_text(HailoDetectionPtr detection, bool show_con
     return text;
 }
 
-static overlay_status_t draw_tile(HailoMat &mat, HailoTileROIPtr tile)
+static overlay_status_t draw_tile(HailoMat &mat, OverlayDrawList &draw_list, HailoTileROIPtr tile)
 {
     auto bbox = tile->get_bbox();
     auto bbox_min = cv::Point(bbox.xmin() * mat.width(), bbox.ymin() * mat.height());
     auto bbox_max = cv::Point(bbox.xmax() * mat.width(), bbox.ymax() * mat.height());
-    cv::Rect rect(bbox_min, bbox_max);
     cv::Scalar color;
     uint tile_layer = tile->get_layer();
     if (tile_layer < tile_layer_color_table.size())
@@ -184,12 +195,12 @@ static overlay_status_t draw_tile(HailoMat &mat, HailoTileROIPtr tile)
         color = get_color(DEFAULT_TILE_COLOR);
 
     // Draw the tile box
-    mat.draw_rectangle(rect, color);
+    add_shape(draw_list, OVERLAY_SHAPE_RECTANGLE, bbox_min, bbox_max, cv::Size(), color);
 
     return OVERLAY_STATUS_OK;
 }
 
-static overlay_status_t draw_id(HailoMat &mat, HailoUniqueIDPtr &hailo_id, HailoROIPtr roi)
+static overlay_status_t draw_id(HailoMat &mat, OverlayDrawList &draw_list, HailoUniqueIDPtr &hailo_id, HailoROIPtr roi)
 {
     std::string id_text = std::to_string(hailo_id->get_id());
 
@@ -203,139 +214,13 @@ static overlay_status_t draw_id(HailoMat &mat, HailoUniqueIDPtr &hailo_id, Hailo
     double font_scale = TEXT_FONT_FACTOR * log(bbox_width);
     auto text_position = cv::Point(bbox_min.x + log(bbox_width), bbox_max.y - log(bbox_width));
     // Draw the class and confidence text
-    mat.draw_text(id_text, text_position, font_scale, color);
+    add_text(draw_list, std::move(id_text), text_position, font_scale, color);
     return OVERLAY_STATUS_OK;
 }
 
-/**
- * @brief calculate the destionation region of interest and the resized mask
- *
- * @param destinationROI the region of interest to paint
- * @param image_planes the image data
- * @param roi the region of interest
- * @param mask a mask object inherited from from HailoMask
- * @param resized_mask_data an output of the fucntion, the mask resized
- * @param data_ptr mask data pointer
- * @param cv_type type of cv data, example: CV_32F
- */
-template <typename T>
-void calc_destination_roi_and_resize_mask(cv::Mat &destinationROI, cv::Mat &image_planes, HailoROIPtr roi, HailoMaskPtr mask, cv::Mat &resized_mask_data, T data_ptr, int cv_type)
-{
-    HailoBBox bbox = roi->get_bbox();
-    int roi_xmin = bbox.xmin() * image_planes.cols;
-    int roi_ymin = bbox.ymin() * image_planes.rows;
-    int roi_width = image_planes.cols * bbox.width();
-    int roi_height = image_planes.rows * bbox.height();
-
-    // clamp the region of interest so it is inside the image planes
-    roi_xmin = std::clamp(roi_xmin, 0, image_planes.cols);
-    roi_ymin = std::clamp(roi_ymin, 0, image_planes.rows);
-    roi_width = std::clamp(roi_width, 0, image_planes.cols - roi_xmin);
-    roi_height = std::clamp(roi_height, 0, image_planes.rows - roi_ymin);
-
-    cv::Mat mat_data = cv::Mat(mask->get_height(), mask->get_width(), cv_type, (uint8_t *)data_ptr.data());
-    cv::resize(mat_data, resized_mask_data, cv::Size(roi_width, roi_height), 0, 0, cv::INTER_LINEAR);
-
-    cv::Rect roi_rect(cv::Point(roi_xmin, roi_ymin), cv::Size(roi_width, roi_height));
-    destinationROI = image_planes(roi_rect);
-}
-
-/**
- * @brief convert the estimated depths to colors and draw it (override the original image), a darker color means that the depth is smaller.
- *
- * @param image_planes: matrix of the image
- * @param mask : HailoDepthMaskPtr that contains the data of the estimated depth of each pixel
- * @param roi region of interest
- * @return overlay_status_t
- */
-static overlay_status_t draw_depth_mask(cv::Mat &image_planes, HailoDepthMaskPtr mask, HailoROIPtr roi, const uint mask_overlay_n_threads)
+static void collect_objects(HailoMat &hmat, OverlayDrawList &draw_list, HailoROIPtr roi, float landmark_point_radius, bool show_confidence, bool local_gallery)
 {
-    cv::Mat resized_mask_data;
-    cv::Mat destinationROI;
-    calc_destination_roi_and_resize_mask(destinationROI, image_planes, roi, mask, resized_mask_data, mask->get_data(), CV_32F);
-
-    float min = DEPTH_MIN_DISTANCE;
-    float max = DEPTH_MAX_DISTANCE;
-
-    double min_val;
-    double max_val;
-    cv::Point min_loc;
-    cv::Point max_loc;
-
-    cv::minMaxLoc(resized_mask_data, &min_val, &max_val, &min_loc, &max_loc);
-
-    if (max < max_val)
-        max = max_val;
-    if (min > min_val)
-        min = min_val;
-
-    resized_mask_data = (resized_mask_data - min) / (max - min);
-
-    if (mask_overlay_n_threads > 0)
-        cv::setNumThreads(mask_overlay_n_threads);
-
-    // perform efficient parallel matrix iteration and color every pixel its class color
-    cv::parallel_for_(cv::Range(0, destinationROI.rows * destinationROI.cols), ParallelPixelDepthMask(destinationROI.data, resized_mask_data.data, mask->get_transparency(), image_planes.cols, destinationROI.cols));
-
-    return OVERLAY_STATUS_OK;
-}
-
-/**
- * @brief draw a mask whose values are ints represting class ids.
- * draw every pixel in the color in its class color.
- *
- * @param image_planes the image data
- * @param mask  HailoClassMask mask object pointer
- * @param roi the region of interest
- * @return overlay_status_t OVERLAY_STATUS_OK
- */
-static overlay_status_t
-draw_class_mask(cv::Mat &image_planes, HailoClassMaskPtr mask, HailoROIPtr roi, const uint mask_overlay_n_threads)
-{
-    cv::Mat resized_mask_data;
-    cv::Mat destinationROI;
-    calc_destination_roi_and_resize_mask(destinationROI, image_planes, roi, mask, resized_mask_data, mask->get_data(), CV_8UC1);
-
-    if (mask_overlay_n_threads > 0)
-        cv::setNumThreads(mask_overlay_n_threads);
-
-    // perform efficient parallel matrix iteration and color every pixel its class color
-    cv::parallel_for_(cv::Range(0, destinationROI.rows * destinationROI.cols), ParallelPixelClassMask(destinationROI.data, resized_mask_data.data, mask->get_transparency(), image_planes.cols, destinationROI.cols));
-
-    return OVERLAY_STATUS_OK;
-}
-
-/**
- * @brief draw a mask that its values are floats representing confidence.
- * if the pixel value is above threshold, draw this pixel in the mask's class color.
- *
- * @param image_planes the image data
- * @param mask HailoConfClassMask mask object pointer
- * @param roi the region of interest
- * @return overlay_status_t OVERLAY_STATUS_OK
- */
-static overlay_status_t draw_conf_class_mask(cv::Mat &image_planes, HailoConfClassMaskPtr mask, HailoROIPtr roi, const uint mask_overlay_n_threads)
-{
-    cv::Mat resized_mask_data;
-    cv::Mat destinationROI;
-    calc_destination_roi_and_resize_mask(destinationROI, image_planes, roi, mask, resized_mask_data, mask->get_data(), CV_32F);
-
-    cv::Scalar mask_color = indexToColor(mask->get_class_id());
-
-    if (mask_overlay_n_threads > 0)
-        cv::setNumThreads(mask_overlay_n_threads);
-
-    // perform efficient parallel matrix iteration and color every pixel its class color
-    cv::parallel_for_(cv::Range(0, destinationROI.rows * destinationROI.cols), ParallelPixelClassConfMask(destinationROI.data, resized_mask_data.data, mask->get_transparency(), image_planes.cols, destinationROI.cols, mask_color));
-
-    return OVERLAY_STATUS_OK;
-}
-
-overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence, bool local_gallery, const uint mask_overlay_n_threads)
-{
-    overlay_status_t ret = OVERLAY_STATUS_UNINITIALIZED;
     uint number_of_classifications = 0;
-    cv::Mat &mat = hmat.get_matrices()[0];
     for (auto obj : roi->get_objects())
     {
         switch (obj->get_type())
@@ -362,15 +247,15 @@ overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_
 
             // Draw Rectangle
             auto rect = get_rect(hmat, detection, roi);
-            hmat.draw_rectangle(rect, color);
+            add_shape(draw_list, OVERLAY_SHAPE_RECTANGLE, rect.tl(), rect.br(), cv::Size(), color);
 
             // Draw text
             auto text_position = cv::Point(rect.x - log(rect.width), rect.y - log(rect.width));
             float font_scale = TEXT_FONT_FACTOR * log(rect.width);
-            hmat.draw_text(text, text_position, font_scale, color);
+            add_text(draw_list, std::move(text), text_position, font_scale, color);
 
             // Draw inner objects.
-            ret = draw_all(hmat, detection, landmark_point_radius, show_confidence, local_gallery, mask_overlay_n_threads);
+            collect_objects(hmat, draw_list, detection, landmark_point_radius, show_confidence, local_gallery);
             break;
         }
         case HAILO_CLASSIFICATION:
@@ -381,55 +266,44 @@ overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_
             {
                 std::string text = get_classification_text(classification, false);
                 if (text == "lost")
-                    ret = draw_classification(hmat, roi, text, number_of_classifications, 0);
+                    draw_classification(hmat, draw_list, roi, text, number_of_classifications, 0);
                 else if (text == "new")
-                    ret = draw_classification(hmat, roi, text, number_of_classifications, 1);
+                    draw_classification(hmat, draw_list, roi, text, number_of_classifications, 1);
                 else if (text == "tracked")
-                    ret = draw_classification(hmat, roi, text, number_of_classifications, 2);
+                    draw_classification(hmat, draw_list, roi, text, number_of_classifications, 2);
             }
             else
             {
                 std::string text = get_classification_text(classification, show_confidence);
-                ret = draw_classification(hmat, roi, text, number_of_classifications);
+                draw_classification(hmat, draw_list, roi, text, number_of_classifications);
             }
             break;
         }
         case HAILO_LANDMARKS:
         {
             HailoLandmarksPtr landmarks = std::dynamic_pointer_cast<HailoLandmarks>(obj);
-            draw_landmarks(hmat, landmarks, roi, landmark_point_radius);
+            draw_landmarks(hmat, draw_list, landmarks, roi, landmark_point_radius);
             break;
         }
         case HAILO_TILE:
         {
             HailoTileROIPtr tile = std::dynamic_pointer_cast<HailoTileROI>(obj);
-            draw_tile(hmat, tile);
-            draw_all(hmat, tile, landmark_point_radius, show_confidence, local_gallery, mask_overlay_n_threads);
+            draw_tile(hmat, draw_list, tile);
+            collect_objects(hmat, draw_list, tile, landmark_point_radius, show_confidence, local_gallery);
             break;
         }
         case HAILO_UNIQUE_ID:
         {
             HailoUniqueIDPtr id = std::dynamic_pointer_cast<HailoUniqueID>(obj);
             if ((local_gallery && id->get_mode() == GLOBAL_ID) || (!local_gallery && id->get_mode() == TRACKING_ID))
-                draw_id(hmat, id, roi);
+                draw_id(hmat, draw_list, id, roi);
             break;
         }
         case HAILO_DEPTH_MASK:
-        {
-            HailoDepthMaskPtr mask = std::dynamic_pointer_cast<HailoDepthMask>(obj);
-            draw_depth_mask(mat, mask, roi, mask_overlay_n_threads);
-            break;
-        }
         case HAILO_CLASS_MASK:
-        {
-            HailoClassMaskPtr mask = std::dynamic_pointer_cast<HailoClassMask>(obj);
-            draw_class_mask(mat, mask, roi, mask_overlay_n_threads);
-            break;
-        }
         case HAILO_CONF_CLASS_MASK:
         {
-            HailoConfClassMaskPtr mask = std::dynamic_pointer_cast<HailoConfClassMask>(obj);
-            draw_conf_class_mask(mat, mask, roi, mask_overlay_n_threads);
+            draw_list.masks.push_back({std::dynamic_pointer_cast<HailoMask>(obj), roi->get_bbox()});
             break;
         }
         default:
@@ -437,8 +311,251 @@ overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_
             break;
         }
     }
-    ret = OVERLAY_STATUS_OK;
-    return ret;
+}
+
+void OverlayRenderer::collect(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence, bool local_gallery)
+{
+    collect_objects(hmat, m_draw_list, roi, landmark_point_radius, show_confidence, local_gallery);
+}
+
+static bool is_yuv(HailoMat &hmat)
+{
+    return hmat.get_type() == HAILO_MAT_YUY2 || hmat.get_type() == HAILO_MAT_NV12;
+}
+
+static cv::Scalar rgb_to_yuv(const cv::Scalar &rgb)
+{
+    return cv::Scalar(RGB2Y(rgb[0], rgb[1], rgb[2]), RGB2U(rgb[0], rgb[1], rgb[2]), RGB2V(rgb[0], rgb[1], rgb[2]));
+}
+
+static OverlayColor to_overlay_color(const cv::Scalar &rgb, bool yuv)
+{
+    cv::Scalar color = yuv ? rgb_to_yuv(rgb) : rgb;
+    return {{(float)color[0], (float)color[1], (float)color[2]}};
+}
+
+/**
+ * @brief The class colors, converted once for each color space.
+ */
+static const std::vector<OverlayColor> &get_palette(bool yuv)
+{
+    static const std::vector<OverlayColor> palettes[2] = {
+        [] { std::vector<OverlayColor> p; for (auto &c : color_table) p.push_back(to_overlay_color(c, false)); return p; }(),
+        [] { std::vector<OverlayColor> p; for (auto &c : color_table) p.push_back(to_overlay_color(c, true)); return p; }()};
+    return palettes[yuv ? 1 : 0];
+}
+
+const OverlayTextRaster &OverlayRenderer::get_text_raster(const std::string &text, double font_scale, int thickness)
+{
+    // The font scale follows the box size continuously, it is rounded so labels of similar boxes share a raster
+    int scale_step = std::max(1, (int)std::lround(font_scale * TEXT_SCALE_STEPS));
+    m_text_key.assign(text);
+    m_text_key.push_back('\0');
+    m_text_key.append(std::to_string(scale_step));
+    m_text_key.push_back('\0');
+    m_text_key.append(std::to_string(thickness));
+
+    auto cached = m_text_cache.find(m_text_key);
+    if (cached != m_text_cache.end())
+        return cached->second;
+
+    if (m_text_cache.size() >= m_text_cache_size)
+        m_text_cache.clear();
+
+    double scale = (double)scale_step / TEXT_SCALE_STEPS;
+    int baseline = 0;
+    cv::Size size = cv::getTextSize(text, cv::FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline);
+    int margin = thickness + 2;
+    cv::Point origin(margin, margin + size.height);
+
+    OverlayTextRaster raster;
+    raster.alpha = cv::Mat::zeros(size.height + baseline + 2 * margin, size.width + 2 * margin, CV_8UC1);
+    cv::putText(raster.alpha, text, origin, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255), thickness);
+    // Any covered pixel of a 2x2 block covers its chroma sample
+    cv::resize(raster.alpha, raster.half_alpha, cv::Size((raster.alpha.cols + 1) / 2, (raster.alpha.rows + 1) / 2), 0, 0, cv::INTER_AREA);
+    raster.offset = -origin;
+    return m_text_cache.emplace(m_text_key, std::move(raster)).first->second;
+}
+
+/**
+ * @brief Paint color on plane where alpha is set, alpha is clipped to the plane.
+ */
+static void blit_alpha(cv::Mat &plane, const cv::Mat &alpha, cv::Point top_left, const cv::Scalar &color)
+{
+    cv::Rect destination = cv::Rect(top_left, alpha.size()) & cv::Rect(0, 0, plane.cols, plane.rows);
+    if (destination.empty())
+        return;
+    cv::Rect source(destination.tl() - top_left, destination.size());
+    plane(destination).setTo(color, alpha(source));
+}
+
+/**
+ * @brief YUY2 packs two pixels in every element of the mat (Y0 U Y1 V), so it is painted pixel by pixel.
+ */
+static void blit_alpha_yuy2(cv::Mat &plane, const cv::Mat &alpha, cv::Point top_left, const cv::Scalar &yuv)
+{
+    int frame_width = plane.cols * 2;
+    for (int y = std::max(0, -top_left.y); y < alpha.rows && top_left.y + y < plane.rows; y++)
+    {
+        const uint8_t *alpha_row = alpha.ptr<uint8_t>(y);
+        uint8_t *row = plane.ptr<uint8_t>(top_left.y + y);
+        for (int x = std::max(0, -top_left.x); x < alpha.cols && top_left.x + x < frame_width; x++)
+        {
+            if (!alpha_row[x])
+                continue;
+            int frame_x = top_left.x + x;
+            int pair = frame_x & ~1;
+            row[2 * frame_x] = yuv[0];
+            row[2 * pair + 1] = yuv[1];
+            row[2 * pair + 3] = yuv[2];
+        }
+    }
+}
+
+void OverlayRenderer::draw_text(HailoMat &hmat, const OverlayText &text)
+{
+    // Boxes too small for a label get a non positive scale, there is nothing to draw
+    if (text.text.empty() || !(text.font_scale > 0))
+        return;
+    const OverlayTextRaster &raster = get_text_raster(text.text, text.font_scale, std::max(1, hmat.font_thickness()));
+    cv::Point top_left = text.position + raster.offset;
+    std::vector<cv::Mat> &matrices = hmat.get_matrices();
+    switch (hmat.get_type())
+    {
+    case HAILO_MAT_RGB:
+        blit_alpha(matrices[0], raster.alpha, top_left, text.color);
+        break;
+    case HAILO_MAT_RGBA:
+    {
+        cv::Scalar rgba = text.color;
+        rgba[3] = 1;
+        blit_alpha(matrices[0], raster.alpha, top_left, rgba);
+        break;
+    }
+    case HAILO_MAT_YUY2:
+        blit_alpha_yuy2(matrices[0], raster.alpha, top_left, rgb_to_yuv(text.color));
+        break;
+    case HAILO_MAT_NV12:
+    {
+        cv::Scalar yuv = rgb_to_yuv(text.color);
+        blit_alpha(matrices[0], raster.alpha, top_left, cv::Scalar(yuv[0]));
+        blit_alpha(matrices[1], raster.half_alpha, cv::Point(chroma_coordinate(top_left.x), chroma_coordinate(top_left.y)), cv::Scalar(yuv[1], yuv[2]));
+        break;
+    }
+    default:
+        hmat.draw_text(text.text, text.position, text.font_scale, text.color);
+        break;
+    }
+}
+
+void OverlayRenderer::draw_mask(HailoMat &hmat, const OverlayMask &overlay_mask)
+{
+    HailoMaskPtr mask = overlay_mask.mask;
+    const HailoBBox &bbox = overlay_mask.bbox;
+    int frame_width = hmat.native_width();
+    int frame_height = hmat.native_height();
+    if (mask->get_width() <= 0 || mask->get_height() <= 0)
+        return;
+
+    // clamp the region of interest so it is inside the frame
+    int roi_xmin = std::clamp((int)(bbox.xmin() * frame_width), 0, frame_width);
+    int roi_ymin = std::clamp((int)(bbox.ymin() * frame_height), 0, frame_height);
+    int roi_width = std::clamp((int)(frame_width * bbox.width()), 0, frame_width - roi_xmin);
+    int roi_height = std::clamp((int)(frame_height * bbox.height()), 0, frame_height - roi_ymin);
+    if (roi_width == 0 || roi_height == 0)
+        return;
+    cv::Rect rect(roi_xmin, roi_ymin, roi_width, roi_height);
+
+    std::vector<cv::Mat> &matrices = hmat.get_matrices();
+    OverlayPlanes planes = {hmat.get_type(), matrices[0].data, matrices[0].step, nullptr, 0};
+    if (hmat.get_type() == HAILO_MAT_NV12)
+    {
+        planes.uv_data = matrices[1].data;
+        planes.uv_stride = matrices[1].step;
+    }
+    bool yuv = is_yuv(hmat);
+
+    // The mask is sampled at its own resolution while blending, it is never resized
+    m_mask_sampling.init(mask->get_width(), mask->get_height(), roi_width, roi_height);
+    cv::Range rows(0, roi_height);
+    float transparency = mask->get_transparency();
+
+    switch (mask->get_type())
+    {
+    case HAILO_DEPTH_MASK:
+    {
+        HailoDepthMaskPtr depth_mask = std::dynamic_pointer_cast<HailoDepthMask>(mask);
+        const std::vector<float> &data = depth_mask->get_data();
+
+        // Gray levels span [DEPTH_MIN_DISTANCE, DEPTH_MAX_DISTANCE], widened to the values of the mask.
+        // Interpolation never leaves the values of the mask, so the raw mask has the same min and max as
+        // the resized one the range used to be taken from.
+        float min = DEPTH_MIN_DISTANCE;
+        float max = DEPTH_MAX_DISTANCE;
+        auto min_max = std::minmax_element(data.begin(), data.end());
+        if (max < *min_max.second)
+            max = *min_max.second;
+        if (min > *min_max.first)
+            min = *min_max.first;
+
+        cv::parallel_for_(rows, ParallelMaskBlend<DepthMaskSource>(planes, rect, m_mask_sampling, DepthMaskSource(data.data(), mask->get_width(), min, max, yuv), transparency));
+        break;
+    }
+    case HAILO_CLASS_MASK:
+    {
+        HailoClassMaskPtr class_mask = std::dynamic_pointer_cast<HailoClassMask>(mask);
+        cv::parallel_for_(rows, ParallelMaskBlend<ClassMaskSource>(planes, rect, m_mask_sampling, ClassMaskSource(class_mask->get_data().data(), mask->get_width(), get_palette(yuv)), transparency));
+        break;
+    }
+    case HAILO_CONF_CLASS_MASK:
+    {
+        HailoConfClassMaskPtr conf_mask = std::dynamic_pointer_cast<HailoConfClassMask>(mask);
+        OverlayColor color = to_overlay_color(indexToColor(conf_mask->get_class_id()), yuv);
+        cv::parallel_for_(rows, ParallelMaskBlend<ConfClassMaskSource>(planes, rect, m_mask_sampling, ConfClassMaskSource(conf_mask->get_data().data(), mask->get_width(), color), transparency));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+overlay_status_t OverlayRenderer::render(HailoMat &hmat, uint mask_overlay_n_threads)
+{
+    // A global OpenCV setting, changed only when it differs
+    if (!m_draw_list.masks.empty() && mask_overlay_n_threads > 0 && (int)mask_overlay_n_threads != cv::getNumThreads())
+        cv::setNumThreads(mask_overlay_n_threads);
+
+    for (const OverlayMask &mask : m_draw_list.masks)
+        draw_mask(hmat, mask);
+
+    for (const OverlayShape &shape : m_draw_list.shapes)
+    {
+        switch (shape.type)
+        {
+        case OVERLAY_SHAPE_RECTANGLE:
+            hmat.draw_rectangle(cv::Rect(shape.point1, shape.point2), shape.color);
+            break;
+        case OVERLAY_SHAPE_LINE:
+            hmat.draw_line(shape.point1, shape.point2, shape.color, shape.thickness, shape.line_type);
+            break;
+        case OVERLAY_SHAPE_ELLIPSE:
+            hmat.draw_ellipse(shape.point1, shape.axes, 0, 0, 360, shape.color, shape.thickness);
+            break;
+        }
+    }
+
+    for (const OverlayText &text : m_draw_list.texts)
+        draw_text(hmat, text);
+
+    m_draw_list.clear();
+    return OVERLAY_STATUS_OK;
+}
+
+overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence, bool local_gallery, const uint mask_overlay_n_threads)
+{
+    // Callers without their own renderer still keep their rasterized labels between frames
+    thread_local OverlayRenderer renderer;
+    return renderer.draw(hmat, roi, landmark_point_radius, show_confidence, local_gallery, mask_overlay_n_threads);
 }
 
 void face_blur(HailoMat &hmat, HailoROIPtr roi)
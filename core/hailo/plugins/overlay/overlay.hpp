@@ -5,16 +5,20 @@
 /**
  * @file overlay.hpp
  * @author your name (you@domain.com)
- * @brief 
+ * @brief
  * @version 0.1
  * @date 2022-01-20
- * 
+ *
  * @copyright Copyright (c) 2022
- * 
+ *
  */
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <map>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include "hailo_objects.hpp"
 #include "common/hailomat.hpp"
@@ -26,10 +30,163 @@ typedef enum
 
 } overlay_status_t;
 
+typedef enum
+{
+    OVERLAY_SHAPE_RECTANGLE,
+    OVERLAY_SHAPE_LINE,
+    OVERLAY_SHAPE_ELLIPSE,
+} overlay_shape_t;
+
+struct OverlayShape
+{
+    overlay_shape_t type;
+    cv::Point point1; // Top left corner, first end or center
+    cv::Point point2; // Bottom right corner or second end
+    cv::Size axes;
+    cv::Scalar color;
+    int thickness;
+    int line_type;
+};
+
+struct OverlayText
+{
+    std::string text;
+    cv::Point position; // Bottom left corner of the text, as in cv::putText
+    double font_scale;
+    cv::Scalar color;
+};
+
+struct OverlayMask
+{
+    HailoMaskPtr mask;
+    HailoBBox bbox; // The ROI the mask covers
+};
+
+/**
+ * @brief Everything to draw on one frame, collected from the ROI tree before drawing.
+ *        Masks are drawn first, then shapes, then text so labels are never painted over.
+ */
+struct OverlayDrawList
+{
+    std::vector<OverlayMask> masks;
+    std::vector<OverlayShape> shapes;
+    std::vector<OverlayText> texts;
+
+    void clear()
+    {
+        masks.clear();
+        shapes.clear();
+        texts.clear();
+    }
+};
+
+/**
+ * @brief A rasterized label, drawn by copying its color through the alpha mask.
+ */
+struct OverlayTextRaster
+{
+    cv::Mat alpha;      // Full resolution coverage
+    cv::Mat half_alpha; // Half resolution coverage, for the chroma plane of NV12
+    cv::Point offset;   // From the text position to the top left corner of alpha
+};
+
+/**
+ * @brief Maps the pixels of a destination rectangle to the pixels of a smaller mask, the same way
+ *        cv::resize does (INTER_LINEAR and INTER_NEAREST), so masks are blended without resizing them first.
+ */
+struct OverlayMaskSampling
+{
+    std::vector<int> x0, x1, y0, y1;
+    std::vector<float> wx, wy;
+    std::vector<int> nearest_x, nearest_y;
+
+    static void init_axis(int src, int dst, std::vector<int> &i0, std::vector<int> &i1, std::vector<float> &w, std::vector<int> &nearest)
+    {
+        i0.resize(dst);
+        i1.resize(dst);
+        w.resize(dst);
+        nearest.resize(dst);
+        double scale = (double)src / dst;
+        for (int d = 0; d < dst; d++)
+        {
+            float f = (float)((d + 0.5) * scale - 0.5);
+            int i = (int)std::floor(f);
+            float weight = f - i;
+            if (i < 0)
+            {
+                i = 0;
+                weight = 0.0f;
+            }
+            if (i >= src - 1)
+            {
+                i = src - 1;
+                weight = 0.0f;
+            }
+            i0[d] = i;
+            i1[d] = std::min(i + 1, src - 1);
+            w[d] = weight;
+            nearest[d] = std::min((int)std::floor(d * scale), src - 1);
+        }
+    }
+
+    void init(int src_width, int src_height, int dst_width, int dst_height)
+    {
+        init_axis(src_width, dst_width, x0, x1, wx, nearest_x);
+        init_axis(src_height, dst_height, y0, y1, wy, nearest_y);
+    }
+};
+
+/**
+ * @brief Draws HailoObjects on frames of any HailoMat format.
+ *        Keeps the rasterized labels and the draw list between frames, so a long running
+ *        renderer (one per overlay element) draws steady scenes without re-rasterizing text.
+ */
+class OverlayRenderer
+{
+private:
+    OverlayDrawList m_draw_list;
+    std::unordered_map<std::string, OverlayTextRaster> m_text_cache;
+    size_t m_text_cache_size;
+    std::string m_text_key;
+    OverlayMaskSampling m_mask_sampling;
+
+    const OverlayTextRaster &get_text_raster(const std::string &text, double font_scale, int thickness);
+    void draw_text(HailoMat &hmat, const OverlayText &text);
+    void draw_mask(HailoMat &hmat, const OverlayMask &mask);
+
+public:
+    /**
+     * @param text_cache_size  -  size_t
+     *        Maximal number of rasterized labels kept, the cache is emptied when it is full.
+     */
+    explicit OverlayRenderer(size_t text_cache_size = 4096) : m_text_cache_size(text_cache_size) {}
+
+    /**
+     * @brief Collect the objects of roi into the draw list, without drawing.
+     */
+    void collect(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence = true, bool local_gallery = false);
+
+    /**
+     * @brief Draw the draw list on hmat, and clear it.
+     *
+     * @param mask_overlay_n_threads  -  uint
+     *        Threads used for blending masks, 0 keeps the OpenCV default.
+     */
+    overlay_status_t render(HailoMat &hmat, uint mask_overlay_n_threads = 0);
+
+    overlay_status_t draw(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence = true, bool local_gallery = false, uint mask_overlay_n_threads = 0)
+    {
+        collect(hmat, roi, landmark_point_radius, show_confidence, local_gallery);
+        return render(hmat, mask_overlay_n_threads);
+    }
+
+    OverlayDrawList &draw_list() { return m_draw_list; }
+};
+
 __BEGIN_DECLS
 overlay_status_t draw_all(HailoMat &hmat, HailoROIPtr roi, float landmark_point_radius, bool show_confidence = true, bool local_gallery = false, uint mask_overlay_n_threads = 0);
 void face_blur(HailoMat &mat, HailoROIPtr roi);
 
 cv::Scalar indexToColor(size_t index);
 
-__END_DECLS
\ No newline at end of file
+__END_DECLS
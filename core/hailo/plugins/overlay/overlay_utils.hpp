@@ -1,125 +1,242 @@
-
 #pragma once
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
-__BEGIN_DECLS
 #define CONFIDENCE 0.5
 
 /**
- * @brief this class inherites from cv::ParallelLoopBody
- *
+ * @brief The pixels of a frame, in its native format, that masks are blended into.
  */
-class Parallel_pixel_opencv : public cv::ParallelLoopBody
+struct OverlayPlanes
 {
-protected:
-    cv::Vec3b *p;
-    float transparency;
-    int image_cols;
-    int roi_cols;
+    hailo_mat_t type;
+    uint8_t *data;    // RGB, RGBA or YUY2 pixels, or the Y plane of NV12
+    size_t stride;
+    uint8_t *uv_data; // The interleaved UV plane of NV12
+    size_t uv_stride;
+};
 
-public:
-    Parallel_pixel_opencv(uint8_t *ptr, float transparency, int image_cols, int roi_cols) : p((cv::Vec3b *)ptr), transparency(transparency), image_cols(image_cols), roi_cols(roi_cols) {}
+/**
+ * @brief A color in the color space of the frame: RGB, or YUV for YUY2 and NV12.
+ */
+struct OverlayColor
+{
+    float c[3];
 };
 
 /**
- * @brief
- * this class inherites from Parallel_pixel_opencv
- * it override the virtual void operator ()(const cv::Range& range) const, and draws the color of pixel classification.
- * The range in the operator () represents the subset of pixels that will be
- * treated by an individual thread. This splitting is done automatically to
- * distribute equally the computation load.
- *
+ * @brief The chroma sample of a luma coordinate of a 4:2:0 plane. Rounds down: overlays may start left of
+ *        or above the frame, and truncating a negative coordinate would shift them by one chroma sample.
  */
-class ParallelPixelClassMask : public Parallel_pixel_opencv
+inline int chroma_coordinate(int luma)
+{
+    return (luma >= 0) ? luma / 2 : (luma - 1) / 2;
+}
+
+/**
+ * @brief Mask pixels of a class mask, each class is painted in its color.
+ *        Class ids are sampled with nearest neighbour, interpolating them would mix up classes.
+ */
+class ClassMaskSource
 {
 private:
-    uint8_t *mask_data;
+    const uint8_t *m_data;
+    int m_width;
+    const std::vector<OverlayColor> *m_palette;
 
 public:
-    ParallelPixelClassMask(uint8_t *ptr, uint8_t *mask_data, float transparency, int image_cols, int roi_cols) : Parallel_pixel_opencv(ptr, transparency, image_cols, roi_cols), mask_data(mask_data) {}
+    ClassMaskSource(const uint8_t *data, int width, const std::vector<OverlayColor> &palette) : m_data(data), m_width(width), m_palette(&palette) {}
 
-    virtual void operator()(const cv::Range &r) const
+    const uint8_t *row(const OverlayMaskSampling &sampling, int y, std::vector<float> &buffer) const
     {
-        for (int i = r.start; i != r.end; ++i)
-        {
-
-            // i the index inside the full image, convert it to the index inside the ROI
-            int index = i / roi_cols * image_cols + i % roi_cols;
-            int pixel_id = mask_data[i];
+        return m_data + sampling.nearest_y[y] * m_width;
+    }
 
-            p[index][0] = p[index][0] * (1 - transparency) + indexToColor(pixel_id)[0] * transparency;
-            p[index][1] = p[index][1] * (1 - transparency) + indexToColor(pixel_id)[1] * transparency;
-            p[index][2] = p[index][2] * (1 - transparency) + indexToColor(pixel_id)[2] * transparency;
-        }
+    bool operator()(const OverlayMaskSampling &sampling, const uint8_t *row, int x, OverlayColor &color) const
+    {
+        color = (*m_palette)[row[sampling.nearest_x[x]] % m_palette->size()];
+        return true;
     }
 };
+
+/**
+ * @brief Interpolate the two mask rows around destination row y, once for the whole row.
+ */
+inline const float *interpolate_row(const float *data, int width, const OverlayMaskSampling &sampling, int y, std::vector<float> &buffer)
+{
+    const float *row0 = data + sampling.y0[y] * width;
+    const float *row1 = data + sampling.y1[y] * width;
+    float wy = sampling.wy[y];
+    if (wy == 0.0f)
+        return row0;
+    buffer.resize(width);
+    for (int x = 0; x < width; x++)
+        buffer[x] = row0[x] + (row1[x] - row0[x]) * wy;
+    return buffer.data();
+}
+
+inline float interpolate_column(const float *row, const OverlayMaskSampling &sampling, int x)
+{
+    float left = row[sampling.x0[x]];
+    return left + (row[sampling.x1[x]] - left) * sampling.wx[x];
+}
+
 /**
- * @brief
- * this class inherites from Parallel_pixel_opencv
- * it override the virtual void operator ()(const cv::Range& range) const, and draws the color of mask classification if the pixel value is above threshold.
- * The range in the operator () represents the subset of pixels that will be
- * treated by an individual thread. This splitting is done automatically to
- * distribute equally the computation load.
- *
+ * @brief Mask pixels of a confidence mask, pixels above CONFIDENCE are painted in the class color.
  */
-class ParallelPixelClassConfMask : public Parallel_pixel_opencv
+class ConfClassMaskSource
 {
 private:
-    float *mask_data;
-    cv::Scalar mask_color;
+    const float *m_data;
+    int m_width;
+    OverlayColor m_color;
 
 public:
-    ParallelPixelClassConfMask(uint8_t *ptr, uint8_t *mask_data, float transparency, int image_cols, int roi_cols, cv::Scalar mask_color) : Parallel_pixel_opencv(ptr, transparency, image_cols, roi_cols), mask_data((float *)mask_data), mask_color(mask_color) {}
+    ConfClassMaskSource(const float *data, int width, OverlayColor color) : m_data(data), m_width(width), m_color(color) {}
 
-    virtual void operator()(const cv::Range &r) const
+    const float *row(const OverlayMaskSampling &sampling, int y, std::vector<float> &buffer) const
     {
-        for (int i = r.start; i != r.end; ++i)
-        {
+        return interpolate_row(m_data, m_width, sampling, y, buffer);
+    }
 
-            if (mask_data[i] > CONFIDENCE) // confidence is above threshold
-            {
-                // i the index inside the full image, convert it to the index inside the ROI
-                int index = i / roi_cols * image_cols + i % roi_cols;
+    bool operator()(const OverlayMaskSampling &sampling, const float *row, int x, OverlayColor &color) const
+    {
+        if (interpolate_column(row, sampling, x) <= CONFIDENCE)
+            return false;
+        color = m_color;
+        return true;
+    }
+};
 
-                p[index][0] = p[index][0] * (1 - transparency) + mask_color[0] * transparency;
-                p[index][1] = p[index][1] * (1 - transparency) + mask_color[1] * transparency;
-                p[index][2] = p[index][2] * (1 - transparency) + mask_color[2] * transparency;
-            }
+/**
+ * @brief Mask pixels of a depth mask, painted in gray levels between min and max depth.
+ */
+class DepthMaskSource
+{
+private:
+    const float *m_data;
+    int m_width;
+    float m_min;
+    float m_scale;
+    bool m_yuv;
+
+public:
+    DepthMaskSource(const float *data, int width, float min, float max, bool yuv) : m_data(data), m_width(width), m_min(min), m_scale(255.0f / (max - min)), m_yuv(yuv) {}
+
+    const float *row(const OverlayMaskSampling &sampling, int y, std::vector<float> &buffer) const
+    {
+        return interpolate_row(m_data, m_width, sampling, y, buffer);
+    }
+
+    bool operator()(const OverlayMaskSampling &sampling, const float *row, int x, OverlayColor &color) const
+    {
+        float depth = std::clamp((interpolate_column(row, sampling, x) - m_min) * m_scale, 0.0f, 255.0f);
+        if (m_yuv)
+        {
+            // RGB2Y/U/V of a gray level
+            color.c[0] = 0.859f * depth + 16.0f;
+            color.c[1] = 128.0f;
+            color.c[2] = 128.0f;
+        }
+        else
+        {
+            color.c[0] = color.c[1] = color.c[2] = depth;
         }
+        return true;
     }
 };
 
 /**
- * @brief
- * this class inherites from Parallel_pixel_opencv
- * it override the virtual void operator ()(const cv::Range& range) const, and draws pixel based on the depth.
- * The range in the operator () represents the subset of pixels that will be
- * treated by an individual thread. This splitting is done automatically to
- * distribute equally the computation load.
- *
+ * @brief Samples a mask and blends it into a rectangle of the frame in one pass, in the frame's native format.
+ *        The range of the parallel loop is the rows of the rectangle. Each row of the mask is interpolated
+ *        vertically once, then every pixel only interpolates horizontally.
+ *        With YUY2 and NV12 the chroma of a pixel pair (or 2x2 block) follows its top left pixel.
  */
-class ParallelPixelDepthMask : public Parallel_pixel_opencv
+template <typename Source>
+class ParallelMaskBlend : public cv::ParallelLoopBody
 {
 private:
-    float *mask_data;
+    OverlayPlanes m_planes;
+    cv::Rect m_rect;
+    const OverlayMaskSampling &m_sampling;
+    Source m_source;
+    float m_transparency;
+
+    inline void blend(uint8_t &pixel, float color) const
+    {
+        pixel = pixel * (1 - m_transparency) + color * m_transparency;
+    }
 
 public:
-    ParallelPixelDepthMask(uint8_t *ptr, uint8_t *mask_data, float transparency, int image_cols, int roi_cols) : Parallel_pixel_opencv(ptr, transparency, image_cols, roi_cols), mask_data((float *)mask_data) {}
+    ParallelMaskBlend(const OverlayPlanes &planes, cv::Rect rect, const OverlayMaskSampling &sampling, Source source, float transparency)
+        : m_planes(planes), m_rect(rect), m_sampling(sampling), m_source(source), m_transparency(transparency) {}
 
     virtual void operator()(const cv::Range &r) const
     {
-        for (int i = r.start; i != r.end; ++i)
+        OverlayColor color;
+        std::vector<float> buffer;
+        for (int y = r.start; y < r.end; y++)
         {
-            // i the index inside the full image, convert it to the index inside the ROI
-            int index = i / roi_cols * image_cols + i % roi_cols;
-
-            int depth = p[index][0] * (1 - transparency) + std::clamp(255 * mask_data[i], 0.0f, 255.0f) * transparency;
-            p[index][0] = depth;
-            p[index][1] = depth;
-            p[index][2] = depth;
+            auto mask_row = m_source.row(m_sampling, y, buffer);
+            int frame_y = m_rect.y + y;
+            uint8_t *row = m_planes.data + frame_y * m_planes.stride;
+            switch (m_planes.type)
+            {
+            case HAILO_MAT_RGB:
+            case HAILO_MAT_RGBA:
+            {
+                int channels = (m_planes.type == HAILO_MAT_RGB) ? 3 : 4;
+                uint8_t *pixel = row + m_rect.x * channels;
+                for (int x = 0; x < m_rect.width; x++, pixel += channels)
+                {
+                    if (!m_source(m_sampling, mask_row, x, color))
+                        continue;
+                    blend(pixel[0], color.c[0]);
+                    blend(pixel[1], color.c[1]);
+                    blend(pixel[2], color.c[2]);
+                }
+                break;
+            }
+            case HAILO_MAT_YUY2:
+            {
+                // Y0 U Y1 V: the luma of pixel x is at 2x, its pair's chroma at 2x + 1 and 2x + 3 for an even x
+                for (int x = 0; x < m_rect.width; x++)
+                {
+                    if (!m_source(m_sampling, mask_row, x, color))
+                        continue;
+                    int frame_x = m_rect.x + x;
+                    blend(row[2 * frame_x], color.c[0]);
+                    if ((frame_x & 1) == 0)
+                    {
+                        blend(row[2 * frame_x + 1], color.c[1]);
+                        blend(row[2 * frame_x + 3], color.c[2]);
+                    }
+                }
+                break;
+            }
+            case HAILO_MAT_NV12:
+            {
+                uint8_t *uv_row = ((frame_y & 1) == 0) ? m_planes.uv_data + chroma_coordinate(frame_y) * m_planes.uv_stride : nullptr;
+                for (int x = 0; x < m_rect.width; x++)
+                {
+                    if (!m_source(m_sampling, mask_row, x, color))
+                        continue;
+                    int frame_x = m_rect.x + x;
+                    blend(row[frame_x], color.c[0]);
+                    if (uv_row && (frame_x & 1) == 0)
+                    {
+                        blend(uv_row[frame_x], color.c[1]);
+                        blend(uv_row[frame_x + 1], color.c[2]);
+                    }
+                }
+                break;
+            }
+            default:
+                return;
+            }
         }
     }
 };
-
-__END_DECLS
\ No newline at end of file
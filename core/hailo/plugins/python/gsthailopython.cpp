@@ -335,8 +335,14 @@ static void get_tensors_from_meta(GstBuffer *buffer, HailoROIPtr roi)
     while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_PARENT_BUFFER_META_API_TYPE)))
     {
         pmeta = reinterpret_cast<GstParentBufferMeta *>(meta);
-        (void)gst_buffer_map(pmeta->buffer, &info, GST_MAP_READWRITE);
-        const hailo_vstream_info_t vstream_info = reinterpret_cast<GstHailoTensorMeta *>(gst_buffer_get_meta(pmeta->buffer, g_type_from_name(TENSOR_META_API_NAME)))->info;
+        // check if the buffer has tensor metadata
+        GstMeta *tensor_meta = gst_buffer_get_meta(pmeta->buffer, g_type_from_name(TENSOR_META_API_NAME));
+        if (!tensor_meta)
+            continue;
+        // Mapped for reading only: a tensor of an earlier hailofilter may still hold a reference, which makes the buffer not writable
+        if (!gst_buffer_map(pmeta->buffer, &info, GST_MAP_READ))
+            continue;
+        const hailo_vstream_info_t vstream_info = reinterpret_cast<GstHailoTensorMeta *>(tensor_meta)->info;
         roi->add_tensor(std::make_shared<HailoTensor>(reinterpret_cast<uint8_t *>(info.data), vstream_info));
         gst_buffer_unmap(pmeta->buffer, &info);
     }
@@ -3,11 +3,16 @@
  * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
  **/
 #include <gst/gst.h>
+#include <algorithm>
+#include <mutex>
 #include <opencv2/opencv.hpp>
+#include <unordered_map>
+#include <unordered_set>
 #include "hailo_objects.hpp"
 #include "hailo_common.hpp"
 #include "gst_hailo_meta.hpp"
 #include "gsthailotileaggregator.hpp"
+#include "tiling/tile_merge.hpp"
 
 GST_DEBUG_CATEGORY_STATIC(gst_hailotileaggregator_debug);
 #define GST_CAT_DEFAULT gst_hailotileaggregator_debug
@@ -21,11 +26,15 @@ enum
     PROP_IOU_THRESHOLD,
     PROP_BORDER_THRESHOLD,
     PROP_REMOVE_LARGE_LANDSCAPE,
+    PROP_BORDER_MERGE,
+    PROP_MERGE_THRESHOLD,
 };
 
 #define DEFAULT_IOU_THRESHOLD 0.3
 #define DEFAULT_BORDER_THRESHOLD 0.1
 #define DEFAULT_REMOVE_LARGE_LANDSCAPE true
+#define DEFAULT_BORDER_MERGE true
+#define DEFAULT_MERGE_THRESHOLD 0.5
 
 #define LARGE_LANDSCAPE_MASK_WIDTH_HEIGHT_RATIO 1.3
 #define LARGE_LANDSCAPE_MASK_SIZE 0.05
@@ -34,8 +43,6 @@ enum
 
 G_DEFINE_TYPE_WITH_CODE(GstHailoTileAggregator, gst_hailotileaggregator, GST_TYPE_HAILO_AGGREGATOR, _do_init);
 
-static float iou_calc(const HailoBBox &box_1, const HailoBBox &box_2);
-static void nms(HailoROIPtr hailo_roi, const float iou_thr);
 static void gst_hailotileaggregator_set_property(GObject *object,
                                                  guint prop_id, const GValue *value, GParamSpec *pspec);
 static void gst_hailotileaggregator_get_property(GObject *object,
@@ -46,6 +53,143 @@ static void gst_hailotileaggregator_finalize(GObject *object);
 
 static void gst_hailotileaggregator_post_aggregation(GstHailoAggregator *hailoaggregator, HailoROIPtr hailo_roi);
 static void gst_hailotileaggregator_handle_sub_frame_roi(GstHailoAggregator *hailoaggregator, HailoROIPtr sub_buffer_roi);
+static GstStateChangeReturn gst_hailotileaggregator_change_state(GstElement *element, GstStateChange transition);
+
+static bool is_large_landscape(const HailoBBox &bbox, int frame_width, int frame_height);
+
+/**
+ * @brief Keeps the source tile of every detection from the moment the tile arrives until its main frame
+ *        is aggregated, then merges the detections of the frame with a TileMergeEngine.
+ *        Tiles of several main frames may be in flight at once, so they are kept per main frame.
+ *        A main frame that is never aggregated (flushed, or dropped with its crops missing) would keep
+ *        its entry forever, so only the frames the aggregator may still have in flight are kept, the
+ *        oldest ones are forgotten first.
+ */
+class HailoTileMerger
+{
+private:
+    struct FrameTiles
+    {
+        std::vector<HailoBBox> tiles;
+        std::unordered_map<HailoDetectionPtr, uint32_t> sources; // Tile of each detection
+        uint64_t sequence = 0;                                    // Order of arrival of the main frame
+    };
+
+    std::mutex m_mutex;
+    std::unordered_map<HailoROIPtr, FrameTiles> m_frames;
+    uint64_t m_next_sequence = 0;
+
+    /**
+     * @brief Forget the oldest main frames until at most max_frames are kept.
+     *        The map holds at most a handful of frames, a linear scan is cheaper than keeping an order.
+     */
+    void evict_stale_frames(size_t max_frames)
+    {
+        while (m_frames.size() > max_frames)
+        {
+            auto oldest = std::min_element(m_frames.begin(), m_frames.end(), [](const auto &a, const auto &b)
+                                           { return a.second.sequence < b.second.sequence; });
+            m_frames.erase(oldest);
+        }
+    }
+
+    // Used only by merge, which runs for one main frame at a time
+    TileMergeEngine m_engine;
+    std::vector<HailoDetectionPtr> m_detections;
+    std::unordered_set<HailoObject *> m_removed;
+
+public:
+    /**
+     * @brief Record the detections of a tile, before they are flattened into the main frame.
+     *
+     * @param max_in_flight  -  size_t
+     *        The number of main frames the aggregator may have in flight, older frames are not aggregated
+     *        anymore. One more is kept, for the frame the aggregator popped but has not merged yet.
+     */
+    void add_tile(HailoROIPtr main_roi, HailoTileROIPtr tile, size_t max_in_flight)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto inserted = m_frames.try_emplace(main_roi);
+        FrameTiles &frame = inserted.first->second;
+        if (inserted.second)
+        {
+            frame.sequence = m_next_sequence++;
+            evict_stale_frames(std::max<size_t>(max_in_flight, 1) + 1);
+        }
+        frame.tiles.push_back(tile->get_bbox());
+        uint32_t tile_id = frame.tiles.size() - 1;
+        for (HailoDetectionPtr &detection : hailo_common::get_hailo_detections(tile))
+            frame.sources.emplace(detection, tile_id);
+    }
+
+    /**
+     * @brief Run NMS and border merging on the detections of the main frame, then remove
+     *        the suppressed detections from it in one pass.
+     *
+     * @param remove_large_landscape  -  bool
+     *        Also remove the large landscape detections (see is_large_landscape).
+     */
+    void merge(HailoROIPtr main_roi, const TileMergeParams &params, bool remove_large_landscape, int frame_width, int frame_height)
+    {
+        FrameTiles frame;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto found = m_frames.find(main_roi);
+            if (found != m_frames.end())
+            {
+                frame = std::move(found->second);
+                m_frames.erase(found);
+            }
+        }
+
+        m_engine.clear();
+        m_detections.clear();
+        m_removed.clear();
+        for (const HailoBBox &tile : frame.tiles)
+            m_engine.add_tile(tile);
+        for (HailoDetectionPtr &detection : hailo_common::get_hailo_detections(main_roi))
+        {
+            HailoBBox bbox = detection->get_bbox();
+            if (remove_large_landscape && is_large_landscape(bbox, frame_width, frame_height))
+            {
+                m_removed.insert(detection.get());
+                continue;
+            }
+            auto source = frame.sources.find(detection);
+            uint32_t tile_id = (source != frame.sources.end()) ? source->second : TileMergeEngine::NO_TILE;
+            m_engine.add(bbox, detection->get_confidence(), detection->get_class_id(), tile_id);
+            m_detections.push_back(detection);
+        }
+
+        const std::vector<uint32_t> &kept = m_engine.run(params);
+        std::vector<bool> is_kept(m_detections.size(), false);
+        for (uint32_t index : kept)
+        {
+            is_kept[index] = true;
+            if (m_engine.merged(index))
+                m_detections[index]->set_bbox(m_engine.bbox(index));
+        }
+        for (uint32_t index = 0; index < m_detections.size(); index++)
+        {
+            if (!is_kept[index])
+                m_removed.insert(m_detections[index].get());
+        }
+
+        if (!m_removed.empty())
+            main_roi->remove_objects_if([this](const HailoObjectPtr &obj)
+                                        { return m_removed.count(obj.get()) > 0; });
+        m_detections.clear();
+    }
+
+    /**
+     * @brief Forget the tiles of main frames that will not be aggregated anymore.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_frames.clear();
+    }
+};
 
 static void
 gst_hailotileaggregator_class_init(GstHailoTileAggregatorClass *klass)
@@ -65,6 +209,7 @@ gst_hailotileaggregator_class_init(GstHailoTileAggregatorClass *klass)
 
     hailoaggregator_class->handle_main_roi_post_aggregation = gst_hailotileaggregator_post_aggregation;
     hailoaggregator_class->handle_sub_frame_roi = gst_hailotileaggregator_handle_sub_frame_roi;
+    gstelement_class->change_state = gst_hailotileaggregator_change_state;
 
     gst_element_class_set_static_metadata(gstelement_class,
                                           "hailotileaggregator",
@@ -83,6 +228,14 @@ gst_hailotileaggregator_class_init(GstHailoTileAggregatorClass *klass)
     g_object_class_install_property(gobject_class, PROP_REMOVE_LARGE_LANDSCAPE,
                                     g_param_spec_boolean("remove-large-landscape", "Remove large landscape", "remove large landscape objects when running in multi-scale mode", true,
                                                          (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_BORDER_MERGE,
+                                    g_param_spec_boolean("border-merge", "Border merge", "merge detections cut by a tile border with the overlapping detection of the neighbouring tile, instead of suppressing one of them", DEFAULT_BORDER_MERGE,
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_MERGE_THRESHOLD,
+                                    g_param_spec_float("merge-threshold", "Border merge threshold", "overlap along the tile border, relative to the shorter detection, needed to merge two detections", 0, 1, DEFAULT_MERGE_THRESHOLD,
+                                                       (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
 }
 
 static void
@@ -91,6 +244,9 @@ gst_hailotileaggregator_init(GstHailoTileAggregator *hailotileaggregator)
     hailotileaggregator->iou_threshold = DEFAULT_IOU_THRESHOLD;
     hailotileaggregator->border_threshold = DEFAULT_BORDER_THRESHOLD;
     hailotileaggregator->remove_large_landscape = DEFAULT_REMOVE_LARGE_LANDSCAPE;
+    hailotileaggregator->border_merge = DEFAULT_BORDER_MERGE;
+    hailotileaggregator->merge_threshold = DEFAULT_MERGE_THRESHOLD;
+    hailotileaggregator->merger = new HailoTileMerger();
 }
 
 void gst_hailotileaggregator_dispose(GObject *object)
@@ -104,6 +260,8 @@ void gst_hailotileaggregator_finalize(GObject *object)
 {
     GstHailoTileAggregator *hailotileaggregator = GST_HAILO_TILE_AGGREGATOR(object);
     GST_DEBUG_OBJECT(hailotileaggregator, "finalize");
+    delete hailotileaggregator->merger;
+    hailotileaggregator->merger = nullptr;
     G_OBJECT_CLASS(gst_hailotileaggregator_parent_class)->finalize(object);
 }
 
@@ -121,6 +279,12 @@ static void gst_hailotileaggregator_set_property(GObject *object, guint prop_id,
     case PROP_REMOVE_LARGE_LANDSCAPE:
         hailotileaggregator->remove_large_landscape = g_value_get_boolean(value);
         break;
+    case PROP_BORDER_MERGE:
+        hailotileaggregator->border_merge = g_value_get_boolean(value);
+        break;
+    case PROP_MERGE_THRESHOLD:
+        hailotileaggregator->merge_threshold = g_value_get_float(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -141,6 +305,12 @@ static void gst_hailotileaggregator_get_property(GObject *object, guint prop_id,
     case PROP_REMOVE_LARGE_LANDSCAPE:
         g_value_set_boolean(value, hailotileaggregator->remove_large_landscape);
         break;
+    case PROP_BORDER_MERGE:
+        g_value_set_boolean(value, hailotileaggregator->border_merge);
+        break;
+    case PROP_MERGE_THRESHOLD:
+        g_value_set_float(value, hailotileaggregator->merge_threshold);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -148,29 +318,23 @@ static void gst_hailotileaggregator_get_property(GObject *object, guint prop_id,
 }
 
 /**
- * Remove large detection objects in multi-scale.
+ * Check if a detection is a large object to remove in multi-scale.
  * Usually related to crowded people when defined as one object, or other network related annomalies.
  * A large object is defined by it's size and it's width to height ratio.
  *
- * @param[in] hailo_roi       main HailoROI taken from the buffer.
+ * @param[in] bbox    HailoBBox of the detection, in the main frame.
  * @param[in] frame_width    integer. width of the full frame.
  * @param[in] frame_height    integer. height of the full frame.
- * @return void.
+ * @return bool.
  */
-static void remove_large_landscape(HailoROIPtr hailo_roi, int &frame_width, int &frame_height)
+static bool is_large_landscape(const HailoBBox &bbox, int frame_width, int frame_height)
 {
-    auto detections = hailo_common::get_hailo_detections(hailo_roi);
-    for (const HailoDetectionPtr &detection : detections)
-    {
-        HailoBBox bbox = detection->get_bbox();
-        float width = bbox.width() * frame_width;
-        float height = bbox.height() * frame_height;
+    float width = bbox.width() * frame_width;
+    float height = bbox.height() * frame_height;
 
-        bool is_landscape_mask = (width >= (height * LARGE_LANDSCAPE_MASK_WIDTH_HEIGHT_RATIO));
-        bool is_landscape_size_mask = (((width * height) / (frame_height * frame_width)) > LARGE_LANDSCAPE_MASK_SIZE);
-        if (is_landscape_mask && is_landscape_size_mask)
-            hailo_roi->remove_object(detection);
-    }
+    bool is_landscape_mask = (width >= (height * LARGE_LANDSCAPE_MASK_WIDTH_HEIGHT_RATIO));
+    bool is_landscape_size_mask = (((width * height) / (frame_height * frame_width)) > LARGE_LANDSCAPE_MASK_SIZE);
+    return is_landscape_mask && is_landscape_size_mask;
 }
 
 /**
@@ -203,92 +367,59 @@ static void
 gst_hailotileaggregator_post_aggregation(GstHailoAggregator *hailoaggregator, HailoROIPtr hailo_roi)
 {
     GstHailoTileAggregator *hailotileaggregator = GST_HAILO_TILE_AGGREGATOR(hailoaggregator);
+    if (hailo_roi == nullptr)
+        return;
 
     // Get the frame width and height from the main sinkpad
     GstCaps *caps = gst_pad_get_current_caps(hailoaggregator->sinkpad_main);
-    gint frame_width, frame_height;
-    auto caps_st = gst_caps_get_structure(caps, 0);
-    gst_structure_get_int(caps_st, "width", &frame_width);
-    gst_structure_get_int(caps_st, "height", &frame_height);
-    if(hailo_roi == nullptr)
-        return;
+    gint frame_width = 0, frame_height = 0;
+    if (caps)
+    {
+        auto caps_st = gst_caps_get_structure(caps, 0);
+        gst_structure_get_int(caps_st, "width", &frame_width);
+        gst_structure_get_int(caps_st, "height", &frame_height);
+        gst_caps_unref(caps);
+    }
     auto tiles = hailo_common::get_hailo_tiles(hailo_roi);
-    if (tiles[0]->get_mode() == MULTI_SCALE && hailotileaggregator->remove_large_landscape)
-        remove_large_landscape(hailo_roi, frame_width, frame_height);
-
-    // Perform NMS on the main frame's detections after aggragation is done
-    nms(hailo_roi, hailotileaggregator->iou_threshold);
+    bool remove_large_landscape = !tiles.empty() && tiles[0]->get_mode() == MULTI_SCALE &&
+                                  hailotileaggregator->remove_large_landscape && frame_width > 0 && frame_height > 0;
+
+    // Perform NMS and border merging on the main frame's detections after aggragation is done
+    TileMergeParams params(hailotileaggregator->iou_threshold);
+    params.border_merge = hailotileaggregator->border_merge;
+    params.merge_threshold = hailotileaggregator->merge_threshold;
+    hailotileaggregator->merger->merge(hailo_roi, params, remove_large_landscape, frame_width, frame_height);
 }
 
 static void
 gst_hailotileaggregator_handle_sub_frame_roi(GstHailoAggregator *hailoaggregator, HailoROIPtr sub_buffer_roi)
 {
+    GstHailoTileAggregator *hailotileaggregator = GST_HAILO_TILE_AGGREGATOR(hailoaggregator);
     HailoTileROIPtr hailo_tile_roi = std::dynamic_pointer_cast<HailoTileROI>(sub_buffer_roi);
     if (hailo_tile_roi->get_mode() == MULTI_SCALE)
     {
         // Remove tile's exceeded objects (close to boundary) using given border_threshold
-        GstHailoTileAggregator *hailotileaggregator = GST_HAILO_TILE_AGGREGATOR(hailoaggregator);
         remove_exceeded_bboxes(hailo_tile_roi, hailotileaggregator->border_threshold);
     }
 
+    // Remember the tile of each detection, they are all moved to the main frame when flattened
+    if (hailoaggregator->flatten_detections)
+        hailotileaggregator->merger->add_tile(get_hailo_main_roi(hailoaggregator->mainframe), hailo_tile_roi,
+                                              hailoaggregator->max_in_flight);
+
     // Calling the base handle_sub_frame_roi of the parent (hailoaggregator)
     GST_HAILO_AGGREGATOR_CLASS(parent_class)->handle_sub_frame_roi(hailoaggregator, sub_buffer_roi);
 }
 
-float iou_calc(const HailoBBox &box_1, const HailoBBox &box_2)
+static GstStateChangeReturn
+gst_hailotileaggregator_change_state(GstElement *element, GstStateChange transition)
 {
-    // Calculate IOU between two detection boxes
-    const float width_of_overlap_area = std::min(box_1.xmax(), box_2.xmax()) - std::max(box_1.xmin(), box_2.xmin());
-    const float height_of_overlap_area = std::min(box_1.ymax(), box_2.ymax()) - std::max(box_1.ymin(), box_2.ymin());
-    const float positive_width_of_overlap_area = std::max(width_of_overlap_area, 0.0f);
-    const float positive_height_of_overlap_area = std::max(height_of_overlap_area, 0.0f);
-    const float area_of_overlap = positive_width_of_overlap_area * positive_height_of_overlap_area;
-    const float box_1_area = (box_1.ymax() - box_1.ymin()) * (box_1.xmax() - box_1.xmin());
-    const float box_2_area = (box_2.ymax() - box_2.ymin()) * (box_2.xmax() - box_2.xmin());
-    // The IOU is a ratio of how much the boxes overlap vs their size outside the overlap.
-    // Boxes that are similar will have a higher overlap threshold.
-    return area_of_overlap / (box_1_area + box_2_area - area_of_overlap);
+    GstStateChangeReturn ret = GST_ELEMENT_CLASS(parent_class)->change_state(element, transition);
+    if (ret == GST_STATE_CHANGE_FAILURE)
+        return ret;
+
+    // Main frames that were not aggregated before stopping never will be
+    if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+        GST_HAILO_TILE_AGGREGATOR(element)->merger->clear();
+    return ret;
 }
-
-/**
- * @brief Perform IOU based NMS on detection objects of HailoRoi
- *
- * @param hailo_roi  -  HailoROIPtr
- *        The HailoROI contains detections to perform NMS on.
- *
- * @param iou_thr  -  float
- *        Threshold for IOU filtration
- */
-void nms(HailoROIPtr hailo_roi, const float iou_thr)
-{
-    // The network may propose multiple detections of similar size/score,
-    // which are actually the same detection. We want to filter out the lesser
-    // detections with a simple nms.
-
-    std::vector<HailoDetectionPtr> objects = hailo_common::get_hailo_detections(hailo_roi);
-    std::sort(objects.begin(), objects.end(),
-              [](HailoDetectionPtr a, HailoDetectionPtr b)
-              { return a->get_confidence() > b->get_confidence(); });
-
-    for (uint index = 0; index < objects.size(); index++)
-    {
-        for (uint jindex = index + 1; jindex < objects.size(); jindex++)
-        {
-            if (objects[index]->get_class_id() == objects[jindex]->get_class_id())
-            {
-                // For each detection, calculate the IOU against each following detection.
-                float iou = iou_calc(objects[index]->get_bbox(), objects[jindex]->get_bbox());
-                // If the IOU is above threshold, then we have two similar detections,
-                // and want to delete the one.
-                if (iou >= iou_thr)
-                {
-                    // The detections are arranged in highest score order,
-                    // so we want to erase the latter detection.
-                    hailo_roi->remove_object(objects[jindex]);
-                    objects.erase(objects.begin() + jindex);
-                    jindex--; // Step back jindex since we just erased the current detection.
-                }
-            }
-        }
-    }
-}
\ No newline at end of file
@@ -12,6 +12,8 @@
 #include <gst/gst.h>
 #include "cropping/gsthailoaggregator.hpp"
 
+class HailoTileMerger;
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_HAILO_TILE_AGGREGATOR (gst_hailotileaggregator_get_type())
@@ -31,6 +33,9 @@ struct _GstHailoTileAggregator
     gfloat iou_threshold;
     gfloat border_threshold;
     gboolean remove_large_landscape;
+    gboolean border_merge;
+    gfloat merge_threshold;
+    HailoTileMerger *merger;
 };
 
 struct _GstHailoTileAggregatorClass
@@ -3,8 +3,14 @@
 * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
 **/
 #include <gst/gst.h>
+#include <gst/video/video.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <deque>
 #include <opencv2/opencv.hpp>
 
+#include "hailo_common.hpp"
 #include "gst_hailo_meta.hpp"
 #include "gsthailotilecropper.hpp"
 
@@ -19,6 +25,10 @@ GST_DEBUG_CATEGORY_STATIC(gst_hailotilecropper_debug);
 #define DEFAULT_OVERLAP_X_AXIS 0
 #define DEFAULT_OVERLAP_Y_AXIS 0
 #define DEFAULT_MULTI_SCALE_LEVEL 2
+#define DEFAULT_ADAPTIVE_TILING false
+#define DEFAULT_MOTION_THRESHOLD 6.0
+#define DEFAULT_REFRESH_PERIOD 30
+#define DEFAULT_MAX_TILES 0
 static const uint scales_template[][2]{{1, 1}, {2, 2}, {3, 3}};
 
 enum
@@ -30,8 +40,19 @@ enum
     PROP_OVERLAP_Y_AXIS,
     PROP_TILING_MODE,
     PROP_MULTI_SCALE_LEVEL,
+    PROP_ADAPTIVE_TILING,
+    PROP_MOTION_THRESHOLD,
+    PROP_REFRESH_PERIOD,
+    PROP_MAX_TILES,
+    PROP_TILES_EMITTED,
+    PROP_TILES_SKIPPED,
 };
 
+// Width of the luma thumbnail that motion is measured on
+#define MOTION_THUMBNAIL_WIDTH 160
+// Main frames whose detections keep the tiles they overlap active
+#define DETECTION_HISTORY_SIZE 4
+
 #define gst_hailotilecropper_parent_class parent_class
 
 G_DEFINE_TYPE_WITH_CODE(GstHailoTileCropper, gst_hailotilecropper, GST_TYPE_HAILO_BASE_CROPPER, _do_init);
@@ -66,6 +87,241 @@ static std::vector<HailoROIPtr> gst_hailotilecropper_prepare_crops(GstHailoBaseC
                                                                    GstBuffer *buf);
 void tiling_resize(GstHailoBaseCropper *basecropper, std::vector<cv::Mat> &cropped_image_vec, std::vector<cv::Mat> &resized_image_vec, HailoROIPtr roi, GstVideoFormat image_format);
 
+/**
+ * @brief Chooses which tiles of a frame are worth an inference.
+ *        A tile is emitted when the luma under it changed since it was last emitted, when a detection
+ *        (or track) of one of the previous frames overlaps it, or when it was not emitted for refresh-period
+ *        frames, so every tile is eventually covered. Tiles are identified by their position in the
+ *        tile layout, which stays the same from frame to frame.
+ *        Luma is sampled on a small thumbnail, so the cost per frame is independent of the resolution.
+ */
+class HailoAdaptiveTiling
+{
+private:
+    struct TileState
+    {
+        std::vector<uint8_t> reference; // Thumbnail luma under the tile when it was last emitted
+        uint frames_since_emitted = 0;
+    };
+
+    struct TileCandidate
+    {
+        uint index;
+        bool overdue;
+        bool detected;
+        float motion;
+    };
+
+    std::vector<TileState> m_tiles;
+    std::vector<uint8_t> m_thumbnail;
+    int m_thumbnail_width = 0;
+    int m_thumbnail_height = 0;
+    std::deque<HailoROIPtr> m_history; // Main ROIs of the previous frames, the aggregator adds their detections
+    std::vector<HailoBBox> m_detections;
+    std::vector<TileCandidate> m_candidates;
+    std::atomic<guint64> m_emitted{0};
+    std::atomic<guint64> m_skipped{0};
+
+    static inline uint8_t rgb_luma(const uint8_t *pixel)
+    {
+        // BT.601 weights in 8 bit fixed point
+        return (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2]) >> 8;
+    }
+
+    /**
+     * @brief Sample the luma of the frame every step pixels into m_thumbnail.
+     */
+    bool update_thumbnail(GstBuffer *buffer, GstVideoInfo *info)
+    {
+        GstVideoFrame frame;
+        if (!gst_video_frame_map(&frame, info, buffer, GST_MAP_READ))
+            return false;
+
+        int width = GST_VIDEO_INFO_WIDTH(info);
+        int height = GST_VIDEO_INFO_HEIGHT(info);
+        int step = std::max(1, width / MOTION_THUMBNAIL_WIDTH);
+        int thumbnail_width = width / step;
+        int thumbnail_height = height / step;
+        if (thumbnail_width != m_thumbnail_width || thumbnail_height != m_thumbnail_height)
+        {
+            // The references of the tiles were sampled on another resolution
+            m_tiles.clear();
+            m_thumbnail_width = thumbnail_width;
+            m_thumbnail_height = thumbnail_height;
+        }
+        m_thumbnail.resize(thumbnail_width * thumbnail_height);
+
+        const uint8_t *data = (const uint8_t *)GST_VIDEO_FRAME_PLANE_DATA(&frame, 0);
+        int stride = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0);
+        GstVideoFormat format = GST_VIDEO_INFO_FORMAT(info);
+        for (int y = 0; y < thumbnail_height; y++)
+        {
+            const uint8_t *row = data + (size_t)y * step * stride;
+            uint8_t *out = m_thumbnail.data() + y * thumbnail_width;
+            switch (format)
+            {
+            case GST_VIDEO_FORMAT_RGB:
+                for (int x = 0; x < thumbnail_width; x++)
+                    out[x] = rgb_luma(row + x * step * 3);
+                break;
+            case GST_VIDEO_FORMAT_RGBA:
+                for (int x = 0; x < thumbnail_width; x++)
+                    out[x] = rgb_luma(row + x * step * 4);
+                break;
+            case GST_VIDEO_FORMAT_YUY2:
+                for (int x = 0; x < thumbnail_width; x++)
+                    out[x] = row[x * step * 2];
+                break;
+            default:
+                // NV12 and the other planar formats keep luma in the first plane
+                for (int x = 0; x < thumbnail_width; x++)
+                    out[x] = row[x * step];
+                break;
+            }
+        }
+        gst_video_frame_unmap(&frame);
+        return true;
+    }
+
+    cv::Rect thumbnail_rect(const HailoBBox &bbox) const
+    {
+        int x0 = CLAMP((int)std::floor(bbox.xmin() * m_thumbnail_width), 0, m_thumbnail_width);
+        int y0 = CLAMP((int)std::floor(bbox.ymin() * m_thumbnail_height), 0, m_thumbnail_height);
+        int x1 = CLAMP((int)std::ceil(bbox.xmax() * m_thumbnail_width), 0, m_thumbnail_width);
+        int y1 = CLAMP((int)std::ceil(bbox.ymax() * m_thumbnail_height), 0, m_thumbnail_height);
+        return cv::Rect(x0, y0, x1 - x0, y1 - y0);
+    }
+
+    /**
+     * @brief Mean absolute luma difference between the tile now and when it was last emitted.
+     */
+    float motion_score(const TileState &state, const cv::Rect &rect) const
+    {
+        if (rect.area() == 0 || state.reference.size() != (size_t)rect.area())
+            return 0.0f;
+        uint64_t sum = 0;
+        const uint8_t *reference = state.reference.data();
+        for (int y = rect.y; y < rect.y + rect.height; y++)
+        {
+            const uint8_t *row = m_thumbnail.data() + y * m_thumbnail_width + rect.x;
+            for (int x = 0; x < rect.width; x++)
+                sum += std::abs((int)row[x] - (int)*reference++);
+        }
+        return (float)sum / rect.area();
+    }
+
+    void store_reference(TileState &state, const cv::Rect &rect)
+    {
+        state.reference.resize(rect.area());
+        uint8_t *reference = state.reference.data();
+        for (int y = rect.y; y < rect.y + rect.height; y++)
+        {
+            const uint8_t *row = m_thumbnail.data() + y * m_thumbnail_width + rect.x;
+            reference = std::copy(row, row + rect.width, reference);
+        }
+        state.frames_since_emitted = 0;
+    }
+
+    bool overlaps_detection(const HailoBBox &tile) const
+    {
+        for (const HailoBBox &bbox : m_detections)
+        {
+            if (bbox.xmin() < tile.xmax() && bbox.xmax() > tile.xmin() && bbox.ymin() < tile.ymax() && bbox.ymax() > tile.ymin())
+                return true;
+        }
+        return false;
+    }
+
+public:
+    /**
+     * @brief Keep only the tiles of this frame worth an inference.
+     *
+     * @param tiles  -  std::vector<HailoROIPtr>
+     *        All the tiles of the frame, in layout order. Filtered in place.
+     *
+     * @param hailo_roi  -  HailoROIPtr
+     *        Main ROI of the frame, remembered for its detections.
+     *
+     * @param motion_threshold  -  float
+     *        Mean absolute luma difference (0 - 255) that marks a tile as changed.
+     *
+     * @param refresh_period  -  uint
+     *        A tile is emitted at least once every refresh_period frames.
+     *
+     * @param max_tiles  -  uint
+     *        Maximal number of tiles to emit, 0 for no limit.
+     */
+    void select(std::vector<HailoROIPtr> &tiles, GstBuffer *buffer, GstVideoInfo *info, HailoROIPtr hailo_roi,
+                float motion_threshold, uint refresh_period, uint max_tiles)
+    {
+        uint total = tiles.size();
+        if (!update_thumbnail(buffer, info))
+        {
+            m_emitted += total;
+            return;
+        }
+        if (m_tiles.size() != total)
+            m_tiles.assign(total, TileState());
+
+        // Detections of the previous frames, added by the aggregator (or by a tracker) after this element
+        m_detections.clear();
+        for (HailoROIPtr &roi : m_history)
+            for (HailoDetectionPtr &detection : hailo_common::get_hailo_detections(roi))
+                m_detections.push_back(detection->get_bbox());
+        m_history.push_back(hailo_roi);
+        if (m_history.size() > DETECTION_HISTORY_SIZE)
+            m_history.pop_front();
+
+        m_candidates.clear();
+        for (uint index = 0; index < total; index++)
+        {
+            TileState &state = m_tiles[index];
+            state.frames_since_emitted++;
+            const HailoBBox &bbox = tiles[index]->get_bbox();
+            TileCandidate candidate = {index,
+                                       state.reference.empty() || state.frames_since_emitted >= refresh_period,
+                                       overlaps_detection(bbox),
+                                       motion_score(state, thumbnail_rect(bbox))};
+            if (candidate.overdue || candidate.detected || candidate.motion >= motion_threshold)
+                m_candidates.push_back(candidate);
+        }
+
+        // Over the budget, the tiles waiting for their refresh come first, then tiles with detections, then the most changed ones
+        if (max_tiles > 0 && m_candidates.size() > max_tiles)
+        {
+            std::stable_sort(m_candidates.begin(), m_candidates.end(), [this](const TileCandidate &a, const TileCandidate &b)
+                             {
+                                 if (a.overdue != b.overdue)
+                                     return a.overdue;
+                                 if (a.overdue)
+                                     return m_tiles[a.index].frames_since_emitted > m_tiles[b.index].frames_since_emitted;
+                                 if (a.detected != b.detected)
+                                     return a.detected;
+                                 return a.motion > b.motion; });
+            m_candidates.resize(max_tiles);
+            std::sort(m_candidates.begin(), m_candidates.end(), [](const TileCandidate &a, const TileCandidate &b)
+                      { return a.index < b.index; });
+        }
+
+        std::vector<HailoROIPtr> selected;
+        selected.reserve(m_candidates.size());
+        for (const TileCandidate &candidate : m_candidates)
+        {
+            store_reference(m_tiles[candidate.index], thumbnail_rect(tiles[candidate.index]->get_bbox()));
+            selected.emplace_back(tiles[candidate.index]);
+        }
+        m_emitted += selected.size();
+        m_skipped += total - selected.size();
+        GST_LOG("Adaptive tiling emits %zu of %u tiles", selected.size(), total);
+        tiles = std::move(selected);
+    }
+
+    void add_emitted(guint64 count) { m_emitted += count; }
+
+    guint64 emitted() const { return m_emitted; }
+    guint64 skipped() const { return m_skipped; }
+};
+
 
 static void
 gst_hailotilecropper_class_init(GstHailoTileCropperClass *klass)
@@ -115,6 +371,42 @@ gst_hailotilecropper_class_init(GstHailoTileCropperClass *klass)
     g_object_class_install_property(gobject_class, PROP_MULTI_SCALE_LEVEL,
                                     g_param_spec_uint("scale-level", "Scale level", "Scales (layers of tiles) in addition to the main layer 1: [(1 X 1)] 2: [(1 X 1), (2 X 2)] 3: [(1 X 1), (2 X 2), (3 X 3)]]", 1, 3, 2,
                                                       (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_ADAPTIVE_TILING,
+                                    g_param_spec_boolean("adaptive-tiling", "Adaptive tiling",
+                                                         "Emit only the tiles whose content changed (see motion-threshold), the tiles overlapping detections of the previous frames, "
+                                                         "and the tiles not emitted for refresh-period frames. Other tiles are skipped.",
+                                                         DEFAULT_ADAPTIVE_TILING,
+                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_MOTION_THRESHOLD,
+                                    g_param_spec_float("motion-threshold", "Motion threshold",
+                                                       "Adaptive tiling: mean absolute luma difference (0 - 255) between a tile and its content when it was last emitted, that marks it as changed",
+                                                       0, 255, DEFAULT_MOTION_THRESHOLD,
+                                                       (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_REFRESH_PERIOD,
+                                    g_param_spec_uint("refresh-period", "Refresh period",
+                                                      "Adaptive tiling: every tile is emitted at least once every refresh-period frames",
+                                                      1, G_MAXUINT, DEFAULT_REFRESH_PERIOD,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_MAX_TILES,
+                                    g_param_spec_uint("max-tiles", "Max tiles",
+                                                      "Adaptive tiling: maximal number of tiles emitted per frame, 0 for no limit. "
+                                                      "Over the limit, tiles waiting for their refresh come first, then tiles with detections, then the most changed tiles.",
+                                                      0, G_MAXUINT, DEFAULT_MAX_TILES,
+                                                      (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY)));
+
+    g_object_class_install_property(gobject_class, PROP_TILES_EMITTED,
+                                    g_param_spec_uint64("tiles-emitted", "Tiles emitted", "Number of tiles emitted so far",
+                                                        0, G_MAXUINT64, 0,
+                                                        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    g_object_class_install_property(gobject_class, PROP_TILES_SKIPPED,
+                                    g_param_spec_uint64("tiles-skipped", "Tiles skipped", "Number of tiles skipped so far by adaptive tiling",
+                                                        0, G_MAXUINT64, 0,
+                                                        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
 }
 
 static void
@@ -126,6 +418,11 @@ gst_hailotilecropper_init(GstHailoTileCropper *hailotilecropper)
     hailotilecropper->overlap_y_axis = DEFAULT_OVERLAP_Y_AXIS;
     hailotilecropper->tiling_mode = SINGLE_SCALE;
     hailotilecropper->multi_scale_level = DEFAULT_MULTI_SCALE_LEVEL;
+    hailotilecropper->adaptive_tiling = DEFAULT_ADAPTIVE_TILING;
+    hailotilecropper->motion_threshold = DEFAULT_MOTION_THRESHOLD;
+    hailotilecropper->refresh_period = DEFAULT_REFRESH_PERIOD;
+    hailotilecropper->max_tiles = DEFAULT_MAX_TILES;
+    hailotilecropper->adaptive = new HailoAdaptiveTiling();
 }
 
 void gst_hailotilecropper_dispose(GObject *object)
@@ -139,6 +436,8 @@ void gst_hailotilecropper_finalize(GObject *object)
 {
     GstHailoTileCropper *hailotilecropper = GST_HAILO_TILE_CROPPER(object);
     GST_DEBUG_OBJECT(hailotilecropper, "finalize");
+    delete hailotilecropper->adaptive;
+    hailotilecropper->adaptive = nullptr;
     G_OBJECT_CLASS(gst_hailotilecropper_parent_class)->finalize(object);
 }
 
@@ -169,6 +468,18 @@ gst_hailotilecropper_set_property(GObject *object, guint prop_id,
         hailotilecropper->tiling_mode = (hailo_tiling_mode_t)g_value_get_enum(value);
         GST_OBJECT_UNLOCK(hailotilecropper);
         break;
+    case PROP_ADAPTIVE_TILING:
+        hailotilecropper->adaptive_tiling = g_value_get_boolean(value);
+        break;
+    case PROP_MOTION_THRESHOLD:
+        hailotilecropper->motion_threshold = g_value_get_float(value);
+        break;
+    case PROP_REFRESH_PERIOD:
+        hailotilecropper->refresh_period = g_value_get_uint(value);
+        break;
+    case PROP_MAX_TILES:
+        hailotilecropper->max_tiles = g_value_get_uint(value);
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -203,6 +514,24 @@ gst_hailotilecropper_get_property(GObject *object, guint prop_id,
         g_value_set_enum(value, (gint)hailotilecropper->tiling_mode);
         GST_OBJECT_UNLOCK(hailotilecropper);
         break;
+    case PROP_ADAPTIVE_TILING:
+        g_value_set_boolean(value, hailotilecropper->adaptive_tiling);
+        break;
+    case PROP_MOTION_THRESHOLD:
+        g_value_set_float(value, hailotilecropper->motion_threshold);
+        break;
+    case PROP_REFRESH_PERIOD:
+        g_value_set_uint(value, hailotilecropper->refresh_period);
+        break;
+    case PROP_MAX_TILES:
+        g_value_set_uint(value, hailotilecropper->max_tiles);
+        break;
+    case PROP_TILES_EMITTED:
+        g_value_set_uint64(value, hailotilecropper->adaptive->emitted());
+        break;
+    case PROP_TILES_SKIPPED:
+        g_value_set_uint64(value, hailotilecropper->adaptive->skipped());
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
         break;
@@ -232,7 +561,7 @@ static HailoTileROI create_tile_roi(const uint &index, const float &col_overlap,
     return HailoTileROI(HailoBBox(x, y, width, height), index, col_overlap, row_overlap, layer, tiling_mode);
 }
 
-static void prepare_tiles(HailoROIPtr hailo_roi, std::vector<HailoROIPtr> &crop_rois, float tiles_along_x_axis, float tiles_along_y_axis, float overlap_x_axis, float overlap_y_axis, uint layer, hailo_tiling_mode_t tiling_mode)
+static void prepare_tiles(std::vector<HailoROIPtr> &crop_rois, float tiles_along_x_axis, float tiles_along_y_axis, float overlap_x_axis, float overlap_y_axis, uint layer, hailo_tiling_mode_t tiling_mode)
 {
     // Calculate the scale for a tile for col and row
     double row_step = 1 / double(tiles_along_y_axis);
@@ -250,12 +579,11 @@ static void prepare_tiles(HailoROIPtr hailo_roi, std::vector<HailoROIPtr> &crop_
         while (float(col_offset + col_step) <= 1)
         {
             // Create new tile ROI
-            HailoTileROIPtr tile_roi = std::make_shared<HailoTileROI>(create_tile_roi(index, col_overlap, row_overlap,
+            HailoTileROIPtr tile_roi = hailo_make_shared<HailoTileROI>(create_tile_roi(index, col_overlap, row_overlap,
                                                                                       col_offset, row_offset, (col_offset + col_step), (row_offset + row_step),
                                                                                       layer, tiling_mode));
-            // Add the tile to the result vector and into the main hailo_roi.
+            // Add the tile to the result vector
             crop_rois.emplace_back(tile_roi);
-            hailo_roi->add_object(tile_roi);
 
             col_offset += col_step;
             index++;
@@ -270,6 +598,7 @@ static void prepare_tiles(HailoROIPtr hailo_roi, std::vector<HailoROIPtr> &crop_
  * overrides hailocropper base functionality.
  * prepares vector of tiles in row/column structure (determined by elemnet properties) (HailoTileROI for each tile).
  * adds each one to the main roi. tiles can overlap each other.
+ * With adaptive tiling only the tiles selected by HailoAdaptiveTiling are kept.
  *
  * @param[in] hailocropper    cropping element.
  * @param[in] hailo_roi       main HailoROI taken from the buffer.
@@ -283,7 +612,7 @@ static std::vector<HailoROIPtr> gst_hailotilecropper_prepare_crops(GstHailoBaseC
     HailoROIPtr hailo_roi = get_hailo_main_roi(buf, true);
 
     // Calculate the total number of tiles
-    uint total_num_of_tiles = hailotilecropper->tiles_along_x_axis * hailotilecropper->tiles_along_x_axis;
+    uint total_num_of_tiles = hailotilecropper->tiles_along_x_axis * hailotilecropper->tiles_along_y_axis;
     uint num_of_scales = hailotilecropper->multi_scale_level;
 
     if (hailotilecropper->tiling_mode == MULTI_SCALE)
@@ -297,13 +626,32 @@ static std::vector<HailoROIPtr> gst_hailotilecropper_prepare_crops(GstHailoBaseC
     crop_rois.reserve(total_num_of_tiles);
 
     // Prepare tiles for the main scale
-    prepare_tiles(hailo_roi, crop_rois, hailotilecropper->tiles_along_x_axis, hailotilecropper->tiles_along_y_axis,
+    prepare_tiles(crop_rois, hailotilecropper->tiles_along_x_axis, hailotilecropper->tiles_along_y_axis,
                   hailotilecropper->overlap_x_axis, hailotilecropper->overlap_y_axis, 0, hailotilecropper->tiling_mode);
 
     // Prepare tiles for every scale requsted as multi scale
     if (hailotilecropper->tiling_mode == MULTI_SCALE)
         for (uint i = 0; i < num_of_scales; i++)
-            prepare_tiles(hailo_roi, crop_rois, scales_template[i][0], scales_template[i][1], hailotilecropper->overlap_x_axis, hailotilecropper->overlap_y_axis, (i + 1), (hailo_tiling_mode_t)hailotilecropper->tiling_mode);
+            prepare_tiles(crop_rois, scales_template[i][0], scales_template[i][1], hailotilecropper->overlap_x_axis, hailotilecropper->overlap_y_axis, (i + 1), (hailo_tiling_mode_t)hailotilecropper->tiling_mode);
+
+    if (hailotilecropper->adaptive_tiling)
+    {
+        GstCaps *caps = gst_pad_get_current_caps(hailocropper->sinkpad);
+        GstVideoInfo video_info;
+        if (caps && gst_video_info_from_caps(&video_info, caps))
+            hailotilecropper->adaptive->select(crop_rois, buf, &video_info, hailo_roi, hailotilecropper->motion_threshold,
+                                               hailotilecropper->refresh_period, hailotilecropper->max_tiles);
+        if (caps)
+            gst_caps_unref(caps);
+    }
+    else
+    {
+        hailotilecropper->adaptive->add_emitted(crop_rois.size());
+    }
+
+    // Add the emitted tiles into the main hailo_roi.
+    for (HailoROIPtr &tile_roi : crop_rois)
+        hailo_roi->add_object(tile_roi);
 
     return crop_rois;
 }
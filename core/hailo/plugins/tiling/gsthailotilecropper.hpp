@@ -13,6 +13,8 @@
 #include "cropping/gsthailobasecropper.hpp"
 #include "hailo_objects.hpp"
 
+class HailoAdaptiveTiling;
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_HAILO_TILE_CROPPER (gst_hailotilecropper_get_type())
@@ -34,6 +36,11 @@ struct _GstHailoTileCropper
     gfloat overlap_y_axis;
     guint multi_scale_level;
     hailo_tiling_mode_t tiling_mode;
+    gboolean adaptive_tiling;
+    gfloat motion_threshold;
+    guint refresh_period;
+    guint max_tiles;
+    HailoAdaptiveTiling *adaptive;
 };
 
 struct _GstHailoTileCropperClass
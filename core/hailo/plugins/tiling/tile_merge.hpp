@@ -0,0 +1,333 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * @file tile_merge.hpp
+ * @brief NMS and border merging of detections gathered from the tiles of a frame.
+ **/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "hailo_objects.hpp"
+
+struct TileMergeParams
+{
+    float iou_threshold;
+    bool border_merge = true;    // Merge boxes cut by a tile border with their other part, instead of suppressing them.
+    float merge_threshold = 0.5; // Overlap along the cut border, relative to the shorter of the two boxes, needed to merge.
+    float cut_margin = 0.02;     // A box is cut if its edge is this close to an inner tile border, relative to the tile size.
+    TileMergeParams(float iou_threshold) : iou_threshold(iou_threshold){};
+};
+
+/**
+ * @brief NMS over the detections of all the tiles of a frame, in frame coordinates.
+ *        Boxes are hashed into a uniform grid sized after the average box, so each kept box
+ *        is compared only against the boxes sharing a cell with it. Boxes of the same tile are
+ *        never compared, the post-process of the tile already ran NMS on them, so only boxes
+ *        from overlapping tiles or other scale levels meet.
+ *        A box that ends at an inner tile border is cut: when the box it overlaps continues
+ *        past that border, the two are merged into their union instead of one suppressing the other.
+ *        All the buffers are kept between runs, so a reused engine doesn't allocate.
+ */
+class TileMergeEngine
+{
+public:
+    static constexpr uint32_t NO_TILE = UINT32_MAX;
+
+    void clear()
+    {
+        m_tiles.clear();
+        m_xmin.clear();
+        m_ymin.clear();
+        m_xmax.clear();
+        m_ymax.clear();
+        m_area.clear();
+        m_score.clear();
+        m_class_id.clear();
+        m_tile.clear();
+    }
+
+    /**
+     * @brief Add a tile, in frame coordinates.
+     *
+     * @return uint32_t the id of the tile, for the boxes it detected.
+     */
+    uint32_t add_tile(const HailoBBox &bbox)
+    {
+        m_tiles.push_back(bbox);
+        return m_tiles.size() - 1;
+    }
+
+    /**
+     * @brief Add a box, in frame coordinates.
+     *
+     * @param tile  -  uint32_t
+     *        The tile that detected the box, NO_TILE compares it against every box.
+     */
+    void add(const HailoBBox &bbox, float score, int class_id, uint32_t tile = NO_TILE)
+    {
+        m_xmin.push_back(bbox.xmin());
+        m_ymin.push_back(bbox.ymin());
+        m_xmax.push_back(bbox.xmax());
+        m_ymax.push_back(bbox.ymax());
+        m_area.push_back((bbox.ymax() - bbox.ymin()) * (bbox.xmax() - bbox.xmin()));
+        m_score.push_back(score);
+        m_class_id.push_back(class_id);
+        m_tile.push_back(tile);
+    }
+
+    std::size_t size() const { return m_score.size(); }
+
+    /**
+     * @brief Box after the last run, the union of the boxes merged into it.
+     */
+    HailoBBox bbox(uint32_t index) const
+    {
+        return HailoBBox(m_xmin[index], m_ymin[index], m_xmax[index] - m_xmin[index], m_ymax[index] - m_ymin[index]);
+    }
+
+    /**
+     * @brief True if other boxes were merged into this box in the last run.
+     */
+    bool merged(uint32_t index) const { return m_merged[index]; }
+
+    /**
+     * @brief Run NMS and border merging over the added boxes.
+     *
+     * @param params  -  TileMergeParams
+     *        The merge configuration.
+     *
+     * @return const std::vector<uint32_t>& indices of the kept boxes, by descending score.
+     */
+    const std::vector<uint32_t> &run(const TileMergeParams &params)
+    {
+        const uint32_t count = size();
+        m_kept.clear();
+        m_state.assign(count, PENDING);
+        m_merged.assign(count, false);
+        m_stamp.assign(count, 0);
+        m_current_stamp = 0;
+        compute_cuts(params.cut_margin);
+        build_grid();
+
+        m_by_score.resize(count);
+        for (uint32_t i = 0; i < count; i++)
+            m_by_score[i] = i;
+        std::sort(m_by_score.begin(), m_by_score.end(),
+                  [&](uint32_t a, uint32_t b)
+                  { return m_score[a] > m_score[b] || (m_score[a] == m_score[b] && a < b); });
+
+        // With a non positive threshold even boxes that don't overlap are suppressed, so look at the whole grid.
+        const bool whole_grid = params.iou_threshold <= 0.0f;
+        for (uint32_t i : m_by_score)
+        {
+            if (m_state[i] != PENDING)
+                continue;
+            m_state[i] = KEPT;
+            m_kept.push_back(i);
+
+            // A merge grows box i, which may reach boxes in new cells, so look again until it stops growing.
+            bool grew = true;
+            while (grew)
+            {
+                grew = false;
+                m_current_stamp++;
+                int x0 = 0, y0 = 0, x1 = m_grid_size - 1, y1 = m_grid_size - 1;
+                if (!whole_grid)
+                    cell_range(i, x0, y0, x1, y1);
+                for (int cy = y0; cy <= y1; cy++)
+                {
+                    for (int cx = x0; cx <= x1; cx++)
+                    {
+                        const int cell = cy * m_grid_size + cx;
+                        for (uint32_t pos = m_cell_start[cell]; pos < m_cell_start[cell + 1]; pos++)
+                        {
+                            uint32_t j = m_cell_boxes[pos];
+                            if (m_stamp[j] == m_current_stamp)
+                                continue;
+                            m_stamp[j] = m_current_stamp;
+                            if (m_state[j] != PENDING || m_class_id[j] != m_class_id[i] ||
+                                (m_tile[i] != NO_TILE && m_tile[i] == m_tile[j]))
+                                continue;
+                            if (iou(i, j) >= params.iou_threshold)
+                            {
+                                m_state[j] = SUPPRESSED;
+                            }
+                            else if (params.border_merge && can_merge(i, j, params.merge_threshold))
+                            {
+                                merge(i, j);
+                                m_state[j] = SUPPRESSED;
+                                grew = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        return m_kept;
+    }
+
+private:
+    enum : uint8_t
+    {
+        PENDING,
+        KEPT,
+        SUPPRESSED
+    };
+
+    enum : uint8_t
+    {
+        CUT_LEFT = 1 << 0,
+        CUT_TOP = 1 << 1,
+        CUT_RIGHT = 1 << 2,
+        CUT_BOTTOM = 1 << 3,
+    };
+
+    static constexpr int MAX_GRID_SIZE = 64;
+    static constexpr float FRAME_EDGE_EPSILON = 1e-4;
+
+    std::vector<HailoBBox> m_tiles;
+
+    std::vector<float> m_xmin;
+    std::vector<float> m_ymin;
+    std::vector<float> m_xmax;
+    std::vector<float> m_ymax;
+    std::vector<float> m_area;
+    std::vector<float> m_score;
+    std::vector<int> m_class_id;
+    std::vector<uint32_t> m_tile;
+    std::vector<uint8_t> m_cut;
+
+    int m_grid_size = 1;
+    float m_cell_size = 1.0f;
+    std::vector<uint32_t> m_cell_start; // Start of each cell in m_cell_boxes, with one extra entry at the end.
+    std::vector<uint32_t> m_cell_boxes; // Box indices of each cell, a box is in every cell it covers.
+    std::vector<uint32_t> m_cell_fill;
+
+    std::vector<uint32_t> m_by_score;
+    std::vector<uint8_t> m_state;
+    std::vector<bool> m_merged;
+    std::vector<uint32_t> m_stamp; // Last search that visited each box, so a box in several cells is visited once.
+    uint32_t m_current_stamp = 0;
+    std::vector<uint32_t> m_kept;
+
+    float iou(uint32_t a, uint32_t b) const
+    {
+        // Same arithmetic as the IOU of the post-processes, so decisions match it exactly.
+        const float width_of_overlap_area = std::min(m_xmax[a], m_xmax[b]) - std::max(m_xmin[a], m_xmin[b]);
+        const float height_of_overlap_area = std::min(m_ymax[a], m_ymax[b]) - std::max(m_ymin[a], m_ymin[b]);
+        const float area_of_overlap = std::max(width_of_overlap_area, 0.0f) * std::max(height_of_overlap_area, 0.0f);
+        return area_of_overlap / (m_area[a] + m_area[b] - area_of_overlap);
+    }
+
+    void compute_cuts(float cut_margin)
+    {
+        m_cut.assign(size(), 0);
+        for (uint32_t i = 0; i < size(); i++)
+        {
+            if (m_tile[i] == NO_TILE)
+                continue;
+            // Borders on the edge of the frame don't cut anything.
+            const HailoBBox &tile = m_tiles[m_tile[i]];
+            const float margin_x = cut_margin * tile.width();
+            const float margin_y = cut_margin * tile.height();
+            if (tile.xmin() > FRAME_EDGE_EPSILON && m_xmin[i] - tile.xmin() <= margin_x)
+                m_cut[i] |= CUT_LEFT;
+            if (tile.ymin() > FRAME_EDGE_EPSILON && m_ymin[i] - tile.ymin() <= margin_y)
+                m_cut[i] |= CUT_TOP;
+            if (tile.xmax() < 1.0f - FRAME_EDGE_EPSILON && tile.xmax() - m_xmax[i] <= margin_x)
+                m_cut[i] |= CUT_RIGHT;
+            if (tile.ymax() < 1.0f - FRAME_EDGE_EPSILON && tile.ymax() - m_ymax[i] <= margin_y)
+                m_cut[i] |= CUT_BOTTOM;
+        }
+    }
+
+    /**
+     * @brief True if one box is cut by a tile border that the other box continues past,
+     *        and the two overlap along that border.
+     */
+    bool can_merge(uint32_t a, uint32_t b, float merge_threshold) const
+    {
+        const float x_overlap = std::min(m_xmax[a], m_xmax[b]) - std::max(m_xmin[a], m_xmin[b]);
+        const float y_overlap = std::min(m_ymax[a], m_ymax[b]) - std::max(m_ymin[a], m_ymin[b]);
+        if (x_overlap <= 0.0f || y_overlap <= 0.0f)
+            return false;
+
+        const bool cut_along_x = ((m_cut[a] & CUT_RIGHT) && m_xmax[b] > m_xmax[a]) ||
+                                 ((m_cut[a] & CUT_LEFT) && m_xmin[b] < m_xmin[a]) ||
+                                 ((m_cut[b] & CUT_RIGHT) && m_xmax[a] > m_xmax[b]) ||
+                                 ((m_cut[b] & CUT_LEFT) && m_xmin[a] < m_xmin[b]);
+        if (cut_along_x && y_overlap >= merge_threshold * std::min(m_ymax[a] - m_ymin[a], m_ymax[b] - m_ymin[b]))
+            return true;
+
+        const bool cut_along_y = ((m_cut[a] & CUT_BOTTOM) && m_ymax[b] > m_ymax[a]) ||
+                                 ((m_cut[a] & CUT_TOP) && m_ymin[b] < m_ymin[a]) ||
+                                 ((m_cut[b] & CUT_BOTTOM) && m_ymax[a] > m_ymax[b]) ||
+                                 ((m_cut[b] & CUT_TOP) && m_ymin[a] < m_ymin[b]);
+        return cut_along_y && x_overlap >= merge_threshold * std::min(m_xmax[a] - m_xmin[a], m_xmax[b] - m_xmin[b]);
+    }
+
+    void merge(uint32_t into, uint32_t from)
+    {
+        m_xmin[into] = std::min(m_xmin[into], m_xmin[from]);
+        m_ymin[into] = std::min(m_ymin[into], m_ymin[from]);
+        m_xmax[into] = std::max(m_xmax[into], m_xmax[from]);
+        m_ymax[into] = std::max(m_ymax[into], m_ymax[from]);
+        m_area[into] = (m_ymax[into] - m_ymin[into]) * (m_xmax[into] - m_xmin[into]);
+        // The merged box carries the edges of both parts, so it is cut only where both were.
+        m_cut[into] &= m_cut[from];
+        m_merged[into] = true;
+    }
+
+    int cell_of(float coordinate) const
+    {
+        return std::clamp((int)std::floor(coordinate / m_cell_size), 0, m_grid_size - 1);
+    }
+
+    void cell_range(uint32_t i, int &x0, int &y0, int &x1, int &y1) const
+    {
+        x0 = cell_of(m_xmin[i]);
+        y0 = cell_of(m_ymin[i]);
+        x1 = cell_of(m_xmax[i]);
+        y1 = cell_of(m_ymax[i]);
+    }
+
+    void build_grid()
+    {
+        const uint32_t count = size();
+        // Cells twice the average box keep most boxes in a few cells, and few boxes in each cell.
+        float extent = 0.0f;
+        for (uint32_t i = 0; i < count; i++)
+            extent += std::max(m_xmax[i] - m_xmin[i], m_ymax[i] - m_ymin[i]);
+        extent = (count > 0) ? 2.0f * extent / count : 1.0f;
+        m_grid_size = std::clamp((int)std::ceil(1.0f / std::max(extent, 1e-6f)), 1, MAX_GRID_SIZE);
+        m_cell_size = 1.0f / m_grid_size;
+
+        // Counting sort of the boxes into their cells.
+        const int cells = m_grid_size * m_grid_size;
+        m_cell_start.assign(cells + 1, 0);
+        int x0, y0, x1, y1;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            cell_range(i, x0, y0, x1, y1);
+            for (int cy = y0; cy <= y1; cy++)
+                for (int cx = x0; cx <= x1; cx++)
+                    m_cell_start[cy * m_grid_size + cx + 1]++;
+        }
+        for (int cell = 0; cell < cells; cell++)
+            m_cell_start[cell + 1] += m_cell_start[cell];
+        m_cell_boxes.resize(m_cell_start[cells]);
+        m_cell_fill.assign(m_cell_start.begin(), m_cell_start.end() - 1);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            cell_range(i, x0, y0, x1, y1);
+            for (int cy = y0; cy <= y1; cy++)
+                for (int cx = x0; cx <= x1; cx++)
+                    m_cell_boxes[m_cell_fill[cy * m_grid_size + cx]++] = i;
+        }
+    }
+};
@@ -10,6 +10,11 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <sstream>
+#include <thread>
 
 // Tappas includes
 // General includes
@@ -51,6 +56,8 @@ enum
     PROP_STD_WEIGHT_VELOCITY_BOX,
     PROP_DEBUG,
     PROP_HAILO_OBJECTS_BLACKLIST,
+    PROP_UPDATE_THREADS,
+    PROP_UPDATE_STATS,
 };
 
 //******************************************************************
@@ -64,6 +71,171 @@ enum
 #define VIDEO_SINK_CAPS \
     gst_caps_new_any()
 
+//******************************************************************
+// TRACKER UPDATES
+//******************************************************************
+/* Update the tracker of one stream with the detections of a frame, and put the tracked detections on the frame's roi. */
+static void update_tracker(GstHailoTracker *hailotracker, const std::string &tracker_name, const std::string &stream_id,
+                           HailoROIPtr hailo_roi, std::vector<HailoDetectionPtr> &detections)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::vector<HailoDetectionPtr> online_detection_ptrs = HailoTracker::GetInstance().update(tracker_name, detections);
+    guint64 elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    hailo_common::add_detection_pointers(hailo_roi, online_detection_ptrs);
+
+    std::lock_guard<std::mutex> lock(*hailotracker->stats_mutex);
+    HailoTrackerUpdateStats &stats = hailotracker->update_stats[stream_id];
+    stats.updates++;
+    stats.total_us += elapsed_us;
+    stats.max_us = std::max(stats.max_us, elapsed_us);
+}
+
+/* A frame waiting for (or done with) its tracker update. */
+struct TrackerJob
+{
+    GstBuffer *buffer;
+    HailoROIPtr hailo_roi;
+    std::string tracker_name;
+    std::string stream_id;
+    std::vector<HailoDetectionPtr> detections;
+    bool done = false;
+};
+using TrackerJobPtr = std::shared_ptr<TrackerJob>;
+
+/**
+ * HailoTrackerShards - Runs the tracker updates of different streams concurrently.
+ * Every stream is pinned to one worker thread (streams are spread over the workers in order of appearance),
+ * so the updates of a stream keep their order. Frames are pushed downstream by an output thread,
+ * in the order they entered the element.
+ */
+class HailoTrackerShards
+{
+private:
+    GstHailoTracker *m_element;
+    std::mutex m_mutex;
+    std::condition_variable m_work_cv;
+    std::condition_variable m_done_cv;
+    std::vector<std::deque<TrackerJobPtr>> m_worker_queues;
+    std::map<std::string, size_t> m_stream_workers;
+    std::deque<TrackerJobPtr> m_pending; // Frames in input order, not yet pushed
+    size_t m_max_pending;
+    bool m_pushing = false;              // The output thread is pushing a frame it already popped
+    bool m_stop = false;
+    GstFlowReturn m_flow_return = GST_FLOW_OK;
+    std::vector<std::thread> m_workers;
+    std::thread m_output_thread;
+
+    void worker_loop(size_t index)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_work_cv.wait(lock, [this, index]
+                           { return m_stop || !m_worker_queues[index].empty(); });
+            if (m_worker_queues[index].empty())
+                return;
+            TrackerJobPtr job = m_worker_queues[index].front();
+            m_worker_queues[index].pop_front();
+            lock.unlock();
+
+            update_tracker(m_element, job->tracker_name, job->stream_id, job->hailo_roi, job->detections);
+
+            lock.lock();
+            job->done = true;
+            m_done_cv.notify_all();
+        }
+    }
+
+    void output_loop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_done_cv.wait(lock, [this]
+                           { return (!m_pending.empty() && m_pending.front()->done) || (m_stop && m_pending.empty()); });
+            if (m_pending.empty())
+                return;
+            TrackerJobPtr job = m_pending.front();
+            m_pending.pop_front();
+            m_pushing = true;
+            lock.unlock();
+
+            GstFlowReturn ret = gst_pad_push(GST_BASE_TRANSFORM_SRC_PAD(m_element), job->buffer);
+
+            lock.lock();
+            m_pushing = false;
+            if (ret != GST_FLOW_OK)
+                m_flow_return = ret;
+            m_done_cv.notify_all();
+        }
+    }
+
+public:
+    HailoTrackerShards(GstHailoTracker *element, guint num_workers)
+        : m_element(element), m_worker_queues(num_workers), m_max_pending(2 * num_workers)
+    {
+        for (size_t i = 0; i < num_workers; i++)
+            m_workers.emplace_back(&HailoTrackerShards::worker_loop, this, i);
+        m_output_thread = std::thread(&HailoTrackerShards::output_loop, this);
+    }
+
+    ~HailoTrackerShards()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_work_cv.notify_all();
+        m_done_cv.notify_all();
+        for (std::thread &worker : m_workers)
+            worker.join();
+        m_output_thread.join();
+    }
+
+    /**
+     * @brief Queue the tracker update of a frame, blocks while too many frames are in flight.
+     *        The buffer reference is taken, the frame is pushed downstream once it was updated.
+     *
+     * @return GstFlowReturn the last failed downstream flow return, GST_FLOW_OK otherwise.
+     */
+    GstFlowReturn submit(GstBuffer *buffer, HailoROIPtr hailo_roi, std::string tracker_name, std::string stream_id,
+                         std::vector<HailoDetectionPtr> detections)
+    {
+        TrackerJobPtr job = std::make_shared<TrackerJob>();
+        job->buffer = buffer;
+        job->hailo_roi = hailo_roi;
+        job->tracker_name = std::move(tracker_name);
+        job->stream_id = std::move(stream_id);
+        job->detections = std::move(detections);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]
+                       { return m_pending.size() < m_max_pending; });
+        auto worker = m_stream_workers.find(job->stream_id);
+        if (worker == m_stream_workers.end())
+            worker = m_stream_workers.emplace(job->stream_id, m_stream_workers.size() % m_worker_queues.size()).first;
+        m_worker_queues[worker->second].push_back(job);
+        m_pending.push_back(job);
+        m_work_cv.notify_all();
+
+        GstFlowReturn ret = m_flow_return;
+        m_flow_return = GST_FLOW_OK;
+        return ret;
+    }
+
+    /**
+     * @brief Wait until every queued frame was updated and pushed downstream.
+     *        Called before serialized events, so they do not overtake buffers.
+     */
+    void drain()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done_cv.wait(lock, [this]
+                       { return m_pending.empty() && !m_pushing; });
+    }
+};
+
 //******************************************************************
 // CLASS INITIALIZATION
 //******************************************************************
@@ -189,6 +361,19 @@ gst_hailo_tracker_class_init(GstHailoTrackerClass *klass)
                                     g_param_spec_string("hailo-objects-blacklist", "Hailo objects blacklist",
                                                         "list of hailo objects types that the tracker should not keep, comma separated", "hailo_landmarks,hailo_depth_mask,hailo_class_mask",
                                                         (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_UPDATE_THREADS,
+                                    g_param_spec_uint("update-threads", "Update threads",
+                                                      "Number of worker threads that update the trackers of different streams concurrently. \n\
+                                    Every stream is handled by a single worker, so its frames keep their order. \n\
+                                    Useful when one tracker serves many muxed streams (see hailoroundrobin). \n\
+                                    0 (default) updates the trackers on the streaming thread.",
+                                                      0, 64, 0,
+                                                      (GParamFlags)(GST_PARAM_MUTABLE_READY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
+    g_object_class_install_property(gobject_class, PROP_UPDATE_STATS,
+                                    g_param_spec_string("update-stats", "Update stats",
+                                                        "Per stream latency of the tracker updates: number of updates, average and maximal update time in microseconds.",
+                                                        "",
+                                                        (GParamFlags)(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
     // Set virtual functions
     gobject_class->dispose = gst_hailo_tracker_dispose;
     base_transform_class->stop = GST_DEBUG_FUNCPTR(gst_hailo_tracker_stop);
@@ -214,6 +399,24 @@ gst_hailo_tracker_init(GstHailoTracker *hailotracker)
     hailotracker->tracker_params.std_weight_velocity_box = DEFAULT_STD_WEIGHT_VELOCITY_BOX;
     hailotracker->tracker_params.debug = DEFAULT_DEBUG;
     hailotracker->tracker_params.hailo_objects_blacklist = DEFAULT_HAILO_OBJECTS_BLACKLIST;
+    hailotracker->update_threads = 0;
+    hailotracker->shards = nullptr;
+    hailotracker->stats_mutex = std::make_unique<std::mutex>();
+    hailotracker->update_stats.clear();
+}
+
+static std::string get_update_stats(GstHailoTracker *hailotracker)
+{
+    std::ostringstream stats_stream;
+    std::lock_guard<std::mutex> lock(*hailotracker->stats_mutex);
+    for (auto &stream_stats : hailotracker->update_stats)
+    {
+        const HailoTrackerUpdateStats &stats = stream_stats.second;
+        stats_stream << stream_stats.first << ": updates=" << stats.updates
+                     << " avg_us=" << (stats.updates ? stats.total_us / stats.updates : 0)
+                     << " max_us=" << stats.max_us << "; ";
+    }
+    return stats_stream.str();
 }
 
 //******************************************************************
@@ -364,6 +567,9 @@ void gst_hailo_tracker_set_property(GObject *object, guint property_id,
         hailotracker->tracker_params.hailo_objects_blacklist = std::move(hailo_objects_blacklist_vec);
         break;
     }
+    case PROP_UPDATE_THREADS:
+        hailotracker->update_threads = g_value_get_uint(value);
+        break;
 
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
@@ -433,6 +639,12 @@ void gst_hailo_tracker_get_property(GObject *object, guint property_id,
         g_value_set_string(value, blacklist.c_str());
         break;
     }
+    case PROP_UPDATE_THREADS:
+        g_value_set_uint(value, hailotracker->update_threads);
+        break;
+    case PROP_UPDATE_STATS:
+        g_value_set_string(value, get_update_stats(hailotracker).c_str());
+        break;
     default:
         G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
         break;
@@ -461,6 +673,13 @@ static gboolean
 gst_hailo_tracker_stop(GstBaseTransform *trans)
 {
     GstHailoTracker *hailotracker = GST_HAILO_TRACKER(trans);
+    if (hailotracker->shards)
+    {
+        delete hailotracker->shards;
+        hailotracker->shards = nullptr;
+    }
+    GST_INFO_OBJECT(hailotracker, "tracker update stats: %s", get_update_stats(hailotracker).c_str());
+
     for (std::string stream_id : hailotracker->active_streams)
     {
         std::string tracker_name = get_tracker_name(hailotracker, stream_id);
@@ -503,11 +722,21 @@ gst_hailo_tracker_transform_frame_ip(GstVideoFilter *filter, GstVideoFrame *fram
     }
 
     // Swap the detections in the roi with just the online tracked detections
+    if (hailotracker->update_threads > 0)
+    {
+        // Update on a worker, the frame is pushed downstream by the shards once it is done
+        if (!hailotracker->shards)
+            hailotracker->shards = new HailoTrackerShards(hailotracker, hailotracker->update_threads);
+        GstFlowReturn ret = hailotracker->shards->submit(gst_buffer_ref(buffer), hailo_roi,
+                                                         get_tracker_name(hailotracker, std::string(stream_id)),
+                                                         std::string(stream_id), std::move(detections));
+        GST_DEBUG_OBJECT(hailotracker, "transform_frame_ip");
+        return (ret == GST_FLOW_OK) ? GST_BASE_TRANSFORM_FLOW_DROPPED : ret;
+    }
+
     GST_OBJECT_LOCK(hailotracker);
     std::string tracker_name = get_tracker_name(hailotracker, std::string(stream_id));
-    std::vector<HailoDetectionPtr> online_detection_ptrs = HailoTracker::GetInstance().update(tracker_name, detections);
-
-    hailo_common::add_detection_pointers(hailo_roi, online_detection_ptrs);
+    update_tracker(hailotracker, tracker_name, std::string(stream_id), hailo_roi, detections);
     GST_OBJECT_UNLOCK(hailotracker);
 
     GST_DEBUG_OBJECT(hailotracker, "transform_frame_ip");
@@ -523,6 +752,10 @@ gst_hailo_tracker_sink_event(GstBaseTransform *trans,
                              GstEvent *event)
 {
     GstHailoTracker *hailotracker = GST_HAILO_TRACKER(trans);
+    // Frames still being updated must be pushed before any serialized event
+    if (hailotracker->shards && GST_EVENT_IS_SERIALIZED(event))
+        hailotracker->shards->drain();
+
     switch (GST_EVENT_TYPE(event))
     {
     case GST_EVENT_STREAM_START:
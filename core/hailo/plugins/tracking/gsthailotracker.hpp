@@ -25,6 +25,9 @@
 
 #include <gst/video/video.h>
 #include <gst/video/gstvideofilter.h>
+#include <map>
+#include <memory>
+#include <mutex>
 #include "hailo_tracker.hpp"
 
 G_BEGIN_DECLS
@@ -38,6 +41,17 @@ G_BEGIN_DECLS
 typedef struct _GstHailoTracker GstHailoTracker;
 typedef struct _GstHailoTrackerClass GstHailoTrackerClass;
 
+// Latency of the tracker updates of one stream
+struct HailoTrackerUpdateStats
+{
+    guint64 updates = 0;
+    guint64 total_us = 0;
+    guint64 max_us = 0;
+};
+
+// Runs the tracker updates of different streams on worker threads, see gsthailotracker.cpp
+class HailoTrackerShards;
+
 struct _GstHailoTracker
 {
     GstVideoFilter base_hailotracker;
@@ -46,6 +60,10 @@ struct _GstHailoTracker
     gint class_id;
     HailoTrackerParams tracker_params;
     std::vector<std::string> active_streams;
+    guint update_threads;
+    HailoTrackerShards *shards;
+    std::unique_ptr<std::mutex> stats_mutex;
+    std::map<std::string, HailoTrackerUpdateStats> update_stats;
 };
 
 struct _GstHailoTrackerClass
@@ -41,6 +41,8 @@ struct _GstBufferTracer
 G_DEFINE_TYPE_WITH_CODE (GstBufferTracer, gst_buffer_tracer,
     GST_SHARK_TYPE_TRACER, _do_init);
 
+#define PAD_NAME_SIZE  (128)
+
 static void gst_buffer_buffer_pre (GObject * self, GstClockTime ts,
     GstPad * pad, GstBuffer * buffer);
 static void gst_buffer_buffer_list_pre (GObject * self, GstClockTime ts,
@@ -72,7 +74,7 @@ static void
 gst_buffer_buffer_pre (GObject * self, GstClockTime ts, GstPad * pad,
     GstBuffer * buffer)
 {
-  gchar *pad_name;
+  gchar pad_name[PAD_NAME_SIZE];
   GstClockTime pts;
   gchar *spts;
   GstClockTime dts;
@@ -87,19 +89,14 @@ gst_buffer_buffer_pre (GObject * self, GstClockTime ts, GstPad * pad,
   gchar *sflags;
   guint refcount;
 
-  pad_name = g_strdup_printf ("%s:%s", GST_DEBUG_PAD_NAME (pad));
-
     if (NULL == buffer) {
         return;
     }
-  pts = GST_BUFFER_PTS (buffer);
-  spts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
+  gst_shark_tracer_pad_name (pad, ':', pad_name, PAD_NAME_SIZE);
 
+  pts = GST_BUFFER_PTS (buffer);
   dts = GST_BUFFER_DTS (buffer);
-  sdts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (dts));
-
   duration = GST_BUFFER_DURATION (buffer);
-  sduration = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
 
   offset = GST_BUFFER_OFFSET (buffer);
   offset_end = GST_BUFFER_OFFSET_END (buffer);
@@ -107,24 +104,31 @@ gst_buffer_buffer_pre (GObject * self, GstClockTime ts, GstPad * pad,
   size = gst_buffer_get_size (buffer);
 
   flags = (GstBufferFlags)GST_BUFFER_FLAGS (buffer);
-  g_value_init (&vflags, GST_TYPE_BUFFER_FLAGS);
-  g_value_set_flags (&vflags, flags);
-  sflags = gst_value_serialize (&vflags);
 
   refcount = GST_MINI_OBJECT_REFCOUNT_VALUE (buffer);
 
-  gst_tracer_record_log (tr_buffer, pad_name, spts, sdts, sduration, offset,
-      offset_end, size, sflags, refcount);
+  if (gst_shark_tracer_log_enabled ()) {
+    spts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (pts));
+    sdts = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (dts));
+    sduration =
+        g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (duration));
+
+    g_value_init (&vflags, GST_TYPE_BUFFER_FLAGS);
+    g_value_set_flags (&vflags, flags);
+    sflags = gst_value_serialize (&vflags);
+
+    gst_tracer_record_log (tr_buffer, pad_name, spts, sdts, sduration, offset,
+        offset_end, size, sflags, refcount);
+
+    g_value_unset (&vflags);
+    g_free (spts);
+    g_free (sdts);
+    g_free (sduration);
+    g_free (sflags);
+  }
 
   do_print_buffer_event (BUFFER_EVENT_ID, pad_name, pts, dts, duration,
       offset, offset_end, size, flags, refcount);
-
-  g_value_unset (&vflags);
-  g_free (spts);
-  g_free (sdts);
-  g_free (sduration);
-  g_free (sflags);
-  g_free (pad_name);
 }
 
 static void
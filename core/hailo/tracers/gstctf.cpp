@@ -28,7 +28,13 @@
 #include <glib/gstdio.h>
 #include <glib/gprintf.h>
 #include <gio/gio.h>
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 
 #include "gstctf.hpp"
@@ -114,23 +120,88 @@ typedef guint32 ctf_header_timestamp;
   } G_STMT_END
 
 /* *INDENT-OFF* */
-#define CTF_EVENT_WRITE_HEADER(id,mem) \
-  G_STMT_START {                       \
-    /* Write event ID */               \
-    CTF_EVENT_WRITE_INT16(id,mem);     \
-    /* Write timestamp */              \
-    CTF_EVENT_WRITE_INT32(             \
-      GST_CLOCK_DIFF (                 \
-          ctf_descriptor->start_time,  \
-          gst_util_get_timestamp ()    \
-      )/1000,                          \
-    mem);                              \
+#define CTF_EVENT_WRITE_HEADER(id,timestamp,mem) \
+  G_STMT_START {                                 \
+    /* Write event ID */                         \
+    CTF_EVENT_WRITE_INT16(id,mem);               \
+    /* Write timestamp */                        \
+    CTF_EVENT_WRITE_INT32(                       \
+      GST_CLOCK_DIFF (                           \
+          ctf_descriptor->start_time,            \
+          timestamp                              \
+      )/1000,                                    \
+    mem);                                        \
   } G_STMT_END
 /* *INDENT-ON* */
 
+/* Events are not written by the streaming threads. Every tracing thread owns
+   a ring of fixed-size binary records that only it writes and only the
+   flusher thread reads, so posting an event takes no lock and does no I/O.
+   The flusher wakes up periodically, merges the rings by timestamp and
+   serializes the records to the datastream as CTF events. */
+#define CTF_RING_RECORDS        (1024)  /* Power of two */
+#define CTF_RING_MASK           (CTF_RING_RECORDS - 1)
+#define CTF_RECORD_SIZE         (256)
+#define CTF_RECORD_HEADER_SIZE  (16)
+#define CTF_RECORD_PAYLOAD_SIZE (CTF_RECORD_SIZE - CTF_RECORD_HEADER_SIZE)
+#define CTF_FLUSH_PERIOD        (10 * G_TIME_SPAN_MILLISECOND)
+/* Records are held back this long so that the ones of slower threads can be
+   merged in timestamp order */
+#define CTF_REORDER_WINDOW      (50 * GST_MSECOND)
+/* The datastream is mapped in windows of this size */
+#define CTF_MAP_WINDOW          (4 * 1024 * 1024)
+
+typedef struct
+{
+  guint16 id;
+  guint16 padding;
+  guint32 size;
+} CtfRecordInfo;
+
+typedef struct
+{
+  GstClockTime timestamp;
+  CtfRecordInfo info;
+  /* Event payload, in its CTF layout. Events larger than this are allocated
+     on the heap with the payload they need. */
+  guint8 payload[CTF_RECORD_PAYLOAD_SIZE];
+} CtfRecord;
+
+G_STATIC_ASSERT (sizeof (CtfRecord) == CTF_RECORD_SIZE);
+G_STATIC_ASSERT (G_STRUCT_OFFSET (CtfRecord, payload) ==
+    G_STRUCT_OFFSET (CtfRecord, info) + sizeof (CtfRecordInfo));
+
+/* A ring index is only written by one side, which publishes the records
+   before it with a release store. Unlike g_atomic_int_set() this costs
+   nothing more than a plain store on x86. */
+#define CTF_RING_LOAD(index) __atomic_load_n (&(index), __ATOMIC_ACQUIRE)
+#define CTF_RING_STORE(index,value) \
+  __atomic_store_n (&(index), (value), __ATOMIC_RELEASE)
+
+typedef struct
+{
+  CtfRecord records[CTF_RING_RECORDS];
+  /* Written by the producer thread only */
+  guint head;
+  /* Written by the flusher thread only */
+  guint tail;
+  /* Set once the producer thread exited */
+  gint orphaned;
+} CtfRing;
+
+/* A record waiting in the flusher to be merged, its info and payload are at
+   offset in the flusher staging memory. Events with the same timestamp keep
+   the order they were collected in, which is the order of their offsets. */
+typedef struct
+{
+  GstClockTime timestamp;
+  gsize offset;
+} CtfPendingEvent;
+
 static void file_parser_handler (gchar * line);
 static void tcp_parser_handler (gchar * line);
 static inline gboolean event_exceeds_mem_size (gsize size);
+static void ctf_ring_release (gpointer data);
 
 typedef enum
 {
@@ -150,7 +221,11 @@ struct _GstCtfDescriptor
    */
   /* File variables */
   FILE *metadata;
-  FILE *datastream;
+  gint datastream;
+  guint8 *datastream_map;
+  gsize datastream_map_offset;
+  gsize datastream_map_size;
+  gsize datastream_size;
   gchar *dir_name;
   gchar *env_dir_name;
   gboolean file_output_disable;
@@ -164,10 +239,34 @@ struct _GstCtfDescriptor
   GSocketConnection *socket_connection;
   GOutputStream *output_stream;
   gboolean tcp_output_disable;
+
+  /* Flusher variables */
+  GThread *flush_thread;
+  GMutex flush_mutex;
+  GCond flush_cond;
+  GCond drain_cond;
+  gboolean flush_running;
+  /* Events that don't fit in a ring record */
+  GAsyncQueue *overflow;
+  GArray *pending;
+  /* Start of every run of ordered events in pending: the events held back by
+     the last flush, then the records of every ring collection */
+  GArray *runs;
+  GByteArray *staging;
+  GstClockTime last_timestamp;
+  /* Serialization memory of the flusher */
+  guint8 flush_mem[CTF_MEM_SIZE];
+  gsize flush_mem_size;
 };
 
 static GstCtfDescriptor *ctf_descriptor = NULL;
 
+/* The rings of the tracing threads. A ring is freed by the flusher once its
+   thread exited and it was drained, or by its thread if there is no flusher */
+static GMutex ctf_rings_mutex;
+static GList *ctf_rings = NULL;
+static GPrivate ctf_ring_key = G_PRIVATE_INIT (ctf_ring_release);
+
 static const parser_handler_desc parser_handler_desc_list[] = {
   {"file://", file_parser_handler},
   {"tcp://", tcp_parser_handler},
@@ -285,7 +384,11 @@ ctf_create_struct (void)
   ctf->file_output_disable = FALSE;
 
   ctf->metadata = NULL;
-  ctf->datastream = NULL;
+  ctf->datastream = -1;
+  ctf->datastream_map = NULL;
+  ctf->datastream_map_offset = 0;
+  ctf->datastream_map_size = 0;
+  ctf->datastream_size = 0;
 
   /* TCP connection variables */
   ctf->host_name = NULL;
@@ -298,12 +401,99 @@ ctf_create_struct (void)
   /* Default TCP connection state Enable */
   ctf->tcp_output_disable = FALSE;
 
+  /* Flusher variables */
+  ctf->flush_thread = NULL;
+  g_mutex_init (&ctf->flush_mutex);
+  g_cond_init (&ctf->flush_cond);
+  g_cond_init (&ctf->drain_cond);
+  ctf->flush_running = FALSE;
+  ctf->overflow = g_async_queue_new ();
+  ctf->pending = g_array_new (FALSE, FALSE, sizeof (CtfPendingEvent));
+  ctf->runs = g_array_new (FALSE, FALSE, sizeof (guint));
+  ctf->staging = g_byte_array_new ();
+  ctf->last_timestamp = 0;
+  ctf->flush_mem_size = 0;
+
   /* Currently a constant UUID value is used */
   memcpy (ctf->uuid, UUID, CTF_UUID_SIZE);
 
   return ctf;
 }
 
+static void
+ctf_datastream_write (const guint8 * data, gsize size)
+{
+  GstCtfDescriptor *ctf = ctf_descriptor;
+  guint8 *map;
+  gsize page_size;
+  gsize end;
+
+  end = ctf->datastream_size + size;
+
+  /* The file always ends at the last event written, so the trace stays
+     readable even if the process does not exit cleanly */
+  if (0 != ftruncate (ctf->datastream, end)) {
+    GST_ERROR ("Could not grow the datastream file");
+    return;
+  }
+
+  if (end > ctf->datastream_map_offset + ctf->datastream_map_size) {
+    if (NULL != ctf->datastream_map) {
+      munmap (ctf->datastream_map, ctf->datastream_map_size);
+      ctf->datastream_map = NULL;
+      ctf->datastream_map_size = 0;
+    }
+
+    page_size = sysconf (_SC_PAGESIZE);
+    ctf->datastream_map_offset =
+        ctf->datastream_size - ctf->datastream_size % page_size;
+    ctf->datastream_map_size =
+        ((end - ctf->datastream_map_offset + CTF_MAP_WINDOW -
+            1) / CTF_MAP_WINDOW) * CTF_MAP_WINDOW;
+
+    map = (guint8 *) mmap (NULL, ctf->datastream_map_size,
+        PROT_READ | PROT_WRITE, MAP_SHARED, ctf->datastream,
+        ctf->datastream_map_offset);
+    if (MAP_FAILED == map) {
+      GST_ERROR ("Could not map the datastream file");
+      ctf->datastream_map_size = 0;
+      if (0 != ftruncate (ctf->datastream, ctf->datastream_size)) {
+        GST_ERROR ("Could not restore the datastream file size");
+      }
+      return;
+    }
+    ctf->datastream_map = map;
+  }
+
+  memcpy (ctf->datastream_map + (ctf->datastream_size -
+          ctf->datastream_map_offset), data, size);
+  ctf->datastream_size = end;
+}
+
+/* mem holds room for the TCP header followed by event_size bytes of
+   datastream */
+static void
+ctf_write_datastream (guint8 * mem, gsize event_size)
+{
+  guint8 *header_mem;
+
+  if (FALSE == ctf_descriptor->file_output_disable) {
+    ctf_datastream_write (mem + TCP_HEADER_SIZE, event_size);
+  }
+
+  if (FALSE == ctf_descriptor->tcp_output_disable) {
+    /* Write the TCP header */
+    header_mem = mem;
+    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, header_mem);
+
+    /* The output stream is shared with the metadata writers */
+    g_mutex_lock (&ctf_descriptor->mutex);
+    g_output_stream_write (ctf_descriptor->output_stream,
+        mem, event_size + TCP_HEADER_SIZE, NULL, NULL);
+    g_mutex_unlock (&ctf_descriptor->mutex);
+  }
+}
+
 static void
 generate_datastream_header (void)
 {
@@ -312,19 +502,16 @@ generate_datastream_header (void)
   guint32 magic = 0xC1FC1FC1;
   guint32 padding;
   gint32 stream_id;
-  guint8 *mem;
+  guint8 mem[TCP_HEADER_SIZE + CTF_UUID_SIZE + 4 + 4 + 8 + 8 + 4];
   guint event_size;
   guint8 *event_mem;
-  GError *error;
 
   stream_id = 0;
 
   event_size = CTF_UUID_SIZE + 4 + 8 + 8 + 4 + 4;
   /* Create Stream */
-  mem = ctf_descriptor->mem;
   event_mem = mem + TCP_HEADER_SIZE;
 
-  g_mutex_lock (&ctf_descriptor->mutex);
   /* The begin of the data stream header is compound by the Magic Number,
      the trace UUID and the Stream ID. These are all required fields. */
   /* Magic Number */
@@ -344,20 +531,364 @@ generate_datastream_header (void)
   padding = 0x0000FFFF;
   CTF_EVENT_WRITE_INT32 (padding, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
+  ctf_write_datastream (mem, event_size);
+}
+
+static CtfRing *
+ctf_get_thread_ring (void)
+{
+  CtfRing *ring;
+
+  ring = (CtfRing *) g_private_get (&ctf_ring_key);
+  if (G_UNLIKELY (NULL == ring)) {
+    ring = g_new0 (CtfRing, 1);
+
+    g_mutex_lock (&ctf_rings_mutex);
+    ctf_rings = g_list_prepend (ctf_rings, ring);
+    g_mutex_unlock (&ctf_rings_mutex);
+
+    g_private_set (&ctf_ring_key, ring);
   }
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+  return ring;
+}
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+static void
+ctf_ring_release (gpointer data)
+{
+  CtfRing *ring = (CtfRing *) data;
+
+  g_mutex_lock (&ctf_rings_mutex);
+  if (NULL != ctf_descriptor) {
+    /* The flusher frees it once its last records are written */
+    g_atomic_int_set (&ring->orphaned, TRUE);
+  } else {
+    ctf_rings = g_list_remove (ctf_rings, ring);
+    g_free (ring);
   }
+  g_mutex_unlock (&ctf_rings_mutex);
+}
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+/* The ring is full, wake the flusher up and wait for it to drain the ring.
+   Events are never dropped, a thread tracing faster than the flusher writes
+   is held back instead. */
+static gboolean
+ctf_ring_wait (GstCtfDescriptor * ctf, CtfRing * ring)
+{
+  gboolean running;
+
+  g_mutex_lock (&ctf->flush_mutex);
+  g_cond_signal (&ctf->flush_cond);
+  while ((running = ctf->flush_running)
+      && ring->head - CTF_RING_LOAD (ring->tail) ==
+      CTF_RING_RECORDS) {
+    g_cond_wait (&ctf->drain_cond, &ctf->flush_mutex);
+  }
+  g_mutex_unlock (&ctf->flush_mutex);
+
+  return running;
+}
+
+/* Reserve the record of an event with a payload of size bytes. The record is
+   taken from the ring of the calling thread, or allocated if the payload
+   doesn't fit in a record, in which case ring is set to NULL. */
+static CtfRecord *
+ctf_record_reserve (CtfRing ** ring, event_id id, gsize size)
+{
+  CtfRing *thread_ring;
+  CtfRecord *record;
+  guint head;
+
+  *ring = NULL;
+  record = NULL;
+
+  if (G_UNLIKELY (NULL == ctf_descriptor
+          || !g_atomic_int_get (&ctf_descriptor->flush_running))) {
+    return NULL;
+  }
+
+  if (event_exceeds_mem_size (size + CTF_HEADER_SIZE)) {
+    return NULL;
+  }
+
+  if (G_LIKELY (size <= CTF_RECORD_PAYLOAD_SIZE)) {
+    thread_ring = ctf_get_thread_ring ();
+    head = thread_ring->head;
+    if (G_UNLIKELY (head - CTF_RING_LOAD (thread_ring->tail) ==
+            CTF_RING_RECORDS)
+        && !ctf_ring_wait (ctf_descriptor, thread_ring)) {
+      return NULL;
+    }
+    record = &thread_ring->records[head & CTF_RING_MASK];
+    *ring = thread_ring;
+  } else {
+    record = (CtfRecord *) g_malloc (CTF_RECORD_HEADER_SIZE + size);
+  }
+
+  record->timestamp = gst_util_get_timestamp ();
+  record->info.id = id;
+  record->info.size = size;
+
+  return record;
+}
+
+static void
+ctf_record_commit (CtfRing * ring, CtfRecord * record)
+{
+  if (G_LIKELY (NULL != ring)) {
+    /* Publish the record to the flusher */
+    CTF_RING_STORE (ring->head, ring->head + 1);
+  } else {
+    g_async_queue_push (ctf_descriptor->overflow, record);
+  }
+}
+
+static void
+ctf_flush_append (GstCtfDescriptor * ctf, const CtfRecord * record)
+{
+  CtfPendingEvent event;
+
+  event.timestamp = record->timestamp;
+  event.offset = ctf->staging->len;
+
+  g_byte_array_append (ctf->staging, (const guint8 *) &record->info,
+      sizeof (CtfRecordInfo) + record->info.size);
+  g_array_append_val (ctf->pending, event);
+}
+
+static void
+ctf_flush_start_run (GstCtfDescriptor * ctf)
+{
+  g_array_append_val (ctf->runs, ctf->pending->len);
+}
+
+static void
+ctf_flush_collect (GstCtfDescriptor * ctf)
+{
+  CtfRecord *record;
+  CtfRing *ring;
+  GList *node;
+  GList *next;
+  gboolean orphaned;
+  guint head;
+  guint tail;
+
+  /* The overflow goes first, so the ring records committed before an
+     overflow event are all read in the same flush */
+  while (NULL != (record = (CtfRecord *) g_async_queue_try_pop (ctf->overflow))) {
+    ctf_flush_start_run (ctf);
+    ctf_flush_append (ctf, record);
+    g_free (record);
+  }
+
+  g_mutex_lock (&ctf_rings_mutex);
+  for (node = ctf_rings; NULL != node; node = next) {
+    next = g_list_next (node);
+    ring = (CtfRing *) node->data;
+
+    /* Once a ring is seen orphaned, its head is final */
+    orphaned = g_atomic_int_get (&ring->orphaned);
+    head = CTF_RING_LOAD (ring->head);
+    if (ring->tail != head) {
+      ctf_flush_start_run (ctf);
+    }
+    for (tail = ring->tail; tail != head; ++tail) {
+      ctf_flush_append (ctf, &ring->records[tail & CTF_RING_MASK]);
+    }
+    /* Give the records back to the producer */
+    CTF_RING_STORE (ring->tail, head);
+
+    if (orphaned) {
+      ctf_rings = g_list_delete_link (ctf_rings, node);
+      g_free (ring);
+    }
+  }
+  g_mutex_unlock (&ctf_rings_mutex);
+}
+
+static inline bool
+ctf_pending_event_before (const CtfPendingEvent & a, const CtfPendingEvent & b)
+{
+  if (a.timestamp != b.timestamp) {
+    return a.timestamp < b.timestamp;
+  }
+
+  return a.offset < b.offset;
+}
+
+static void
+ctf_flush_write (GstCtfDescriptor * ctf)
+{
+  if (0 != ctf->flush_mem_size) {
+    ctf_write_datastream (ctf->flush_mem, ctf->flush_mem_size);
+    ctf->flush_mem_size = 0;
+  }
+}
+
+/* Write the collected events to the datastream in timestamp order. Unless
+   final, the events of the last CTF_REORDER_WINDOW are held back. */
+static void
+ctf_flush (GstCtfDescriptor * ctf, gboolean final)
+{
+  CtfPendingEvent *event;
+  CtfRecordInfo info;
+  GByteArray *staging;
+  GstClockTime timestamp;
+  GstClockTime now;
+  guint8 *event_mem;
+  guint emitted;
+  guint idx;
+
+  if (0 == ctf->pending->len) {
+    return;
+  }
+
+  /* Every ring is collected in order, merge the runs two by two */
+  event = &g_array_index (ctf->pending, CtfPendingEvent, 0);
+  while (ctf->runs->len > 1) {
+    for (idx = 0; idx + 1 < ctf->runs->len; idx += 2) {
+      std::inplace_merge (event + g_array_index (ctf->runs, guint, idx),
+          event + g_array_index (ctf->runs, guint, idx + 1),
+          event + (idx + 2 < ctf->runs->len ?
+              g_array_index (ctf->runs, guint, idx + 2) : ctf->pending->len),
+          ctf_pending_event_before);
+    }
+    for (idx = 0; idx < ctf->runs->len; idx += 2) {
+      g_array_index (ctf->runs, guint, idx / 2) =
+          g_array_index (ctf->runs, guint, idx);
+    }
+    g_array_set_size (ctf->runs, (ctf->runs->len + 1) / 2);
+  }
+
+  now = gst_util_get_timestamp ();
+  for (emitted = 0; emitted < ctf->pending->len; ++emitted) {
+    event = &g_array_index (ctf->pending, CtfPendingEvent, emitted);
+    if (!final && event->timestamp + CTF_REORDER_WINDOW > now) {
+      break;
+    }
+
+    /* Event timestamps can't go back in the datastream, an event later than
+       the window is written at the time of the last one */
+    timestamp = MAX (event->timestamp, ctf->last_timestamp);
+    ctf->last_timestamp = timestamp;
+
+    memcpy (&info, ctf->staging->data + event->offset, sizeof (info));
+    if (CTF_HEADER_SIZE + info.size >
+        CTF_AVAILABLE_MEM_SIZE - ctf->flush_mem_size) {
+      ctf_flush_write (ctf);
+    }
+
+    event_mem = ctf->flush_mem + TCP_HEADER_SIZE + ctf->flush_mem_size;
+    /* Add CTF header */
+    CTF_EVENT_WRITE_HEADER (info.id, timestamp, event_mem);
+    /* Add event payload */
+    memcpy (event_mem, ctf->staging->data + event->offset + sizeof (info),
+        info.size);
+    ctf->flush_mem_size += CTF_HEADER_SIZE + info.size;
+  }
+  ctf_flush_write (ctf);
+
+  /* Keep the held back events for the next flush */
+  staging = g_byte_array_new ();
+  for (idx = emitted; idx < ctf->pending->len; ++idx) {
+    event = &g_array_index (ctf->pending, CtfPendingEvent, idx);
+    memcpy (&info, ctf->staging->data + event->offset, sizeof (info));
+    g_byte_array_append (staging, ctf->staging->data + event->offset,
+        sizeof (info) + info.size);
+    event->offset = staging->len - sizeof (info) - info.size;
+  }
+  g_array_remove_range (ctf->pending, 0, emitted);
+  g_array_set_size (ctf->runs, 0);
+  if (0 != ctf->pending->len) {
+    ctf_flush_start_run (ctf);
+  }
+  g_byte_array_unref (ctf->staging);
+  ctf->staging = staging;
+}
+
+static gpointer
+ctf_flush_thread_func (gpointer data)
+{
+  GstCtfDescriptor *ctf = (GstCtfDescriptor *) data;
+  gint64 end_time;
+
+  end_time = g_get_monotonic_time () + CTF_FLUSH_PERIOD;
+
+  g_mutex_lock (&ctf->flush_mutex);
+  while (ctf->flush_running) {
+    /* Woken up before the period only to free the rings that got full */
+    g_cond_wait_until (&ctf->flush_cond, &ctf->flush_mutex, end_time);
+    g_mutex_unlock (&ctf->flush_mutex);
+
+    ctf_flush_collect (ctf);
+    if (g_get_monotonic_time () >= end_time) {
+      ctf_flush (ctf, FALSE);
+      end_time = g_get_monotonic_time () + CTF_FLUSH_PERIOD;
+    }
+
+    g_mutex_lock (&ctf->flush_mutex);
+    g_cond_broadcast (&ctf->drain_cond);
+  }
+  g_mutex_unlock (&ctf->flush_mutex);
+
+  /* Write whatever is left */
+  ctf_flush_collect (ctf);
+  ctf_flush (ctf, TRUE);
+
+  return NULL;
+}
+
+static void
+ctf_flush_stop (void)
+{
+  GstCtfDescriptor *ctf = ctf_descriptor;
+
+  if (NULL == ctf || NULL == ctf->flush_thread) {
+    return;
+  }
+
+  g_mutex_lock (&ctf->flush_mutex);
+  g_atomic_int_set (&ctf->flush_running, FALSE);
+  g_cond_signal (&ctf->flush_cond);
+  g_cond_broadcast (&ctf->drain_cond);
+  g_mutex_unlock (&ctf->flush_mutex);
+
+  g_thread_join (ctf->flush_thread);
+  ctf->flush_thread = NULL;
+
+  if (NULL != ctf->metadata) {
+    fflush (ctf->metadata);
+  }
+}
+
+static void
+ctf_flush_start (void)
+{
+  static gboolean stop_at_exit = FALSE;
+  GError *error = NULL;
+
+  if (ctf_descriptor->file_output_disable
+      && ctf_descriptor->tcp_output_disable) {
+    return;
+  }
+
+  ctf_descriptor->flush_running = TRUE;
+  ctf_descriptor->flush_thread =
+      g_thread_try_new ("gstshark-ctf", ctf_flush_thread_func, ctf_descriptor,
+      &error);
+  if (NULL == ctf_descriptor->flush_thread) {
+    GST_ERROR ("Could not create the CTF flusher thread: %s", error->message);
+    g_clear_error (&error);
+    ctf_descriptor->flush_running = FALSE;
+    return;
+  }
+
+  /* The pipeline may never close the CTF output, the last events are
+     written when the process exits */
+  if (!stop_at_exit) {
+    atexit (ctf_flush_stop);
+    stop_at_exit = TRUE;
+  }
 }
 
 static void
@@ -624,8 +1155,9 @@ ctf_file_init (void)
           g_strjoin (G_DIR_SEPARATOR_S, ctf_descriptor->dir_name, "metadata",
           NULL);
 
-      ctf_descriptor->datastream = g_fopen (datastream_file, "w");
-      if (ctf_descriptor->datastream == NULL) {
+      ctf_descriptor->datastream =
+          g_open (datastream_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (ctf_descriptor->datastream == -1) {
         GST_ERROR ("Could not open datastream file, path does not exist.");
         goto error;
       }
@@ -636,15 +1168,13 @@ ctf_file_init (void)
         goto error;
       }
 
+      /* The datastream is mapped, only the metadata goes through stdio */
       if (ctf_descriptor->change_file_buf_size) {
         if (ctf_descriptor->file_buf_size == 0) {
           setvbuf (ctf_descriptor->metadata, NULL, _IONBF, 0);
-          setvbuf (ctf_descriptor->datastream, NULL, _IONBF, 0);
         } else {
           setvbuf (ctf_descriptor->metadata, NULL, _IOFBF,
               ctf_descriptor->file_buf_size);
-          setvbuf (ctf_descriptor->datastream, NULL, _IOFBF,
-              ctf_descriptor->file_buf_size);
         }
       }
 
@@ -664,6 +1194,10 @@ ctf_file_init (void)
   return;
 
 error:
+  if (ctf_descriptor->datastream != -1) {
+    close (ctf_descriptor->datastream);
+    ctf_descriptor->datastream = -1;
+  }
   ctf_descriptor->file_output_disable = TRUE;
   g_free (datastream_file);
   g_free (metadata_file);
@@ -729,6 +1263,7 @@ gst_ctf_init (void)
 
   generate_metadata (1, 3, BYTE_ORDER_LE);
   generate_datastream_header ();
+  ctf_flush_start ();
   do_print_ctf_init (INIT_EVENT_ID);
 
 
@@ -774,156 +1309,134 @@ add_metadata_event_struct (const gchar * metadata_event)
 void
 do_print_cpuusage_event (event_id id, guint32 cpu_num, gfloat * cpuload)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
   guint cpu_idx;
 
-  event_size = cpu_num * sizeof (gfloat) + CTF_HEADER_SIZE;
+  event_size = cpu_num * sizeof (gfloat);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem, datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
+  event_mem = record->payload;
   /* Write CPU load for each CPU */
   for (cpu_idx = 0; cpu_idx < cpu_num; ++cpu_idx) {
     /* Write CPU load */
     CTF_EVENT_WRITE_FLOAT (cpuload[cpu_idx], event_mem);
   }
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_proctime_event (event_id id, gchar * elementname, guint64 time)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
-  event_size = strlen (elementname) + 1 + sizeof (time) + CTF_HEADER_SIZE;
+  event_size = strlen (elementname) + 1 + sizeof (time);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
+  event_mem = record->payload;
   /* Write element name */
   CTF_EVENT_WRITE_STRING (elementname, event_mem);
   /* Write time */
   CTF_EVENT_WRITE_INT64 (time, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem -= event_size;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
+  ctf_record_commit (ring, record);
+}
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+/* Write the count, percentiles and max of a latency stats event */
+#define CTF_EVENT_WRITE_LATENCY_STATS(count,p50,p90,p99,p999,max,mem) \
+  G_STMT_START {                                \
+    CTF_EVENT_WRITE_INT64 (count, mem);         \
+    CTF_EVENT_WRITE_INT64 (p50, mem);           \
+    CTF_EVENT_WRITE_INT64 (p90, mem);           \
+    CTF_EVENT_WRITE_INT64 (p99, mem);           \
+    CTF_EVENT_WRITE_INT64 (p999, mem);          \
+    CTF_EVENT_WRITE_INT64 (max, mem);           \
+  } G_STMT_END
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+#define CTF_LATENCY_STATS_SIZE (6 * sizeof (guint64))
+
+void
+do_print_proctime_stats_event (event_id id, const gchar * elementname,
+    guint64 count, guint64 p50, guint64 p90, guint64 p99, guint64 p999,
+    guint64 max)
+{
+  CtfRing *ring;
+  CtfRecord *record;
+  guint8 *event_mem;
+  gsize event_size;
+
+  event_size = strlen (elementname) + 1 + CTF_LATENCY_STATS_SIZE;
+
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
+    return;
   }
 
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  event_mem = record->payload;
+  /* Write element name */
+  CTF_EVENT_WRITE_STRING (elementname, event_mem);
+  /* Write the window stats */
+  CTF_EVENT_WRITE_LATENCY_STATS (count, p50, p90, p99, p999, max, event_mem);
+
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_framerate_event (event_id id, gchar * elementname, guint64 fps)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
-  event_size = strlen (elementname) + 1 + sizeof (guint64) + CTF_HEADER_SIZE;
+  event_size = strlen (elementname) + 1 + sizeof (guint64);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
+  event_mem = record->payload;
   /* Write element name */
   CTF_EVENT_WRITE_STRING (elementname, event_mem);
   /* Write fps */
   CTF_EVENT_WRITE_INT64 (fps, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_interlatency_event (event_id id,
     gchar * originpad, gchar * destinationpad, guint64 time)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
   event_size =
-      strlen (originpad) + 1 + strlen (destinationpad) + 1 + sizeof (guint64) +
-      CTF_HEADER_SIZE;
+      strlen (originpad) + 1 + strlen (destinationpad) + 1 + sizeof (guint64);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
+  event_mem = record->payload;
   /* Write origin pad name */
   CTF_EVENT_WRITE_STRING (originpad, event_mem);
   /* Write destination pad name */
@@ -931,62 +1444,60 @@ do_print_interlatency_event (event_id id,
   /* Write time */
   CTF_EVENT_WRITE_INT64 (time, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
+  ctf_record_commit (ring, record);
+}
 
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
+void
+do_print_interlatency_stats_event (event_id id, const gchar * originpad,
+    const gchar * destinationpad, guint64 count, guint64 p50, guint64 p90,
+    guint64 p99, guint64 p999, guint64 max)
+{
+  CtfRing *ring;
+  CtfRecord *record;
+  guint8 *event_mem;
+  gsize event_size;
 
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
+  event_size = strlen (originpad) + 1 + strlen (destinationpad) + 1 +
+      CTF_LATENCY_STATS_SIZE;
+
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
+    return;
   }
-  g_mutex_unlock (&ctf_descriptor->mutex);
+
+  event_mem = record->payload;
+  /* Write origin pad name */
+  CTF_EVENT_WRITE_STRING (originpad, event_mem);
+  /* Write destination pad name */
+  CTF_EVENT_WRITE_STRING (destinationpad, event_mem);
+  /* Write the window stats */
+  CTF_EVENT_WRITE_LATENCY_STATS (count, p50, p90, p99, p999, max, event_mem);
+
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_scheduling_event (event_id id, gchar * elementname, guint64 time)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
-  event_size = strlen (elementname) + 1 + sizeof (guint64) + CTF_HEADER_SIZE;
+  event_size = strlen (elementname) + 1 + sizeof (guint64);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
+  event_mem = record->payload;
   /* Write element name */
   CTF_EVENT_WRITE_STRING (elementname, event_mem);
   /* Write time */
   CTF_EVENT_WRITE_INT64 (time, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
@@ -994,27 +1505,20 @@ do_print_queue_level_event (event_id id, const gchar * elementname,
     guint32 bytes, guint32 max_bytes, guint32 buffers, guint32 max_buffers,
     guint64 time, guint64 max_time)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
   event_size =
-      strlen (elementname) + 1 + 4 * sizeof (guint32) + 2 * sizeof (guint64) +
-      CTF_HEADER_SIZE;
+      strlen (elementname) + 1 + 4 * sizeof (guint32) + 2 * sizeof (guint64);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-  /* Add event payload */
+  event_mem = record->payload;
   /* Write element name */
   CTF_EVENT_WRITE_STRING (elementname, event_mem);
 
@@ -1036,62 +1540,31 @@ do_print_queue_level_event (event_id id, const gchar * elementname,
   /* Write time */
   CTF_EVENT_WRITE_INT64 (max_time, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_bitrate_event (event_id id, gchar * elementname, guint64 bps)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
-  event_size = strlen (elementname) + 1 + sizeof (bps) + CTF_HEADER_SIZE;
+  event_size = strlen (elementname) + 1 + sizeof (bps);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
+  event_mem = record->payload;
   /* Write element name */
   CTF_EVENT_WRITE_STRING (elementname, event_mem);
   /* Write bitrate */
   CTF_EVENT_WRITE_INT64 (bps, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
@@ -1099,27 +1572,19 @@ do_print_buffer_event (event_id id, const gchar * pad, GstClockTime pts,
     GstClockTime dts, GstClockTime duration, guint64 offset,
     guint64 offset_end, guint64 size, GstBufferFlags flags, guint32 refcount)
 {
-  GError *error;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
   gsize event_size;
 
-  event_size =
-      strlen (pad) + 1 + 6 * sizeof (guint64) + 2 * sizeof (guint32) +
-      CTF_HEADER_SIZE;
+  event_size = strlen (pad) + 1 + 6 * sizeof (guint64) + 2 * sizeof (guint32);
 
-  if (event_exceeds_mem_size (event_size)) {
+  record = ctf_record_reserve (&ring, id, event_size);
+  if (NULL == record) {
     return;
   }
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
-
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
-
+  event_mem = record->payload;
   /* Write event specific fields */
   CTF_EVENT_WRITE_STRING (pad, event_mem);
   CTF_EVENT_WRITE_INT64 (pts, event_mem);
@@ -1131,86 +1596,97 @@ do_print_buffer_event (event_id id, const gchar * pad, GstClockTime pts,
   CTF_EVENT_WRITE_INT32 (flags, event_mem);
   CTF_EVENT_WRITE_INT32 (refcount, event_mem);
 
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem -= event_size;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
 do_print_ctf_init (event_id id)
 {
-  GError *error;
   guint32 unknown = 0;
-  guint8 *mem;
+  CtfRing *ring;
+  CtfRecord *record;
   guint8 *event_mem;
-  gsize event_size;
 
-  mem = ctf_descriptor->mem;
-  event_mem = mem + TCP_HEADER_SIZE;
+  record = ctf_record_reserve (&ring, id, sizeof (unknown));
+  if (NULL == record) {
+    return;
+  }
 
-  /* Lock mem and datastream and output_stream resources */
-  g_mutex_lock (&ctf_descriptor->mutex);
-  /* Add CTF header */
-  CTF_EVENT_WRITE_HEADER (id, event_mem);
+  event_mem = record->payload;
   /* Write padding */
   CTF_EVENT_WRITE_INT32 (unknown, event_mem);
 
-  /* Computer event size */
-  event_size = event_mem - (mem + TCP_HEADER_SIZE);
-
-  if (FALSE == ctf_descriptor->file_output_disable) {
-    event_mem = mem + TCP_HEADER_SIZE;
-    fwrite (event_mem, sizeof (gchar), event_size, ctf_descriptor->datastream);
-  }
-
-  if (FALSE == ctf_descriptor->tcp_output_disable) {
-    /* Write the TCP header */
-    TCP_EVENT_HEADER_WRITE (TCP_DATASTREAM_ID, event_size, mem);
-
-    g_output_stream_write (ctf_descriptor->output_stream,
-        ctf_descriptor->mem, event_size + TCP_HEADER_SIZE, NULL, &error);
-  }
-
-  g_mutex_unlock (&ctf_descriptor->mutex);
+  ctf_record_commit (ring, record);
 }
 
 void
 gst_ctf_close (void)
 {
+  GstCtfDescriptor *ctf;
   GError *error;
   gboolean res;
-  fclose (ctf_descriptor->metadata);
-  fclose (ctf_descriptor->datastream);
-  g_mutex_clear (&ctf_descriptor->mutex);
+  gpointer record;
+  GList *node;
+  GList *next;
+
+  /* Write the pending events */
+  ctf_flush_stop ();
+
+  /* From now on the tracing threads free their own rings */
+  g_mutex_lock (&ctf_rings_mutex);
+  ctf = ctf_descriptor;
+  ctf_descriptor = NULL;
+  for (node = ctf_rings; NULL != node; node = next) {
+    next = g_list_next (node);
+    if (((CtfRing *) node->data)->orphaned) {
+      g_free (node->data);
+      ctf_rings = g_list_delete_link (ctf_rings, node);
+    }
+  }
+  g_mutex_unlock (&ctf_rings_mutex);
 
-  if (NULL != ctf_descriptor->dir_name) {
-    g_free (ctf_descriptor->dir_name);
+  if (NULL != ctf->metadata) {
+    fclose (ctf->metadata);
   }
-  if (NULL != ctf_descriptor->host_name) {
-    g_free (ctf_descriptor->host_name);
+  if (NULL != ctf->datastream_map) {
+    munmap (ctf->datastream_map, ctf->datastream_map_size);
+  }
+  if (-1 != ctf->datastream) {
+    close (ctf->datastream);
+  }
+  g_mutex_clear (&ctf->mutex);
+
+  if (NULL != ctf->dir_name) {
+    g_free (ctf->dir_name);
+  }
+  if (NULL != ctf->host_name) {
+    g_free (ctf->host_name);
   }
   /* Closes the stream, releasing resources related to it. */
-  if (NULL != ctf_descriptor->output_stream) {
-    res = g_output_stream_close (ctf_descriptor->output_stream, NULL, &error);
+  if (NULL != ctf->output_stream) {
+    error = NULL;
+    res = g_output_stream_close (ctf->output_stream, NULL, &error);
     if (FALSE == res) {
       GST_ERROR ("Failed to close output stream");
+      g_clear_error (&error);
     }
   }
 
-  if (NULL != ctf_descriptor->socket_client) {
-    g_object_unref (ctf_descriptor->socket_client);
+  if (NULL != ctf->socket_client) {
+    g_object_unref (ctf->socket_client);
   }
 
-  g_free (ctf_descriptor);
+  /* Events posted while stopping */
+  while (NULL != (record = g_async_queue_try_pop (ctf->overflow))) {
+    g_free (record);
+  }
+  g_async_queue_unref (ctf->overflow);
+  g_array_free (ctf->pending, TRUE);
+  g_array_free (ctf->runs, TRUE);
+  g_byte_array_unref (ctf->staging);
+  g_mutex_clear (&ctf->flush_mutex);
+  g_cond_clear (&ctf->flush_cond);
+  g_cond_clear (&ctf->drain_cond);
+
+  g_free (ctf);
 }
@@ -33,6 +33,8 @@ typedef enum
   QUEUE_LEVEL_EVENT_ID,
   BITRATE_EVENT_ID,
   BUFFER_EVENT_ID,
+  PROCTIME_STATS_EVENT_ID,
+  INTERLATENCY_STATS_EVENT_ID,
 } event_id;
 
 gchar *get_ctf_path_name (void);
@@ -44,6 +46,12 @@ void do_print_proctime_event (event_id id, gchar * elementname, guint64 time);
 void do_print_framerate_event (event_id id, gchar * elementname, guint64 fps);
 void do_print_interlatency_event (event_id id,
     char *originpad, gchar * destinationpad, guint64 time);
+void do_print_proctime_stats_event (event_id id, const gchar * elementname,
+    guint64 count, guint64 p50, guint64 p90, guint64 p99, guint64 p999,
+    guint64 max);
+void do_print_interlatency_stats_event (event_id id, const gchar * originpad,
+    const gchar * destinationpad, guint64 count, guint64 p50, guint64 p90,
+    guint64 p99, guint64 p999, guint64 max);
 void do_print_scheduling_event (event_id id, gchar * elementname, guint64 time);
 void do_print_queue_level_event (event_id id, const gchar * elementname, guint32 bytes,
     guint32 max_bytes, guint32 buffers, guint32 max_buffers, guint64 time, guint64 max_time);
@@ -28,6 +28,9 @@
  *
  * A tracing module that determines latencies between src and intermediate elements
  * by injecting custom events at sources and process them in the pads.
+ *
+ * With mode=histogram the latencies are not logged per buffer but aggregated
+ * per pad pair, and their count, percentiles and max are logged every period.
  */
 /* TODO(ensonic): if there are two sources feeding into a mixer/muxer and later
  * we fan-out with tee and have two sinks, each sink would get all two events,
@@ -47,13 +50,16 @@ GST_DEBUG_CATEGORY_STATIC (gst_interlatency_debug);
 #define _do_init GST_DEBUG_CATEGORY_INIT (gst_interlatency_debug, "interlatency", 0, "interlatency tracer");
 #define gst_interlatency_tracer_parent_class parent_class
 G_DEFINE_TYPE_WITH_CODE (GstInterLatencyTracer, gst_interlatency_tracer,
-    GST_SHARK_TYPE_TRACER, _do_init);
+    GST_TYPE_PERIODIC_TRACER, _do_init);
+
+#define PAD_NAME_SIZE  (128)
 
 static GQuark latency_probe_id;
 static GQuark latency_probe_pad;
 static GQuark latency_probe_ts;
 
 static GstTracerRecord *tr_interlatency;
+static GstTracerRecord *tr_interlatency_stats;
 
 static const gchar interlatency_metadata_event[] = "event {\n\
     name = interlatency;\n\
@@ -67,7 +73,29 @@ static const gchar interlatency_metadata_event[] = "event {\n\
 };\n\
 \n";
 
+static const gchar interlatency_stats_metadata_event[] = "event {\n\
+    name = interlatency_stats;\n\
+    id = %d;\n\
+    stream_id = %d;\n\
+    fields := struct {\n\
+        string from_pad;\n\
+        string to_pad;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _count;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p50;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p90;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p99;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p999;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _max;\n\
+    };\n\
+};\n\
+\n";
+
+static void gst_interlatency_tracer_constructed (GObject * object);
 static void gst_interlatency_tracer_dispose (GObject * object);
+static void gst_interlatency_tracer_finalize (GObject * object);
+static gboolean print_latency_stats (GstPeriodicTracer * tracer);
+static void reset_latency_stats (GstPeriodicTracer * tracer);
+static void create_stats_metadata_event (GstPeriodicTracer * tracer);
 
 /* data helpers */
 
@@ -111,31 +139,87 @@ static void
 log_latency (GstInterLatencyTracer * interlatency_tracer,
     const GstStructure * data, GstPad * sink_pad, guint64 sink_ts)
 {
-  GstPad *src_pad = NULL;
+  GstPad *src_pad;
   guint64 src_ts;
-  gchar *src = NULL, *sink = NULL;
+  gchar src[PAD_NAME_SIZE];
+  gchar sink[PAD_NAME_SIZE];
   guint64 time;
-  GString *time_string = NULL;
+  gchar *time_string;
 
-  gst_structure_id_get (data,
-      latency_probe_pad, GST_TYPE_PAD, &src_pad,
-      latency_probe_ts, G_TYPE_UINT64, &src_ts, NULL);
-
-  src = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (src_pad));
-  sink = g_strdup_printf ("%s_%s", GST_DEBUG_PAD_NAME (sink_pad));
+  /* Borrow the values, the event keeps the pad alive */
+  src_pad = GST_PAD (g_value_get_object (gst_structure_id_get_value (data,
+              latency_probe_pad)));
+  src_ts = g_value_get_uint64 (gst_structure_id_get_value (data,
+          latency_probe_ts));
 
   time = GST_CLOCK_DIFF (src_ts, sink_ts);
 
-  time_string = g_string_new ("");
-  g_string_printf (time_string, "%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
+  if (NULL != interlatency_tracer->stats) {
+    gst_latency_stats_record (interlatency_tracer->stats,
+        GST_OBJECT (src_pad), GST_OBJECT (sink_pad), time);
+    return;
+  }
+
+  gst_shark_tracer_pad_name (src_pad, '_', src, PAD_NAME_SIZE);
+  gst_shark_tracer_pad_name (sink_pad, '_', sink, PAD_NAME_SIZE);
 
-  gst_tracer_record_log (tr_interlatency, src, sink, time_string->str);
+  if (gst_shark_tracer_log_enabled ()) {
+    time_string = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
+    gst_tracer_record_log (tr_interlatency, src, sink, time_string);
+    g_free (time_string);
+  }
 
   do_print_interlatency_event (INTERLATENCY_EVENT_ID, src, sink, time);
+}
+
+static void
+log_latency_summary (const GstLatencySummary * summary, gpointer user_data)
+{
+  gst_tracer_record_log (tr_interlatency_stats, summary->first,
+      summary->second, summary->count, summary->p50, summary->p90,
+      summary->p99, summary->p999, summary->max);
+  do_print_interlatency_stats_event (INTERLATENCY_STATS_EVENT_ID,
+      summary->first, summary->second, summary->count, summary->p50,
+      summary->p90, summary->p99, summary->p999, summary->max);
+}
+
+static gboolean
+print_latency_stats (GstPeriodicTracer * tracer)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (tracer);
+
+  if (NULL != self->stats) {
+    gst_latency_stats_foreach_window (self->stats, log_latency_summary, NULL);
+  }
+
+  return TRUE;
+}
+
+static void
+reset_latency_stats (GstPeriodicTracer * tracer)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (tracer);
+
+  if (NULL != self->stats) {
+    gst_latency_stats_reset (self->stats);
+  }
+}
+
+static void
+create_stats_metadata_event (GstPeriodicTracer * tracer)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (tracer);
+  gchar *metadata_event;
 
-  g_string_free (time_string, TRUE);
-  g_free (src);
-  g_free (sink);
+  if (NULL == self->stats) {
+    return;
+  }
+
+  metadata_event =
+      g_strdup_printf (interlatency_stats_metadata_event,
+      INTERLATENCY_STATS_EVENT_ID, 0);
+  add_metadata_event_struct (metadata_event);
+  g_free (metadata_event);
 }
 
 static void
@@ -258,9 +342,11 @@ static void
 gst_interlatency_tracer_class_init (GstInterLatencyTracerClass * klass)
 {
   GObjectClass *oclass;
+  GstPeriodicTracerClass *ptracer_class;
   gchar *metadata_event;
 
   oclass = G_OBJECT_CLASS (klass);
+  ptracer_class = GST_PERIODIC_TRACER_CLASS (klass);
 
   latency_probe_id = g_quark_from_static_string ("latency_probe.id");
   latency_probe_pad = g_quark_from_static_string ("latency_probe.pad");
@@ -282,8 +368,35 @@ gst_interlatency_tracer_class_init (GstInterLatencyTracerClass * klass)
           NULL),
       NULL);
 
-
+  tr_interlatency_stats = gst_tracer_record_new ("interlatency_stats.class",
+      "from_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_PAD,
+          NULL),
+      "to_pad", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE, GST_TRACER_VALUE_SCOPE_PAD,
+          NULL),
+      "count", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Buffers in the period"),
+      "p50", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Median latency in nanoseconds"),
+      "p90", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("90th percentile in nanoseconds"),
+      "p99", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("99th percentile in nanoseconds"),
+      "p999", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("99.9th percentile in nanoseconds"),
+      "max", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Maximum latency in nanoseconds"), NULL);
+
+  oclass->constructed = gst_interlatency_tracer_constructed;
   oclass->dispose = gst_interlatency_tracer_dispose;
+  oclass->finalize = gst_interlatency_tracer_finalize;
+
+  ptracer_class->timer_callback = GST_DEBUG_FUNCPTR (print_latency_stats);
+  ptracer_class->reset = GST_DEBUG_FUNCPTR (reset_latency_stats);
+  ptracer_class->write_header = GST_DEBUG_FUNCPTR (create_stats_metadata_event);
 
   metadata_event =
       g_strdup_printf (interlatency_metadata_event, INTERLATENCY_EVENT_ID, 0);
@@ -296,6 +409,8 @@ gst_interlatency_tracer_init (GstInterLatencyTracer * self)
 {
   GstTracer *tracer = GST_TRACER (self);
 
+  self->stats = NULL;
+
   /* In push mode, pre/post will be called before/after the peer chain
    * function has been called. For this reason, we only use -pre to avoid
    * accounting for the processing time of the peer element (the sink).
@@ -322,3 +437,30 @@ static void
 gst_interlatency_tracer_dispose (GObject * object)
 {
 }
+
+static void
+gst_interlatency_tracer_constructed (GObject * object)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (object);
+
+  G_OBJECT_CLASS (parent_class)->constructed (object);
+
+  /* The params are only available once constructed */
+  if (gst_latency_stats_enabled (GST_SHARK_TRACER (self))) {
+    GST_INFO_OBJECT (self, "Aggregating latencies in histograms");
+    self->stats = gst_latency_stats_new ();
+  }
+}
+
+static void
+gst_interlatency_tracer_finalize (GObject * object)
+{
+  GstInterLatencyTracer *self = GST_INTERLATENCY_TRACER (object);
+
+  if (NULL != self->stats) {
+    gst_latency_stats_free (self->stats);
+    self->stats = NULL;
+  }
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
@@ -22,7 +22,8 @@
  */
 #pragma once
 
-#include "gstsharktracer.hpp"
+#include "gstperiodictracer.hpp"
+#include "gstlatencystats.hpp"
 
 G_BEGIN_DECLS
 #define GST_TYPE_INTERLATENCY_TRACER \
@@ -46,13 +47,14 @@ typedef struct _GstInterLatencyTracerClass GstInterLatencyTracerClass;
  */
 struct _GstInterLatencyTracer
 {
-  GstSharkTracer parent;
+  GstPeriodicTracer parent;
   /*< private > */
+  GstLatencyStats *stats;
 };
 
 struct _GstInterLatencyTracerClass
 {
-  GstSharkTracerClass parent_class;
+  GstPeriodicTracerClass parent_class;
 
   /* signals */
 };
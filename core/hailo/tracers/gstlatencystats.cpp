@@ -0,0 +1,505 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/**
+ * SECTION:gstlatencystats
+ * @short_description: streaming latency histograms for the tracers
+ *
+ * Log-linear histograms: values under 2 * LATENCY_SUB_BUCKETS get their own
+ * bucket, above that every power of two is split in LATENCY_SUB_BUCKETS
+ * buckets, so a bucket is never wider than ~3% of its values. Values are
+ * clamped to LATENCY_MAX_VALUE (~68 s).
+ *
+ * Every thread keeps its histograms in its own shard, an open addressing
+ * table from (stats, first, second) to the histogram of the series, so
+ * recording is a hash probe and a couple of relaxed stores. The counters
+ * are cumulative and only written by their thread, the reader builds the
+ * window histogram of a series by summing what every shard recorded since
+ * the previous window.
+ */
+
+#include <string.h>
+
+#include "gstlatencystats.hpp"
+
+#define LATENCY_SUB_BUCKET_BITS (5)
+#define LATENCY_SUB_BUCKETS     (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_BITS        (36)
+#define LATENCY_MAX_VALUE       ((G_GUINT64_CONSTANT (1) << LATENCY_MAX_BITS) - 1)
+#define LATENCY_BUCKETS \
+  ((LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+#define LATENCY_MODE_PARAM      "mode"
+#define LATENCY_MODE_HISTOGRAM  "histogram"
+
+#define LATENCY_NAME_SIZE       (128)
+#define LATENCY_SHARD_SIZE      (64)    /* Power of two */
+
+#define LATENCY_LOAD(value) __atomic_load_n (&(value), __ATOMIC_RELAXED)
+#define LATENCY_STORE(value,new_value) \
+  __atomic_store_n (&(value), (new_value), __ATOMIC_RELAXED)
+
+typedef struct _GstLatencySeries GstLatencySeries;
+typedef struct _GstLatencyGroup GstLatencyGroup;
+typedef struct _GstLatencyShard GstLatencyShard;
+typedef struct _GstLatencyShardEntry GstLatencyShardEntry;
+
+/* The histogram of a series in one thread */
+struct _GstLatencySeries
+{
+  guint32 counts[LATENCY_BUCKETS];
+  /* The maximum of the last windows with an even and an odd epoch. The
+     reader moves to the next epoch before reading the slot of the closed
+     window, so the writer never reuses a slot while it is being read. */
+  GstClockTime max[2];
+  guint max_epoch[2];
+  /* Reader side, the counts up to the last closed window */
+  guint32 seen[LATENCY_BUCKETS];
+};
+
+/* A (first, second) pair and its series, one per recording thread */
+struct _GstLatencyGroup
+{
+  GstObject *first;
+  GstObject *second;
+  gchar *first_name;
+  gchar *second_name;
+  GPtrArray *series;
+};
+
+struct _GstLatencyShardEntry
+{
+  guint stats_id;
+  gconstpointer first;
+  gconstpointer second;
+  GstLatencySeries *series;
+};
+
+struct _GstLatencyShard
+{
+  GstLatencyShardEntry *entries;
+  guint size;
+  guint used;
+};
+
+struct _GstLatencyStats
+{
+  /* Shards outlive their stats, entries are matched by id and not by
+     address so they never alias a later instance */
+  guint id;
+  guint epoch;
+  GMutex mutex;
+  GHashTable *groups;
+  guint64 window[LATENCY_BUCKETS];
+};
+
+static void latency_shard_free (gpointer data);
+
+static GPrivate latency_shard_key = G_PRIVATE_INIT (latency_shard_free);
+static guint latency_stats_last_id = 0;
+
+static inline guint
+latency_bucket_index (GstClockTime value)
+{
+  guint shift;
+
+  if (value < 2 * LATENCY_SUB_BUCKETS) {
+    return (guint) value;
+  }
+
+  shift = (63 - __builtin_clzll (value)) - LATENCY_SUB_BUCKET_BITS;
+
+  return shift * LATENCY_SUB_BUCKETS + (guint) (value >> shift);
+}
+
+static GstClockTime
+latency_bucket_upper_bound (guint index)
+{
+  guint shift;
+  guint64 sub_bucket;
+
+  if (index < 2 * LATENCY_SUB_BUCKETS) {
+    return index;
+  }
+
+  shift = index / LATENCY_SUB_BUCKETS - 1;
+  sub_bucket = index - shift * LATENCY_SUB_BUCKETS;
+
+  return ((sub_bucket + 1) << shift) - 1;
+}
+
+static GstClockTime
+latency_bucket_lower_bound (guint index)
+{
+  return (0 == index) ? 0 : latency_bucket_upper_bound (index - 1) + 1;
+}
+
+static inline guint
+latency_shard_hash (guint stats_id, gconstpointer first, gconstpointer second)
+{
+  guint64 hash;
+
+  hash = (guint64) (guintptr) first * G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+  hash ^= (guint64) (guintptr) second + stats_id;
+  hash *= G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+
+  return (guint) (hash >> 32);
+}
+
+static GstLatencyShard *
+latency_shard_new (void)
+{
+  GstLatencyShard *shard;
+
+  shard = g_new0 (GstLatencyShard, 1);
+  shard->size = LATENCY_SHARD_SIZE;
+  shard->entries = g_new0 (GstLatencyShardEntry, shard->size);
+
+  return shard;
+}
+
+static void
+latency_shard_free (gpointer data)
+{
+  GstLatencyShard *shard = (GstLatencyShard *) data;
+
+  /* The series belong to their stats */
+  g_free (shard->entries);
+  g_free (shard);
+}
+
+static inline GstLatencySeries *
+latency_shard_lookup (GstLatencyShard * shard, guint stats_id,
+    gconstpointer first, gconstpointer second)
+{
+  GstLatencyShardEntry *entry;
+  guint mask = shard->size - 1;
+  guint i;
+
+  for (i = latency_shard_hash (stats_id, first, second) & mask;;
+      i = (i + 1) & mask) {
+    entry = &shard->entries[i];
+    if (NULL == entry->series) {
+      return NULL;
+    }
+    if (entry->stats_id == stats_id && entry->first == first
+        && entry->second == second) {
+      return entry->series;
+    }
+  }
+}
+
+static void
+latency_shard_insert (GstLatencyShard * shard, guint stats_id,
+    gconstpointer first, gconstpointer second, GstLatencySeries * series)
+{
+  GstLatencyShardEntry *entry;
+  guint mask;
+  guint i;
+
+  /* Keep the table at most half full so probes stay short */
+  if (2 * (shard->used + 1) > shard->size) {
+    GstLatencyShardEntry *entries = shard->entries;
+    guint size = shard->size;
+
+    shard->size = size * 2;
+    shard->entries = g_new0 (GstLatencyShardEntry, shard->size);
+    shard->used = 0;
+    for (i = 0; i < size; i++) {
+      if (NULL != entries[i].series) {
+        latency_shard_insert (shard, entries[i].stats_id, entries[i].first,
+            entries[i].second, entries[i].series);
+      }
+    }
+    g_free (entries);
+  }
+
+  mask = shard->size - 1;
+  for (i = latency_shard_hash (stats_id, first, second) & mask;
+      NULL != shard->entries[i].series; i = (i + 1) & mask);
+
+  entry = &shard->entries[i];
+  entry->stats_id = stats_id;
+  entry->first = first;
+  entry->second = second;
+  entry->series = series;
+  shard->used++;
+}
+
+static gchar *
+latency_object_name (GstObject * object)
+{
+  gchar name[LATENCY_NAME_SIZE];
+
+  if (NULL == object) {
+    return NULL;
+  }
+
+  if (GST_IS_PAD (object)) {
+    gst_shark_tracer_pad_name (GST_PAD (object), '_', name, LATENCY_NAME_SIZE);
+    return g_strdup (name);
+  }
+
+  return g_strdup (GST_STR_NULL (GST_OBJECT_NAME (object)));
+}
+
+static guint
+latency_group_hash (gconstpointer key)
+{
+  const GstLatencyGroup *group = (const GstLatencyGroup *) key;
+
+  return latency_shard_hash (0, group->first, group->second);
+}
+
+static gboolean
+latency_group_equal (gconstpointer a, gconstpointer b)
+{
+  const GstLatencyGroup *group_a = (const GstLatencyGroup *) a;
+  const GstLatencyGroup *group_b = (const GstLatencyGroup *) b;
+
+  return group_a->first == group_b->first && group_a->second == group_b->second;
+}
+
+static void
+latency_group_free (gpointer data)
+{
+  GstLatencyGroup *group = (GstLatencyGroup *) data;
+
+  gst_object_unref (group->first);
+  if (NULL != group->second) {
+    gst_object_unref (group->second);
+  }
+  g_free (group->first_name);
+  g_free (group->second_name);
+  g_ptr_array_free (group->series, TRUE);
+  g_free (group);
+}
+
+static GstLatencySeries *
+latency_stats_add_series (GstLatencyStats * stats, GstLatencyShard * shard,
+    GstObject * first, GstObject * second)
+{
+  GstLatencyGroup key;
+  GstLatencyGroup *group;
+  GstLatencySeries *series;
+
+  series = g_new0 (GstLatencySeries, 1);
+
+  key.first = first;
+  key.second = second;
+
+  g_mutex_lock (&stats->mutex);
+  group = (GstLatencyGroup *) g_hash_table_lookup (stats->groups, &key);
+  if (NULL == group) {
+    /* The objects are kept alive so their addresses keep identifying them */
+    group = g_new0 (GstLatencyGroup, 1);
+    group->first = (GstObject *) gst_object_ref (first);
+    group->second =
+        (NULL != second) ? (GstObject *) gst_object_ref (second) : NULL;
+    group->first_name = latency_object_name (first);
+    group->second_name = latency_object_name (second);
+    group->series = g_ptr_array_new_with_free_func (g_free);
+    g_hash_table_add (stats->groups, group);
+  }
+  g_ptr_array_add (group->series, series);
+  g_mutex_unlock (&stats->mutex);
+
+  latency_shard_insert (shard, stats->id, first, second, series);
+
+  return series;
+}
+
+gboolean
+gst_latency_stats_enabled (GstSharkTracer * tracer)
+{
+  GList *list;
+
+  g_return_val_if_fail (tracer, FALSE);
+
+  list = gst_shark_tracer_get_param (tracer, LATENCY_MODE_PARAM);
+
+  return NULL != list
+      && 0 == g_strcmp0 ((const gchar *) list->data, LATENCY_MODE_HISTOGRAM);
+}
+
+GstStructure *
+gst_latency_stats_value_spec (const gchar * description)
+{
+  return gst_structure_new ("value",
+      "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+      "description", G_TYPE_STRING, description,
+      "flags", GST_TYPE_TRACER_VALUE_FLAGS, GST_TRACER_VALUE_FLAGS_AGGREGATED,
+      "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+      "max", G_TYPE_UINT64, G_MAXUINT64, NULL);
+}
+
+GstLatencyStats *
+gst_latency_stats_new (void)
+{
+  GstLatencyStats *stats;
+
+  stats = g_new0 (GstLatencyStats, 1);
+  stats->id = g_atomic_int_add (&latency_stats_last_id, 1) + 1;
+  stats->epoch = 0;
+  g_mutex_init (&stats->mutex);
+  stats->groups =
+      g_hash_table_new_full (latency_group_hash, latency_group_equal,
+      NULL, latency_group_free);
+
+  return stats;
+}
+
+void
+gst_latency_stats_record (GstLatencyStats * stats, GstObject * first,
+    GstObject * second, GstClockTime latency)
+{
+  GstLatencyShard *shard;
+  GstLatencySeries *series;
+  guint index;
+  guint epoch;
+  guint slot;
+
+  shard = (GstLatencyShard *) g_private_get (&latency_shard_key);
+  if (G_UNLIKELY (NULL == shard)) {
+    shard = latency_shard_new ();
+    g_private_set (&latency_shard_key, shard);
+  }
+
+  series = latency_shard_lookup (shard, stats->id, first, second);
+  if (G_UNLIKELY (NULL == series)) {
+    series = latency_stats_add_series (stats, shard, first, second);
+  }
+
+  if (latency > LATENCY_MAX_VALUE) {
+    latency = LATENCY_MAX_VALUE;
+  }
+
+  /* This thread is the only writer of the series, no read-modify-write
+     atomics needed */
+  index = latency_bucket_index (latency);
+  LATENCY_STORE (series->counts[index], LATENCY_LOAD (series->counts[index]) + 1);
+
+  epoch = LATENCY_LOAD (stats->epoch);
+  slot = epoch & 1;
+  if (series->max_epoch[slot] != epoch) {
+    LATENCY_STORE (series->max[slot], latency);
+    __atomic_store_n (&series->max_epoch[slot], epoch, __ATOMIC_RELEASE);
+  } else if (latency > series->max[slot]) {
+    LATENCY_STORE (series->max[slot], latency);
+  }
+}
+
+static void
+latency_group_summarize (GstLatencyGroup * group, guint epoch,
+    guint64 * window, GstLatencySummary * summary)
+{
+  static const guint64 permille[] = { 500, 900, 990, 999 };
+  GstClockTime *percentiles[] = { &summary->p50, &summary->p90,
+    &summary->p99, &summary->p999
+  };
+  guint64 ranks[G_N_ELEMENTS (permille)];
+  guint64 cumulative;
+  guint top;
+  guint i, j, k;
+
+  memset (window, 0, LATENCY_BUCKETS * sizeof (guint64));
+  memset (summary, 0, sizeof (GstLatencySummary));
+  summary->first = group->first_name;
+  summary->second = group->second_name;
+
+  for (i = 0; i < group->series->len; i++) {
+    GstLatencySeries *series =
+        (GstLatencySeries *) g_ptr_array_index (group->series, i);
+    guint slot = epoch & 1;
+
+    for (j = 0; j < LATENCY_BUCKETS; j++) {
+      guint32 count = LATENCY_LOAD (series->counts[j]);
+
+      /* Unsigned difference, counter wraparound is harmless */
+      window[j] += (guint32) (count - series->seen[j]);
+      series->seen[j] = count;
+    }
+
+    if (__atomic_load_n (&series->max_epoch[slot], __ATOMIC_ACQUIRE) == epoch) {
+      summary->max = MAX (summary->max, LATENCY_LOAD (series->max[slot]));
+    }
+  }
+
+  top = 0;
+  for (j = 0; j < LATENCY_BUCKETS; j++) {
+    if (0 != window[j]) {
+      summary->count += window[j];
+      top = j;
+    }
+  }
+
+  if (0 == summary->count) {
+    return;
+  }
+
+  /* A latency recorded while the window was being closed counts in the
+     next one, its maximum can be missing */
+  if (summary->max < latency_bucket_lower_bound (top)) {
+    summary->max = latency_bucket_upper_bound (top);
+  }
+
+  for (k = 0; k < G_N_ELEMENTS (permille); k++) {
+    ranks[k] = MAX (1, (summary->count * permille[k] + 999) / 1000);
+  }
+
+  cumulative = 0;
+  k = 0;
+  for (j = 0; j <= top && k < G_N_ELEMENTS (permille); j++) {
+    cumulative += window[j];
+    for (; k < G_N_ELEMENTS (permille) && cumulative >= ranks[k]; k++) {
+      *percentiles[k] = MIN (latency_bucket_upper_bound (j), summary->max);
+    }
+  }
+}
+
+void
+gst_latency_stats_foreach_window (GstLatencyStats * stats,
+    GstLatencySummaryFunc func, gpointer user_data)
+{
+  GHashTableIter iter;
+  gpointer group;
+  GstLatencySummary summary;
+  guint epoch;
+
+  g_return_if_fail (stats);
+
+  g_mutex_lock (&stats->mutex);
+
+  /* Writers move to the other max slot, the one of the closed window is
+     left for us */
+  epoch = stats->epoch;
+  LATENCY_STORE (stats->epoch, epoch + 1);
+
+  g_hash_table_iter_init (&iter, stats->groups);
+  while (g_hash_table_iter_next (&iter, &group, NULL)) {
+    latency_group_summarize ((GstLatencyGroup *) group, epoch, stats->window,
+        &summary);
+    if (NULL != func && 0 != summary.count) {
+      func (&summary, user_data);
+    }
+  }
+
+  g_mutex_unlock (&stats->mutex);
+}
+
+void
+gst_latency_stats_reset (GstLatencyStats * stats)
+{
+  gst_latency_stats_foreach_window (stats, NULL, NULL);
+}
+
+void
+gst_latency_stats_free (GstLatencyStats * stats)
+{
+  g_return_if_fail (stats);
+
+  g_hash_table_destroy (stats->groups);
+  g_mutex_clear (&stats->mutex);
+  g_free (stats);
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+#pragma once
+
+#include <gst/gst.h>
+
+#include "gstsharktracer.hpp"
+
+G_BEGIN_DECLS
+
+typedef struct _GstLatencyStats GstLatencyStats;
+typedef struct _GstLatencySummary GstLatencySummary;
+
+/* Latency distribution of one series over a window, in nanoseconds.
+   Percentiles are the upper bound of their histogram bucket (within ~3%
+   of the real value), max is exact. */
+struct _GstLatencySummary
+{
+  const gchar *first;
+  const gchar *second;
+  guint64 count;
+  GstClockTime p50;
+  GstClockTime p90;
+  GstClockTime p99;
+  GstClockTime p999;
+  GstClockTime max;
+};
+
+typedef void (*GstLatencySummaryFunc) (const GstLatencySummary * summary,
+    gpointer user_data);
+
+/* Whether the tracer was configured to aggregate, with mode=histogram */
+gboolean gst_latency_stats_enabled (GstSharkTracer * tracer);
+
+/* Spec of a latency stats field for gst_tracer_record_new () */
+GstStructure *gst_latency_stats_value_spec (const gchar * description);
+
+GstLatencyStats *gst_latency_stats_new (void);
+
+/* Adds a latency to the series of the (first, second) pair, second may be
+   NULL. Lock free, every thread records in its own shard; the objects are
+   only named and referenced the first time a thread records the series. */
+void gst_latency_stats_record (GstLatencyStats * stats, GstObject * first,
+    GstObject * second, GstClockTime latency);
+
+/* Closes the current window, calling func with the summary of every series
+   that recorded latencies during it, and starts a new one. */
+void gst_latency_stats_foreach_window (GstLatencyStats * stats,
+    GstLatencySummaryFunc func, gpointer user_data);
+
+/* Drops the latencies of the current window and starts a new one */
+void gst_latency_stats_reset (GstLatencyStats * stats);
+
+void gst_latency_stats_free (GstLatencyStats * stats);
+
+G_END_DECLS
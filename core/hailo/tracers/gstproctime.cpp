@@ -22,8 +22,13 @@
  * @short_description: log cpu usage stats
  *
  * A tracing module that take proctime() snapshots and logs them.
+ *
+ * With mode=histogram the processing times are not logged per buffer but
+ * aggregated per element, and their count, percentiles and max are logged
+ * every period.
  */
 
+#include "gstlatencystats.hpp"
 #include "gstproctimecompute.hpp"
 #include "gstproctime.hpp"
 #include "gstctf.hpp"
@@ -38,18 +43,20 @@ GST_DEBUG_CATEGORY_STATIC (gst_proc_time_debug);
  */
 struct _GstProcTimeTracer
 {
-  GstSharkTracer parent;
+  GstPeriodicTracer parent;
 
   GstProcTime *proc_time;
+  GstLatencyStats *stats;
 };
 
 #define _do_init \
     GST_DEBUG_CATEGORY_INIT (gst_proc_time_debug, "proctime", 0, "proctime tracer");
 
 G_DEFINE_TYPE_WITH_CODE (GstProcTimeTracer, gst_proc_time_tracer,
-    GST_SHARK_TYPE_TRACER, _do_init);
+    GST_TYPE_PERIODIC_TRACER, _do_init);
 
 static GstTracerRecord *tr_proc_time;
+static GstTracerRecord *tr_proc_time_stats;
 
 static const gchar proc_time_metadata_event[] = "event {\n\
     name = proctime;\n\
@@ -62,6 +69,22 @@ static const gchar proc_time_metadata_event[] = "event {\n\
 };\n\
 \n";
 
+static const gchar proc_time_stats_metadata_event[] = "event {\n\
+    name = proctime_stats;\n\
+    id = %d;\n\
+    stream_id = %d;\n\
+    fields := struct {\n\
+        string element; \n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _count;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p50;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p90;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p99;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _p999;\n\
+        integer { size = 64; align = 8; signed = 0; encoding = none; base = 10; } _max;\n\
+    };\n\
+};\n\
+\n";
+
 static void
 do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad)
 {
@@ -91,14 +114,18 @@ do_push_buffer_pre (GstTracer * self, guint64 ts, GstPad * pad)
       gst_proctime_proc_time (proc_time, &time, pad_peer, pad, ts,
       should_calculate);
 
-  if (should_log) {
-    time_string = g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
-
-    gst_tracer_record_log (tr_proc_time, name, time_string);
+  if (should_log && NULL != proc_time_tracer->stats) {
+    gst_latency_stats_record (proc_time_tracer->stats, GST_OBJECT_PARENT (pad),
+        NULL, time);
+  } else if (should_log) {
+    if (gst_shark_tracer_log_enabled ()) {
+      time_string =
+          g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (time));
+      gst_tracer_record_log (tr_proc_time, name, time_string);
+      g_free (time_string);
+    }
 
     do_print_proctime_event (PROCTIME_EVENT_ID, name, time);
-
-    g_free (time_string);
   }
 
   gst_object_unref (pad_peer);
@@ -116,8 +143,74 @@ do_element_new (GObject * self, GstClockTime ts, GstElement * element)
   gst_proctime_add_new_element (proc_time, element);
 }
 
+static void
+log_proc_time_summary (const GstLatencySummary * summary, gpointer user_data)
+{
+  gst_tracer_record_log (tr_proc_time_stats, summary->first, summary->count,
+      summary->p50, summary->p90, summary->p99, summary->p999, summary->max);
+  do_print_proctime_stats_event (PROCTIME_STATS_EVENT_ID, summary->first,
+      summary->count, summary->p50, summary->p90, summary->p99,
+      summary->p999, summary->max);
+}
+
+static gboolean
+print_proc_time_stats (GstPeriodicTracer * tracer)
+{
+  GstProcTimeTracer *self = GST_PROC_TIME_TRACER (tracer);
+
+  if (NULL != self->stats) {
+    gst_latency_stats_foreach_window (self->stats, log_proc_time_summary,
+        NULL);
+  }
+
+  return TRUE;
+}
+
+static void
+reset_proc_time_stats (GstPeriodicTracer * tracer)
+{
+  GstProcTimeTracer *self = GST_PROC_TIME_TRACER (tracer);
+
+  if (NULL != self->stats) {
+    gst_latency_stats_reset (self->stats);
+  }
+}
+
+static void
+create_stats_metadata_event (GstPeriodicTracer * tracer)
+{
+  GstProcTimeTracer *self = GST_PROC_TIME_TRACER (tracer);
+  gchar *metadata_event;
+
+  if (NULL == self->stats) {
+    return;
+  }
+
+  metadata_event =
+      g_strdup_printf (proc_time_stats_metadata_event,
+      PROCTIME_STATS_EVENT_ID, 0);
+  add_metadata_event_struct (metadata_event);
+  g_free (metadata_event);
+}
+
 /* tracer class */
 
+static void
+gst_proc_time_tracer_constructed (GObject * obj)
+{
+  GstProcTimeTracer *self;
+
+  self = GST_PROC_TIME_TRACER (obj);
+
+  G_OBJECT_CLASS (gst_proc_time_tracer_parent_class)->constructed (obj);
+
+  /* The params are only available once constructed */
+  if (gst_latency_stats_enabled (GST_SHARK_TRACER (self))) {
+    GST_INFO_OBJECT (self, "Aggregating processing times in histograms");
+    self->stats = gst_latency_stats_new ();
+  }
+}
+
 static void
 gst_proc_time_tracer_finalize (GObject * obj)
 {
@@ -128,6 +221,11 @@ gst_proc_time_tracer_finalize (GObject * obj)
   gst_proctime_free (self->proc_time);
   self->proc_time = NULL;
 
+  if (NULL != self->stats) {
+    gst_latency_stats_free (self->stats);
+    self->stats = NULL;
+  }
+
   G_OBJECT_CLASS (gst_proc_time_tracer_parent_class)->finalize (obj);
 }
 
@@ -135,10 +233,16 @@ static void
 gst_proc_time_tracer_class_init (GstProcTimeTracerClass * klass)
 {
   GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstPeriodicTracerClass *ptracer_class = GST_PERIODIC_TRACER_CLASS (klass);
   gchar *metadata_event;
 
+  gobject_class->constructed = gst_proc_time_tracer_constructed;
   gobject_class->finalize = gst_proc_time_tracer_finalize;
 
+  ptracer_class->timer_callback = GST_DEBUG_FUNCPTR (print_proc_time_stats);
+  ptracer_class->reset = GST_DEBUG_FUNCPTR (reset_proc_time_stats);
+  ptracer_class->write_header = GST_DEBUG_FUNCPTR (create_stats_metadata_event);
+
   tr_proc_time = gst_tracer_record_new ("proctime.class",
       "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
           "type", G_TYPE_GTYPE, G_TYPE_STRING,
@@ -148,6 +252,24 @@ gst_proc_time_tracer_class_init (GstProcTimeTracerClass * klass)
           "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
           GST_TRACER_VALUE_SCOPE_PROCESS, NULL), NULL);
 
+  tr_proc_time_stats = gst_tracer_record_new ("proctime_stats.class",
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "count", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Buffers in the period"),
+      "p50", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Median time in nanoseconds"),
+      "p90", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("90th percentile in nanoseconds"),
+      "p99", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("99th percentile in nanoseconds"),
+      "p999", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("99.9th percentile in nanoseconds"),
+      "max", GST_TYPE_STRUCTURE,
+      gst_latency_stats_value_spec ("Maximum time in nanoseconds"), NULL);
+
   metadata_event =
       g_strdup_printf (proc_time_metadata_event, PROCTIME_EVENT_ID, 0);
   add_metadata_event_struct (metadata_event);
@@ -162,6 +284,7 @@ gst_proc_time_tracer_init (GstProcTimeTracer * self)
 
 
   self->proc_time = gst_proctime_new ();
+  self->stats = NULL;
 
   gst_tracing_register_hook (tracer, "pad-push-pre",
       G_CALLBACK (do_push_buffer_pre));
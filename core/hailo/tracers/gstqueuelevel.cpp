@@ -115,17 +115,20 @@ do_queue_level (GstTracer * self, guint64 ts, GstPad * pad)
       "max-size-buffers", &max_size_buffers,
       "max-size-time", &max_size_time, NULL);
 
-  size_time_string =
-      g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (size_time));
+  if (gst_shark_tracer_log_enabled ()) {
+    size_time_string =
+        g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (size_time));
 
-  max_size_time_string =
-      g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (max_size_time));
+    max_size_time_string =
+        g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (max_size_time));
 
-  gst_tracer_record_log (tr_qlevel, element_name, size_bytes, max_size_bytes,
-      size_buffers, max_size_buffers, size_time_string, max_size_time_string);
+    gst_tracer_record_log (tr_qlevel, element_name, size_bytes,
+        max_size_bytes, size_buffers, max_size_buffers, size_time_string,
+        max_size_time_string);
 
-  g_free (size_time_string);
-  g_free (max_size_time_string);
+    g_free (size_time_string);
+    g_free (max_size_time_string);
+  }
 
   do_print_queue_level_event (QUEUE_LEVEL_EVENT_ID, element_name, size_bytes,
       max_size_bytes, size_buffers, max_size_buffers, size_time, max_size_time);
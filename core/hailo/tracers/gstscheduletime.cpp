@@ -89,7 +89,7 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   GHashTable *schedule_pads;
   GstSchedulePad *schedule_pad;
   GstSchedulePad *schedule_pad_new;
-  GString *time_string = NULL;
+  gchar *time_string;
   gchar pad_name[PAD_NAME_SIZE];
   guint64 time_diff;
 
@@ -99,7 +99,6 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   self = GST_SCHEDULETIME_TRACER (tracer);
   schedule_pads = self->schedule_pads;
 
-  g_snprintf (pad_name, PAD_NAME_SIZE, "%s_%s", GST_DEBUG_PAD_NAME (pad));
   schedule_pad = (GstSchedulePad *) g_hash_table_lookup (schedule_pads, pad);
 
   if (NULL == schedule_pad) {
@@ -115,15 +114,17 @@ sched_time_compute (GstTracer * tracer, guint64 ts, GstPad * pad)
   }
 
   if (schedule_pad->previous_time != 0) {
-    time_string = g_string_new ("");
+    gst_shark_tracer_pad_name (pad, '_', pad_name, PAD_NAME_SIZE);
     time_diff = GST_CLOCK_DIFF (schedule_pad->previous_time, ts);
-    g_string_printf (time_string, "%" GST_TIME_FORMAT,
-        GST_TIME_ARGS (time_diff));
 
-    gst_tracer_record_log (tr_schedule, pad_name, time_string->str);
+    if (gst_shark_tracer_log_enabled ()) {
+      time_string =
+          g_strdup_printf ("%" GST_TIME_FORMAT, GST_TIME_ARGS (time_diff));
+      gst_tracer_record_log (tr_schedule, pad_name, time_string);
+      g_free (time_string);
+    }
 
     do_print_scheduling_event (SCHED_TIME_EVENT_ID, pad_name, time_diff);
-    g_string_free (time_string, TRUE);
   }
   schedule_pad->previous_time = ts;
 }
@@ -397,6 +397,51 @@ gst_shark_tracer_register_hook (GstSharkTracer * self, const gchar * detail,
   }
 }
 
+/* The tracer records are only printed with GST_TRACER at TRACE level, the
+   strings they take don't need to be formatted otherwise */
+gboolean
+gst_shark_tracer_log_enabled (void)
+{
+#ifndef GST_DISABLE_GST_DEBUG
+  static GstDebugCategory *tracer_category = NULL;
+
+  if (G_UNLIKELY (NULL == tracer_category)) {
+    GST_DEBUG_CATEGORY_GET (tracer_category, "GST_TRACER");
+  }
+
+  return NULL != tracer_category
+      && gst_debug_category_get_threshold (tracer_category) >= GST_LEVEL_TRACE;
+#else
+  return FALSE;
+#endif
+}
+
+/* Writes the name GST_DEBUG_PAD_NAME gives, parent and pad name joined by
+   separator, without going through printf or allocating */
+void
+gst_shark_tracer_pad_name (GstPad * pad, gchar separator, gchar * name,
+    gsize size)
+{
+  GstObject *parent;
+  const gchar *parent_name;
+  const gchar *pad_name;
+  gsize len;
+
+  g_return_if_fail (name);
+  g_return_if_fail (size > 0);
+
+  parent = (NULL != pad) ? GST_OBJECT_PARENT (pad) : NULL;
+  parent_name =
+      (NULL != parent) ? GST_STR_NULL (GST_OBJECT_NAME (parent)) : "''";
+  pad_name = (NULL != pad) ? GST_STR_NULL (GST_OBJECT_NAME (pad)) : "''";
+
+  len = g_strlcpy (name, parent_name, size);
+  if (len + 1 < size) {
+    name[len] = separator;
+    g_strlcpy (name + len + 1, pad_name, size - len - 1);
+  }
+}
+
 /* My hooks */
 static void
 gst_shark_tracer_hook_pad_push_pre (GObject * object, GstClockTime ts,
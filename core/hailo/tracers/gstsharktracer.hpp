@@ -38,4 +38,8 @@ GList * gst_shark_tracer_get_param (GstSharkTracer *self, const gchar *param);
 void gst_shark_tracer_register_hook (GstSharkTracer *self, const gchar *detail,
     GCallback func);
 
+gboolean gst_shark_tracer_log_enabled (void);
+void gst_shark_tracer_pad_name (GstPad *pad, gchar separator, gchar *name,
+    gsize size);
+
 G_END_DECLS
\ No newline at end of file
@@ -9,32 +9,64 @@
 #include "hailo_tracker.hpp"
 #include "hailo_common.hpp"
 
-std::mutex HailoTracker::mutex_;
+std::shared_mutex HailoTracker::mutex_;
 
 class HailoTracker::HailoTrackerPrivate
 {
 public:
-    std::map<std::string, JDETracker> trackers;
+    // A tracker and the lock that serializes its updates.
+    struct TrackerEntry
+    {
+        JDETracker tracker;
+        std::mutex mutex;
+
+        template <typename... Args>
+        TrackerEntry(Args &&...args) : tracker(std::forward<Args>(args)...) {}
+    };
+    std::map<std::string, TrackerEntry> trackers;
+
+    /**
+     * @brief Run func on the named tracker while holding the tracker's lock (a default tracker is created if missing).
+     *        The registry is only locked for writing when trackers are added or removed,
+     *        so different trackers (streams) can be updated concurrently.
+     */
+    template <typename Func>
+    auto with_tracker(std::shared_mutex &registry_mutex, const std::string &name, Func func)
+    {
+        {
+            std::shared_lock<std::shared_mutex> registry_lock(registry_mutex);
+            auto it = trackers.find(name);
+            if (it != trackers.end())
+            {
+                std::lock_guard<std::mutex> lock(it->second.mutex);
+                return func(it->second.tracker);
+            }
+        }
+        std::unique_lock<std::shared_mutex> registry_lock(registry_mutex);
+        TrackerEntry &entry = trackers.try_emplace(name).first->second;
+        std::lock_guard<std::mutex> lock(entry.mutex);
+        return func(entry.tracker);
+    }
 };
 
 HailoTracker::HailoTracker() : priv(std::make_unique<HailoTrackerPrivate>()){};
 HailoTracker::~HailoTracker(){};
 HailoTracker &HailoTracker::GetInstance()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // Initialization of a function local static is thread safe.
     static HailoTracker instance;
     return instance;
 }
 
 void HailoTracker::remove_jde_tracker(const std::string &name)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
     priv->trackers.erase(name);
 }
 
 void HailoTracker::add_jde_tracker(const std::string &name, HailoTrackerParams tracker_params)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_lock<std::shared_mutex> lock(mutex_);
 
     priv->trackers.emplace(std::piecewise_construct, std::forward_as_tuple(name),
                            std::forward_as_tuple(tracker_params.kalman_distance,
@@ -54,119 +86,122 @@ void HailoTracker::add_jde_tracker(const std::string &name, HailoTrackerParams t
 
 void HailoTracker::add_jde_tracker(const std::string &name)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers.emplace(name, JDETracker());
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    priv->trackers.try_emplace(name);
 }
 
 std::vector<HailoDetectionPtr> HailoTracker::update(const std::string &name, std::vector<HailoDetectionPtr> &inputs)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto online_stracks = priv->trackers[name].update(inputs);
-    bool debug = priv->trackers[name].get_debug();
-    return JDETracker::stracks_to_hailo_detections(online_stracks, debug);
+    return priv->with_tracker(mutex_, name, [&inputs](JDETracker &tracker)
+                              {
+                                  auto online_stracks = tracker.update(inputs);
+                                  return JDETracker::stracks_to_hailo_detections(online_stracks, tracker.get_debug()); });
 }
 
 void HailoTracker::add_object_to_track(const std::string &name, int track_id, HailoObjectPtr obj)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    STrack *tracked_detection = priv->trackers[name].get_detection_with_id(track_id);
-    if (nullptr != tracked_detection)
-    {
-        tracked_detection->add_object(obj);
-    }
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       {
+                           STrack *tracked_detection = tracker.get_detection_with_id(track_id);
+                           if (nullptr != tracked_detection)
+                           {
+                               tracked_detection->add_object(obj);
+                           } });
 }
 
 void HailoTracker::remove_matrices_from_track(const std::string &name, int track_id)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    STrack *tracked_detection = priv->trackers[name].get_detection_with_id(track_id);
-    if (tracked_detection)
-    {
-        std::vector<HailoObjectPtr> matrices;
-        auto detection = tracked_detection->get_hailo_detection();
-        for (auto obj : detection->get_objects_typed(HAILO_MATRIX))
-        {
-            HailoMatrixPtr matrix = std::dynamic_pointer_cast<HailoMatrix>(obj);
-            matrices.push_back(matrix);
-        }
-        hailo_common::remove_objects(detection, matrices);
-    }
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       {
+                           STrack *tracked_detection = tracker.get_detection_with_id(track_id);
+                           if (tracked_detection)
+                           {
+                               std::vector<HailoObjectPtr> matrices;
+                               auto detection = tracked_detection->get_hailo_detection();
+                               for (auto obj : detection->get_objects_typed(HAILO_MATRIX))
+                               {
+                                   HailoMatrixPtr matrix = std::dynamic_pointer_cast<HailoMatrix>(obj);
+                                   matrices.push_back(matrix);
+                               }
+                               hailo_common::remove_objects(detection, matrices);
+                           } });
 }
 
 void HailoTracker::remove_classifications_from_track(const std::string &name, int track_id, std::string classifier_type)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    STrack *tracked_detection = priv->trackers[name].get_detection_with_id(track_id);
-    if (tracked_detection)
-    {
-        hailo_common::remove_classifications(tracked_detection->get_hailo_detection(), classifier_type);
-    }
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       {
+                           STrack *tracked_detection = tracker.get_detection_with_id(track_id);
+                           if (tracked_detection)
+                           {
+                               hailo_common::remove_classifications(tracked_detection->get_hailo_detection(), classifier_type);
+                           } });
 }
 
 // Setters for members accessible at element-property level
 void HailoTracker::set_kalman_distance(const std::string &name, float new_distance)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_kalman_distance(new_distance);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_kalman_distance(new_distance); });
 }
 void HailoTracker::set_iou_threshold(const std::string &name, float new_iou_thr)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_iou_threshold(new_iou_thr);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_iou_threshold(new_iou_thr); });
 }
 void HailoTracker::set_init_iou_threshold(const std::string &name, float new_init_iou_thr)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_init_iou_threshold(new_init_iou_thr);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_init_iou_threshold(new_init_iou_thr); });
 }
 void HailoTracker::set_keep_tracked_frames(const std::string &name, int new_keep_tracked)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_keep_tracked_frames(new_keep_tracked);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_keep_tracked_frames(new_keep_tracked); });
 }
 void HailoTracker::set_keep_new_frames(const std::string &name, int new_keep_new)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_keep_new_frames(new_keep_new);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_keep_new_frames(new_keep_new); });
 }
 void HailoTracker::set_keep_lost_frames(const std::string &name, int new_keep_lost)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_keep_lost_frames(new_keep_lost);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_keep_lost_frames(new_keep_lost); });
 }
 void HailoTracker::set_keep_past_metadata(const std::string &name, bool new_keep_past)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_keep_past_metadata(new_keep_past);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_keep_past_metadata(new_keep_past); });
 }
 void HailoTracker::set_std_weight_position(const std::string &name, float new_std_weight_pos)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_std_weight_position(new_std_weight_pos);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_std_weight_position(new_std_weight_pos); });
 }
 void HailoTracker::set_std_weight_position_box(const std::string &name, float new_std_weight_position_box)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_std_weight_position_box(new_std_weight_position_box);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_std_weight_position_box(new_std_weight_position_box); });
 }
 void HailoTracker::set_std_weight_velocity(const std::string &name, float new_std_weight_vel)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_std_weight_velocity(new_std_weight_vel);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_std_weight_velocity(new_std_weight_vel); });
 }
 void HailoTracker::set_std_weight_velocity_box(const std::string &name, float new_std_weight_velocity_box)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_std_weight_velocity_box(new_std_weight_velocity_box);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_std_weight_velocity_box(new_std_weight_velocity_box); });
 }
 void HailoTracker::set_debug(const std::string &name, bool new_debug)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_debug(new_debug);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_debug(new_debug); });
 }
 
 void HailoTracker::set_hailo_objects_blacklist(const std::string &name, std::vector<hailo_object_t> hailo_objects_blacklist_vec)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    priv->trackers[name].set_hailo_objects_blacklist(hailo_objects_blacklist_vec);
+    priv->with_tracker(mutex_, name, [&](JDETracker &tracker)
+                       { tracker.set_hailo_objects_blacklist(hailo_objects_blacklist_vec); });
 }
\ No newline at end of file
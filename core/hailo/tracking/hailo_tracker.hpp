@@ -8,6 +8,7 @@
 #include <iostream>
 #include <vector>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 #include <map>
 
@@ -54,7 +55,7 @@ private:
     HailoTracker &operator=(const HailoTracker &) = delete;
     ~HailoTracker();
     HailoTracker();
-    static std::mutex mutex_;
+    static std::shared_mutex mutex_; // Guards the trackers registry, every tracker has its own lock
 
 public:
     static HailoTracker &GetInstance();
@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/*
+  A contiguous row-major cost matrix for the JDE Tracker's association steps,
+  and the batched kernels that fill it (iou distance and embedding distance).
+  Rows are tracks and columns are detections.
+*/
+
+#pragma once
+
+// General cpp includes
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+class CostMatrix
+{
+private:
+    int m_rows = 0;
+    int m_cols = 0;
+    std::vector<float> m_data;
+
+public:
+    CostMatrix() = default;
+    CostMatrix(int rows, int cols, float value = 0.0f) { resize(rows, cols, value); }
+
+    /**
+     * @brief Reshape the matrix, reusing the existing storage when possible.
+     *        All elements are set to value.
+     */
+    void resize(int rows, int cols, float value = 0.0f)
+    {
+        m_rows = rows;
+        m_cols = cols;
+        m_data.assign((size_t)rows * cols, value);
+    }
+
+    void clear()
+    {
+        m_rows = 0;
+        m_cols = 0;
+        m_data.clear();
+    }
+
+    int rows() const { return m_rows; }
+    int cols() const { return m_cols; }
+    bool empty() const { return m_data.empty(); }
+
+    float *data() { return m_data.data(); }
+    const float *data() const { return m_data.data(); }
+    float *row(int i) { return m_data.data() + (size_t)i * m_cols; }
+    const float *row(int i) const { return m_data.data() + (size_t)i * m_cols; }
+    float &operator()(int i, int j) { return m_data[(size_t)i * m_cols + j]; }
+    float operator()(int i, int j) const { return m_data[(size_t)i * m_cols + j]; }
+};
+
+/**
+ * @brief Bounding boxes in structure-of-arrays layout, so a whole set of
+ *        boxes can be processed a SIMD register at a time.
+ */
+struct BoxesSoA
+{
+    std::vector<float> xmin, ymin, xmax, ymax, area;
+
+    void reserve(size_t count)
+    {
+        xmin.reserve(count);
+        ymin.reserve(count);
+        xmax.reserve(count);
+        ymax.reserve(count);
+        area.reserve(count);
+    }
+
+    /**
+     * @brief Add a box given as tlwh (xmin,ymin,width,height).
+     */
+    void push_tlwh(const std::vector<float> &tlwh)
+    {
+        float x1 = tlwh[0], y1 = tlwh[1];
+        float x2 = tlwh[0] + tlwh[2], y2 = tlwh[1] + tlwh[3];
+        xmin.push_back(x1);
+        ymin.push_back(y1);
+        xmax.push_back(x2);
+        ymax.push_back(y2);
+        area.push_back((x2 - x1) * (y2 - y1));
+    }
+
+    size_t size() const { return xmin.size(); }
+};
+
+/**
+ * @brief Fill a cost matrix with the iou distances (1 - iou) between two sets of boxes.
+ *        Each row is computed against all the columns at once, 4 boxes per instruction
+ *        with SSE2/NEON.
+ *
+ * @param a  -  BoxesSoA
+ *        Row boxes.
+ *
+ * @param b  -  BoxesSoA
+ *        Column boxes.
+ *
+ * @param cost_matrix  -  CostMatrix
+ *        Output, resized to a.size() x b.size().
+ *        For interpreting distances - 1 is far, 0 is close
+ */
+inline void iou_distance_matrix(const BoxesSoA &a, const BoxesSoA &b, CostMatrix &cost_matrix)
+{
+    const int rows = a.size();
+    const int cols = b.size();
+    cost_matrix.resize(rows, cols);
+    for (int i = 0; i < rows; i++)
+    {
+        float *out = cost_matrix.row(i);
+        int j = 0;
+#if defined(__SSE2__)
+        const __m128 ax1 = _mm_set1_ps(a.xmin[i]), ay1 = _mm_set1_ps(a.ymin[i]);
+        const __m128 ax2 = _mm_set1_ps(a.xmax[i]), ay2 = _mm_set1_ps(a.ymax[i]);
+        const __m128 aarea = _mm_set1_ps(a.area[i]);
+        const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+        for (; j + 4 <= cols; j += 4)
+        {
+            __m128 iw = _mm_sub_ps(_mm_min_ps(ax2, _mm_loadu_ps(&b.xmax[j])), _mm_max_ps(ax1, _mm_loadu_ps(&b.xmin[j])));
+            __m128 ih = _mm_sub_ps(_mm_min_ps(ay2, _mm_loadu_ps(&b.ymax[j])), _mm_max_ps(ay1, _mm_loadu_ps(&b.ymin[j])));
+            __m128 overlap = _mm_and_ps(_mm_cmpgt_ps(iw, zero), _mm_cmpgt_ps(ih, zero));
+            __m128 inter = _mm_mul_ps(iw, ih);
+            __m128 uni = _mm_sub_ps(_mm_add_ps(aarea, _mm_loadu_ps(&b.area[j])), inter);
+            __m128 iou = _mm_and_ps(overlap, _mm_div_ps(inter, uni));
+            _mm_storeu_ps(out + j, _mm_sub_ps(one, iou));
+        }
+#elif defined(__aarch64__)
+        const float32x4_t ax1 = vdupq_n_f32(a.xmin[i]), ay1 = vdupq_n_f32(a.ymin[i]);
+        const float32x4_t ax2 = vdupq_n_f32(a.xmax[i]), ay2 = vdupq_n_f32(a.ymax[i]);
+        const float32x4_t aarea = vdupq_n_f32(a.area[i]);
+        const float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+        for (; j + 4 <= cols; j += 4)
+        {
+            float32x4_t iw = vsubq_f32(vminq_f32(ax2, vld1q_f32(&b.xmax[j])), vmaxq_f32(ax1, vld1q_f32(&b.xmin[j])));
+            float32x4_t ih = vsubq_f32(vminq_f32(ay2, vld1q_f32(&b.ymax[j])), vmaxq_f32(ay1, vld1q_f32(&b.ymin[j])));
+            uint32x4_t overlap = vandq_u32(vcgtq_f32(iw, zero), vcgtq_f32(ih, zero));
+            float32x4_t inter = vmulq_f32(iw, ih);
+            float32x4_t uni = vsubq_f32(vaddq_f32(aarea, vld1q_f32(&b.area[j])), inter);
+            float32x4_t iou = vbslq_f32(overlap, vdivq_f32(inter, uni), zero);
+            vst1q_f32(out + j, vsubq_f32(one, iou));
+        }
+#endif
+        for (; j < cols; j++)
+        {
+            float iou = 0.0f;
+            float iw = std::min(a.xmax[i], b.xmax[j]) - std::max(a.xmin[i], b.xmin[j]);
+            float ih = std::min(a.ymax[i], b.ymax[j]) - std::max(a.ymin[i], b.ymin[j]);
+            if (iw > 0.0f && ih > 0.0f)
+                iou = iw * ih / (a.area[i] + b.area[j] - iw * ih);
+            out[j] = 1.0f - iou;
+        }
+    }
+}
+
+/**
+ * @brief y[0:n] += alpha * x[0:n], the inner step of embedding_distance_matrix.
+ */
+inline void cost_matrix_axpy(float alpha, const float *x, float *y, int n)
+{
+    int j = 0;
+#if defined(__SSE2__)
+    const __m128 a = _mm_set1_ps(alpha);
+    for (; j + 4 <= n; j += 4)
+        _mm_storeu_ps(y + j, _mm_add_ps(_mm_loadu_ps(y + j), _mm_mul_ps(a, _mm_loadu_ps(x + j))));
+#elif defined(__aarch64__)
+    const float32x4_t a = vdupq_n_f32(alpha);
+    for (; j + 4 <= n; j += 4)
+        vst1q_f32(y + j, vfmaq_f32(vld1q_f32(y + j), a, vld1q_f32(x + j)));
+#endif
+    for (; j < n; j++)
+        y[j] += alpha * x[j];
+}
+
+/**
+ * @brief Fill a cost matrix with the euclidean distances between two sets of feature vectors.
+ *        The distances are expanded as ||a||^2 + ||b||^2 - 2<a,b>, so the whole matrix is a
+ *        single (rows x dim) * (dim x cols) product instead of rows * cols separate loops.
+ *        For the L2 normalized tracker features this is sqrt(2 - 2 * cosine similarity).
+ *
+ * @param a_features  -  const float *
+ *        Row features, rows x dim, row-major.
+ *
+ * @param b_features_t  -  const float *
+ *        Column features, transposed: dim x cols, row-major.
+ *
+ * @param rows  -  int
+ * @param cols  -  int
+ * @param dim  -  int
+ *
+ * @param cost_matrix  -  CostMatrix
+ *        Output, resized to rows x cols.
+ */
+inline void embedding_distance_matrix(const float *a_features, const float *b_features_t,
+                                      int rows, int cols, int dim, CostMatrix &cost_matrix)
+{
+    cost_matrix.resize(rows, cols);
+
+    std::vector<float> b_norms(cols, 0.0f);
+    for (int k = 0; k < dim; k++)
+    {
+        const float *b_row = b_features_t + (size_t)k * cols;
+        for (int j = 0; j < cols; j++)
+            b_norms[j] += b_row[j] * b_row[j];
+    }
+
+    for (int i = 0; i < rows; i++)
+    {
+        const float *a_row = a_features + (size_t)i * dim;
+        float *out = cost_matrix.row(i);
+        float a_norm = 0.0f;
+        // Broadcast one track value against a contiguous row of all the detections
+        for (int k = 0; k < dim; k++)
+        {
+            a_norm += a_row[k] * a_row[k];
+            if (a_row[k] != 0.0f)
+                cost_matrix_axpy(a_row[k], b_features_t + (size_t)k * cols, out, cols);
+        }
+        for (int j = 0; j < cols; j++)
+            out[j] = std::sqrt(std::max(0.0f, a_norm + b_norms[j] - 2.0f * out[j]));
+    }
+}
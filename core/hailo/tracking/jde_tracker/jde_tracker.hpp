@@ -19,6 +19,7 @@
 // Tappas includes
 #include "hailo_objects.hpp"
 #include "kalman_filter.hpp"
+#include "cost_matrix.hpp"
 #include "lapjv.hpp"
 #include "strack.hpp"
 #include "tracker_macros.hpp"
@@ -57,6 +58,9 @@ private:
     KalmanFilter m_kalman_filter;                          // Kalman Filter
     std::vector<hailo_object_t> m_hailo_objects_blacklist; // Objects that will never be kept track of
 
+    std::vector<float> m_track_features;     // Packed track features scratch for embedding_distance, reused across frames
+    std::vector<float> m_detection_features; // Packed (transposed) detection features scratch for embedding_distance
+
     //******************************************************************
     // CLASS RESOURCE MANAGEMENT
     //******************************************************************
@@ -128,10 +132,10 @@ public:
 private:
     void update_unmatches(std::vector<STrack *> strack_pool, std::vector<STrack> &tracked_stracks, std::vector<STrack> &lost_stracks, std::vector<STrack> &new_stracks);
     void update_matches(std::vector<std::pair<int, int>> matches, std::vector<STrack *> tracked_stracks, std::vector<STrack> &detections, std::vector<STrack> &activated_stracks);
-    void linear_assignment(std::vector<std::vector<float>> &cost_matrix, int cost_matrix_rows, int cost_matrix_cols, float thresh, std::vector<std::pair<int, int>> &matches, std::vector<int> &unmatched_a, std::vector<int> &unmatched_b);
+    void linear_assignment(const CostMatrix &cost_matrix, int cost_matrix_rows, int cost_matrix_cols, float thresh, std::vector<std::pair<int, int>> &matches, std::vector<int> &unmatched_a, std::vector<int> &unmatched_b);
 
-    std::vector<std::vector<float>> iou_distance(std::vector<STrack *> &atracks, std::vector<STrack> &btracks);
-    std::vector<std::vector<float>> iou_distance(std::vector<STrack> &atracks, std::vector<STrack> &btracks);
+    void iou_distance(std::vector<STrack *> &atracks, std::vector<STrack> &btracks, CostMatrix &cost_matrix);
+    void iou_distance(std::vector<STrack> &atracks, std::vector<STrack> &btracks, CostMatrix &cost_matrix);
 
     std::vector<STrack *> joint_strack_pointers(std::vector<STrack *> &tlista, std::vector<STrack *> &tlistb);
     std::vector<STrack *> joint_strack_pointers(std::vector<STrack> &tlista, std::vector<STrack> &tlistb);
@@ -139,8 +143,8 @@ private:
     std::vector<STrack> sub_stracks(std::vector<STrack> &tlista, std::vector<STrack> &tlistb);
     void remove_duplicate_stracks(std::vector<STrack> &stracksa, std::vector<STrack> &stracksb);
 
-    void embedding_distance(std::vector<STrack *> &tracks, std::vector<STrack> &detections, std::vector<std::vector<float>> &cost_matrix);
-    void fuse_motion(std::vector<std::vector<float>> &cost_matrix, std::vector<STrack *> &tracks, std::vector<STrack> &detections, float lambda_);
+    void embedding_distance(std::vector<STrack *> &tracks, std::vector<STrack> &detections, CostMatrix &cost_matrix);
+    void fuse_motion(CostMatrix &cost_matrix, std::vector<STrack *> &tracks, std::vector<STrack> &detections, float lambda_);
 };
 __END_DECLS
 
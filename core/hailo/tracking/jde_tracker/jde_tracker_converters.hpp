@@ -88,7 +88,7 @@ inline std::vector<HailoDetectionPtr> JDETracker::stracks_to_hailo_detections(st
             // Strack tlwh is stored as top-left, width-height: xmin,ymin,width,height
             HailoBBox bbox(stracks[i].m_tlwh[0], stracks[i].m_tlwh[1], stracks[i].m_tlwh[2], stracks[i].m_tlwh[3]);
             // HailoDetection is constructed as HailoDetection(HailoBBox, label, confidence)
-            objects.emplace_back(std::make_shared<HailoDetection>(HailoDetection(bbox, "tracked", stracks[i].m_confidence)));
+            objects.emplace_back(hailo_make_shared<HailoDetection>(HailoDetection(bbox, "tracked", stracks[i].m_confidence)));
         }
     }
 
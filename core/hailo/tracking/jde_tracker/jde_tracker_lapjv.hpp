@@ -13,6 +13,7 @@
 #include <vector>
 
 // Tappas includes
+#include "cost_matrix.hpp"
 #include "lapjv.hpp"
 #include "strack.hpp"
 #include "tracker_macros.hpp"
@@ -22,8 +23,10 @@
  * @brief Performs linear assignment on a given cost matrix.
  *        No return is made, instead vectors are filled with
  *        matching indices for row and column items.
+ *        lapjv solves a square problem, so the (rows x cols) costs are written once
+ *        into a single contiguous (rows + cols) x (rows + cols) buffer, padded with cost_limit / 2.
  * 
- * @param cost  -  std::vector<std::vector<float>>
+ * @param cost  -  CostMatrix
  *        A 2D cost matrix of distances between 2 sets of objects
  *
  * @param rowsol  -  std::vector<int>
@@ -40,125 +43,68 @@
  * @param return_cost  -  bool
  *        If true, then return the total cost, default true.
  */
-inline double lapjv_external(const std::vector<std::vector<float>> &cost,
+inline double lapjv_external(const CostMatrix &cost,
                              std::vector<int> &rowsol,
                              std::vector<int> &colsol,
                              float cost_limit = LONG_MAX, bool return_cost = true)
 {
-    std::vector<std::vector<float>> cost_c;
-    cost_c.assign(cost.begin(), cost.end());
-
-    std::vector<std::vector<float>> cost_c_extended;
-
-    int n_rows = cost.size();
-    int n_cols = cost[0].size();
+    const int n_rows = cost.rows();
+    const int n_cols = cost.cols();
+    const int n = n_rows + n_cols;
     rowsol.resize(n_rows);
     colsol.resize(n_cols);
 
-    int n = 0;
-    if (n_rows == n_cols)
-    {
-        n = n_rows;
-    }
-
-    n = n_rows + n_cols;
-    cost_c_extended.resize(n);
-    for (uint i = 0; i < cost_c_extended.size(); i++) {
-        cost_c_extended[i].resize(n);
-    }
-
-    for (uint i = 0; i < cost_c_extended.size(); i++)
-    {
-        for (uint j = 0; j < cost_c_extended[i].size(); j++)
-        {
-            cost_c_extended[i][j] = cost_limit / 2.0;
-        }
-    }
-
-    for (uint i = n_rows; i < cost_c_extended.size(); i++)
+    // Extended matrix: [cost, limit/2; limit/2, 0]
+    std::vector<double> extended((size_t)n * n);
+    std::vector<double *> cost_ptr(n);
+    for (int i = 0; i < n; i++)
     {
-        for (uint j = n_cols; j < cost_c_extended[i].size(); j++)
+        double *row = extended.data() + (size_t)i * n;
+        cost_ptr[i] = row;
+        if (i < n_rows)
         {
-            cost_c_extended[i][j] = 0;
+            const float *cost_row = cost.row(i);
+            for (int j = 0; j < n_cols; j++)
+                row[j] = cost_row[j];
+            std::fill(row + n_cols, row + n, cost_limit / 2.0);
         }
-    }
-    for (int i = 0; i < n_rows; i++)
-    {
-        for (int j = 0; j < n_cols; j++)
+        else
         {
-            cost_c_extended[i][j] = cost_c[i][j];
+            std::fill(row, row + n_cols, cost_limit / 2.0);
+            std::fill(row + n_cols, row + n, 0.0);
         }
     }
 
-    cost_c.clear();
-    cost_c.assign(cost_c_extended.begin(), cost_c_extended.end());
+    std::vector<int> x_c(n);
+    std::vector<int> y_c(n);
 
-    double **cost_ptr;
-    cost_ptr = new double *[sizeof(double *) * n];
-    for (int i = 0; i < n; i++)
-        cost_ptr[i] = new double[sizeof(double) * n];
-
-    for (int i = 0; i < n; i++)
+    int ret = lapjv_internal(n, cost_ptr.data(), x_c.data(), y_c.data());
+    if (ret != 0)
     {
-        for (int j = 0; j < n; j++)
-        {
-            cost_ptr[i][j] = cost_c[i][j];
-        }
+        throw std::runtime_error("JDETracker error: incorrect lapjv calculation!");
     }
 
-    int x_c[n];
-    int y_c[n];
-
-    int ret = lapjv_internal(n, cost_ptr, x_c, y_c);
-    if (ret != 0)
+    for (int i = 0; i < n; i++)
     {
-        throw std::runtime_error("JDETracker error: incorrect lapjv calculation!");
+        if (x_c[i] >= n_cols)
+            x_c[i] = -1;
+        if (y_c[i] >= n_rows)
+            y_c[i] = -1;
     }
+    std::copy(x_c.begin(), x_c.begin() + n_rows, rowsol.begin());
+    std::copy(y_c.begin(), y_c.begin() + n_cols, colsol.begin());
 
     double opt = 0.0;
-
-    if (n != n_rows)
+    if (return_cost)
     {
-        for (int i = 0; i < n; i++)
-        {
-            if (x_c[i] >= n_cols)
-                x_c[i] = -1;
-            if (y_c[i] >= n_rows)
-                y_c[i] = -1;
-        }
         for (int i = 0; i < n_rows; i++)
         {
-            rowsol[i] = x_c[i];
-        }
-        for (int i = 0; i < n_cols; i++)
-        {
-            colsol[i] = y_c[i];
-        }
-
-        if (return_cost)
-        {
-            for (uint i = 0; i < rowsol.size(); i++)
+            if (rowsol[i] != -1)
             {
-                if (rowsol[i] != -1)
-                {
-                    opt += cost_ptr[i][rowsol[i]];
-                }
+                opt += cost_ptr[i][rowsol[i]];
             }
         }
     }
-    else if (return_cost)
-    {
-        for (uint i = 0; i < rowsol.size(); i++)
-        {
-            opt += cost_ptr[i][rowsol[i]];
-        }
-    }
-
-    for (int i = 0; i < n; i++)
-    {
-        delete[] cost_ptr[i];
-    }
-    delete[] cost_ptr;
 
     return opt;
 }
@@ -169,7 +115,7 @@ inline double lapjv_external(const std::vector<std::vector<float>> &cost,
  *        No return is made, instead a given matrix of matches is filled,
  *        and vectors are filled for unmatched members of each list.
  * 
- * @param cost_matrix  -  std::vector<std::vector<float>>
+ * @param cost_matrix  -  CostMatrix
  *        A 2D cost matrix of distances between 2 sets of objects
  *
  * @param thresh  -  float
@@ -184,7 +130,7 @@ inline double lapjv_external(const std::vector<std::vector<float>> &cost,
  * @param unmatched_b  - std::vector<int>
  *        Indices of unmatched objects from the column items
  */
-inline void JDETracker::linear_assignment(std::vector<std::vector<float>> &cost_matrix,
+inline void JDETracker::linear_assignment(const CostMatrix &cost_matrix,
                                           int cost_matrix_rows,
                                           int cost_matrix_cols,
                                           float thresh,
@@ -197,7 +143,7 @@ inline void JDETracker::linear_assignment(std::vector<std::vector<float>> &cost_
     unmatched_a.clear();
     unmatched_b.clear();
 
-	if (cost_matrix.size() == 0)
+	if (cost_matrix.empty())
 	{
 		for (int i = 0; i < cost_matrix_rows; i++)
 		{
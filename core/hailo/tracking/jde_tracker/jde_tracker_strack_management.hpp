@@ -165,13 +165,14 @@ inline std::vector<STrack> JDETracker::sub_stracks(std::vector<STrack> &tlista,
 inline void JDETracker::remove_duplicate_stracks(std::vector<STrack> &stracksa, std::vector<STrack> &stracksb)
 {
     std::vector<STrack> resa, resb;
-    std::vector<std::vector<float>> pdist = iou_distance(stracksa, stracksb);
+    CostMatrix pdist;
+    iou_distance(stracksa, stracksb, pdist);
     std::vector<std::pair<int, int>> pairs;
-    for (uint i = 0; i < pdist.size(); i++)
+    for (int i = 0; i < pdist.rows(); i++)
     {
-        for (uint j = 0; j < pdist[i].size(); j++)
+        for (int j = 0; j < pdist.cols(); j++)
         {
-            if (pdist[i][j] < IOU_THRESHOLD)
+            if (pdist(i, j) < IOU_THRESHOLD)
             {
                 pairs.push_back(std::pair<int, int>(i, j));
             }
@@ -0,0 +1,329 @@
+/**
+ * Copyright (c) 2021-2022 Hailo Technologies Ltd. All rights reserved.
+ * Distributed under the LGPL license (https://www.gnu.org/licenses/old-licenses/lgpl-2.1.txt)
+ **/
+/*
+  Fixed size kernels for the 8-state / 4-measurement Kalman filter (see kalman_filter.hpp).
+  All matrices are row-major float arrays that live on the stack (or inside the
+  xtensor_fixed members of an STrack), nothing here allocates.
+
+  The filter's matrices are never multiplied explicitly:
+      motion matrix F = [I I; 0 I] (constant velocity, dt = 1)
+      update matrix H = [I 0]      (x, y, a, h are observed directly)
+  so F P F^T is a couple of row/column additions and H P H^T is the top-left 4x4 block.
+ */
+
+#pragma once
+
+// General cpp includes
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace kalman
+{
+    constexpr int STATE_DIM = 8;
+    constexpr int MEASURE_DIM = 4;
+
+    /**
+     * @brief Standard deviation weights of the filter, per state element.
+     */
+    struct NoiseWeights
+    {
+        float position;     // x, y
+        float position_box; // a, h
+        float velocity;     // vx, vy
+        float velocity_box; // va, vh
+
+        float state(int k) const
+        {
+            switch (k % MEASURE_DIM)
+            {
+            case 0:
+            case 1:
+                return k < MEASURE_DIM ? position : velocity;
+            default:
+                return k < MEASURE_DIM ? position_box : velocity_box;
+            }
+        }
+    };
+
+    /**
+     * @brief Closed form LL^T Cholesky decomposition of a symmetric positive definite 4x4 matrix.
+     *        Only the lower triangle of A is read, the upper triangle of L is zeroed.
+     *
+     * @param A  -  const float[16]
+     * @param L  -  float[16]
+     */
+    inline void cholesky_4x4(const float *A, float *L)
+    {
+        float l00 = std::sqrt(A[0]);
+        float l10 = A[4] / l00;
+        float l20 = A[8] / l00;
+        float l30 = A[12] / l00;
+        float l11 = std::sqrt(A[5] - l10 * l10);
+        float l21 = (A[9] - l20 * l10) / l11;
+        float l31 = (A[13] - l30 * l10) / l11;
+        float l22 = std::sqrt(A[10] - (l20 * l20 + l21 * l21));
+        float l32 = (A[14] - (l30 * l20 + l31 * l21)) / l22;
+        float l33 = std::sqrt(A[15] - (l30 * l30 + l31 * l31 + l32 * l32));
+
+        L[0] = l00, L[1] = 0.0f, L[2] = 0.0f, L[3] = 0.0f;
+        L[4] = l10, L[5] = l11, L[6] = 0.0f, L[7] = 0.0f;
+        L[8] = l20, L[9] = l21, L[10] = l22, L[11] = 0.0f;
+        L[12] = l30, L[13] = l31, L[14] = l32, L[15] = l33;
+    }
+
+    /**
+     * @brief Solve Lx = b in place (forward substitution), L lower triangular 4x4.
+     */
+    inline void forward_substitution_4(const float *L, float *b)
+    {
+        b[0] = b[0] / L[0];
+        b[1] = (b[1] - L[4] * b[0]) / L[5];
+        b[2] = (b[2] - (L[8] * b[0] + L[9] * b[1])) / L[10];
+        b[3] = (b[3] - (L[12] * b[0] + L[13] * b[1] + L[14] * b[2])) / L[15];
+    }
+
+    /**
+     * @brief Solve L^T x = b in place (back substitution), L lower triangular 4x4.
+     */
+    inline void back_substitution_4(const float *L, float *b)
+    {
+        b[3] = b[3] / L[15];
+        b[2] = (b[2] - L[14] * b[3]) / L[10];
+        b[1] = (b[1] - (L[13] * b[3] + L[9] * b[2])) / L[5];
+        b[0] = (b[0] - (L[12] * b[3] + L[8] * b[2] + L[4] * b[1])) / L[0];
+    }
+
+    /**
+     * @brief Prediction step: mean = F mean, P = F P F^T + Q.
+     *
+     * @param mean  -  float[8]
+     * @param P  -  float[64]
+     * @param weights  -  NoiseWeights
+     */
+    inline void predict(float *mean, float *P, const NoiseWeights &weights)
+    {
+        const float height = mean[3];
+        // P F^T: columns 0-3 gain columns 4-7
+        for (int i = 0; i < STATE_DIM; i++)
+            for (int j = 0; j < MEASURE_DIM; j++)
+                P[i * STATE_DIM + j] += P[i * STATE_DIM + j + MEASURE_DIM];
+        // F (P F^T): rows 0-3 gain rows 4-7
+        for (int i = 0; i < MEASURE_DIM; i++)
+            for (int j = 0; j < STATE_DIM; j++)
+                P[i * STATE_DIM + j] += P[(i + MEASURE_DIM) * STATE_DIM + j];
+        for (int k = 0; k < STATE_DIM; k++)
+        {
+            float std = weights.state(k) * height;
+            P[k * STATE_DIM + k] += std * std;
+        }
+        for (int i = 0; i < MEASURE_DIM; i++)
+            mean[i] += mean[i + MEASURE_DIM];
+    }
+
+    /**
+     * @brief Project the state to measurement space: H mean, H P H^T + R.
+     *
+     * @param mean  -  const float[8]
+     * @param P  -  const float[64]
+     * @param weights  -  NoiseWeights
+     * @param projected_mean  -  float[4]
+     * @param projected_covariance  -  float[16]
+     */
+    inline void project(const float *mean, const float *P, const NoiseWeights &weights,
+                        float *projected_mean, float *projected_covariance)
+    {
+        const float height = mean[3];
+        for (int i = 0; i < MEASURE_DIM; i++)
+        {
+            projected_mean[i] = mean[i];
+            for (int j = 0; j < MEASURE_DIM; j++)
+                projected_covariance[i * MEASURE_DIM + j] = P[i * STATE_DIM + j];
+            float std = weights.state(i) * height;
+            projected_covariance[i * MEASURE_DIM + i] += std * std;
+        }
+    }
+
+    /**
+     * @brief Correction step with a (x, y, a, h) measurement, mean and P are updated in place.
+     *
+     * @param mean  -  float[8]
+     * @param P  -  float[64]
+     * @param measurement  -  const float[4]
+     * @param weights  -  NoiseWeights
+     */
+    inline void update(float *mean, float *P, const float *measurement, const NoiseWeights &weights)
+    {
+        float projected_mean[MEASURE_DIM];
+        float S[MEASURE_DIM * MEASURE_DIM];
+        float L[MEASURE_DIM * MEASURE_DIM];
+        project(mean, P, weights, projected_mean, S);
+        cholesky_4x4(S, L);
+
+        // Kalman gain, transposed: K^T = S^-1 (P H^T)^T, solved column by column
+        float KT[MEASURE_DIM * STATE_DIM];
+        for (int c = 0; c < STATE_DIM; c++)
+        {
+            float column[MEASURE_DIM];
+            for (int r = 0; r < MEASURE_DIM; r++)
+                column[r] = P[c * STATE_DIM + r];
+            forward_substitution_4(L, column);
+            back_substitution_4(L, column);
+            for (int r = 0; r < MEASURE_DIM; r++)
+                KT[r * STATE_DIM + c] = column[r];
+        }
+
+        float innovation[MEASURE_DIM];
+        for (int i = 0; i < MEASURE_DIM; i++)
+            innovation[i] = measurement[i] - projected_mean[i];
+
+        // S K^T
+        float SKT[MEASURE_DIM * STATE_DIM];
+        for (int i = 0; i < MEASURE_DIM; i++)
+        {
+            for (int j = 0; j < STATE_DIM; j++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < MEASURE_DIM; k++)
+                    sum += S[i * MEASURE_DIM + k] * KT[k * STATE_DIM + j];
+                SKT[i * STATE_DIM + j] = sum;
+            }
+        }
+
+        // mean += K innovation, P -= K S K^T
+        for (int i = 0; i < STATE_DIM; i++)
+        {
+            float correction = 0.0f;
+            for (int k = 0; k < MEASURE_DIM; k++)
+                correction += innovation[k] * KT[k * STATE_DIM + i];
+            mean[i] += correction;
+            for (int j = 0; j < STATE_DIM; j++)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < MEASURE_DIM; k++)
+                    sum += KT[k * STATE_DIM + i] * SKT[k * STATE_DIM + j];
+                P[i * STATE_DIM + j] -= sum;
+            }
+        }
+    }
+
+    /**
+     * @brief Squared Mahalanobis distances between a state and a set of measurements.
+     *
+     * @param mean  -  const float[8]
+     * @param P  -  const float[64]
+     * @param weights  -  NoiseWeights
+     * @param measurements  -  const float *
+     *        count measurements of (x, y, a, h), packed.
+     * @param count  -  size_t
+     * @param distances  -  float *
+     *        Output, count distances.
+     */
+    inline void gating_distance(const float *mean, const float *P, const NoiseWeights &weights,
+                                const float *measurements, std::size_t count, float *distances)
+    {
+        float projected_mean[MEASURE_DIM];
+        float S[MEASURE_DIM * MEASURE_DIM];
+        float L[MEASURE_DIM * MEASURE_DIM];
+        project(mean, P, weights, projected_mean, S);
+        cholesky_4x4(S, L);
+
+        for (std::size_t n = 0; n < count; n++)
+        {
+            float d[MEASURE_DIM];
+            for (int i = 0; i < MEASURE_DIM; i++)
+                d[i] = measurements[n * MEASURE_DIM + i] - projected_mean[i];
+            forward_substitution_4(L, d);
+            distances[n] = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + d[3] * d[3];
+        }
+    }
+
+    /**
+     * @brief The states of many tracks in structure-of-arrays layout:
+     *        element k of track t is stored at [k * count + t], so every
+     *        step of the prediction is a contiguous loop over all the tracks.
+     *        Worth it for states that are kept in this layout, gathering the states
+     *        of individual STracks into a batch costs more than the prediction itself.
+     */
+    struct StateBatch
+    {
+        std::size_t count = 0;
+        std::vector<float> mean;       // STATE_DIM x count
+        std::vector<float> covariance; // STATE_DIM * STATE_DIM x count
+
+        // Resizing keeps the capacity, so a batch reused across frames stops allocating.
+        void resize(std::size_t tracks)
+        {
+            count = tracks;
+            mean.resize(STATE_DIM * tracks);
+            covariance.resize(STATE_DIM * STATE_DIM * tracks);
+        }
+
+        void store(std::size_t t, const float *track_mean, const float *track_covariance)
+        {
+            for (int k = 0; k < STATE_DIM; k++)
+                mean[k * count + t] = track_mean[k];
+            for (int k = 0; k < STATE_DIM * STATE_DIM; k++)
+                covariance[k * count + t] = track_covariance[k];
+        }
+
+        void load(std::size_t t, float *track_mean, float *track_covariance) const
+        {
+            for (int k = 0; k < STATE_DIM; k++)
+                track_mean[k] = mean[k * count + t];
+            for (int k = 0; k < STATE_DIM * STATE_DIM; k++)
+                track_covariance[k] = covariance[k * count + t];
+        }
+    };
+
+    /**
+     * @brief Prediction step over a whole batch, same arithmetic as predict().
+     */
+    inline void predict(StateBatch &batch, const NoiseWeights &weights)
+    {
+        const std::size_t n = batch.count;
+        float *mean = batch.mean.data();
+        float *P = batch.covariance.data();
+        const float *height = mean + 3 * n;
+
+        for (int i = 0; i < STATE_DIM; i++)
+        {
+            for (int j = 0; j < MEASURE_DIM; j++)
+            {
+                float *dst = P + (i * STATE_DIM + j) * n;
+                const float *src = P + (i * STATE_DIM + j + MEASURE_DIM) * n;
+                for (std::size_t t = 0; t < n; t++)
+                    dst[t] += src[t];
+            }
+        }
+        for (int i = 0; i < MEASURE_DIM; i++)
+        {
+            for (int j = 0; j < STATE_DIM; j++)
+            {
+                float *dst = P + (i * STATE_DIM + j) * n;
+                const float *src = P + ((i + MEASURE_DIM) * STATE_DIM + j) * n;
+                for (std::size_t t = 0; t < n; t++)
+                    dst[t] += src[t];
+            }
+        }
+        for (int k = 0; k < STATE_DIM; k++)
+        {
+            const float weight = weights.state(k);
+            float *dst = P + (k * STATE_DIM + k) * n;
+            for (std::size_t t = 0; t < n; t++)
+            {
+                float std = weight * height[t];
+                dst[t] += std * std;
+            }
+        }
+        for (int i = 0; i < MEASURE_DIM; i++)
+        {
+            float *dst = mean + i * n;
+            const float *src = mean + (i + MEASURE_DIM) * n;
+            for (std::size_t t = 0; t < n; t++)
+                dst[t] += src[t];
+        }
+    }
+}
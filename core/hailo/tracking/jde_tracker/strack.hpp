@@ -12,6 +12,7 @@
 
 // General cpp includes
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <string>
@@ -277,10 +278,15 @@ public:
      */
     int next_id()
     {
-        static int _count = 0;
-        _count++;
-        _count = _count % 100000; // Cycle ids after 100000
-        return _count;
+        // Shared by all the trackers, which may be updated concurrently (one per stream)
+        static std::atomic<int> _count{0};
+        int current = _count.load(std::memory_order_relaxed);
+        int next;
+        do
+        {
+            next = (current + 1) % 100000; // Cycle ids after 100000
+        } while (!_count.compare_exchange_weak(current, next, std::memory_order_relaxed));
+        return next;
     }
 
     /**
@@ -332,7 +338,7 @@ public:
         this->m_kalman_filter = kalman_filter;
         this->m_track_id = this->next_id();
 
-        HailoUniqueIDPtr object_id = std::make_shared<HailoUniqueID>(HailoUniqueID(this->m_track_id));
+        HailoUniqueIDPtr object_id = hailo_make_shared<HailoUniqueID>(HailoUniqueID(this->m_track_id));
         this->m_hailo_detection->add_object(object_id);
 
         TrackerTypes::DETECTBOX xyah_box = STrack::get_detectbox_from_tlwh(this->tmp_location_tlwh);